@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+#include "../src/scene_file.h"
+
+// Loads a scene file's assets one after another on the main thread and then
+// as parallel jobs, best of a few rounds each. Defaults to the showcase scene
+// with every bundled model; pass another scene path as the first argument.
+//
+// First parses a few instance lines with their fields in every order, a
+// uniform scale in the middle of a line included, and lines that have to be
+// rejected, from a scratch file next to the working directory.
+
+#define ROUNDS 3
+#define PARSE_CHECK "parse_check.scene"
+
+typedef struct {
+    const char* line;
+    vec3 position;
+    vec3 rotation;
+    vec3 scale;
+} ParseCase;
+
+// Whether a scene of the mesh and texture declarations and line parses, and
+// into the instance of c if there is one
+static int parse_line(const char* line, const ParseCase* c){
+    FILE* f = fopen(PARSE_CHECK, "wb");
+    if(!f){
+        printf("Cannot write %s\n", PARSE_CHECK);
+        return 0;
+    }
+    fprintf(f, "mesh peng Penguin.obj\ntexture skin Penguin.png\n%s\n", line);
+    fclose(f);
+    SceneFile file;
+    int parsed = scene_file_parse(PARSE_CHECK, &file);
+    remove(PARSE_CHECK);
+    if(!parsed){
+        return 0;
+    }
+    int ok = !c || (file.instanceCount == 1 && glm_vec3_eqv(file.instances[0].position, (float*)c->position) &&
+                    glm_vec3_eqv(file.instances[0].rotation, (float*)c->rotation) &&
+                    glm_vec3_eqv(file.instances[0].scale, (float*)c->scale));
+    scene_file_free(&file);
+    return ok;
+}
+
+static int check_parse(void){
+    static const ParseCase cases[] = {
+        {"instance peng - scale 3 position 1 2 3", {1, 2, 3}, {0, 0, 0}, {3, 3, 3}},
+        {"instance peng skin position 1 2 3 scale 3", {1, 2, 3}, {0, 0, 0}, {3, 3, 3}},
+        {"instance peng - rotation 0 90 0 scale 1 2 3 position -4 0.5 6", {-4, 0.5f, 6}, {0, 90, 0}, {1, 2, 3}},
+        {"instance peng - scale 2\trotation 10 20 30   # comment", {0, 0, 0}, {10, 20, 30}, {2, 2, 2}},
+        {"instance peng - scale 0.5 scale 2 4 8", {0, 0, 0}, {0, 0, 0}, {2, 4, 8}},
+    };
+    static const char* rejected[] = {
+        "instance peng - scale 1 2 position 0 0 0",
+        "instance peng - position 1 2 scale 3",
+        "instance peng - scale position 1 2 3",
+        "instance peng - scale 3x",
+    };
+    int errors = 0;
+    for(uint32_t i = 0; i<sizeof(cases)/sizeof(cases[0]); ++i){
+        if(!parse_line(cases[i].line, &cases[i])){
+            printf("  FAILED to parse '%s' as expected\n", cases[i].line);
+            errors++;
+        }
+    }
+    for(uint32_t i = 0; i<sizeof(rejected)/sizeof(rejected[0]); ++i){
+        if(parse_line(rejected[i], NULL)){
+            printf("  FAILED to reject '%s'\n", rejected[i]);
+            errors++;
+        }
+    }
+    printf("scene file parsing, %u lines and %u to reject: %s\n", (uint32_t)(sizeof(cases)/sizeof(cases[0])),
+           (uint32_t)(sizeof(rejected)/sizeof(rejected[0])), errors ? "FAILED" : "OK");
+    return errors;
+}
+
+static double load_best(SceneFile* file, int parallel){
+    double best = 1e30;
+    for(int r = 0; r<ROUNDS; ++r){
+        if(scene_file_load(file, parallel) > 0){
+            printf("Some assets failed to load\n");
+        }
+        best = file->loadMs < best ? file->loadMs : best;
+        if(r < ROUNDS-1){
+            scene_file_free_assets(file);
+        }
+    }
+    return best;
+}
+
+int main(int argc, char** argv){
+    const char* path = argc > 1 ? argv[1] : "../assets/showcase.scene";
+    mem_init(1024*1024);
+    job_system_init(0);
+    int errors = check_parse();
+
+    SceneFile file;
+    if(!scene_file_parse(path, &file)){
+        job_system_shutdown();
+        mem_shutdown();
+        return 1;
+    }
+
+    printf("Sequential:\n");
+    double sequential = load_best(&file, 0);
+    scene_file_report(&file);
+    scene_file_free_assets(&file);
+
+    printf("Parallel (%u threads):\n", job_thread_count());
+    double parallel = load_best(&file, 1);
+    scene_file_report(&file);
+
+    printf("best of %d: sequential %.2f ms, parallel %.2f ms, %.2fx\n", ROUNDS, sequential, parallel, sequential/parallel);
+
+    scene_file_free(&file);
+    job_system_shutdown();
+    mem_shutdown();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,234 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/batch.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+
+// Batch kernels against the per element cglm loops they replace, for every ISA
+// the CPU supports. Results are checked against the scalar kernels. Runs once
+// with a cache resident working set and once with a memory bound one.
+
+static float* random_floats(uint32_t count, float lo, float hi){
+    float* values = (float*)mem_alloc_aligned(MEM_TAG_GENERAL, count*sizeof(float), 32);
+    for(uint32_t i = 0; i<count; ++i){
+        values[i] = lo + (hi - lo)*(float)rand()/(float)RAND_MAX;
+    }
+    return values;
+}
+
+static float max_error(const float* a, const float* b, uint32_t count){
+    float worst = 0.0f;
+    for(uint32_t i = 0; i<count; ++i){
+        float e = fabsf(a[i] - b[i]) / (1.0f + fabsf(a[i]));
+        worst = e > worst ? e : worst;
+    }
+    return worst;
+}
+
+static void report(const char* name, const char* variant, double ms, double baselineMs, uint32_t count){
+    printf("  %-20s %-8s %8.3f ms  %7.2f ns/elem  %5.2fx\n", name, variant, ms, ms*1e6/count, baselineMs/ms);
+}
+
+static void bench_suite(uint32_t count, int rounds){
+    mat4 m;
+    glm_mat4_identity(m);
+    glm_rotate(m, 0.7f, (vec3){0.3f, 1.0f, 0.2f});
+    glm_translate(m, (vec3){1.0f, -2.0f, 3.0f});
+    glm_scale_uni(m, 1.5f);
+
+    Vec3Soa in = {random_floats(count, -10, 10), random_floats(count, -10, 10), random_floats(count, -10, 10)};
+    Vec3Soa out = {random_floats(count, 0, 0), random_floats(count, 0, 0), random_floats(count, 0, 0)};
+    Vec3Soa ref = {random_floats(count, 0, 0), random_floats(count, 0, 0), random_floats(count, 0, 0)};
+
+    // ---------------------------------------------------------
+    // Points: the AoS glm_mat4_mulv3 loop is the baseline
+    // ---------------------------------------------------------
+    vec3* aos = (vec3*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(vec3));
+    vec3* aosOut = (vec3*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(vec3));
+    for(uint32_t i = 0; i<count; ++i){
+        aos[i][0] = in.x[i]; aos[i][1] = in.y[i]; aos[i][2] = in.z[i];
+    }
+    uint64_t start = time_now_ns();
+    for(int r = 0; r<rounds; ++r){
+        for(uint32_t i = 0; i<count; ++i){
+            glm_mat4_mulv3(m, aos[i], 1.0f, aosOut[i]);
+        }
+    }
+    double baseline = time_ms_since(start)/rounds;
+    printf("%u elements, best ISA: %s\n", count, batch_isa_name(batch_isa()));
+    report("transform points", "cglm", baseline, baseline, count);
+
+    batch_set_isa(BATCH_ISA_SCALAR);
+    batch_transform_points(m, in, ref, count);
+    for(int isa = 0; isa<BATCH_ISA_COUNT; ++isa){
+        if(!batch_set_isa((BatchIsa)isa)){
+            continue;
+        }
+        start = time_now_ns();
+        for(int r = 0; r<rounds; ++r){
+            batch_transform_points(m, in, out, count);
+        }
+        report("transform points", batch_isa_name((BatchIsa)isa), time_ms_since(start)/rounds, baseline, count);
+        float err = max_error(ref.x, out.x, count) + max_error(ref.y, out.y, count) + max_error(ref.z, out.z, count);
+        if(err > 1e-5f){
+            printf("  MISMATCH: %s error %g\n", batch_isa_name((BatchIsa)isa), err);
+        }
+    }
+
+    // ---------------------------------------------------------
+    // AABBs: baseline is glm_aabb_transform per box
+    // ---------------------------------------------------------
+    AabbSoa boxes = {in.x, in.y, in.z, random_floats(count, 10, 12), random_floats(count, 10, 12), random_floats(count, 10, 12)};
+    AabbSoa boxOut = {random_floats(count, 0, 0), random_floats(count, 0, 0), random_floats(count, 0, 0),
+                      random_floats(count, 0, 0), random_floats(count, 0, 0), random_floats(count, 0, 0)};
+    vec3 (*aosBoxes)[2] = (vec3(*)[2])mem_alloc(MEM_TAG_GENERAL, count*sizeof(vec3[2]));
+    vec3 (*aosBoxesOut)[2] = (vec3(*)[2])mem_alloc(MEM_TAG_GENERAL, count*sizeof(vec3[2]));
+    for(uint32_t i = 0; i<count; ++i){
+        aosBoxes[i][0][0] = boxes.minX[i]; aosBoxes[i][0][1] = boxes.minY[i]; aosBoxes[i][0][2] = boxes.minZ[i];
+        aosBoxes[i][1][0] = boxes.maxX[i]; aosBoxes[i][1][1] = boxes.maxY[i]; aosBoxes[i][1][2] = boxes.maxZ[i];
+    }
+    start = time_now_ns();
+    for(int r = 0; r<rounds; ++r){
+        for(uint32_t i = 0; i<count; ++i){
+            glm_aabb_transform(aosBoxes[i], m, aosBoxesOut[i]);
+        }
+    }
+    baseline = time_ms_since(start)/rounds;
+    report("transform aabbs", "cglm", baseline, baseline, count);
+    for(int isa = 0; isa<BATCH_ISA_COUNT; ++isa){
+        if(!batch_set_isa((BatchIsa)isa)){
+            continue;
+        }
+        start = time_now_ns();
+        for(int r = 0; r<rounds; ++r){
+            batch_transform_aabbs(m, boxes, boxOut, count);
+        }
+        report("transform aabbs", batch_isa_name((BatchIsa)isa), time_ms_since(start)/rounds, baseline, count);
+    }
+
+    // ---------------------------------------------------------
+    // Height along an axis: baseline is glm_vec3_dot per point. Every ISA
+    // has to give the same bits as the scalar kernel.
+    // ---------------------------------------------------------
+    vec3 axis = {0.2f, 0.9f, -0.4f};
+    start = time_now_ns();
+    for(int r = 0; r<rounds; ++r){
+        for(uint32_t i = 0; i<count; ++i){
+            out.x[i] = glm_vec3_dot(aos[i], axis) + 0.5f;
+        }
+    }
+    baseline = time_ms_since(start)/rounds;
+    report("project points", "cglm", baseline, baseline, count);
+    batch_set_isa(BATCH_ISA_SCALAR);
+    batch_project_points(in, axis, 0.5f, ref.x, count);
+    for(int isa = 0; isa<BATCH_ISA_COUNT; ++isa){
+        if(!batch_set_isa((BatchIsa)isa)){
+            continue;
+        }
+        start = time_now_ns();
+        for(int r = 0; r<rounds; ++r){
+            batch_project_points(in, axis, 0.5f, out.x, count);
+        }
+        report("project points", batch_isa_name((BatchIsa)isa), time_ms_since(start)/rounds, baseline, count);
+        if(memcmp(ref.x, out.x, count*sizeof(float)) != 0){
+            printf("  MISMATCH: %s differs from the scalar kernel\n", batch_isa_name((BatchIsa)isa));
+        }
+    }
+
+    // ---------------------------------------------------------
+    // Matrix products: baseline is glm_mat4_mul per pair
+    // ---------------------------------------------------------
+    const uint32_t matCount = count/4;
+    mat4* ma = (mat4*)random_floats(matCount*16, -1, 1);
+    mat4* mb = (mat4*)random_floats(matCount*16, -1, 1);
+    mat4* mo = (mat4*)random_floats(matCount*16, 0, 0);
+    mat4* mr = (mat4*)random_floats(matCount*16, 0, 0);
+    start = time_now_ns();
+    for(int r = 0; r<rounds; ++r){
+        for(uint32_t i = 0; i<matCount; ++i){
+            glm_mat4_mul(ma[i], mb[i], mo[i]);
+        }
+    }
+    baseline = time_ms_since(start)/rounds;
+    report("mat4 mul", "cglm", baseline, baseline, matCount);
+    batch_set_isa(BATCH_ISA_SCALAR);
+    batch_mat4_mul(ma, mb, mr, matCount);
+    for(int isa = 0; isa<BATCH_ISA_COUNT; ++isa){
+        if(!batch_set_isa((BatchIsa)isa)){
+            continue;
+        }
+        start = time_now_ns();
+        for(int r = 0; r<rounds; ++r){
+            batch_mat4_mul(ma, mb, mo, matCount);
+        }
+        report("mat4 mul", batch_isa_name((BatchIsa)isa), time_ms_since(start)/rounds, baseline, matCount);
+        float err = max_error((float*)mr, (float*)mo, matCount*16);
+        if(err > 1e-5f){
+            printf("  MISMATCH: %s error %g\n", batch_isa_name((BatchIsa)isa), err);
+        }
+    }
+
+    // ---------------------------------------------------------
+    // Sphere culling: baseline is a per sphere plane loop with glm_vec3_dot
+    // ---------------------------------------------------------
+    mat4 proj, view, viewProj;
+    vec4 planes[6];
+    glm_perspective(glm_rad(45.0f), 800.0f/600.0f, 0.1f, 100.0f, proj);
+    glm_lookat((vec3){0, 0, 20}, (vec3){0, 0, 0}, (vec3){0, 1, 0}, view);
+    glm_mat4_mul(proj, view, viewProj);
+    glm_frustum_planes(viewProj, planes);
+    SphereSoa spheres = {in.x, in.y, in.z, random_floats(count, 0.1f, 1.0f)};
+    uint8_t* visible = (uint8_t*)mem_alloc(MEM_TAG_GENERAL, count);
+    uint32_t expected = 0;
+    start = time_now_ns();
+    for(int r = 0; r<rounds; ++r){
+        expected = 0;
+        for(uint32_t i = 0; i<count; ++i){
+            vec3 center = {spheres.x[i], spheres.y[i], spheres.z[i]};
+            int inside = 1;
+            for(int p = 0; p<6; ++p){
+                inside &= glm_vec3_dot(planes[p], center) + planes[p][3] >= -spheres.radius[i];
+            }
+            expected += inside;
+        }
+    }
+    baseline = time_ms_since(start)/rounds;
+    report("spheres in frustum", "cglm", baseline, baseline, count);
+    for(int isa = 0; isa<BATCH_ISA_COUNT; ++isa){
+        if(!batch_set_isa((BatchIsa)isa)){
+            continue;
+        }
+        uint32_t found = 0;
+        start = time_now_ns();
+        for(int r = 0; r<rounds; ++r){
+            found = batch_spheres_in_frustum(planes, spheres, visible, count);
+        }
+        report("spheres in frustum", batch_isa_name((BatchIsa)isa), time_ms_since(start)/rounds, baseline, count);
+        if(found != expected){
+            printf("  MISMATCH: %s found %u visible, expected %u\n", batch_isa_name((BatchIsa)isa), found, expected);
+        }
+    }
+
+    float* arrays[] = {in.x, in.y, in.z, out.x, out.y, out.z, ref.x, ref.y, ref.z,
+                       boxes.maxX, boxes.maxY, boxes.maxZ, boxOut.minX, boxOut.minY, boxOut.minZ,
+                       boxOut.maxX, boxOut.maxY, boxOut.maxZ, (float*)ma, (float*)mb, (float*)mo, (float*)mr, spheres.radius};
+    for(size_t i = 0; i<sizeof(arrays)/sizeof(arrays[0]); ++i){
+        mem_free(arrays[i]);
+    }
+    mem_free(aos);
+    mem_free(aosOut);
+    mem_free(aosBoxes);
+    mem_free(aosBoxesOut);
+    mem_free(visible);
+}
+
+int main(void){
+    mem_init(1024);
+    srand(1234);
+    bench_suite(1u << 14, 2000);
+    bench_suite(1u << 20, 20);
+    mem_shutdown();
+    return 0;
+}
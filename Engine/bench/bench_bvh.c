@@ -0,0 +1,441 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/asset.h"
+#include "../src/bvh.h"
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/particle_graph.h"
+#include "../src/platform.h"
+
+// BVH build and query speed on Human.obj and Tree.obj: build time for 1 to
+// all cores with node count and SAH cost, then rays per second for camera
+// rays (coherent) and random rays (incoherent), one at a time and in packets,
+// and closest point queries per second, for the scalar and the AVX2
+// traversal. Every query kind is first checked against brute force over all
+// triangles, and packets against single rays.
+//
+// Then deforms the mesh over DEFORM_FRAMES frames (a twist of up to half a
+// turn around the vertical axis, a sideways bend and a fine crumple that
+// stretches triangles up and down) and refits every frame,
+// once refit only and once with subtree rebuilds, with the refit time per
+// frame and the SAH cost and ray speed at the end against a fresh build.
+// Rays and closest points on the refit trees have to match the fresh build,
+// and no refit may rebuild more subtrees than the rebuild budget.
+
+#define BUILD_ROUNDS    10
+#define IMAGE           512     // camera rays per side
+#define RANDOM_RAYS     (IMAGE*IMAGE)
+#define CLOSEST_QUERIES 100000
+#define CHECK_QUERIES   2000
+#define DEFORM_FRAMES   120
+#define COMPARE_QUERIES 100000
+
+typedef struct {
+    Vec3Soa positions;
+    const uint32_t* indices;
+    uint32_t triangleCount;
+    vec3 lo, hi;
+} Mesh;
+
+// The AVX2 traversal against the scalar reference
+static const BatchIsa isas[2] = {BATCH_ISA_SCALAR, BATCH_ISA_AVX2};
+static uint32_t rng = 12345;
+
+static float random_float(void){
+    rng = rng*1664525u + 1013904223u;
+    return (rng >> 8)*(1.0f/16777216.0f);
+}
+
+static int valid_triangle(const uint32_t* v){
+    return v[0] != PARTICLE_NONE && v[1] != PARTICLE_NONE && v[2] != PARTICLE_NONE && v[0] != v[1] && v[1] != v[2] && v[0] != v[2];
+}
+
+static float brute_ray(const Mesh* mesh, const float* origin, const float* direction){
+    float best = FLT_MAX;
+    for(uint32_t t = 0; t<mesh->triangleCount; ++t){
+        float d, u, w;
+        if(valid_triangle(mesh->indices + 3*t) && bvh_intersect_triangle(mesh->positions, mesh->indices + 3*t, origin, direction, best, &d, &u, &w)){
+            best = d;
+        }
+    }
+    return best;
+}
+
+static float brute_closest(const Mesh* mesh, const float* point){
+    float best = FLT_MAX;
+    for(uint32_t t = 0; t<mesh->triangleCount; ++t){
+        float p[3];
+        float d = valid_triangle(mesh->indices + 3*t) ? bvh_closest_on_triangle(mesh->positions, mesh->indices + 3*t, point, p) : FLT_MAX;
+        best = d < best ? d : best;
+    }
+    return best;
+}
+
+// Rays from a sphere around the model through random points of its box
+static void random_ray(const Mesh* mesh, float* origin, float* direction){
+    vec3 center, target;
+    glm_vec3_center((float*)mesh->lo, (float*)mesh->hi, center);
+    float radius = glm_vec3_distance((float*)mesh->lo, (float*)mesh->hi);
+    float z = 2.0f*random_float() - 1.0f, a = 6.2831853f*random_float(), s = sqrtf(1.0f - z*z);
+    origin[0] = center[0] + radius*s*cosf(a);
+    origin[1] = center[1] + radius*s*sinf(a);
+    origin[2] = center[2] + radius*z;
+    for(int k = 0; k<3; ++k){
+        target[k] = mesh->lo[k] + (mesh->hi[k] - mesh->lo[k])*random_float();
+        direction[k] = target[k] - origin[k];
+    }
+    glm_vec3_normalize(direction);
+}
+
+// Pinhole camera in front of the model (+z), pixel (x, y) of an IMAGE square
+static void camera_ray(const Mesh* mesh, uint32_t x, uint32_t y, float* origin, float* direction){
+    vec3 center;
+    glm_vec3_center((float*)mesh->lo, (float*)mesh->hi, center);
+    float size = glm_vec3_distance((float*)mesh->lo, (float*)mesh->hi);
+    origin[0] = center[0];
+    origin[1] = center[1];
+    origin[2] = center[2] + 1.5f*size;
+    float half = 0.25f;  // tan of half the field of view
+    direction[0] = half*(2.0f*(x + 0.5f)/IMAGE - 1.0f);
+    direction[1] = half*(1.0f - 2.0f*(y + 0.5f)/IMAGE);
+    direction[2] = -1.0f;
+    glm_vec3_normalize(direction);
+}
+
+static int same_t(float a, float b){
+    return (a == FLT_MAX && b == FLT_MAX) || fabsf(a - b) <= 1e-4f*fmaxf(fabsf(b), 1e-3f);
+}
+
+static int validate(const Mesh* mesh, const Bvh* bvh){
+    int errors = 0, hits = 0;
+    for(uint32_t q = 0; q<CHECK_QUERIES; ++q){
+        vec3 origin, direction;
+        random_ray(mesh, origin, direction);
+        float reference = brute_ray(mesh, origin, direction);
+        for(int i = 0; i<2; ++i){
+            if(!batch_set_isa(isas[i])){
+                continue;
+            }
+            BvhHit hit;
+            float t = bvh_raycast(bvh, mesh->positions, origin, direction, FLT_MAX, &hit) ? hit.t : FLT_MAX;
+            errors += !same_t(t, reference);
+        }
+        hits += reference < FLT_MAX;
+    }
+    printf("  %u random rays vs brute force, %d hit: %s (%d mismatches)\n", CHECK_QUERIES, hits, errors ? "FAILED" : "OK", errors);
+    int failed = errors;
+
+    errors = 0;
+    for(uint32_t q = 0; q<CHECK_QUERIES; ++q){
+        vec3 point, closest;
+        for(int k = 0; k<3; ++k){
+            float extent = mesh->hi[k] - mesh->lo[k];
+            point[k] = mesh->lo[k] - 0.2f*extent + 1.4f*extent*random_float();
+        }
+        float reference = brute_closest(mesh, point);
+        for(int i = 0; i<2; ++i){
+            if(!batch_set_isa(isas[i])){
+                continue;
+            }
+            BvhClosest result;
+            bvh_closest_point(bvh, mesh->positions, point, FLT_MAX, &result);
+            glm_vec3_copy(result.point, closest);
+            float d = glm_vec3_distance2(point, closest);
+            errors += !same_t(result.distanceSq, reference) || !same_t(d, reference);
+        }
+    }
+    printf("  %u closest points vs brute force: %s (%d mismatches)\n", CHECK_QUERIES, errors ? "FAILED" : "OK", errors);
+    failed += errors;
+
+    // Packets of camera rays against single rays, every pixel
+    errors = 0;
+    for(int i = 0; i<2; ++i){
+        if(!batch_set_isa(isas[i])){
+            continue;
+        }
+        for(uint32_t y = 0; y<IMAGE; y += 2){
+            for(uint32_t x = 0; x<IMAGE; x += 4){
+                BvhPacket packet;
+                packet.count = (x*7 + y) % 11 == 0 ? 5 : BVH_PACKET;    // some partial packets too
+                for(uint32_t r = 0; r<packet.count; ++r){
+                    vec3 origin, direction;
+                    camera_ray(mesh, x + r % 4, y + r/4, origin, direction);
+                    packet.originX[r] = origin[0]; packet.originY[r] = origin[1]; packet.originZ[r] = origin[2];
+                    packet.directionX[r] = direction[0]; packet.directionY[r] = direction[1]; packet.directionZ[r] = direction[2];
+                    packet.maxT[r] = FLT_MAX;
+                }
+                BvhHit hits[BVH_PACKET];
+                bvh_raycast_packet(bvh, mesh->positions, &packet, hits);
+                for(uint32_t r = 0; r<packet.count; ++r){
+                    vec3 origin = {packet.originX[r], packet.originY[r], packet.originZ[r]};
+                    vec3 direction = {packet.directionX[r], packet.directionY[r], packet.directionZ[r]};
+                    BvhHit hit;
+                    bvh_raycast(bvh, mesh->positions, origin, direction, FLT_MAX, &hit);
+                    errors += !same_t(hits[r].triangle == BVH_NONE ? FLT_MAX : hits[r].t, hit.triangle == BVH_NONE ? FLT_MAX : hit.t);
+                }
+            }
+        }
+    }
+    printf("  camera ray packets vs single rays: %s (%d mismatches)\n", errors ? "FAILED" : "OK", errors);
+    batch_init();
+    return failed + errors;
+}
+
+static void bench_rays(const Mesh* mesh, const Bvh* bvh){
+    vec3* origins = (vec3*)malloc(RANDOM_RAYS*sizeof(vec3));
+    vec3* directions = (vec3*)malloc(RANDOM_RAYS*sizeof(vec3));
+    vec3* points = (vec3*)malloc(CLOSEST_QUERIES*sizeof(vec3));
+    for(uint32_t i = 0; i<RANDOM_RAYS; ++i){
+        random_ray(mesh, origins[i], directions[i]);
+    }
+    for(uint32_t i = 0; i<CLOSEST_QUERIES; ++i){
+        for(int k = 0; k<3; ++k){
+            float extent = mesh->hi[k] - mesh->lo[k];
+            points[i][k] = mesh->lo[k] - 0.2f*extent + 1.4f*extent*random_float();
+        }
+    }
+    for(int i = 0; i<2; ++i){
+        if(!batch_set_isa(isas[i])){
+            continue;
+        }
+        uint32_t found = 0;
+        uint64_t start = time_now_ns();
+        for(uint32_t y = 0; y<IMAGE; ++y){
+            for(uint32_t x = 0; x<IMAGE; ++x){
+                vec3 origin, direction;
+                camera_ray(mesh, x, y, origin, direction);
+                BvhHit hit;
+                found += bvh_raycast(bvh, mesh->positions, origin, direction, FLT_MAX, &hit);
+            }
+        }
+        double cameraMs = time_ms_since(start);
+
+        start = time_now_ns();
+        for(uint32_t y = 0; y<IMAGE; y += 2){
+            for(uint32_t x = 0; x<IMAGE; x += 4){
+                BvhPacket packet;
+                packet.count = BVH_PACKET;
+                for(uint32_t r = 0; r<BVH_PACKET; ++r){
+                    vec3 origin, direction;
+                    camera_ray(mesh, x + r % 4, y + r/4, origin, direction);
+                    packet.originX[r] = origin[0]; packet.originY[r] = origin[1]; packet.originZ[r] = origin[2];
+                    packet.directionX[r] = direction[0]; packet.directionY[r] = direction[1]; packet.directionZ[r] = direction[2];
+                    packet.maxT[r] = FLT_MAX;
+                }
+                BvhHit hits[BVH_PACKET];
+                bvh_raycast_packet(bvh, mesh->positions, &packet, hits);
+            }
+        }
+        double packetMs = time_ms_since(start);
+
+        start = time_now_ns();
+        for(uint32_t q = 0; q<RANDOM_RAYS; ++q){
+            BvhHit hit;
+            bvh_raycast(bvh, mesh->positions, origins[q], directions[q], FLT_MAX, &hit);
+        }
+        double randomMs = time_ms_since(start);
+
+        start = time_now_ns();
+        for(uint32_t q = 0; q<CLOSEST_QUERIES; ++q){
+            BvhClosest closest;
+            bvh_closest_point(bvh, mesh->positions, points[q], FLT_MAX, &closest);
+        }
+        double closestMs = time_ms_since(start);
+
+        printf("  %-6s camera %6.2f Mrays/s (%.0f%% hit)  camera packets %6.2f Mrays/s  random %6.2f Mrays/s  closest point %6.2f M/s\n",
+               batch_isa_name(isas[i]), IMAGE*IMAGE/(cameraMs*1e3), 100.0*found/(IMAGE*IMAGE), IMAGE*IMAGE/(packetMs*1e3),
+               RANDOM_RAYS/(randomMs*1e3), CLOSEST_QUERIES/(closestMs*1e3));
+    }
+    batch_init();
+    free(origins);
+    free(directions);
+    free(points);
+}
+
+static int compare_double(const void* a, const void* b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Random rays and closest points on a refit tree against a fresh build
+static int compare_trees(const Mesh* mesh, const Bvh* refit, const Bvh* fresh){
+    int errors = 0;
+    for(uint32_t q = 0; q<COMPARE_QUERIES; ++q){
+        vec3 origin, direction, point;
+        random_ray(mesh, origin, direction);
+        BvhHit a, b;
+        bvh_raycast(refit, mesh->positions, origin, direction, FLT_MAX, &a);
+        bvh_raycast(fresh, mesh->positions, origin, direction, FLT_MAX, &b);
+        errors += !same_t(a.triangle == BVH_NONE ? FLT_MAX : a.t, b.triangle == BVH_NONE ? FLT_MAX : b.t);
+        for(int k = 0; k<3; ++k){
+            float extent = mesh->hi[k] - mesh->lo[k];
+            point[k] = mesh->lo[k] - 0.2f*extent + 1.4f*extent*random_float();
+        }
+        BvhClosest c, d;
+        bvh_closest_point(refit, mesh->positions, point, FLT_MAX, &c);
+        bvh_closest_point(fresh, mesh->positions, point, FLT_MAX, &d);
+        errors += !same_t(c.distanceSq, d.distanceSq);
+    }
+    return errors;
+}
+
+static double random_rays_per_second(const Mesh* mesh, const Bvh* bvh){
+    uint64_t start = time_now_ns();
+    for(uint32_t q = 0; q<RANDOM_RAYS/4; ++q){
+        vec3 origin, direction;
+        random_ray(mesh, origin, direction);
+        BvhHit hit;
+        bvh_raycast(bvh, mesh->positions, origin, direction, FLT_MAX, &hit);
+    }
+    return RANDOM_RAYS/4/(time_ms_since(start)*1e3);
+}
+
+static int bench_deform(const Mesh* rest){
+    uint32_t particleCount = 0;
+    for(uint32_t i = 0; i<3*rest->triangleCount; ++i){
+        particleCount = rest->indices[i] != PARTICLE_NONE && rest->indices[i] >= particleCount ? rest->indices[i]+1 : particleCount;
+    }
+    Mesh mesh = *rest;
+    mesh.positions.x = (float*)malloc(3*particleCount*sizeof(float));
+    mesh.positions.y = mesh.positions.x + particleCount;
+    mesh.positions.z = mesh.positions.y + particleCount;
+    memcpy(mesh.positions.x, rest->positions.x, particleCount*sizeof(float));
+    memcpy(mesh.positions.y, rest->positions.y, particleCount*sizeof(float));
+    memcpy(mesh.positions.z, rest->positions.z, particleCount*sizeof(float));
+
+    Bvh trees[2];
+    static const char* labels[2] = {"refit only", "refit + rebuilds"};
+    static double samples[2][DEFORM_FRAMES];
+    uint32_t rebuilds = 0, mostRebuilds = 0;
+    for(int i = 0; i<2; ++i){
+        bvh_build(&trees[i], mesh.positions, mesh.indices, mesh.triangleCount);
+    }
+    trees[0].rebuildRatio = 0.0f;
+    float height = rest->hi[1] - rest->lo[1];
+    float wave = 6.2831853f/(0.02f*height);     // crumples the surface, stretching triangles up and down
+    vec3 center;
+    glm_vec3_center((float*)rest->lo, (float*)rest->hi, center);
+    for(uint32_t f = 1; f<=DEFORM_FRAMES; ++f){
+        float amount = (float)f/DEFORM_FRAMES;
+        for(uint32_t p = 0; p<particleCount; ++p){
+            float x = rest->positions.x[p] - center[0], y = rest->positions.y[p], z = rest->positions.z[p] - center[2];
+            float h = (y - rest->lo[1])/height;
+            float angle = 3.14159265f*amount*h, c = cosf(angle), s = sinf(angle);
+            mesh.positions.x[p] = center[0] + c*x - s*z + 0.3f*height*amount*h*h;
+            mesh.positions.y[p] = y + 0.05f*height*amount*sinf(x*wave)*cosf(z*wave);
+            mesh.positions.z[p] = center[2] + s*x + c*z;
+        }
+        for(int i = 0; i<2; ++i){
+            uint64_t start = time_now_ns();
+            bvh_refit(&trees[i], mesh.positions);
+            samples[i][f-1] = time_ms_since(start);
+        }
+        rebuilds += trees[1].rebuildCount;
+        mostRebuilds = trees[1].rebuildCount > mostRebuilds ? trees[1].rebuildCount : mostRebuilds;
+    }
+    for(uint32_t p = 0; p<particleCount; ++p){
+        vec3 q = {mesh.positions.x[p], mesh.positions.y[p], mesh.positions.z[p]};
+        glm_vec3_minv(mesh.lo, q, mesh.lo);
+        glm_vec3_maxv(mesh.hi, q, mesh.hi);
+    }
+
+    Bvh fresh;
+    bvh_build(&fresh, mesh.positions, mesh.indices, mesh.triangleCount);
+    printf("  deformed over %u frames, %u subtrees of %u rebuilt along the way, at most %u per refit (budget %u)\n",
+           DEFORM_FRAMES, rebuilds, trees[1].subtreeCount, mostRebuilds, trees[1].rebuildBudget);
+    int errors = mostRebuilds > trees[1].rebuildBudget;
+    for(int i = 0; i<2; ++i){
+        double sum = 0.0;
+        for(uint32_t f = 0; f<DEFORM_FRAMES; ++f){
+            sum += samples[i][f];
+        }
+        qsort(samples[i], DEFORM_FRAMES, sizeof(double), compare_double);
+        int mismatches = compare_trees(&mesh, &trees[i], &fresh);
+        printf("  %-16s refit mean %.3f ms p99 %.3f ms, SAH cost %6.2f, random %5.2f Mrays/s, vs fresh build: %s (%d mismatches)\n",
+               labels[i], sum/DEFORM_FRAMES, samples[i][(DEFORM_FRAMES-1)*99/100], bvh_sah_cost(&trees[i]),
+               random_rays_per_second(&mesh, &trees[i]), mismatches ? "FAILED" : "OK", mismatches);
+        errors += mismatches;
+        bvh_free(&trees[i]);
+    }
+    printf("  %-16s SAH cost %6.2f, random %5.2f Mrays/s\n", "fresh build", bvh_sah_cost(&fresh), random_rays_per_second(&mesh, &fresh));
+    bvh_free(&fresh);
+    free(mesh.positions.x);
+    return errors;
+}
+
+static int bench_model(const char* path){
+    fastObjMesh* obj = asset_read_obj(path);
+    if(!obj){
+        return 1;
+    }
+    ParticleGraphDesc graphDesc = {0.0f, 1, PARTICLE_ORDER_NONE};
+    ParticleGraph graph;
+    if(!particle_graph_build(obj, &graphDesc, &graph)){
+        return 1;
+    }
+    asset_free_obj(obj);
+    Mesh mesh = {graph.positions, graph.renderToParticle, graph.renderVertexCount/3, {FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+    for(uint32_t i = 0; i<graph.particleCount; ++i){
+        vec3 p = {graph.positions.x[i], graph.positions.y[i], graph.positions.z[i]};
+        glm_vec3_minv(mesh.lo, p, mesh.lo);
+        glm_vec3_maxv(mesh.hi, p, mesh.hi);
+    }
+    printf("%s: %u particles, %u triangles\n", path, graph.particleCount, mesh.triangleCount);
+
+    unsigned int cores = cpu_core_count();
+    Bvh bvh;
+    for(unsigned int threads = 1; ; threads = threads*2 < cores ? threads*2 : cores){
+        job_system_init(threads);
+        double best = 1e30;
+        for(int r = 0; r<BUILD_ROUNDS; ++r){
+            uint64_t start = time_now_ns();
+            bvh_build(&bvh, mesh.positions, mesh.indices, mesh.triangleCount);
+            double ms = time_ms_since(start);
+            best = ms < best ? ms : best;
+            if(r+1 < BUILD_ROUNDS){
+                bvh_free(&bvh);
+            }
+        }
+        uint64_t start = time_now_ns();
+        for(int r = 0; r<BUILD_ROUNDS; ++r){
+            bvh_refit(&bvh, mesh.positions);
+        }
+        double refitMs = time_ms_since(start)/BUILD_ROUNDS;
+        bvh_free(&bvh);
+        printf("  %2u thread(s): build %8.3f ms (best of %d), refit %.3f ms\n", threads, best, BUILD_ROUNDS, refitMs);
+        job_system_shutdown();
+        if(threads == cores){
+            break;
+        }
+    }
+    job_system_init(0);
+    bvh_build(&bvh, mesh.positions, mesh.indices, mesh.triangleCount);
+    uint32_t leaves = 0;
+    for(uint32_t n = 0; n<bvh.nodeCount; ++n){
+        for(uint32_t c = 0; c<bvh.nodes[n].childCount; ++c){
+            leaves += (bvh.nodes[n].child[c] & BVH_LEAF) != 0;
+        }
+    }
+    printf("  %u nodes of %u wide, %u leaves (%.2f triangles each), SAH cost %.2f\n", bvh.nodeCount, BVH_WIDTH,
+           leaves, (double)bvh.triangleCount/leaves, bvh_sah_cost(&bvh));
+
+    int errors = validate(&mesh, &bvh);
+    bench_rays(&mesh, &bvh);
+    bvh_free(&bvh);
+    errors += bench_deform(&mesh);
+    job_system_shutdown();
+    particle_graph_free(&graph);
+    return errors;
+}
+
+int main(void){
+    mem_init(1024*1024);
+    batch_init();
+    int errors = bench_model("../assets/Human.obj");
+    errors += bench_model("../assets/Tree.obj");
+    mem_shutdown();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,347 @@
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/asset.h"
+#include "../src/contour.h"
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/particle_graph.h"
+#include "../src/platform.h"
+
+// Contour extraction speed on Human.obj and Tree.obj: levels of the height
+// along y, LEVELS of them over the model, at coarser and finer spacings.
+// Times field evaluation plus extraction for every ISA on 1 to all cores
+// and reports segments per second. Every run has to give the same segments,
+// bit for bit, as contour_extract_reference, which is timed as well.
+//
+// Then stitches the segments into line strips on 1 to all cores and
+// reports the vertex and byte counts against drawing them as GL_LINES.
+// Consecutive strip vertices have to be the two ends of a segment, each
+// segment exactly once.
+//
+// Last, pokes Human.obj: dents of a few sizes pressed in over some frames,
+// one after the other, with contour_update every frame against extracting
+// and stitching everything. The strips have to match the reference segments
+// of the snapshot positions after every dent.
+//
+// First of all, a GRID x GRID height field whose values all lie between
+// levels 0 and 1 has no segments at all: contour_update has to keep
+// rebuilding it into empty strips until a bump reaches level 1, and then
+// give the strips of the snapshot.
+
+#define ROUNDS 20
+#define LEVELS 100
+#define POKES  20
+#define PRESS  8       // frames per poke
+#define GRID   32
+
+// Restarts the job system for every thread count, leaves it on all cores
+static int bench_spacing(Contour* contour, Vec3Soa positions, ContourSegment* expected, uint32_t expectedCount){
+    int errors = 0;
+    job_system_shutdown();
+    unsigned int cores = cpu_core_count();
+    for(int isa = 0; isa<BATCH_ISA_COUNT; ++isa){
+        if(!batch_set_isa((BatchIsa)isa)){
+            continue;
+        }
+        for(unsigned int threads = 1; ; threads = threads*2 < cores ? threads*2 : cores){
+            job_system_init(threads);
+            double best = 1e30;
+            for(int r = 0; r<ROUNDS; ++r){
+                uint64_t start = time_now_ns();
+                contour_evaluate_height(contour, positions);
+                contour_extract(contour, positions);
+                double ms = time_ms_since(start);
+                best = ms < best ? ms : best;
+            }
+            int same = contour->segmentCount == expectedCount &&
+                       memcmp(contour->segments, expected, expectedCount*sizeof(ContourSegment)) == 0;
+            errors += !same;
+            printf("    %-6s %2u thread(s): %8.3f ms, %7.2f Msegments/s, %s\n", batch_isa_name((BatchIsa)isa), threads, best,
+                   contour->segmentCount/(best*1e3), same ? "same as reference" : "DIFFERENT from reference");
+            job_system_shutdown();
+            if(threads == cores){
+                break;
+            }
+        }
+    }
+    batch_init();
+    job_system_init(0);
+    return errors;
+}
+
+static int compare_pair(const void* a, const void* b){
+    return memcmp(a, b, 6*sizeof(float));
+}
+
+// Every pair of consecutive strip vertices against the segment ends
+static int validate_strips(const Contour* contour, const ContourSegment* segments, uint32_t n){
+    uint32_t pairs = 0;
+    float* expected = (float*)mem_alloc(MEM_TAG_CONTOUR, (6*n+1)*sizeof(float));
+    float* found = (float*)mem_alloc(MEM_TAG_CONTOUR, (6*n+1)*sizeof(float));
+    for(uint32_t i = 0; i<n; ++i){
+        memcpy(expected + 6*i, segments[i].start, 3*sizeof(float));
+        memcpy(expected + 6*i + 3, segments[i].end, 3*sizeof(float));
+    }
+    int ok = 1;
+    for(uint32_t i = 0; i+1<contour->lineIndexCount && ok; ++i){
+        uint32_t a = contour->lineIndices[i], b = contour->lineIndices[i+1];
+        if(a == CONTOUR_RESTART || b == CONTOUR_RESTART){
+            continue;
+        }
+        ok = pairs < n;
+        if(ok){
+            memcpy(found + 6*pairs, contour->lineVertices + 3*a, 3*sizeof(float));
+            memcpy(found + 6*pairs + 3, contour->lineVertices + 3*b, 3*sizeof(float));
+            pairs++;
+        }
+    }
+    if(ok && pairs == n){
+        qsort(expected, n, 6*sizeof(float), compare_pair);
+        qsort(found, n, 6*sizeof(float), compare_pair);
+        ok = memcmp(expected, found, 6*n*sizeof(float)) == 0;
+    }
+    mem_free(expected);
+    mem_free(found);
+    return ok && pairs == n;
+}
+
+// Restarts the job system for every thread count, leaves it on all cores
+static int bench_stitch(Contour* contour){
+    int errors = 0;
+    job_system_shutdown();
+    unsigned int cores = cpu_core_count();
+    for(unsigned int threads = 1; ; threads = threads*2 < cores ? threads*2 : cores){
+        job_system_init(threads);
+        double best = 1e30;
+        for(int r = 0; r<ROUNDS; ++r){
+            uint64_t start = time_now_ns();
+            contour_stitch(contour);
+            double ms = time_ms_since(start);
+            best = ms < best ? ms : best;
+        }
+        int ok = validate_strips(contour, contour->segments, contour->segmentCount);
+        errors += !ok;
+        printf("    stitch %2u thread(s): %8.3f ms, %7.2f Msegments/s, %s\n", threads, best,
+               contour->segmentCount/(best*1e3), ok ? "strips match the segments" : "strips DIFFER from the segments");
+        job_system_shutdown();
+        if(threads == cores){
+            break;
+        }
+    }
+    job_system_init(0);
+    uint32_t lines = 2*contour->segmentCount;
+    uint32_t vertices = contour->lineSegmentCount + contour->polylineCount;
+    uint32_t indices = contour->lineSegmentCount + 2*contour->polylineCount + 2*contour->loopCount;
+    printf("    %u levels, %u polylines, %u loops: %u vertices + %u indices (%u KB) vs %u GL_LINES vertices (%u KB), %.2fx fewer vertices\n",
+           contour->levelCount, contour->polylineCount, contour->loopCount, vertices, indices, (12*vertices + 4*indices)/1024,
+           lines, 12*lines/1024, (double)lines/(vertices ? vertices : 1));
+    printf("    with room for updates: %u vertices + %u indices (%u KB)\n", contour->lineVertexCount, contour->lineIndexCount,
+           (12*contour->lineVertexCount + 4*contour->lineIndexCount)/1024);
+    return errors;
+}
+
+// The strips of a contour that was updated against the reference segments of its snapshot
+static int validate_update(const Contour* contour){
+    uint32_t count = contour_extract_reference(contour, contour->extracted, NULL);
+    ContourSegment* expected = (ContourSegment*)mem_alloc(MEM_TAG_CONTOUR, (count+1)*sizeof(ContourSegment));
+    contour_extract_reference(contour, contour->extracted, expected);
+    int ok = count == contour->lineSegmentCount && validate_strips(contour, expected, count);
+    mem_free(expected);
+    return ok;
+}
+
+static uint32_t random_next(uint32_t* state){
+    *state = *state*1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Dents of radius size*height pressed in over PRESS frames, each into the last ones
+static int bench_pokes(Contour* contour, Contour* full, Vec3Soa positions, uint32_t count, float height, float size){
+    uint32_t* inside = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (count+1)*sizeof(uint32_t));
+    float* start = (float*)mem_alloc(MEM_TAG_CONTOUR, (3*count+1)*sizeof(float));
+    float* push = (float*)mem_alloc(MEM_TAG_CONTOUR, (count+1)*sizeof(float));
+    vec3 center = {0.0f, 0.0f, 0.0f};
+    for(uint32_t i = 0; i<count; ++i){
+        center[0] += positions.x[i]/count;
+        center[1] += positions.y[i]/count;
+        center[2] += positions.z[i]/count;
+    }
+    uint32_t state = 12345, moved = 0, triangles = 0, levels = 0, rebuilds = contour->rebuildCount, frames = 0;
+    double update = 0.0, worst = 0.0, reference = 0.0;
+    int errors = 0;
+    float radius = size*height, depth = 0.3f*radius;
+    for(int poke = 0; poke<POKES; ++poke){
+        // The vertices around a random one, pushed towards the middle
+        uint32_t at = random_next(&state) % count, n = 0;
+        vec3 hit = {positions.x[at], positions.y[at], positions.z[at]}, direction;
+        glm_vec3_sub(center, hit, direction);
+        glm_vec3_normalize(direction);
+        for(uint32_t i = 0; i<count; ++i){
+            vec3 p = {positions.x[i], positions.y[i], positions.z[i]};
+            float d2 = glm_vec3_distance2(p, hit)/(radius*radius);
+            if(d2 < 1.0f){
+                inside[n] = i;
+                memcpy(start + 3*n, p, sizeof(vec3));
+                push[n++] = depth*(1.0f - d2)*(1.0f - d2);
+            }
+        }
+        for(int f = 1; f<=PRESS; ++f){
+            for(uint32_t i = 0; i<n; ++i){
+                float s = push[i]*f/PRESS;
+                positions.x[inside[i]] = start[3*i+0] + s*direction[0];
+                positions.y[inside[i]] = start[3*i+1] + s*direction[1];
+                positions.z[inside[i]] = start[3*i+2] + s*direction[2];
+            }
+            uint64_t t = time_now_ns();
+            triangles += contour_update(contour, positions);
+            double ms = time_ms_since(t);
+            update += ms;
+            worst = ms > worst ? ms : worst;
+            moved += contour->movedCount;
+            levels += contour->updatedLevelCount;
+            t = time_now_ns();
+            contour_evaluate_height(full, positions);
+            contour_extract(full, positions);
+            contour_stitch(full);
+            reference += time_ms_since(t);
+            frames++;
+        }
+        errors += !validate_update(contour);
+    }
+    printf("    dents of %4.1f%% height: %6.0f moved vertices, %6.0f triangles, %5.1f levels per frame: update %7.4f ms (worst %7.4f) vs %7.4f ms everything, %5.1fx, %u rebuilds, %s\n",
+           100.0f*size, (double)moved/frames, (double)triangles/frames, (double)levels/frames, update/frames, worst,
+           reference/frames, reference/update, contour->rebuildCount - rebuilds, errors ? "strips DIFFER from the snapshot" : "strips match the snapshot");
+    mem_free(inside);
+    mem_free(start);
+    mem_free(push);
+    return errors;
+}
+
+static int bench_update(const ParticleGraph* graph, float lo, float hi){
+    Vec3Soa positions;
+    size_t size = (graph->particleCount+1)*sizeof(float);
+    positions.x = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    positions.y = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    positions.z = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    int errors = 0;
+    const float sizes[] = {0.02f, 0.05f, 0.1f, 0.2f};
+    for(uint32_t k = 0; k<sizeof(sizes)/sizeof(sizes[0]); ++k){
+        memcpy(positions.x, graph->positions.x, size);
+        memcpy(positions.y, graph->positions.y, size);
+        memcpy(positions.z, graph->positions.z, size);
+        ContourDesc desc = {{0.0f, 1.0f, 0.0f}, (hi - lo)/LEVELS, lo, 1e-5f*(hi - lo)};
+        Contour contour, full;
+        contour_init_graph(&contour, &desc, graph);
+        contour_init_graph(&full, &desc, graph);
+        contour_update(&contour, positions);
+        errors += bench_pokes(&contour, &full, positions, graph->particleCount, hi - lo, sizes[k]);
+        contour_free(&contour);
+        contour_free(&full);
+    }
+    mem_free(positions.x);
+    mem_free(positions.y);
+    mem_free(positions.z);
+    return errors;
+}
+
+static int bench_model(const char* path, int pokes){
+    fastObjMesh* obj = asset_read_obj(path);
+    if(!obj){
+        return 1;
+    }
+    ParticleGraphDesc graphDesc = {0.0f, 0, PARTICLE_ORDER_NONE};
+    ParticleGraph graph;
+    if(!particle_graph_build(obj, &graphDesc, &graph)){
+        return 1;
+    }
+    asset_free_obj(obj);
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    for(uint32_t i = 0; i<graph.particleCount; ++i){
+        lo = graph.positions.y[i] < lo ? graph.positions.y[i] : lo;
+        hi = graph.positions.y[i] > hi ? graph.positions.y[i] : hi;
+    }
+
+    int errors = 0;
+    const uint32_t levels[] = {LEVELS/4, LEVELS, LEVELS*4};
+    for(uint32_t s = 0; s<sizeof(levels)/sizeof(levels[0]); ++s){
+        ContourDesc desc = {{0.0f, 1.0f, 0.0f}, (hi - lo)/levels[s], lo, 0.0f};
+        Contour contour;
+        contour_init_graph(&contour, &desc, &graph);
+        uint32_t count = contour_extract_reference(&contour, graph.positions, NULL);
+        ContourSegment* expected = (ContourSegment*)mem_alloc(MEM_TAG_CONTOUR, (count+1)*sizeof(ContourSegment));
+        uint64_t start = time_now_ns();
+        contour_extract_reference(&contour, graph.positions, expected);
+        double ms = time_ms_since(start);
+        printf("%s: %u triangles, %u edges, %u levels: %u segments\n", path, contour.triangleCount, contour.edgeCount,
+               levels[s], count);
+        printf("    reference        %8.3f ms, %7.2f Msegments/s\n", ms, count/(ms*1e3));
+        errors += bench_spacing(&contour, graph.positions, expected, count);
+        errors += bench_stitch(&contour);
+        mem_free(expected);
+        contour_free(&contour);
+    }
+    if(pokes){
+        printf("%s: %u levels, %u dents one after the other, each pressed in over %d frames\n", path, LEVELS, POKES, PRESS);
+        errors += bench_update(&graph, lo, hi);
+    }
+    particle_graph_free(&graph);
+    return errors;
+}
+
+static int check_no_levels(void){
+    static float x[(GRID+1)*(GRID+1)], y[(GRID+1)*(GRID+1)], z[(GRID+1)*(GRID+1)];
+    static uint32_t triangles[6*GRID*GRID];
+    uint32_t n = 0;
+    for(uint32_t j = 0; j<=GRID; ++j){
+        for(uint32_t i = 0; i<=GRID; ++i){
+            x[j*(GRID+1) + i] = (float)i;
+            y[j*(GRID+1) + i] = 0.1f + 0.08f*((i*7 + j*3) % 10);
+            z[j*(GRID+1) + i] = (float)j;
+        }
+    }
+    for(uint32_t j = 0; j<GRID; ++j){
+        for(uint32_t i = 0; i<GRID; ++i){
+            uint32_t a = j*(GRID+1) + i, b = a+1, c = a+GRID+1, d = c+1;
+            triangles[n++] = a; triangles[n++] = c; triangles[n++] = b;
+            triangles[n++] = b; triangles[n++] = c; triangles[n++] = d;
+        }
+    }
+    ContourDesc desc = {{0.0f, 1.0f, 0.0f}, 1.0f, 0.0f, 1e-5f};
+    Contour contour;
+    contour_init(&contour, &desc, triangles, n/3, (GRID+1)*(GRID+1));
+    Vec3Soa positions = {x, y, z};
+    int errors = 0;
+    for(int f = 0; f<4; ++f){
+        // Moves within the band from the third update on
+        if(f >= 2){
+            for(uint32_t v = 0; v<(GRID+1)*(GRID+1); v += 5){
+                y[v] = 0.95f - 0.8f*(y[v] - 0.1f);
+            }
+        }
+        contour_update(&contour, positions);
+        errors += contour.levelCount != 0 || contour.lineIndexCount != 0 || contour.lineSegmentCount != 0;
+    }
+    uint32_t rebuilds = contour.rebuildCount;
+    y[(GRID/2)*(GRID+1) + GRID/2] = 1.5f;
+    contour_update(&contour, positions);
+    int ok = validate_update(&contour);
+    errors += !ok || contour.levelCount != 1 || contour.lineSegmentCount == 0;
+    printf("%ux%u grid between two levels: %u rebuilds into empty strips, then a bump to level 1: %u segments, %s\n",
+           GRID, GRID, rebuilds, contour.lineSegmentCount, errors ? "FAILED" : "OK");
+    contour_free(&contour);
+    return errors;
+}
+
+int main(void){
+    mem_init(1024*1024);
+    batch_init();
+    job_system_init(0);
+    int errors = check_no_levels();
+    errors += bench_model("../assets/Human.obj", 1);
+    errors += bench_model("../assets/Tree.obj", 0);
+    job_system_shutdown();
+    mem_shutdown();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/asset.h"
+#include "../src/batch.h"
+#include "../src/contour_renderer.h"
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+
+// ContourRenderer's density LOD on Human.obj with LEVELS levels of the
+// height, drawn 1.5 pixels wide and feathered at 1920x1080 from 1 to 64
+// times its height away. Prints the lod, the levels, stride and segments
+// drawn, the segments per 1000 pixels of the object's bounding circle on
+// screen and the wall time up to glFinish against drawing every level at
+// full detail. The segments per area have to stay within a factor
+// of 4 of each other once the lod is above 0.
+//
+// Then steps the camera by 0.2% across the distances where the level lod
+// and the stride change, and by as much in the middle between two lod
+// steps. Crossing a step must not change the picture more than 4 times
+// the ordinary step does, or the lines popped. Needs a GL 4.3 context, a
+// hidden window is enough, so this also runs on Mesa llvmpipe.
+
+#define WIDTH   1920
+#define HEIGHT  1080
+#define LEVELS  512
+#define ROUNDS  5
+#define STEP    0.002f
+
+typedef struct {
+    ContourRenderer* renderer;
+    mat4 view, projection;
+    vec3 lightPos, viewPos;
+    int full;
+} Frame;
+
+static void frame_camera(Frame* frame, const vec3 center, float distance){
+    vec3 eye = {center[0], center[1], center[2] + distance}, up = {0.0f, 1.0f, 0.0f};
+    glm_lookat(eye, (float*)center, up, frame->view);
+    glm_vec3_copy(eye, frame->viewPos);
+    glm_vec3_copy((vec3){center[0] + distance, center[1] + distance, center[2] + distance}, frame->lightPos);
+}
+
+static void frame_draw(Frame* frame){
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    ContourRenderer* renderer = frame->renderer;
+    if(frame->full){
+        LineRange all = {0, renderer->levelSegments[renderer->levelCount], renderer->lines.style.width};
+        line_renderer_draw_ranges(&renderer->lines, frame->view, frame->projection, frame->lightPos, frame->viewPos,
+                                  WIDTH, HEIGHT, &all, 1);
+    } else {
+        contour_renderer_draw(renderer, frame->view, frame->projection, frame->lightPos, frame->viewPos, WIDTH, HEIGHT);
+    }
+}
+
+// Wall time up to glFinish, timer queries can miss the vertex work
+static double time_frame(Frame* frame){
+    frame_draw(frame);
+    glFinish();
+    double best = 1e30;
+    for(int r = 0; r<ROUNDS; ++r){
+        uint64_t start = time_now_ns();
+        frame_draw(frame);
+        glFinish();
+        double ms = time_ms_since(start);
+        best = ms < best ? ms : best;
+    }
+    return best;
+}
+
+// Mean difference per color channel between the pictures at distance and a STEP further
+static double step_change(Frame* frame, const vec3 center, float distance, uint8_t* a, uint8_t* b){
+    frame_camera(frame, center, distance);
+    frame_draw(frame);
+    glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, a);
+    frame_camera(frame, center, distance*(1.0f + STEP));
+    frame_draw(frame);
+    glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, b);
+    uint64_t sum = 0;
+    for(uint32_t i = 0; i<WIDTH*HEIGHT; ++i){
+        for(int c = 0; c<3; ++c){
+            sum += a[4*i+c] > b[4*i+c] ? a[4*i+c] - b[4*i+c] : b[4*i+c] - a[4*i+c];
+        }
+    }
+    return sum/(3.0*WIDTH*HEIGHT);
+}
+
+// Camera distance at which log2(pixels wanted / pixels per length at the
+// nearest point of the bounds) reaches lod
+static float lod_distance(const Frame* frame, const ContourRenderer* renderer, float length, float pixels, float lod){
+    return renderer->radius + frame->projection[1][1]*0.5f*HEIGHT*length*powf(2.0f, lod)/pixels;
+}
+
+int main(void){
+    mem_init(1024*1024);
+    batch_init();
+    job_system_init(0);
+    if(!glfwInit()){
+        printf("Failed to init GLFW\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench_contour_lod", NULL, NULL);
+    if(!window){
+        printf("Failed to create a GL 4.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
+        printf("Failed to initialize Glad\n");
+        return 1;
+    }
+    printf("%s, %dx%d\n", glGetString(GL_RENDERER), WIDTH, HEIGHT);
+
+    GLuint framebuffer, color, depth;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &color);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WIDTH, HEIGHT);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, WIDTH, HEIGHT);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    fastObjMesh* obj = asset_read_obj("../assets/Human.obj");
+    if(!obj){
+        return 1;
+    }
+    ParticleGraphDesc graphDesc = {0.0f, 0, PARTICLE_ORDER_NONE};
+    ParticleGraph graph;
+    if(!particle_graph_build(obj, &graphDesc, &graph)){
+        return 1;
+    }
+    asset_free_obj(obj);
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    for(uint32_t i = 0; i<graph.particleCount; ++i){
+        lo = graph.positions.y[i] < lo ? graph.positions.y[i] : lo;
+        hi = graph.positions.y[i] > hi ? graph.positions.y[i] : hi;
+    }
+    ContourDesc desc = {{0.0f, 1.0f, 0.0f}, (hi - lo)/LEVELS, lo, 0.0f};
+    Contour contour;
+    contour_init_graph(&contour, &desc, &graph);
+    contour_evaluate_height(&contour, graph.positions);
+    contour_extract(&contour, graph.positions);
+    contour_stitch(&contour);
+
+    LineStyle style = {1.5f, LINE_JOIN_MITER, 4.0f, {0.9f, 0.8f, 0.6f}, 1.0f};
+    ContourLodDesc lodDesc = {4.0f, 4.0f};
+    ContourRenderer renderer;
+    if(!contour_renderer_init(&renderer, &style, &lodDesc)){
+        return 1;
+    }
+    contour_renderer_set(&renderer, &contour);
+    int ok = renderer.levelSegments[renderer.levelCount] == contour.lineSegmentCount;
+    printf("Human.obj, %u levels: %u segments, %u strides, %u segments with all strides\n", renderer.levelCount,
+           contour.lineSegmentCount, renderer.strideCount, renderer.lines.segmentCount);
+
+    Frame frame = {&renderer};
+    glm_perspective(glm_rad(45.0f), (float)WIDTH/HEIGHT, 0.01f, 1000.0f, frame.projection);
+    float height = hi - lo;
+    double lowest = 1e30, highest = 0.0;
+    for(float distance = height; distance<=64.0f*height; distance *= 2.0f){
+        frame_camera(&frame, renderer.center, distance);
+        frame.full = 1;
+        double full = time_frame(&frame);
+        frame.full = 0;
+        double lod = time_frame(&frame);
+        float radius = renderer.radius*frame.projection[1][1]*0.5f*HEIGHT/distance;
+        float area = GLM_PIf*radius*radius;
+        area = area < WIDTH*HEIGHT ? area : WIDTH*HEIGHT;
+        double density = renderer.drawnSegments/(area*1e-3);
+        if(renderer.levelLod > 0.0f){
+            lowest = density < lowest ? density : lowest;
+            highest = density > highest ? density : highest;
+        }
+        printf("    %5.1f heights away: lod %5.2f, %3u levels, stride %3u, %7u segments, %8.1f per 1000 px, %7.2f ms, all %7.2f ms, %.2fx\n",
+               distance/height, renderer.levelLod, renderer.drawnLevels, 1u << renderer.stride, renderer.drawnSegments,
+               density, lod, full, full/lod);
+    }
+    ok &= highest <= 4.0*lowest;
+
+    uint8_t* a = (uint8_t*)mem_alloc(MEM_TAG_GENERAL, WIDTH*HEIGHT*4);
+    uint8_t* b = (uint8_t*)mem_alloc(MEM_TAG_GENERAL, WIDTH*HEIGHT*4);
+    for(float step = 1.0f; step<=3.0f; step += 1.0f){
+        float across = lod_distance(&frame, &renderer, desc.spacing, lodDesc.minSpacing, step);
+        double crossing = step_change(&frame, renderer.center, across*(1.0f - 0.5f*STEP), a, b);
+        float middle = lod_distance(&frame, &renderer, desc.spacing, lodDesc.minSpacing, step - 0.5f);
+        double ordinary = step_change(&frame, renderer.center, middle*(1.0f - 0.5f*STEP), a, b);
+        ok &= crossing <= 4.0*ordinary + 0.01;
+        printf("    level lod %.0f at %5.1f heights: a %.1f%% step across it changes the picture by %.4f, in between by %.4f\n",
+               step, across/height, 100.0f*STEP, crossing, ordinary);
+    }
+    for(float step = 1.0f; step<renderer.strideCount && step<=3.0f; step += 1.0f){
+        float across = lod_distance(&frame, &renderer, renderer.segmentLength, lodDesc.minSegment, step);
+        double crossing = step_change(&frame, renderer.center, across*(1.0f - 0.5f*STEP), a, b);
+        float middle = lod_distance(&frame, &renderer, renderer.segmentLength, lodDesc.minSegment, step - 0.5f);
+        double ordinary = step_change(&frame, renderer.center, middle*(1.0f - 0.5f*STEP), a, b);
+        ok &= crossing <= 4.0*ordinary + 0.01;
+        printf("    stride %u at %5.1f heights: a %.1f%% step across it changes the picture by %.4f, in between by %.4f\n",
+               1u << (uint32_t)step, across/height, 100.0f*STEP, crossing, ordinary);
+    }
+
+    mem_free(a);
+    mem_free(b);
+    contour_renderer_free(&renderer);
+    contour_free(&contour);
+    particle_graph_free(&graph);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    job_system_shutdown();
+    mem_shutdown();
+    return ok ? 0 : 1;
+}
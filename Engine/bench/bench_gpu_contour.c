@@ -0,0 +1,331 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/asset.h"
+#include "../src/gpu_contour.h"
+#include "../src/gpu_verlet.h"
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+
+// GPU contour extraction against the CPU path it replaces. First hangs
+// Human.obj and Tree.obj from their top particles in GpuVerlet, lets them
+// swing for a while, then extracts LEVELS levels of the height on the GPU
+// straight from the particle SSBO and on the CPU from a readback of the
+// same positions. Both have to give the same segments, bit for bit, in
+// whatever order. Then times both on the models and on wavy grids of 100k
+// and 1M vertices: GPU dispatches from GL_TIMESTAMP queries, CPU as the
+// round trip it needs, positions down, extraction on all cores, segments
+// up. Needs a GL 4.3 context, a hidden window is enough, so this also runs
+// on Mesa llvmpipe.
+
+#define LEVELS  100
+#define DT      (1.0f/60.0f)
+#define FRAMES  30
+#define ROUNDS  10
+
+static int compare_segment(const void* a, const void* b){
+    const ContourSegment* x = (const ContourSegment*)a;
+    const ContourSegment* y = (const ContourSegment*)b;
+    if(x->triangle != y->triangle){
+        return x->triangle < y->triangle ? -1 : 1;
+    }
+    return (x->level > y->level) - (x->level < y->level);
+}
+
+static void height_range(Vec3Soa positions, uint32_t count, float* lo, float* hi){
+    *lo = FLT_MAX;
+    *hi = -FLT_MAX;
+    for(uint32_t i = 0; i<count; ++i){
+        *lo = positions.y[i] < *lo ? positions.y[i] : *lo;
+        *hi = positions.y[i] > *hi ? positions.y[i] : *hi;
+    }
+}
+
+// GPU extraction from the simulated particles against the CPU extractor on their readback
+static int validate(const char* path){
+    fastObjMesh* obj = asset_read_obj(path);
+    if(!obj){
+        return 0;
+    }
+    ParticleGraphDesc graphDesc = {0.0f, 1, PARTICLE_ORDER_NONE};
+    ParticleGraph graph;
+    if(!particle_graph_build(obj, &graphDesc, &graph)){
+        return 0;
+    }
+    asset_free_obj(obj);
+    VerletDesc verletDesc = {10, 1.0f, 0.98f, {0.0f, -9.81f, 0.0f}};
+    VerletSolver solver;
+    verlet_init_graph(&solver, &verletDesc, &graph);
+    float lo, hi;
+    height_range(solver.position, solver.particleCount, &lo, &hi);
+    for(uint32_t i = 0; i<solver.particleCount; ++i){
+        if(solver.position.y[i] > hi - 0.02f*(hi - lo)){
+            solver.inverseMass[i] = 0.0f;
+        }
+    }
+    vec3 kick = {0.01f*(hi - lo), 0.0f, 0.0f};
+    for(uint32_t i = 0; i<solver.particleCount; i += 5){
+        verlet_add_displacement(&solver, i, kick);
+    }
+    GpuVerlet verlet;
+    if(!gpu_verlet_init(&verlet, &solver)){
+        return 0;
+    }
+    for(int f = 0; f<FRAMES; ++f){
+        gpu_verlet_step(&verlet, DT);
+    }
+    Vec3Soa positions;
+    size_t size = (solver.particleCount+1)*sizeof(float);
+    positions.x = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    positions.y = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    positions.z = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    gpu_verlet_request_readback(&verlet);
+    while(!gpu_verlet_poll_readback(&verlet, positions)){
+    }
+
+    ContourDesc desc = {{0.0f, 1.0f, 0.0f}, (hi - lo)/LEVELS, lo, 0.0f};
+    Contour contour;
+    contour_init_graph(&contour, &desc, &graph);
+    contour_evaluate_height(&contour, positions);
+    contour_extract(&contour, positions);
+    GpuContour gpu;
+    int ok = gpu_contour_init(&gpu, &contour, contour.segmentCount + contour.segmentCount/4 + 64);
+    if(ok){
+        gpu_contour_extract(&gpu, gpu_verlet_positions(&verlet));
+        ContourSegment* segments = (ContourSegment*)mem_alloc(MEM_TAG_CONTOUR, (gpu.capacity+1)*sizeof(ContourSegment));
+        uint32_t count = gpu_contour_read_segments(&gpu, segments);
+        qsort(segments, count < gpu.capacity ? count : gpu.capacity, sizeof(ContourSegment), compare_segment);
+        uint32_t same = 0, matched = 0;
+        float worst = 0.0f;
+        for(uint32_t i = 0; i<count && i<contour.segmentCount && count <= gpu.capacity; ++i){
+            const ContourSegment* a = &segments[i];
+            const ContourSegment* b = &contour.segments[i];
+            if(a->triangle != b->triangle || a->level != b->level || a->startEdge != b->startEdge || a->endEdge != b->endEdge){
+                continue;
+            }
+            matched++;
+            same += memcmp(a, b, sizeof(ContourSegment)) == 0;
+            for(int c = 0; c<3; ++c){
+                worst = fmaxf(worst, fmaxf(fabsf(a->start[c] - b->start[c]), fabsf(a->end[c] - b->end[c])));
+            }
+        }
+        ok = count == contour.segmentCount && matched == count && same == count;
+        printf("%s after %d GPU steps, %u levels: GPU %u segments, CPU %u, %u with the same triangle, level and edges, %u bit for bit (max difference %g) %s\n",
+               path, FRAMES, LEVELS, count, contour.segmentCount, matched, same, worst, ok ? "OK" : "FAILED");
+        mem_free(segments);
+        gpu_contour_free(&gpu);
+    }
+    contour_free(&contour);
+    mem_free(positions.x);
+    mem_free(positions.y);
+    mem_free(positions.z);
+    gpu_verlet_free(&verlet);
+    verlet_free(&solver);
+    particle_graph_free(&graph);
+    return ok;
+}
+
+// GPU passes against the CPU round trip for the positions in particles
+static void bench_extract(const char* label, const Contour* source, GLuint particles, uint32_t vertexCount){
+    Contour contour;
+    contour_init(&contour, &source->desc, source->triangles, source->triangleCount, source->vertexCount);
+    Vec3Soa positions;
+    size_t size = (vertexCount+1)*sizeof(float);
+    positions.x = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    positions.y = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    positions.z = (float*)mem_alloc(MEM_TAG_CONTOUR, size);
+    float* staging = (float*)mem_alloc(MEM_TAG_CONTOUR, ((size_t)vertexCount*4+1)*sizeof(float));
+    uint32_t count = 0;
+
+    // Positions down, extraction, segments up as two vec4 each like the GPU keeps them
+    GLuint upload = 0;
+    uint32_t uploadCapacity = 0;
+    double cpu = 1e30;
+    for(int r = 0; r<ROUNDS; ++r){
+        uint64_t start = time_now_ns();
+        glBindBuffer(GL_COPY_READ_BUFFER, particles);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)vertexCount*4*sizeof(float), staging);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        for(uint32_t i = 0; i<vertexCount; ++i){
+            positions.x[i] = staging[4*i+0];
+            positions.y[i] = staging[4*i+1];
+            positions.z[i] = staging[4*i+2];
+        }
+        contour_evaluate_height(&contour, positions);
+        count = contour_extract(&contour, positions);
+        float* points = (float*)mem_alloc(MEM_TAG_CONTOUR, ((size_t)count*8+1)*sizeof(float));
+        for(uint32_t i = 0; i<count; ++i){
+            memcpy(points + 8*i, contour.segments[i].start, 3*sizeof(float));
+            memcpy(points + 8*i + 4, contour.segments[i].end, 3*sizeof(float));
+        }
+        if(!upload){
+            glGenBuffers(1, &upload);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, upload);
+        if(count > uploadCapacity){
+            uploadCapacity = count;
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)count*8*sizeof(float), NULL, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)count*8*sizeof(float), points);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glFinish();
+        mem_free(points);
+        double ms = time_ms_since(start);
+        cpu = ms < cpu ? ms : cpu;
+    }
+    glDeleteBuffers(1, &upload);
+
+    GpuContour gpu;
+    if(gpu_contour_init(&gpu, &contour, count + count/4 + 64)){
+        GLuint queries[2];
+        glGenQueries(2, queries);
+        gpu_contour_extract(&gpu, particles);
+        glFinish();
+        double best = 1e30, wall = 1e30;
+        for(int r = 0; r<ROUNDS; ++r){
+            uint64_t start = time_now_ns();
+            glQueryCounter(queries[0], GL_TIMESTAMP);
+            gpu_contour_extract(&gpu, particles);
+            glQueryCounter(queries[1], GL_TIMESTAMP);
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+            double ms = time_ms_since(start);
+            wall = ms < wall ? ms : wall;
+            best = (end - begin)/1e6 < best ? (end - begin)/1e6 : best;
+        }
+        printf("%-12s %8u vertices, %8u segments: GPU %8.3f ms (%8.3f wall), CPU round trip %8.3f ms, %5.1fx\n",
+               label, vertexCount, count, best, wall, cpu, cpu/best);
+        glDeleteQueries(2, queries);
+        gpu_contour_free(&gpu);
+    }
+    mem_free(staging);
+    mem_free(positions.x);
+    mem_free(positions.y);
+    mem_free(positions.z);
+    contour_free(&contour);
+}
+
+static GLuint particle_buffer(Vec3Soa positions, uint32_t count){
+    float* packed = (float*)mem_alloc(MEM_TAG_CONTOUR, ((size_t)count*4+1)*sizeof(float));
+    for(uint32_t i = 0; i<count; ++i){
+        packed[4*i+0] = positions.x[i];
+        packed[4*i+1] = positions.y[i];
+        packed[4*i+2] = positions.z[i];
+        packed[4*i+3] = 1.0f;
+    }
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)count*4*sizeof(float), packed, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    mem_free(packed);
+    return buffer;
+}
+
+static void bench_model(const char* path){
+    fastObjMesh* obj = asset_read_obj(path);
+    if(!obj){
+        return;
+    }
+    ParticleGraphDesc graphDesc = {0.0f, 0, PARTICLE_ORDER_NONE};
+    ParticleGraph graph;
+    if(!particle_graph_build(obj, &graphDesc, &graph)){
+        return;
+    }
+    asset_free_obj(obj);
+    float lo, hi;
+    height_range(graph.positions, graph.particleCount, &lo, &hi);
+    ContourDesc desc = {{0.0f, 1.0f, 0.0f}, (hi - lo)/LEVELS, lo, 0.0f};
+    Contour contour;
+    contour_init_graph(&contour, &desc, &graph);
+    GLuint particles = particle_buffer(graph.positions, graph.particleCount);
+    bench_extract(strrchr(path, '/') + 1, &contour, particles, graph.particleCount);
+    glDeleteBuffers(1, &particles);
+    contour_free(&contour);
+    particle_graph_free(&graph);
+}
+
+// side*side vertices over the xz plane, the height a few waves across
+static void bench_grid(uint32_t side){
+    uint32_t count = side*side, triangleCount = 2*(side-1)*(side-1);
+    Vec3Soa positions;
+    positions.x = (float*)mem_alloc(MEM_TAG_CONTOUR, count*sizeof(float));
+    positions.y = (float*)mem_alloc(MEM_TAG_CONTOUR, count*sizeof(float));
+    positions.z = (float*)mem_alloc(MEM_TAG_CONTOUR, count*sizeof(float));
+    uint32_t* triangles = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (3*(size_t)triangleCount+1)*sizeof(uint32_t));
+    for(uint32_t y = 0; y<side; ++y){
+        for(uint32_t x = 0; x<side; ++x){
+            float u = (float)x/(side-1), v = (float)y/(side-1);
+            positions.x[y*side+x] = u;
+            positions.y[y*side+x] = 0.5f + 0.25f*sinf(12.0f*u)*cosf(9.0f*v) + 0.2f*u*v;
+            positions.z[y*side+x] = v;
+        }
+    }
+    uint32_t* t = triangles;
+    for(uint32_t y = 0; y+1<side; ++y){
+        for(uint32_t x = 0; x+1<side; ++x){
+            uint32_t i = y*side+x;
+            t[0] = i; t[1] = i+side; t[2] = i+1;
+            t[3] = i+1; t[4] = i+side; t[5] = i+side+1;
+            t += 6;
+        }
+    }
+    ContourDesc desc = {{0.0f, 1.0f, 0.0f}, 1.0f/LEVELS, 0.0f, 0.0f};
+    Contour contour;
+    contour_init(&contour, &desc, triangles, triangleCount, count);
+    GLuint particles = particle_buffer(positions, count);
+    char label[32];
+    snprintf(label, sizeof(label), "grid %ux%u", side, side);
+    bench_extract(label, &contour, particles, count);
+    glDeleteBuffers(1, &particles);
+    contour_free(&contour);
+    mem_free(triangles);
+    mem_free(positions.x);
+    mem_free(positions.y);
+    mem_free(positions.z);
+}
+
+int main(void){
+    mem_init(1024*1024);
+    batch_init();
+    job_system_init(0);
+    if(!glfwInit()){
+        printf("Failed to init GLFW\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench_gpu_contour", NULL, NULL);
+    if(!window){
+        printf("Failed to create a GL 4.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
+        printf("Failed to initialize Glad\n");
+        return 1;
+    }
+    printf("%s, %d levels\n", glGetString(GL_RENDERER), LEVELS);
+
+    int ok = validate("../assets/Human.obj");
+    ok &= validate("../assets/Tree.obj");
+    bench_model("../assets/Human.obj");
+    bench_model("../assets/Tree.obj");
+    bench_grid(316);
+    bench_grid(1000);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    job_system_shutdown();
+    mem_shutdown();
+    return ok ? 0 : 1;
+}
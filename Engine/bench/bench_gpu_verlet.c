@@ -0,0 +1,204 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <math.h>
+#include <stdio.h>
+#include "../src/gpu_verlet.h"
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+
+// GPU solver dispatch times from GL_TIMESTAMP queries for square cloth
+// grids of 10k, 100k and 1M particles, same setup as bench_verlet. First runs
+// a small cloth on the CPU and GPU side by side and checks that they still
+// agree after VALIDATE_STEPS steps. Needs a GL 4.3 context, a hidden window
+// is enough, so this also runs on Mesa llvmpipe.
+
+#define ITERATIONS      10
+#define DT              (1.0f/60.0f)
+#define VALIDATE_STEPS  100
+#define TOLERANCE       1e-3f
+
+typedef struct {
+    uint32_t side;
+    Vec3Soa positions;
+    ParticleConstraint* constraints;
+    uint32_t constraintCount;
+} Cloth;
+
+static void cloth_edge(Cloth* cloth, uint32_t a, uint32_t b){
+    ParticleConstraint* c = &cloth->constraints[cloth->constraintCount++];
+    float dx = cloth->positions.x[a] - cloth->positions.x[b];
+    float dy = cloth->positions.y[a] - cloth->positions.y[b];
+    float dz = cloth->positions.z[a] - cloth->positions.z[b];
+    c->a = a;
+    c->b = b;
+    c->restLength = sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+static Cloth cloth_create(uint32_t side){
+    Cloth cloth = {side};
+    uint32_t count = side*side;
+    cloth.positions.x = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    cloth.positions.y = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    cloth.positions.z = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    cloth.constraints = (ParticleConstraint*)mem_alloc(MEM_TAG_GENERAL, 3*count*sizeof(ParticleConstraint));
+    float spacing = 10.0f/(float)side;
+    for(uint32_t y = 0; y<side; ++y){
+        for(uint32_t x = 0; x<side; ++x){
+            cloth.positions.x[y*side+x] = x*spacing;
+            cloth.positions.y[y*side+x] = 0.0f;
+            cloth.positions.z[y*side+x] = y*spacing;
+        }
+    }
+    for(uint32_t y = 0; y<side; ++y){
+        for(uint32_t x = 0; x<side; ++x){
+            uint32_t i = y*side+x;
+            if(x+1 < side) cloth_edge(&cloth, i, i+1);
+            if(y+1 < side) cloth_edge(&cloth, i, i+side);
+            if(x+1 < side && y+1 < side) cloth_edge(&cloth, i, i+side+1);
+        }
+    }
+    return cloth;
+}
+
+static void cloth_free(Cloth* cloth){
+    mem_free(cloth->positions.x);
+    mem_free(cloth->positions.y);
+    mem_free(cloth->positions.z);
+    mem_free(cloth->constraints);
+}
+
+static const VerletDesc pbdDesc = {ITERATIONS, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}};
+// Soft constraints and two iterations per substep so the accumulated
+// multipliers matter
+static const VerletDesc xpbdDesc = {2, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}, VERLET_XPBD, 5, 1e-6f};
+
+static void solver_create(VerletSolver* solver, const Cloth* cloth, const VerletDesc* desc){
+    verlet_init(solver, desc, cloth->positions, cloth->side*cloth->side, cloth->constraints, cloth->constraintCount);
+    for(uint32_t x = 0; x<cloth->side; ++x){
+        solver->inverseMass[x] = 0.0f;
+    }
+}
+
+// Runs both solvers and compares the asynchronous readback with the CPU result
+static int validate(uint32_t side, const VerletDesc* desc){
+    Cloth cloth = cloth_create(side);
+    uint32_t count = side*side;
+    VerletSolver cpu;
+    solver_create(&cpu, &cloth, desc);
+    GpuVerlet gpu;
+    if(!gpu_verlet_init(&gpu, &cpu)){
+        verlet_free(&cpu);
+        cloth_free(&cloth);
+        return 0;
+    }
+    for(int s = 0; s<VALIDATE_STEPS; ++s){
+        verlet_step(&cpu, DT);
+        gpu_verlet_step(&gpu, DT);
+    }
+
+    Vec3Soa readback;
+    readback.x = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    readback.y = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    readback.z = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    gpu_verlet_request_readback(&gpu);
+    int polls = 1;
+    while(!gpu_verlet_poll_readback(&gpu, readback)){
+        ++polls;
+    }
+
+    float worst = 0.0f;
+    for(uint32_t i = 0; i<count; ++i){
+        float d = fabsf(readback.x[i] - cpu.position.x[i]) + fabsf(readback.y[i] - cpu.position.y[i])
+                + fabsf(readback.z[i] - cpu.position.z[i]);
+        worst = d > worst ? d : worst;
+    }
+    int ok = worst <= TOLERANCE;
+    printf("%s, %u particles, %d steps: GPU vs CPU max difference %g (tolerance %g) %s, readback after %d poll(s)\n",
+           desc->mode == VERLET_XPBD ? "XPBD" : "PBD", count, VALIDATE_STEPS, worst, TOLERANCE, ok ? "OK" : "FAILED", polls);
+
+    mem_free(readback.x);
+    mem_free(readback.y);
+    mem_free(readback.z);
+    gpu_verlet_free(&gpu);
+    verlet_free(&cpu);
+    cloth_free(&cloth);
+    return ok;
+}
+
+static void bench_cloth(uint32_t side, int steps){
+    Cloth cloth = cloth_create(side);
+    uint32_t count = side*side;
+    VerletSolver cpu;
+    solver_create(&cpu, &cloth, &pbdDesc);
+    GpuVerlet gpu;
+    if(!gpu_verlet_init(&gpu, &cpu)){
+        verlet_free(&cpu);
+        cloth_free(&cloth);
+        return;
+    }
+
+    GLuint queries[2];
+    glGenQueries(2, queries);
+    gpu_verlet_step(&gpu, DT);
+    glFinish();
+
+    uint64_t gpuNs = 0;
+    uint64_t start = time_now_ns();
+    for(int s = 0; s<steps; ++s){
+        glQueryCounter(queries[0], GL_TIMESTAMP);
+        gpu_verlet_step(&gpu, DT);
+        glQueryCounter(queries[1], GL_TIMESTAMP);
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+        gpuNs += end - begin;
+    }
+    double wallMs = time_ms_since(start)/steps;
+    double gpuMs = gpuNs/1e6/steps;
+    uint32_t dispatches = 1 + ITERATIONS*gpu.colorCount;
+    printf("%7u particles, %u colors: %8.3f ms/step GPU (%8.3f wall), %u dispatches at %7.1f us, %6.2f ns/particle/step\n",
+           count, gpu.colorCount, gpuMs, wallMs, dispatches, gpuMs*1e3/dispatches, gpuMs*1e6/count);
+
+    glDeleteQueries(2, queries);
+    gpu_verlet_free(&gpu);
+    verlet_free(&cpu);
+    cloth_free(&cloth);
+}
+
+int main(void){
+    mem_init(1024*1024);
+    job_system_init(0);
+    if(!glfwInit()){
+        printf("Failed to init GLFW\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench_gpu_verlet", NULL, NULL);
+    if(!window){
+        printf("Failed to create a GL 4.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
+        printf("Failed to initialize Glad\n");
+        return 1;
+    }
+    printf("%s, %d iterations\n", glGetString(GL_RENDERER), ITERATIONS);
+
+    int ok = validate(64, &pbdDesc);
+    ok &= validate(64, &xpbdDesc);
+    bench_cloth(100, 100);
+    bench_cloth(316, 20);
+    bench_cloth(1000, 3);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    job_system_shutdown();
+    mem_shutdown();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#include <math.h>
+#include <stdio.h>
+#include "../src/asset.h"
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/particle_graph.h"
+#include "../src/platform.h"
+
+// Particle graph build time and counts for every bundled model, with and
+// without bending constraints. Also checks the result: constraints unique and
+// ordered, and every render vertex maps to a particle at its own position,
+// also after Morton and RCM reordering, with the mean index distance between
+// the two ends of a constraint before and after.
+
+#define ROUNDS 10
+
+static const char* defaultModels[] = {
+    "../assets/Human.obj", "../assets/Tree.obj", "../assets/Wolf.obj", "../assets/car.obj", "../assets/peng.obj"
+};
+
+static int validate(const ParticleGraph* graph, const char* path){
+    int errors = 0;
+    for(uint32_t i = 0; i<graph->edgeCount; ++i){
+        const ParticleConstraint* c = &graph->constraints[i];
+        if(c->a >= c->b || c->b >= graph->particleCount){
+            errors++;
+        }
+        if(i > 0){
+            const ParticleConstraint* p = &graph->constraints[i-1];
+            if(p->a > c->a || (p->a == c->a && p->b >= c->b)){
+                errors++;
+            }
+        }
+    }
+
+    MeshData mesh;
+    if(asset_load_mesh(path, &mesh)){
+        if(mesh.vertexCount != graph->renderVertexCount){
+            errors++;
+        }
+        float worst = 0.0f;
+        for(uint32_t v = 0; v<mesh.vertexCount && v<graph->renderVertexCount; ++v){
+            uint32_t p = graph->renderToParticle[v];
+            float dx = mesh.vertices[8*v+0] - graph->positions.x[p];
+            float dy = mesh.vertices[8*v+1] - graph->positions.y[p];
+            float dz = mesh.vertices[8*v+2] - graph->positions.z[p];
+            float d = sqrtf(dx*dx + dy*dy + dz*dz);
+            worst = d > worst ? d : worst;
+        }
+        printf("  render remap max weld distance %g\n", worst);
+        asset_free_mesh(&mesh);
+    }
+    return errors;
+}
+
+static void bench_model(const char* path){
+    fastObjMesh* mesh = asset_read_obj(path);
+    if(!mesh){
+        return;
+    }
+    printf("%s: %u positions, %u faces\n", path, mesh->position_count, mesh->face_count);
+
+    for(int bending = 0; bending<2; ++bending){
+        ParticleGraphDesc desc = {0.0f, bending};
+        ParticleGraph graph;
+        double best = 1e30;
+        for(int r = 0; r<ROUNDS; ++r){
+            uint64_t start = time_now_ns();
+            particle_graph_build(mesh, &desc, &graph);
+            double ms = time_ms_since(start);
+            best = ms < best ? ms : best;
+            if(r < ROUNDS-1){
+                particle_graph_free(&graph);
+            }
+        }
+        printf("  %-12s %7u particles %8u edges %8u bends  %7.3f ms\n", bending ? "bending" : "edges only",
+               graph.particleCount, graph.edgeCount, graph.bendCount, best);
+        if(bending){
+            int errors = validate(&graph, path);
+            if(errors){
+                printf("  MISMATCH: %d invalid constraints or remap entries\n", errors);
+            }
+        }
+        particle_graph_free(&graph);
+    }
+
+    static const char* orderNames[] = {"none", "Morton", "RCM"};
+    for(int order = PARTICLE_ORDER_NONE; order<=PARTICLE_ORDER_RCM; ++order){
+        ParticleGraphDesc desc = {0.0f, 1, (ParticleOrder)order};
+        ParticleGraph graph;
+        uint64_t start = time_now_ns();
+        particle_graph_build(mesh, &desc, &graph);
+        double ms = time_ms_since(start);
+        double distance = 0.0;
+        for(uint32_t i = 0; i<graph.constraintCount; ++i){
+            distance += fabs((double)graph.constraints[i].b - (double)graph.constraints[i].a);
+        }
+        printf("  order %-7s %7.3f ms, mean constraint index distance %10.1f\n", orderNames[order], ms,
+               graph.constraintCount ? distance/graph.constraintCount : 0.0);
+        int errors = validate(&graph, path);
+        if(errors){
+            printf("  MISMATCH: %d invalid constraints or remap entries\n", errors);
+        }
+        particle_graph_free(&graph);
+    }
+    asset_free_obj(mesh);
+}
+
+int main(int argc, char** argv){
+    mem_init(1024*1024);
+    job_system_init(0);
+    printf("%u threads\n", job_thread_count());
+
+    if(argc > 1){
+        for(int i = 1; i<argc; ++i){
+            bench_model(argv[i]);
+        }
+    } else {
+        for(size_t i = 0; i<sizeof(defaultModels)/sizeof(defaultModels[0]); ++i){
+            bench_model(defaultModels[i]);
+        }
+    }
+
+    job_system_shutdown();
+    mem_shutdown();
+    return 0;
+}
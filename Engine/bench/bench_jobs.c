@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/job.h"
+#include "../src/platform.h"
+
+// Job system microbenchmarks:
+//  - empty job throughput: how fast can we create, schedule and retire no-op jobs
+//  - fan-out/fan-in latency: time from launching N children to the parent completing
+//  - parallel_for scaling over a memory bound loop
+
+#define EMPTY_JOBS     1000000
+#define BATCH_SIZE     1024
+#define LATENCY_ROUNDS 2000
+
+static void empty_job(Job* job, void* data){
+    (void)job;
+    (void)data;
+}
+
+static void bench_empty_throughput(void){
+    uint64_t start = time_now_ns();
+    for(unsigned int done = 0; done<EMPTY_JOBS; done+=BATCH_SIZE){
+        Job* root = job_create(empty_job, NULL);
+        for(unsigned int i = 0; i<BATCH_SIZE; ++i){
+            job_run(job_create_child(root, empty_job, NULL));
+        }
+        job_run(root);
+        job_wait(root);
+    }
+    double ms = time_ms_since(start);
+    printf("  empty jobs:        %8.1f ns/job  (%.2f M jobs/s)\n", ms*1e6/EMPTY_JOBS, EMPTY_JOBS/(ms*1e3));
+}
+
+static int compare_u64(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_fan_latency(unsigned int fanOut){
+    uint64_t* samples = (uint64_t*)malloc(LATENCY_ROUNDS*sizeof(uint64_t));
+    for(unsigned int r = 0; r<LATENCY_ROUNDS; ++r){
+        uint64_t start = time_now_ns();
+        Job* root = job_create(empty_job, NULL);
+        for(unsigned int i = 0; i<fanOut; ++i){
+            job_run(job_create_child(root, empty_job, NULL));
+        }
+        job_run(root);
+        job_wait(root);
+        samples[r] = time_now_ns() - start;
+    }
+    qsort(samples, LATENCY_ROUNDS, sizeof(uint64_t), compare_u64);
+    printf("  fan-out/in %5u:   median %7.2f us, p99 %7.2f us\n", fanOut,
+        samples[LATENCY_ROUNDS/2]*1e-3, samples[LATENCY_ROUNDS*99/100]*1e-3);
+    free(samples);
+}
+
+typedef struct {
+    float* values;
+} ScaleData;
+
+static void scale_range(void* arg, uint32_t begin, uint32_t end){
+    float* values = ((ScaleData*)arg)->values;
+    for(uint32_t i = begin; i<end; ++i){
+        values[i] = values[i]*1.0001f + 0.5f;
+    }
+}
+
+static void bench_parallel_for(void){
+    const uint32_t count = 1u << 24;
+    ScaleData data = {(float*)calloc(count, sizeof(float))};
+    parallel_for(&data, count, 0, scale_range);
+
+    const int rounds = 20;
+    uint64_t start = time_now_ns();
+    for(int r = 0; r<rounds; ++r){
+        parallel_for(&data, count, 0, scale_range);
+    }
+    double ms = time_ms_since(start)/rounds;
+    printf("  parallel_for 16M:  %8.3f ms  (%.2f GB/s)\n", ms, count*2.0*sizeof(float)/(ms*1e6));
+    free(data.values);
+}
+
+int main(void){
+    unsigned int cores = cpu_core_count();
+    for(unsigned int threads = 1; ; threads = threads*2 < cores ? threads*2 : cores){
+        job_system_init(threads);
+        printf("%u thread(s)\n", threads);
+        bench_empty_throughput();
+        bench_fan_latency(16);
+        bench_fan_latency(256);
+        bench_parallel_for();
+        job_system_shutdown();
+        if(threads == cores){
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/line_renderer.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+
+// LineRenderer's analytic antialiasing against MSAA 4x, at 1920x1080 and
+// 3840x2160: 300k segments in closed rings stacked into a vase, 1 and 0.5
+// pixels wide, drawn
+//   - aliased into a plain framebuffer,
+//   - feathered by a pixel into a plain framebuffer,
+//   - aliased into a 4 sample framebuffer and resolved by a blit.
+// GPU times from GL_TIME_ELAPSED queries around clear, draw and resolve.
+// Memory is what the framebuffers take, RGBA8 color and 24 bit depth with
+// stencil per sample. At 1080p every version is compared with the aliased
+// lines drawn 4x4 times supersampled and box filtered: the mean difference
+// per color channel over the pixels either covers. The feathered lines have
+// to come out closer to it than the aliased ones. Needs a GL 4.3 context, a
+// hidden window is enough, so this also runs on Mesa llvmpipe.
+
+#define ROUNDS      5
+#define POINTS      1000    // per ring
+#define RINGS       300
+#define SUPERSAMPLE 4       // per axis, for the reference
+#define MSAA        4
+
+typedef struct {
+    GLuint framebuffer, color, depth;
+    int width, height, samples;
+    size_t bytes;
+} Target;
+
+static void target_init(Target* target, int width, int height, int samples, int depth){
+    memset(target, 0, sizeof(*target));
+    target->width = width;
+    target->height = height;
+    target->samples = samples;
+    glGenFramebuffers(1, &target->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glGenRenderbuffers(1, &target->color);
+    glBindRenderbuffer(GL_RENDERBUFFER, target->color);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->color);
+    target->bytes = (size_t)width*height*samples*4;
+    if(depth){
+        glGenRenderbuffers(1, &target->depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, target->depth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+        target->bytes += (size_t)width*height*samples*4;
+    }
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+        printf("Framebuffer %dx%d with %d samples is incomplete\n", width, height, samples);
+        exit(1);
+    }
+}
+
+static void target_free(Target* target){
+    glDeleteFramebuffers(1, &target->framebuffer);
+    glDeleteRenderbuffers(1, &target->color);
+    glDeleteRenderbuffers(1, &target->depth);
+}
+
+// rings closed strips of POINTS points around y, stacked from -1 to 1
+static void vase_strips(LineRenderer* lines, uint32_t rings){
+    float* vertices = (float*)mem_alloc(MEM_TAG_GENERAL, (size_t)rings*POINTS*3*sizeof(float));
+    uint32_t* indices = (uint32_t*)mem_alloc(MEM_TAG_GENERAL, (size_t)rings*(POINTS+2)*sizeof(uint32_t));
+    uint32_t n = 0;
+    for(uint32_t k = 0; k<rings; ++k){
+        float y = -1.0f + 2.0f*k/(rings-1);
+        for(uint32_t i = 0; i<POINTS; ++i){
+            float a = 2.0f*GLM_PIf*i/POINTS;
+            float r = 0.6f + 0.3f*sinf(3.0f*y) + 0.05f*sinf(7.0f*a + k);
+            float* v = vertices + 3*(k*POINTS + i);
+            v[0] = r*cosf(a);
+            v[1] = y;
+            v[2] = r*sinf(a);
+            indices[n++] = k*POINTS + i;
+        }
+        indices[n++] = k*POINTS;
+        indices[n++] = LINE_RESTART;
+    }
+    line_renderer_set_strips(lines, vertices, NULL, rings*POINTS, indices, n);
+    mem_free(vertices);
+    mem_free(indices);
+}
+
+typedef struct {
+    LineRenderer* lines;
+    mat4 view, projection;
+    vec3 lightPos, viewPos;
+} Frame;
+
+// Clears and draws into target, resolving into resolve if it is multisampled
+static void draw_frame(Frame* frame, const Target* target, const Target* resolve){
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glViewport(0, 0, target->width, target->height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    line_renderer_draw(frame->lines, frame->view, frame->projection, frame->lightPos, frame->viewPos,
+                       (float)target->width, (float)target->height);
+    if(target->samples > 1){
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target->framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve->framebuffer);
+        glBlitFramebuffer(0, 0, target->width, target->height, 0, 0, resolve->width, resolve->height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+}
+
+static double time_frame(GLuint query, Frame* frame, const Target* target, const Target* resolve){
+    draw_frame(frame, target, resolve);
+    glFinish();
+    double best = 1e30;
+    for(int r = 0; r<ROUNDS; ++r){
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        draw_frame(frame, target, resolve);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        best = ns/1e6 < best ? ns/1e6 : best;
+    }
+    return best;
+}
+
+static void read_rgb(const Target* target, uint8_t* rgb){
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target->framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, target->width, target->height, GL_RGB, GL_UNSIGNED_BYTE, rgb);
+}
+
+// Mean absolute difference per channel over the pixels either image covers
+static double image_error(const uint8_t* image, const float* reference, uint32_t pixels){
+    double sum = 0.0;
+    uint32_t covered = 0;
+    for(uint32_t i = 0; i<pixels; ++i){
+        const uint8_t* p = image + 3*i;
+        const float* q = reference + 3*i;
+        if(p[0] + p[1] + p[2] == 0 && q[0] + q[1] + q[2] == 0.0f){
+            continue;
+        }
+        sum += fabs(p[0] - q[0]) + fabs(p[1] - q[1]) + fabs(p[2] - q[2]);
+        ++covered;
+    }
+    return covered ? sum/(3.0*covered) : 0.0;
+}
+
+int main(void){
+    mem_init(1024*1024);
+    if(!glfwInit()){
+        printf("Failed to init GLFW\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench_line_aa", NULL, NULL);
+    if(!window){
+        printf("Failed to create a GL 4.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
+        printf("Failed to initialize Glad\n");
+        return 1;
+    }
+    GLint maxSamples = 0, maxSize = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+    printf("%s, up to %d samples\n", glGetString(GL_RENDERER), maxSamples);
+    if(maxSamples < MSAA){
+        printf("No %dx MSAA to compare with\n", MSAA);
+        return 1;
+    }
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    LineStyle style = {1.0f, LINE_JOIN_MITER, 4.0f, {0.9f, 0.8f, 0.6f}, 0.0f};
+    LineRenderer lines;
+    if(!line_renderer_init(&lines, &style)){
+        return 1;
+    }
+    vase_strips(&lines, RINGS);
+    Frame frame = {&lines};
+    vec3 eye = {0.0f, 0.8f, 3.2f}, center = {0.0f, 0.0f, 0.0f}, up = {0.0f, 1.0f, 0.0f};
+    glm_lookat(eye, center, up, frame.view);
+    glm_perspective(glm_rad(45.0f), 16.0f/9.0f, 0.1f, 20.0f, frame.projection);
+    glm_vec3_copy(eye, frame.viewPos);
+    glm_vec3_copy((vec3){2.0f, 3.0f, 4.0f}, frame.lightPos);
+    GLuint query;
+    glGenQueries(1, &query);
+    int ok = 1;
+
+    const int sizes[2][2] = {{1920, 1080}, {3840, 2160}};
+    const float widths[] = {1.0f, 0.5f};
+    for(int s = 0; s<2; ++s){
+        int width = sizes[s][0], height = sizes[s][1];
+        Target plain, multisampled, resolve;
+        target_init(&plain, width, height, 1, 1);
+        target_init(&multisampled, width, height, MSAA, 1);
+        target_init(&resolve, width, height, 1, 0);
+        int compare = s == 0 && width*SUPERSAMPLE <= maxSize;
+        uint32_t pixels = (uint32_t)(width*height);
+        uint8_t* image = compare ? (uint8_t*)mem_alloc(MEM_TAG_GENERAL, (size_t)pixels*3) : NULL;
+        float* reference = compare ? (float*)mem_alloc(MEM_TAG_GENERAL, (size_t)pixels*3*sizeof(float)) : NULL;
+
+        printf("%dx%d, %u segments: framebuffers %.1f MB plain, %.1f MB with %dx MSAA and resolve\n", width, height,
+               lines.segmentCount, plain.bytes/1048576.0, (multisampled.bytes + resolve.bytes)/1048576.0, MSAA);
+        for(uint32_t w = 0; w<sizeof(widths)/sizeof(widths[0]); ++w){
+            double error[3] = {0.0, 0.0, 0.0};
+            if(compare){
+                // Box filtered from SUPERSAMPLE^2 aliased samples per pixel
+                Target big;
+                target_init(&big, width*SUPERSAMPLE, height*SUPERSAMPLE, 1, 1);
+                lines.style.width = widths[w]*SUPERSAMPLE;
+                lines.style.feather = 0.0f;
+                draw_frame(&frame, &big, NULL);
+                uint8_t* samples = (uint8_t*)mem_alloc(MEM_TAG_GENERAL, (size_t)pixels*SUPERSAMPLE*SUPERSAMPLE*3);
+                read_rgb(&big, samples);
+                target_free(&big);
+                memset(reference, 0, (size_t)pixels*3*sizeof(float));
+                for(int y = 0; y<height*SUPERSAMPLE; ++y){
+                    for(int x = 0; x<width*SUPERSAMPLE; ++x){
+                        const uint8_t* p = samples + 3*((size_t)y*width*SUPERSAMPLE + x);
+                        float* q = reference + 3*((size_t)(y/SUPERSAMPLE)*width + x/SUPERSAMPLE);
+                        for(int c = 0; c<3; ++c){
+                            q[c] += p[c]*(1.0f/(SUPERSAMPLE*SUPERSAMPLE));
+                        }
+                    }
+                }
+                mem_free(samples);
+            }
+
+            lines.style.width = widths[w];
+            lines.style.feather = 0.0f;
+            double aliased = time_frame(query, &frame, &plain, NULL);
+            if(compare){
+                read_rgb(&plain, image);
+                error[0] = image_error(image, reference, pixels);
+            }
+            lines.style.feather = 1.0f;
+            double analytic = time_frame(query, &frame, &plain, NULL);
+            if(compare){
+                read_rgb(&plain, image);
+                error[1] = image_error(image, reference, pixels);
+            }
+            lines.style.feather = 0.0f;
+            double msaa = time_frame(query, &frame, &multisampled, &resolve);
+            if(compare){
+                read_rgb(&resolve, image);
+                error[2] = image_error(image, reference, pixels);
+                ok &= error[1] < error[0];
+            }
+            printf("    %.1f px lines: aliased %8.2f ms, analytic %8.2f ms, %dx MSAA %8.2f ms (%.2fx analytic)\n",
+                   widths[w], aliased, analytic, MSAA, msaa, msaa/analytic);
+            if(compare){
+                printf("        mean error against %dx%d supersampling: aliased %.2f, analytic %.2f, %dx MSAA %.2f\n",
+                       SUPERSAMPLE, SUPERSAMPLE, error[0], error[1], MSAA, error[2]);
+            }
+        }
+        mem_free(image);
+        mem_free(reference);
+        target_free(&plain);
+        target_free(&multisampled);
+        target_free(&resolve);
+    }
+
+    glDeleteQueries(1, &query);
+    line_renderer_free(&lines);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    mem_shutdown();
+    return ok ? 0 : 1;
+}
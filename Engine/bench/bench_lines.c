@@ -0,0 +1,308 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/line_renderer.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+#include "../src/shader.h"
+
+// Line throughput of LineRenderer's instanced quads against the same
+// expansion in a geometry shader (line_reference_*.glsl), for 100k and 1M
+// segments in closed rings stacked into a vase, 2 pixels wide at 1920x1080,
+// with miter and round joins. GPU times from GL_TIME_ELAPSED queries, and
+// scissored to one pixel the wall time up to glFinish, which is mostly the
+// expansion without the fill.
+// Both versions have to cover the same pixels, up to rounding. Needs a GL 4.3 context, a
+// hidden window is enough, so this also runs on Mesa llvmpipe.
+
+#define WIDTH   1920
+#define HEIGHT  1080
+#define ROUNDS  5
+#define POINTS  1000    // per ring
+#define TOLERANCE (WIDTH*HEIGHT/10000)  // pixels covered by only one version
+
+typedef struct {
+    GLuint program;
+    GLint viewProjectionLoc, viewportLoc, halfWidthLoc, joinLoc, miterLimitLoc;
+    GLint hasNormalsLoc, colorLoc, lightPosLoc, viewPosLoc;
+    GLuint vao;
+    GLuint indices;
+} Reference;
+
+static GLuint reference_stage(const char* path, GLenum type){
+    char* source = readShaderSource(path);
+    if(!source){
+        return 0;
+    }
+    GLuint shader = compile_shader(source, type);
+    mem_free(source);
+    return shader;
+}
+
+static int reference_init(Reference* reference){
+    GLuint stages[3] = {
+        reference_stage(SHADER_DIR "line_reference_vertex.glsl", GL_VERTEX_SHADER),
+        reference_stage(SHADER_DIR "line_reference_geometry.glsl", GL_GEOMETRY_SHADER),
+        reference_stage(SHADER_DIR "line_fragment.glsl", GL_FRAGMENT_SHADER)
+    };
+    reference->program = glCreateProgram();
+    for(int i = 0; i<3; ++i){
+        glAttachShader(reference->program, stages[i]);
+    }
+    glLinkProgram(reference->program);
+    for(int i = 0; i<3; ++i){
+        glDeleteShader(stages[i]);
+    }
+    GLint success;
+    glGetProgramiv(reference->program, GL_LINK_STATUS, &success);
+    if(!success || !stages[0] || !stages[1] || !stages[2]){
+        printf("Failed to build the geometry shader version\n");
+        return 0;
+    }
+    reference->viewProjectionLoc = glGetUniformLocation(reference->program, "viewProjection");
+    reference->viewportLoc = glGetUniformLocation(reference->program, "viewport");
+    reference->halfWidthLoc = glGetUniformLocation(reference->program, "halfWidth");
+    reference->joinLoc = glGetUniformLocation(reference->program, "join");
+    reference->miterLimitLoc = glGetUniformLocation(reference->program, "miterLimit");
+    reference->hasNormalsLoc = glGetUniformLocation(reference->program, "hasNormals");
+    reference->colorLoc = glGetUniformLocation(reference->program, "color");
+    reference->lightPosLoc = glGetUniformLocation(reference->program, "lightPos");
+    reference->viewPosLoc = glGetUniformLocation(reference->program, "viewPos");
+    glGenVertexArrays(1, &reference->vao);
+    glGenBuffers(1, &reference->indices);
+    return 1;
+}
+
+// Lines adjacency from the renderer's segments, a missing neighbour is the end itself
+static void reference_set_segments(Reference* reference, const LineRenderer* lines){
+    uint32_t* segments = (uint32_t*)mem_alloc(MEM_TAG_GENERAL, ((size_t)lines->segmentCount*4+1)*sizeof(uint32_t));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lines->segments);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)lines->segmentCount*16, segments);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    for(uint32_t i = 0; i<lines->segmentCount; ++i){
+        uint32_t* s = segments + 4*i;
+        s[0] = s[0] == LINE_NONE ? s[1] : s[0];
+        s[3] = s[3] == LINE_NONE ? s[2] : s[3];
+    }
+    glBindVertexArray(reference->vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, reference->indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)lines->segmentCount*16, segments, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    mem_free(segments);
+}
+
+static void reference_draw(const Reference* reference, const LineRenderer* lines, mat4 viewProjection,
+                           const vec3 lightPos, const vec3 viewPos){
+    glUseProgram(reference->program);
+    glUniformMatrix4fv(reference->viewProjectionLoc, 1, GL_FALSE, (float*)viewProjection);
+    glUniform2f(reference->viewportLoc, WIDTH, HEIGHT);
+    glUniform1f(reference->halfWidthLoc, 0.5f*lines->style.width);
+    glUniform1ui(reference->joinLoc, lines->style.join);
+    glUniform1f(reference->miterLimitLoc, lines->style.miterLimit);
+    glUniform1ui(reference->hasNormalsLoc, 0);
+    glUniform3fv(reference->colorLoc, 1, lines->style.color);
+    glUniform3fv(reference->lightPosLoc, 1, lightPos);
+    glUniform3fv(reference->viewPosLoc, 1, viewPos);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lines->points);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, lines->points);
+    glBindVertexArray(reference->vao);
+    glDrawElements(GL_LINES_ADJACENCY, lines->segmentCount*4, GL_UNSIGNED_INT, (void*)0);
+    glBindVertexArray(0);
+}
+
+static void reference_free(Reference* reference){
+    glDeleteProgram(reference->program);
+    glDeleteVertexArrays(1, &reference->vao);
+    glDeleteBuffers(1, &reference->indices);
+}
+
+// rings closed strips of POINTS points around y, stacked from -1 to 1
+static void vase_strips(LineRenderer* lines, uint32_t rings){
+    float* vertices = (float*)mem_alloc(MEM_TAG_GENERAL, (size_t)rings*POINTS*3*sizeof(float));
+    uint32_t* indices = (uint32_t*)mem_alloc(MEM_TAG_GENERAL, (size_t)rings*(POINTS+2)*sizeof(uint32_t));
+    uint32_t n = 0;
+    for(uint32_t k = 0; k<rings; ++k){
+        float y = -1.0f + 2.0f*k/(rings-1);
+        for(uint32_t i = 0; i<POINTS; ++i){
+            float a = 2.0f*GLM_PIf*i/POINTS;
+            float r = 0.6f + 0.3f*sinf(3.0f*y) + 0.05f*sinf(7.0f*a + k);
+            float* v = vertices + 3*(k*POINTS + i);
+            v[0] = r*cosf(a);
+            v[1] = y;
+            v[2] = r*sinf(a);
+            indices[n++] = k*POINTS + i;
+        }
+        indices[n++] = k*POINTS;
+        indices[n++] = LINE_RESTART;
+    }
+    line_renderer_set_strips(lines, vertices, NULL, rings*POINTS, indices, n);
+    mem_free(vertices);
+    mem_free(indices);
+}
+
+static double time_draw(GLuint query, void (*draw)(void*), void* data){
+    double best = 1e30;
+    for(int r = 0; r<ROUNDS; ++r){
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        draw(data);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        best = ns/1e6 < best ? ns/1e6 : best;
+    }
+    return best;
+}
+
+// Wall time up to glFinish, for work the timer query does not see
+static double time_finish(void (*draw)(void*), void* data){
+    double best = 1e30;
+    for(int r = 0; r<ROUNDS; ++r){
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glFinish();
+        uint64_t start = time_now_ns();
+        draw(data);
+        glFinish();
+        double ms = time_ms_since(start);
+        best = ms < best ? ms : best;
+    }
+    return best;
+}
+
+typedef struct {
+    LineRenderer* lines;
+    Reference* reference;
+    mat4 view, projection, viewProjection;
+    vec3 lightPos, viewPos;
+} Frame;
+
+static void draw_instanced(void* data){
+    Frame* frame = (Frame*)data;
+    line_renderer_draw(frame->lines, frame->view, frame->projection, frame->lightPos, frame->viewPos, WIDTH, HEIGHT);
+}
+
+static void draw_reference(void* data){
+    Frame* frame = (Frame*)data;
+    reference_draw(frame->reference, frame->lines, frame->viewProjection, frame->lightPos, frame->viewPos);
+}
+
+// Pixels that one version covers and the other not. Where lines overlap
+// rounding may put another line on top, those only count as recolored.
+static uint32_t compare_images(Frame* frame, uint8_t* a, uint8_t* b, uint32_t* recolored){
+    glDisable(GL_DEPTH_TEST);
+    glClear(GL_COLOR_BUFFER_BIT);
+    draw_instanced(frame);
+    glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, a);
+    glClear(GL_COLOR_BUFFER_BIT);
+    draw_reference(frame);
+    glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, b);
+    glEnable(GL_DEPTH_TEST);
+    uint32_t covered = 0;
+    *recolored = 0;
+    for(uint32_t i = 0; i<WIDTH*HEIGHT; ++i){
+        covered += (a[4*i+3] != 0) != (b[4*i+3] != 0);
+        *recolored += memcmp(a + 4*i, b + 4*i, 4) != 0;
+    }
+    *recolored -= covered;
+    return covered;
+}
+
+int main(void){
+    mem_init(1024*1024);
+    if(!glfwInit()){
+        printf("Failed to init GLFW\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench_lines", NULL, NULL);
+    if(!window){
+        printf("Failed to create a GL 4.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
+        printf("Failed to initialize Glad\n");
+        return 1;
+    }
+    printf("%s, %dx%d\n", glGetString(GL_RENDERER), WIDTH, HEIGHT);
+
+    GLuint framebuffer, color, depth;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &color);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WIDTH, HEIGHT);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, WIDTH, HEIGHT);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    LineStyle style = {2.0f, LINE_JOIN_MITER, 4.0f, {0.9f, 0.8f, 0.6f}};
+    LineRenderer lines;
+    Reference reference;
+    if(!line_renderer_init(&lines, &style) || !reference_init(&reference)){
+        return 1;
+    }
+    Frame frame = {&lines, &reference};
+    vec3 eye = {0.0f, 0.8f, 3.2f}, center = {0.0f, 0.0f, 0.0f}, up = {0.0f, 1.0f, 0.0f};
+    glm_lookat(eye, center, up, frame.view);
+    glm_perspective(glm_rad(45.0f), (float)WIDTH/HEIGHT, 0.1f, 20.0f, frame.projection);
+    glm_mat4_mul(frame.projection, frame.view, frame.viewProjection);
+    glm_vec3_copy(eye, frame.viewPos);
+    glm_vec3_copy((vec3){2.0f, 3.0f, 4.0f}, frame.lightPos);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    uint8_t* a = (uint8_t*)mem_alloc(MEM_TAG_GENERAL, WIDTH*HEIGHT*4);
+    uint8_t* b = (uint8_t*)mem_alloc(MEM_TAG_GENERAL, WIDTH*HEIGHT*4);
+    int ok = 1;
+    const uint32_t rings[] = {100, 1000};
+    for(uint32_t r = 0; r<sizeof(rings)/sizeof(rings[0]); ++r){
+        vase_strips(&lines, rings[r]);
+        reference_set_segments(&reference, &lines);
+        for(int join = 0; join<2; ++join){
+            lines.style.join = (LineJoin)join;
+            draw_instanced(&frame);
+            draw_reference(&frame);
+            glFinish();
+            double instanced = time_draw(query, draw_instanced, &frame);
+            double geometry = time_draw(query, draw_reference, &frame);
+            glScissor(0, 0, 1, 1);
+            glEnable(GL_SCISSOR_TEST);
+            double instancedGeometry = time_finish(draw_instanced, &frame);
+            double geometryGeometry = time_finish(draw_reference, &frame);
+            glDisable(GL_SCISSOR_TEST);
+            uint32_t recolored;
+            uint32_t covered = compare_images(&frame, a, b, &recolored);
+            ok &= covered <= TOLERANCE;
+            printf("%8u segments, %s joins: instanced quads %8.2f ms (%6.1f Msegments/s), geometry shader %8.2f ms (%6.1f Msegments/s), %.2fx\n",
+                   lines.segmentCount, join ? "round" : "miter", instanced, lines.segmentCount/(instanced*1e3), geometry,
+                   lines.segmentCount/(geometry*1e3), geometry/instanced);
+            printf("    scissored to 1 pixel: instanced %8.2f ms, geometry shader %8.2f ms, %.2fx; %u pixels covered differently, %u recolored where lines overlap\n",
+                   instancedGeometry, geometryGeometry, geometryGeometry/instancedGeometry, covered, recolored);
+        }
+    }
+
+    mem_free(a);
+    mem_free(b);
+    glDeleteQueries(1, &query);
+    reference_free(&reference);
+    line_renderer_free(&lines);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    mem_shutdown();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/memory.h"
+#include "../src/platform.h"
+
+// Pool checks and pool_alloc/pool_free against mem_alloc/mem_free.
+//
+// A pool of BLOCK byte blocks, CHUNK to a chunk, hands out BLOCKS blocks
+// across several chunks, each filled with its own pattern. The blocks have
+// to be aligned, must not overlap and need exactly one chunk allocation per
+// CHUNK. Freeing every other block and allocating as many again has to hand
+// back exactly the freed blocks without a new chunk and leave the others
+// untouched; so does freeing everything and allocating it all again.
+// pool_destroy has to return every byte. Then FRAMES frames churn the pool
+// between mem_frame_begin calls, which asserts on the heap allocation of a
+// new chunk when built with WOVEN_MEMORY_DEBUG, as do the pool's own checks
+// of freed blocks. Last, the time per alloc and free pair with LIVE blocks
+// live and random ones replaced.
+
+#define BLOCK   24
+#define CHUNK   64
+#define BLOCKS  1000        // 15 full chunks and a partial one
+#define FRAMES  64
+#define LIVE    1024
+#define OPS     4000000
+
+static uint32_t rng = 12345;
+
+static uint32_t random_u32(void){
+    rng = rng*1664525u + 1013904223u;
+    return rng >> 8;
+}
+
+static int compare_ptr(const void* a, const void* b){
+    uintptr_t x = *(const uintptr_t*)a, y = *(const uintptr_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void fill(void* block, uint32_t i){
+    memset(block, (int)(i*7 + 1) & 0xFF, BLOCK);
+}
+
+static int filled(const void* block, uint32_t i){
+    const uint8_t* bytes = (const uint8_t*)block;
+    for(int b = 0; b<BLOCK; ++b){
+        if(bytes[b] != ((i*7 + 1) & 0xFF)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Whether the freed and the allocated blocks are the same set, sorts both
+static int same_blocks(void** freed, void** allocated, uint32_t count){
+    qsort(freed, count, sizeof(void*), compare_ptr);
+    qsort(allocated, count, sizeof(void*), compare_ptr);
+    return memcmp(freed, allocated, count*sizeof(void*)) == 0;
+}
+
+static int check_pool(void){
+    static void* blocks[BLOCKS];
+    static void* freed[BLOCKS];
+    static void* again[BLOCKS];
+    int errors = 0;
+    MemStats before = mem_stats(MEM_TAG_GENERAL);
+    Pool pool;
+    pool_init(&pool, MEM_TAG_GENERAL, BLOCK, CHUNK);
+
+    for(uint32_t i = 0; i<BLOCKS; ++i){
+        blocks[i] = pool_alloc(&pool);
+        if(!blocks[i] || (uintptr_t)blocks[i] % MEM_DEFAULT_ALIGNMENT){
+            printf("  block %u at %p is not aligned\n", i, blocks[i]);
+            return 1;
+        }
+        fill(blocks[i], i);
+    }
+    uint32_t overwritten = 0;
+    for(uint32_t i = 0; i<BLOCKS; ++i){
+        overwritten += !filled(blocks[i], i);
+    }
+    int64_t chunks = mem_stats(MEM_TAG_GENERAL).allocations - before.allocations;
+    int64_t expected = (BLOCKS + CHUNK-1)/CHUNK;
+    errors += overwritten > 0 || chunks != expected || pool.used != BLOCKS || pool.peak != BLOCKS;
+    printf("  %u blocks of %u bytes: %lld chunks (%lld expected), %u overwritten by others, %u used\n", BLOCKS, BLOCK,
+           (long long)chunks, (long long)expected, overwritten, pool.used);
+
+    // Every other block, last first, so the free list runs across chunks
+    uint32_t count = 0;
+    for(uint32_t i = BLOCKS; i-- > 0; ){
+        if(i % 2 == 0){
+            freed[count++] = blocks[i];
+            pool_free(&pool, blocks[i]);
+            blocks[i] = NULL;
+        }
+    }
+    for(uint32_t i = 0; i<count; ++i){
+        again[i] = pool_alloc(&pool);
+    }
+    overwritten = 0;
+    for(uint32_t i = 1; i<BLOCKS; i += 2){
+        overwritten += !filled(blocks[i], i);
+    }
+    for(uint32_t i = 0, k = 0; i<BLOCKS; i += 2){
+        blocks[i] = again[k++];
+        fill(blocks[i], i);
+    }
+    int same = same_blocks(freed, again, count);
+    chunks = mem_stats(MEM_TAG_GENERAL).allocations - before.allocations;
+    errors += !same || overwritten > 0 || chunks != expected || pool.used != BLOCKS;
+    printf("  freed %u and allocated them again: %s blocks, %lld chunks, %u others overwritten\n", count,
+           same ? "the same" : "DIFFERENT", (long long)chunks, overwritten);
+
+    for(uint32_t i = 0; i<BLOCKS; ++i){
+        freed[i] = blocks[i];
+        pool_free(&pool, blocks[i]);
+    }
+    uint32_t usedAfterFree = pool.used;
+    for(uint32_t i = 0; i<BLOCKS; ++i){
+        again[i] = pool_alloc(&pool);
+    }
+    same = same_blocks(freed, again, BLOCKS);
+    chunks = mem_stats(MEM_TAG_GENERAL).allocations - before.allocations;
+    errors += !same || usedAfterFree != 0 || chunks != expected;
+    printf("  freed all, %u used, allocated all again: %s blocks, %lld chunks\n", usedAfterFree,
+           same ? "the same" : "DIFFERENT", (long long)chunks);
+
+    // Steady state: the pool keeps what it has, mem_frame_begin sees no heap allocation
+    for(uint32_t i = 0; i<BLOCKS; ++i){
+        pool_free(&pool, again[i]);
+    }
+    uint32_t live = 0;
+    for(uint32_t f = 0; f<MEM_WARMUP_FRAMES + FRAMES; ++f){
+        mem_frame_begin();
+        for(uint32_t i = 0; i<BLOCKS/2; ++i){
+            uint32_t k = random_u32() % BLOCKS;
+            if(k < live){
+                pool_free(&pool, blocks[k]);
+                blocks[k] = blocks[--live];
+            } else {
+                blocks[live++] = pool_alloc(&pool);
+            }
+        }
+    }
+    chunks = mem_stats(MEM_TAG_GENERAL).allocations - before.allocations;
+    errors += chunks != expected || pool.used != live;
+    printf("  %u frames of churn: %u live, peak %u, %lld chunks\n", MEM_WARMUP_FRAMES + FRAMES, live, pool.peak,
+           (long long)chunks);
+    for(uint32_t i = 0; i<live; ++i){
+        pool_free(&pool, blocks[i]);
+    }
+
+    pool_destroy(&pool);
+    int64_t leaked = mem_stats(MEM_TAG_GENERAL).current - before.current;
+    errors += leaked != 0;
+    printf("  pool_destroy: %lld bytes left\n", (long long)leaked);
+    return errors;
+}
+
+static void bench_churn(void){
+    static void* live[LIVE];
+    static uint32_t slots[OPS];
+    for(uint32_t i = 0; i<OPS; ++i){
+        slots[i] = random_u32() % LIVE;
+    }
+
+    Pool pool;
+    pool_init(&pool, MEM_TAG_GENERAL, BLOCK, CHUNK);
+    for(uint32_t i = 0; i<LIVE; ++i){
+        live[i] = pool_alloc(&pool);
+    }
+    uint64_t start = time_now_ns();
+    for(uint32_t i = 0; i<OPS; ++i){
+        pool_free(&pool, live[slots[i]]);
+        live[slots[i]] = pool_alloc(&pool);
+    }
+    double poolMs = time_ms_since(start);
+    for(uint32_t i = 0; i<LIVE; ++i){
+        pool_free(&pool, live[i]);
+    }
+    pool_destroy(&pool);
+
+    for(uint32_t i = 0; i<LIVE; ++i){
+        live[i] = mem_alloc(MEM_TAG_GENERAL, BLOCK);
+    }
+    start = time_now_ns();
+    for(uint32_t i = 0; i<OPS; ++i){
+        mem_free(live[slots[i]]);
+        live[slots[i]] = mem_alloc(MEM_TAG_GENERAL, BLOCK);
+    }
+    double heapMs = time_ms_since(start);
+    for(uint32_t i = 0; i<LIVE; ++i){
+        mem_free(live[i]);
+    }
+    printf("  free + alloc, %u live: pool %6.1f ns, mem_alloc %6.1f ns, %.1fx\n", LIVE, poolMs*1e6/OPS, heapMs*1e6/OPS,
+           heapMs/poolMs);
+}
+
+int main(void){
+    mem_init(1024*1024);
+#ifdef WOVEN_MEMORY_DEBUG
+    printf("Pool, with WOVEN_MEMORY_DEBUG\n");
+#else
+    printf("Pool\n");
+#endif
+    int errors = check_pool();
+    printf("pool checks: %s\n", errors ? "FAILED" : "OK");
+    bench_churn();
+    mem_shutdown();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+#include "../src/scene.h"
+
+// Static forest of ~100k nodes with a handful of animated nodes. Compares a
+// full hierarchy update against the incremental one, and checks that the
+// incremental result matches a full recompute.
+
+#define TREE_COUNT  800
+#define TREE_DEPTH  7
+#define ANIMATED    8
+#define FRAMES      200
+
+static SceneNode build_branch(Scene* scene, SceneNode parent, int depth, float spread){
+    SceneNode node = scene_create_node(scene, parent);
+    scene_set_position(scene, node, (vec3){spread, 1.0f, 0.0f});
+    scene_set_scale(scene, node, (vec3){0.9f, 0.9f, 0.9f});
+    if(depth > 1){
+        build_branch(scene, node, depth-1, spread*0.5f);
+        build_branch(scene, node, depth-1, -spread*0.5f);
+    }
+    return node;
+}
+
+static double time_update(Scene* scene){
+    mem_frame_begin();
+    uint64_t start = time_now_ns();
+    scene_update(scene);
+    return time_ms_since(start);
+}
+
+int main(void){
+    mem_init(4*1024*1024);
+    job_system_init(0);
+
+    Scene scene;
+    scene_init(&scene, 1024);
+    SceneNode roots[TREE_COUNT];
+    uint64_t start = time_now_ns();
+    for(int t = 0; t<TREE_COUNT; ++t){
+        roots[t] = build_branch(&scene, SCENE_NONE, TREE_DEPTH, 4.0f);
+        scene_set_position(&scene, roots[t], (vec3){(float)(t%40)*10.0f, 0.0f, (float)(t/40)*10.0f});
+    }
+    printf("Built %u nodes in %.2f ms\n", scene.count, time_ms_since(start));
+
+    double first = time_update(&scene);
+    printf("  initial update:      %8.3f ms  (%u nodes)\n", first, scene.updatedNodes);
+
+    // Full update: every tree moved
+    double full = 0.0;
+    for(int f = 0; f<FRAMES; ++f){
+        for(int t = 0; t<TREE_COUNT; ++t){
+            scene_set_position(&scene, roots[t], (vec3){(float)(t%40)*10.0f, (float)f*0.01f, (float)(t/40)*10.0f});
+        }
+        full += time_update(&scene);
+    }
+    printf("  everything moved:    %8.3f ms  (%u nodes)\n", full/FRAMES, scene.updatedNodes);
+
+    // A few animated nodes: one whole tree plus some mid-level branches
+    SceneNode animated[ANIMATED];
+    animated[0] = roots[17];
+    for(int i = 1; i<ANIMATED; ++i){
+        animated[i] = roots[(i*97) % TREE_COUNT] + 1 + (SceneNode)(i % 3);
+    }
+    double partial = 0.0;
+    for(int f = 0; f<FRAMES; ++f){
+        versor rotation;
+        glm_quatv(rotation, (float)f*0.05f, (vec3){0.0f, 1.0f, 0.0f});
+        for(int i = 0; i<ANIMATED; ++i){
+            scene_set_rotation(&scene, animated[i], rotation);
+        }
+        partial += time_update(&scene);
+    }
+    printf("  %d nodes animated:    %8.3f ms  (%u nodes)\n", ANIMATED, partial/FRAMES, scene.updatedNodes);
+
+    double idle = 0.0;
+    for(int f = 0; f<FRAMES; ++f){
+        idle += time_update(&scene);
+    }
+    printf("  nothing moved:       %8.3f ms  (%u nodes)\n", idle/FRAMES, scene.updatedNodes);
+
+    // Incremental results must match recomputing everything
+    mat4* incremental = (mat4*)mem_alloc(MEM_TAG_GENERAL, scene.count*sizeof(mat4));
+    memcpy(incremental, scene.world, scene.count*sizeof(mat4));
+    for(int t = 0; t<TREE_COUNT; ++t){
+        scene_set_scale(&scene, roots[t], (vec3){0.9f, 0.9f, 0.9f});
+    }
+    time_update(&scene);
+    float worst = 0.0f;
+    for(uint32_t i = 0; i<scene.count*16; ++i){
+        float e = fabsf(((float*)incremental)[i] - ((float*)scene.world)[i]);
+        worst = e > worst ? e : worst;
+    }
+    printf("  incremental vs full: max difference %g\n", worst);
+
+    mem_free(incremental);
+    scene_free(&scene);
+    job_system_shutdown();
+    mem_shutdown();
+    return worst == 0.0f ? 0 : 1;
+}
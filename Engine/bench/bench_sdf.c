@@ -0,0 +1,168 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/asset.h"
+#include "../src/batch.h"
+#include "../src/bvh.h"
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/particle_graph.h"
+#include "../src/platform.h"
+#include "../src/sdf.h"
+
+// Bake times of sdf_bake on Human.obj and Tree.obj at 64^3, 128^3 and 256^3
+// voxels on all cores: cold, with a cache file written, and again from the
+// cache, which has to give the same bits. At 64^3 and 128^3 also the bake
+// with exact distances in every voxel, which the narrow band has to beat.
+//
+// Every bake is checked on CHECKS random voxels against brute force over all
+// triangles. Voxels within the band have to hold the exact distance, the
+// others a lower bound of it that is still beyond the band. The sign is
+// compared with the generalized winding number. Human.obj is closed, so the
+// two have to agree on all but a handful of voxels right at the surface.
+// Tree.obj's leaves are open, overlapping, inconsistently wound shells whose
+// winding number lands anywhere from -1 to 2, so its disagreements are only
+// reported.
+
+#define PADDING 2.0f
+#define BAND    4.0f
+#define CHECKS  2000
+#define CACHE   "."
+
+typedef struct {
+    Vec3Soa positions;
+    const uint32_t* indices;
+    uint32_t triangleCount;
+} Mesh;
+
+static uint32_t rng = 12345;
+
+static uint32_t random_u32(void){
+    rng = rng*1664525u + 1013904223u;
+    return rng >> 8;
+}
+
+static int valid_triangle(const uint32_t* v){
+    return v[0] != PARTICLE_NONE && v[1] != PARTICLE_NONE && v[2] != PARTICLE_NONE && v[0] != v[1] && v[1] != v[2] && v[0] != v[2];
+}
+
+static float brute_distance(const Mesh* mesh, const float* point){
+    float best = FLT_MAX, p[3];
+    for(uint32_t t = 0; t<mesh->triangleCount; ++t){
+        if(valid_triangle(mesh->indices + 3*t)){
+            float d = bvh_closest_on_triangle(mesh->positions, mesh->indices + 3*t, point, p);
+            best = d < best ? d : best;
+        }
+    }
+    return sqrtf(best);
+}
+
+// Sum of the solid angles of all triangles over 4 pi (Van Oosterom and Strackee)
+static double winding_number(const Mesh* mesh, const float* point){
+    double sum = 0.0;
+    for(uint32_t t = 0; t<mesh->triangleCount; ++t){
+        const uint32_t* v = mesh->indices + 3*t;
+        if(!valid_triangle(v)){
+            continue;
+        }
+        double a[3][3], l[3];
+        for(int c = 0; c<3; ++c){
+            a[c][0] = mesh->positions.x[v[c]] - point[0];
+            a[c][1] = mesh->positions.y[v[c]] - point[1];
+            a[c][2] = mesh->positions.z[v[c]] - point[2];
+            l[c] = sqrt(a[c][0]*a[c][0] + a[c][1]*a[c][1] + a[c][2]*a[c][2]);
+        }
+        double det = a[0][0]*(a[1][1]*a[2][2] - a[1][2]*a[2][1]) - a[0][1]*(a[1][0]*a[2][2] - a[1][2]*a[2][0]) +
+                     a[0][2]*(a[1][0]*a[2][1] - a[1][1]*a[2][0]);
+        double ab = a[0][0]*a[1][0] + a[0][1]*a[1][1] + a[0][2]*a[1][2];
+        double bc = a[1][0]*a[2][0] + a[1][1]*a[2][1] + a[1][2]*a[2][2];
+        double ca = a[2][0]*a[0][0] + a[2][1]*a[0][1] + a[2][2]*a[0][2];
+        sum += 2.0*atan2(det, l[0]*l[1]*l[2] + ab*l[2] + bc*l[0] + ca*l[1]);
+    }
+    return sum/(4.0*3.14159265358979323846);
+}
+
+// Returns the voxels that break the rules above, counts sign disagreements in flips
+static uint32_t check(const Mesh* mesh, const Sdf* sdf, float band, uint32_t* flips){
+    uint32_t n = sdf->resolution, errors = 0;
+    *flips = 0;
+    for(uint32_t s = 0; s<CHECKS; ++s){
+        uint32_t x = random_u32()%n, y = random_u32()%n, z = random_u32()%n;
+        float p[3] = {sdf->origin[0] + x*sdf->voxelSize, sdf->origin[1] + y*sdf->voxelSize, sdf->origin[2] + z*sdf->voxelSize};
+        float value = sdf->distance[x + n*(y + (size_t)n*z)];
+        float exact = brute_distance(mesh, p);
+        float d = fabsf(value), tolerance = 1e-4f*sdf->voxelSize + 1e-6f*exact;
+        if(exact <= band*sdf->voxelSize || band <= 0.0f){
+            errors += fabsf(d - exact) > tolerance;
+        } else {
+            errors += d > exact + tolerance || d <= band*sdf->voxelSize;
+        }
+        *flips += (value < 0.0f) != (fabs(winding_number(mesh, p)) > 0.5);
+    }
+    return errors;
+}
+
+static int bench_model(const char* path, int closed){
+    fastObjMesh* obj = asset_read_obj(path);
+    if(!obj){
+        return 1;
+    }
+    ParticleGraphDesc graphDesc = {0.0f, 0, PARTICLE_ORDER_NONE};
+    ParticleGraph graph;
+    if(!particle_graph_build(obj, &graphDesc, &graph)){
+        return 1;
+    }
+    asset_free_obj(obj);
+    Mesh mesh = {graph.positions, graph.renderToParticle, graph.renderVertexCount/3};
+    printf("%s: %u triangles, mesh hash %016llx\n", path, mesh.triangleCount,
+           (unsigned long long)sdf_mesh_hash(mesh.positions, mesh.indices, mesh.triangleCount));
+
+    int errors = 0;
+    const uint32_t resolutions[] = {64, 128, 256};
+    for(uint32_t r = 0; r<sizeof(resolutions)/sizeof(resolutions[0]); ++r){
+        SdfDesc desc = {resolutions[r], PADDING, BAND, CACHE};
+        Sdf cold, cached;
+        uint64_t hash = sdf_mesh_hash(mesh.positions, mesh.indices, mesh.triangleCount);
+        char file[512];
+        snprintf(file, sizeof(file), "%s/%016llx-%u.sdf", CACHE, (unsigned long long)hash, desc.resolution);
+        remove(file);
+        if(!sdf_bake(&cold, &desc, mesh.positions, mesh.indices, mesh.triangleCount) ||
+           !sdf_bake(&cached, &desc, mesh.positions, mesh.indices, mesh.triangleCount)){
+            return 1;
+        }
+        size_t bytes = (size_t)desc.resolution*desc.resolution*desc.resolution*sizeof(float);
+        int same = cached.fromCache && memcmp(cold.distance, cached.distance, bytes) == 0;
+        uint32_t flips, wrong = check(&mesh, &cold, BAND, &flips);
+        errors += !same + (wrong > 0) + (closed && flips > CHECKS/200);
+        printf("    %3u^3: bake %9.1f ms, %5u of %5u bricks in the band, from the cache %7.1f ms (%s), %u wrong, %u signs against the winding number\n",
+               desc.resolution, cold.bakeMs, cold.nearBricks, cold.nearBricks + cold.farBricks, cached.bakeMs,
+               same ? "same" : "DIFFERENT", wrong, flips);
+        if(desc.resolution <= 128){
+            SdfDesc dense = {resolutions[r], PADDING, 0.0f, NULL};
+            Sdf exact;
+            sdf_bake(&exact, &dense, mesh.positions, mesh.indices, mesh.triangleCount);
+            wrong = check(&mesh, &exact, 0.0f, &flips);
+            errors += wrong > 0;
+            printf("           exact everywhere %9.1f ms, narrow band %.2fx faster, %u wrong\n", exact.bakeMs,
+                   exact.bakeMs/cold.bakeMs, wrong);
+            sdf_free(&exact);
+        }
+        sdf_free(&cold);
+        sdf_free(&cached);
+    }
+    particle_graph_free(&graph);
+    return errors;
+}
+
+int main(void){
+    mem_init(1024*1024);
+    batch_init();
+    job_system_init(0);
+    printf("%u job threads\n", job_thread_count());
+    int errors = bench_model("../assets/Human.obj", 1);
+    errors += bench_model("../assets/Tree.obj", 0);
+    job_system_shutdown();
+    mem_shutdown();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+#include "../src/spatial_hash.h"
+
+// Spatial hash build time and radius query throughput for 10k, 100k and 1M
+// random particles at about 16 neighbours per query, on 1..N threads. Checks
+// the queries against brute force first, and that constrained neighbours are
+// left out on a cloth grid. Every particle queries its own neighbourhood in
+// bucket order, like a self-collision pass would.
+
+#define NEIGHBOURS  16
+#define MAX_OUT     64
+#define ROUNDS      5
+
+typedef struct {
+    const SpatialHash* hash;
+    float radius;
+    volatile int64_t found;
+} QueryAll;
+
+static uint32_t rng_state = 12345;
+static float rng_float(void){
+    rng_state = rng_state*1664525u + 1013904223u;
+    return (rng_state >> 8)*(1.0f/16777216.0f);
+}
+
+// Box sized for the wanted neighbour count within a unit radius
+static Vec3Soa random_cloud(uint32_t count, float neighbours){
+    Vec3Soa p;
+    p.x = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    p.y = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    p.z = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    float side = cbrtf(count*4.18879f/neighbours);
+    for(uint32_t i = 0; i<count; ++i){
+        p.x[i] = rng_float()*side - 0.5f*side;
+        p.y[i] = rng_float()*side;
+        p.z[i] = rng_float()*side - 0.5f*side;
+    }
+    return p;
+}
+
+static void cloud_free(Vec3Soa* p){
+    mem_free(p->x);
+    mem_free(p->y);
+    mem_free(p->z);
+}
+
+static int compare_u32(const void* a, const void* b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// A sparse cloud spans more cells than the grid has per axis and wraps
+static int validate_brute_force(uint32_t count, float neighbours, float radius){
+    Vec3Soa p = random_cloud(count, neighbours);
+    SpatialHash hash;
+    spatial_hash_init(&hash, 1.0f, count);
+    spatial_hash_build(&hash, p, count);
+    uint32_t got[MAX_OUT], want[MAX_OUT];
+    int errors = 0;
+    for(uint32_t i = 0; i<count; ++i){
+        vec3 c = {p.x[i], p.y[i], p.z[i]};
+        uint32_t n = spatial_hash_query(&hash, c, radius, got, MAX_OUT);
+        uint32_t m = 0;
+        for(uint32_t j = 0; j<count; ++j){
+            float dx = p.x[j] - c[0], dy = p.y[j] - c[1], dz = p.z[j] - c[2];
+            if(dx*dx + dy*dy + dz*dz <= radius*radius && m < MAX_OUT){
+                want[m++] = j;
+            }
+        }
+        if(n != m || n > MAX_OUT){
+            errors++;
+            continue;
+        }
+        qsort(got, n, sizeof(uint32_t), compare_u32);
+        for(uint32_t j = 0; j<n; ++j){
+            errors += got[j] != want[j];
+        }
+    }
+    printf("brute force check, %u particles, radius %g: %s (%d mismatches)\n", count, radius, errors ? "FAILED" : "OK", errors);
+    spatial_hash_free(&hash);
+    cloud_free(&p);
+    return errors == 0;
+}
+
+// 100x100 cloth with structural edges and one diagonal. Within 1.5 spacings an
+// interior particle has 8 neighbours, 6 of them constrained.
+static int validate_exclusion(void){
+    const uint32_t side = 100;
+    uint32_t count = side*side;
+    Vec3Soa p;
+    p.x = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    p.y = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    p.z = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    ParticleConstraint* constraints = (ParticleConstraint*)mem_alloc(MEM_TAG_GENERAL, 3*count*sizeof(ParticleConstraint));
+    uint32_t constraintCount = 0;
+    for(uint32_t y = 0; y<side; ++y){
+        for(uint32_t x = 0; x<side; ++x){
+            uint32_t i = y*side+x;
+            p.x[i] = x*0.1f;
+            p.y[i] = 0.0f;
+            p.z[i] = y*0.1f;
+            ParticleConstraint edges[3] = {{i, i+1, 0.1f}, {i, i+side, 0.1f}, {i, i+side+1, 0.1414f}};
+            int valid[3] = {x+1 < side, y+1 < side, x+1 < side && y+1 < side};
+            for(int e = 0; e<3; ++e){
+                if(valid[e]){
+                    constraints[constraintCount++] = edges[e];
+                }
+            }
+        }
+    }
+    SpatialHash hash;
+    spatial_hash_init(&hash, 0.15f, count);
+    spatial_hash_exclude(&hash, count, constraints, constraintCount);
+    spatial_hash_build(&hash, p, count);
+    int errors = 0;
+    uint32_t out[MAX_OUT];
+    for(uint32_t y = 1; y+1<side; ++y){
+        for(uint32_t x = 1; x+1<side; ++x){
+            uint32_t i = y*side+x;
+            uint32_t n = spatial_hash_query_particle(&hash, i, 0.15f, out, MAX_OUT);
+            errors += n != 2;
+            for(uint32_t j = 0; j<n && j<MAX_OUT; ++j){
+                errors += out[j] != i+side-1 && out[j] != i-side+1;
+            }
+        }
+    }
+    printf("constraint exclusion check: %s (%d errors)\n", errors ? "FAILED" : "OK", errors);
+    spatial_hash_free(&hash);
+    mem_free(constraints);
+    cloud_free(&p);
+    return errors == 0;
+}
+
+static void query_range(void* data, uint32_t begin, uint32_t end){
+    QueryAll* query = (QueryAll*)data;
+    uint32_t out[MAX_OUT];
+    int64_t found = 0;
+    for(uint32_t i = begin; i<end; ++i){
+        found += spatial_hash_query_particle(query->hash, query->hash->sortedParticle[i], query->radius, out, MAX_OUT);
+    }
+    atomic_fetch_add_i64(&query->found, found);
+}
+
+static void bench_count(uint32_t count){
+    Vec3Soa p = random_cloud(count, NEIGHBOURS);
+    printf("%u particles:\n", count);
+    unsigned int cores = cpu_core_count();
+    for(unsigned int threads = 1; ; threads = threads*2 < cores ? threads*2 : cores){
+        job_system_init(threads);
+        SpatialHash hash;
+        spatial_hash_init(&hash, 1.0f, count);
+        double buildMs = 1e30, queryMs = 1e30;
+        QueryAll query = {&hash, 1.0f, 0};
+        for(int r = 0; r<ROUNDS; ++r){
+            uint64_t start = time_now_ns();
+            spatial_hash_build(&hash, p, count);
+            double ms = time_ms_since(start);
+            buildMs = ms < buildMs ? ms : buildMs;
+
+            query.found = 0;
+            start = time_now_ns();
+            parallel_for(&query, count, 1024, query_range);
+            ms = time_ms_since(start);
+            queryMs = ms < queryMs ? ms : queryMs;
+        }
+        printf("  %2u thread(s): build %8.3f ms (%6.1f M particles/s)  query %8.3f ms (%6.2f M queries/s, %.1f neighbours)\n",
+               threads, buildMs, count/(buildMs*1e3), queryMs, count/(queryMs*1e3), (double)query.found/count);
+        spatial_hash_free(&hash);
+        job_system_shutdown();
+        if(threads == cores){
+            break;
+        }
+    }
+    cloud_free(&p);
+}
+
+int main(void){
+    mem_init(1024*1024);
+    int ok = validate_brute_force(4000, NEIGHBOURS, 1.0f);
+    ok &= validate_brute_force(4000, 0.02f, 1.0f);
+    ok &= validate_brute_force(4000, NEIGHBOURS, 0.3f);
+    ok &= validate_brute_force(4000, 1.0f, 2.5f);
+    ok &= validate_exclusion();
+    bench_count(10000);
+    bench_count(100000);
+    bench_count(1000000);
+    mem_shutdown();
+    return ok ? 0 : 1;
+}
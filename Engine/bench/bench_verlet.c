@@ -0,0 +1,811 @@
+#include <math.h>
+#include <stdio.h>
+#include "../src/asset.h"
+#include "../src/job.h"
+#include "../src/memory.h"
+#include "../src/platform.h"
+#include "../src/spatial_hash.h"
+#include "../src/verlet.h"
+
+// CPU solver cost in ns per particle per step for square cloth grids of 10k,
+// 100k and 1M particles (structural edges plus one diagonal per cell, top row
+// pinned) on 1..N threads. Also runs the integration with every ISA from the
+// same start and reports how far the results drift apart, and compares PBD
+// iterations with XPBD substeps at the same number of constraint passes.
+// Lets a field of small cloths fall asleep and times steps with 0, 1, 16 and
+// all of them awake. Finally times a scene of separate models, solved as one
+// job per island, and cuts and rejoins a cloth to check the islands follow.
+// Times Human.obj and Tree.obj with particles in OBJ, Morton and RCM order.
+// Compares fp32 previous positions with fp16 displacements: memory, integration
+// throughput, step time, and drift against fp32 and against free flight.
+
+#define ITERATIONS  10
+#define DT          (1.0f/60.0f)
+
+typedef struct {
+    uint32_t side;
+    Vec3Soa positions;
+    ParticleConstraint* constraints;
+    uint32_t constraintCount;
+} Cloth;
+
+static void cloth_edge(Cloth* cloth, uint32_t a, uint32_t b){
+    ParticleConstraint* c = &cloth->constraints[cloth->constraintCount++];
+    float dx = cloth->positions.x[a] - cloth->positions.x[b];
+    float dy = cloth->positions.y[a] - cloth->positions.y[b];
+    float dz = cloth->positions.z[a] - cloth->positions.z[b];
+    c->a = a;
+    c->b = b;
+    c->restLength = sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+static Cloth cloth_create(uint32_t side){
+    Cloth cloth = {side};
+    uint32_t count = side*side;
+    cloth.positions.x = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    cloth.positions.y = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    cloth.positions.z = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    cloth.constraints = (ParticleConstraint*)mem_alloc(MEM_TAG_GENERAL, 3*count*sizeof(ParticleConstraint));
+    float spacing = 10.0f/(float)side;
+    for(uint32_t y = 0; y<side; ++y){
+        for(uint32_t x = 0; x<side; ++x){
+            cloth.positions.x[y*side+x] = x*spacing;
+            cloth.positions.y[y*side+x] = 0.0f;
+            cloth.positions.z[y*side+x] = y*spacing;
+        }
+    }
+    for(uint32_t y = 0; y<side; ++y){
+        for(uint32_t x = 0; x<side; ++x){
+            uint32_t i = y*side+x;
+            if(x+1 < side) cloth_edge(&cloth, i, i+1);
+            if(y+1 < side) cloth_edge(&cloth, i, i+side);
+            if(x+1 < side && y+1 < side) cloth_edge(&cloth, i, i+side+1);
+        }
+    }
+    return cloth;
+}
+
+static void cloth_free(Cloth* cloth){
+    mem_free(cloth->positions.x);
+    mem_free(cloth->positions.y);
+    mem_free(cloth->positions.z);
+    mem_free(cloth->constraints);
+}
+
+static void solver_create(VerletSolver* solver, const Cloth* cloth){
+    VerletDesc desc = {ITERATIONS, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}};
+    verlet_init(solver, &desc, cloth->positions, cloth->side*cloth->side, cloth->constraints, cloth->constraintCount);
+    for(uint32_t x = 0; x<cloth->side; ++x){
+        solver->inverseMass[x] = 0.0f;
+    }
+}
+
+static void bench_cloth(uint32_t side, int steps){
+    Cloth cloth = cloth_create(side);
+    uint32_t count = side*side;
+    VerletSolver solver;
+    solver_create(&solver, &cloth);
+    printf("%u particles, %u constraints in %u colors%s\n", count, solver.constraintCount, solver.colorCount,
+           solver.serialColor ? " (plus one serial)" : "");
+    verlet_free(&solver);
+
+    unsigned int cores = cpu_core_count();
+    for(unsigned int threads = 1; ; threads = threads*2 < cores ? threads*2 : cores){
+        job_system_init(threads);
+        solver_create(&solver, &cloth);
+        verlet_step(&solver, DT);
+        uint64_t start = time_now_ns();
+        for(int s = 0; s<steps; ++s){
+            verlet_step(&solver, DT);
+        }
+        double ms = time_ms_since(start);
+        printf("  %2u thread(s): %8.3f ms/step  %6.2f ns/particle/step  max stretch %.4f\n",
+               threads, ms/steps, ms*1e6/((double)steps*count), verlet_max_stretch(&solver));
+        verlet_free(&solver);
+        job_system_shutdown();
+        if(threads == cores){
+            break;
+        }
+    }
+    cloth_free(&cloth);
+}
+
+// Same 100 steps with every ISA, compared against the scalar kernel
+static void bench_isa_drift(void){
+    Cloth cloth = cloth_create(64);
+    uint32_t count = 64*64;
+    VerletSolver reference;
+    batch_set_isa(BATCH_ISA_SCALAR);
+    solver_create(&reference, &cloth);
+    for(int s = 0; s<100; ++s){
+        verlet_step(&reference, DT);
+    }
+    for(int isa = 1; isa<BATCH_ISA_COUNT; ++isa){
+        if(!batch_set_isa((BatchIsa)isa)){
+            continue;
+        }
+        VerletSolver solver;
+        solver_create(&solver, &cloth);
+        for(int s = 0; s<100; ++s){
+            verlet_step(&solver, DT);
+        }
+        float worst = 0.0f;
+        for(uint32_t i = 0; i<count; ++i){
+            float d = fabsf(solver.position.x[i] - reference.position.x[i]) + fabsf(solver.position.y[i] - reference.position.y[i])
+                    + fabsf(solver.position.z[i] - reference.position.z[i]);
+            worst = d > worst ? d : worst;
+        }
+        printf("%s vs scalar after 100 steps: max difference %g\n", batch_isa_name((BatchIsa)isa), worst);
+        verlet_free(&solver);
+    }
+    verlet_free(&reference);
+    batch_init();
+    cloth_free(&cloth);
+}
+
+// Stretch left after one second of hanging and the cost per frame, with the
+// same number of constraint passes per frame spent as PBD iterations or as
+// XPBD substeps of one iteration each
+static void stretch_stats(const VerletSolver* solver, float* worst, float* mean){
+    double sum = 0.0;
+    for(uint32_t i = 0; i<solver->constraintCount; ++i){
+        uint32_t a = solver->constraintA[i], b = solver->constraintB[i];
+        float dx = solver->position.x[b] - solver->position.x[a];
+        float dy = solver->position.y[b] - solver->position.y[a];
+        float dz = solver->position.z[b] - solver->position.z[a];
+        float rest = solver->restLength[i];
+        if(rest > 0.0f){
+            sum += fabsf(sqrtf(dx*dx + dy*dy + dz*dz) - rest) / rest;
+        }
+    }
+    *worst = verlet_max_stretch(solver);
+    *mean = solver->constraintCount ? (float)(sum/solver->constraintCount) : 0.0f;
+}
+
+static void convergence_run(const char* label, const VerletDesc* desc, Vec3Soa positions, uint32_t particleCount,
+                            const ParticleConstraint* constraints, uint32_t constraintCount, const uint32_t* pinned, uint32_t pinnedCount){
+    VerletSolver solver;
+    verlet_init(&solver, desc, positions, particleCount, constraints, constraintCount);
+    for(uint32_t i = 0; i<pinnedCount; ++i){
+        solver.inverseMass[pinned[i]] = 0.0f;
+    }
+    uint64_t start = time_now_ns();
+    for(int f = 0; f<60; ++f){
+        verlet_step(&solver, DT);
+    }
+    double ms = time_ms_since(start)/60.0;
+    float worst, mean;
+    stretch_stats(&solver, &worst, &mean);
+    printf("  %-30s %8.3f ms/frame  max stretch %9.6f  mean %9.6f\n", label, ms, worst, mean);
+    verlet_free(&solver);
+}
+
+static void convergence_table(Vec3Soa positions, uint32_t particleCount, const ParticleConstraint* constraints,
+                              uint32_t constraintCount, const uint32_t* pinned, uint32_t pinnedCount){
+    static const uint32_t passes[] = {1, 4, 16, 64};
+    char label[64];
+    for(size_t p = 0; p<sizeof(passes)/sizeof(passes[0]); ++p){
+        uint32_t n = passes[p];
+        VerletDesc pbd = {n, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}};
+        VerletDesc xpbd = {1, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}, VERLET_XPBD, n, 0.0f};
+        snprintf(label, sizeof(label), "PBD %u iterations", n);
+        convergence_run(label, &pbd, positions, particleCount, constraints, constraintCount, pinned, pinnedCount);
+        snprintf(label, sizeof(label), "XPBD %u substeps", n);
+        convergence_run(label, &xpbd, positions, particleCount, constraints, constraintCount, pinned, pinnedCount);
+    }
+    // Soft constraints: PBD stiffness means something else at every iteration
+    // count, XPBD compliance should settle to one stretch
+    for(size_t p = 1; p<sizeof(passes)/sizeof(passes[0]); ++p){
+        uint32_t n = passes[p];
+        VerletDesc pbd = {n, 0.1f, 0.99f, {0.0f, -9.81f, 0.0f}};
+        VerletDesc xpbd = {1, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}, VERLET_XPBD, n, 1e-4f};
+        snprintf(label, sizeof(label), "PBD %u it, stiffness 0.1", n);
+        convergence_run(label, &pbd, positions, particleCount, constraints, constraintCount, pinned, pinnedCount);
+        snprintf(label, sizeof(label), "XPBD %u sub, compliance 1e-4", n);
+        convergence_run(label, &xpbd, positions, particleCount, constraints, constraintCount, pinned, pinnedCount);
+    }
+}
+
+static void bench_convergence(void){
+    Cloth cloth = cloth_create(100);
+    uint32_t pinned[100];
+    for(uint32_t x = 0; x<100; ++x){
+        pinned[x] = x;
+    }
+    printf("Hanging cloth, %u particles, 1 s:\n", 100*100);
+    convergence_table(cloth.positions, 100*100, cloth.constraints, cloth.constraintCount, pinned, 100);
+    cloth_free(&cloth);
+
+    // Human.obj hanging from the top 2% of its height
+    fastObjMesh* mesh = asset_read_obj("../assets/Human.obj");
+    if(!mesh){
+        return;
+    }
+    ParticleGraphDesc graphDesc = {0.0f, 0};
+    ParticleGraph graph;
+    if(particle_graph_build(mesh, &graphDesc, &graph)){
+        float top = -1e30f, bottom = 1e30f;
+        for(uint32_t i = 0; i<graph.particleCount; ++i){
+            top = graph.positions.y[i] > top ? graph.positions.y[i] : top;
+            bottom = graph.positions.y[i] < bottom ? graph.positions.y[i] : bottom;
+        }
+        uint32_t* head = (uint32_t*)mem_alloc(MEM_TAG_GENERAL, (graph.particleCount+1)*sizeof(uint32_t));
+        uint32_t headCount = 0;
+        for(uint32_t i = 0; i<graph.particleCount; ++i){
+            if(graph.positions.y[i] >= top - 0.02f*(top - bottom)){
+                head[headCount++] = i;
+            }
+        }
+        printf("Human.obj, %u particles, %u constraints, %u pinned, 1 s:\n", graph.particleCount, graph.constraintCount, headCount);
+        convergence_table(graph.positions, graph.particleCount, graph.constraints, graph.constraintCount, head, headCount);
+        mem_free(head);
+        particle_graph_free(&graph);
+    }
+    asset_free_obj(mesh);
+}
+
+// OBJECTS_SIDE^2 cloths of OBJECT_SIDE^2 particles, hanging from their first
+// row, 0.25 apart
+#define OBJECTS_SIDE    16
+#define OBJECT_SIDE     16
+
+static Cloth cloth_field(void){
+    Cloth field = {OBJECT_SIDE};
+    uint32_t perObject = OBJECT_SIDE*OBJECT_SIDE;
+    uint32_t count = OBJECTS_SIDE*OBJECTS_SIDE*perObject;
+    field.positions.x = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    field.positions.y = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    field.positions.z = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    field.constraints = (ParticleConstraint*)mem_alloc(MEM_TAG_GENERAL, 3*count*sizeof(ParticleConstraint));
+    for(uint32_t o = 0; o<OBJECTS_SIDE*OBJECTS_SIDE; ++o){
+        uint32_t first = o*perObject;
+        for(uint32_t y = 0; y<OBJECT_SIDE; ++y){
+            for(uint32_t x = 0; x<OBJECT_SIDE; ++x){
+                uint32_t i = first + y*OBJECT_SIDE + x;
+                field.positions.x[i] = (o % OBJECTS_SIDE) + x*0.05f;
+                field.positions.y[i] = 0.0f;
+                field.positions.z[i] = (o / OBJECTS_SIDE) + y*0.05f;
+            }
+        }
+        for(uint32_t y = 0; y<OBJECT_SIDE; ++y){
+            for(uint32_t x = 0; x<OBJECT_SIDE; ++x){
+                uint32_t i = first + y*OBJECT_SIDE + x;
+                if(x+1 < OBJECT_SIDE) cloth_edge(&field, i, i+1);
+                if(y+1 < OBJECT_SIDE) cloth_edge(&field, i, i+OBJECT_SIDE);
+                if(x+1 < OBJECT_SIDE && y+1 < OBJECT_SIDE) cloth_edge(&field, i, i+OBJECT_SIDE+1);
+            }
+        }
+    }
+    return field;
+}
+
+static double time_steps(VerletSolver* solver, int steps){
+    uint64_t start = time_now_ns();
+    for(int s = 0; s<steps; ++s){
+        verlet_step(solver, DT);
+    }
+    return time_ms_since(start)/steps;
+}
+
+static void bench_sleeping(void){
+    Cloth field = cloth_field();
+    uint32_t objects = OBJECTS_SIDE*OBJECTS_SIDE, perObject = OBJECT_SIDE*OBJECT_SIDE;
+    uint32_t count = objects*perObject;
+    job_system_init(cpu_core_count());
+    VerletDesc desc = {ITERATIONS, 1.0f, 0.95f, {0.0f, -9.81f, 0.0f}};
+    VerletSolver solver;
+    verlet_init(&solver, &desc, field.positions, count, field.constraints, field.constraintCount);
+    double alwaysAwake = time_steps(&solver, 20);
+    verlet_free(&solver);
+
+    desc.sleepEnergy = 1e-3f;
+    desc.sleepDelay = 0.5f;
+    verlet_init(&solver, &desc, field.positions, count, field.constraints, field.constraintCount);
+    for(uint32_t o = 0; o<objects; ++o){
+        for(uint32_t x = 0; x<OBJECT_SIDE; ++x){
+            solver.inverseMass[o*perObject + x] = 0.0f;
+        }
+    }
+    int frames = 0;
+    while(frames < 1200 && (frames == 0 || solver.awakeCount > 0)){
+        verlet_step(&solver, DT);
+        frames++;
+    }
+    printf("%u idle cloths, %u particles, %u islands, all asleep after %.2f s, no sleeping %.3f ms/step\n",
+           objects, count, solver.islandCount, frames*DT, alwaysAwake);
+
+    // Woken islands start at rest and stay awake for sleepDelay, longer than
+    // the timed steps
+    static const uint32_t awake[] = {0, 1, 16, OBJECTS_SIDE*OBJECTS_SIDE};
+    for(size_t a = 0; a<sizeof(awake)/sizeof(awake[0]); ++a){
+        for(uint32_t o = 0; o<awake[a]; ++o){
+            verlet_wake_particle(&solver, o*perObject);
+        }
+        verlet_step(&solver, DT);
+        double ms = time_steps(&solver, 20);
+        uint32_t active = awake[a]*perObject;
+        printf("  %3u awake: %8.4f ms/step  %6.2f ns/awake particle/step\n", awake[a], ms, active ? ms*1e6/active : 0.0);
+    }
+
+    // Hanging cloths are 0.25 apart in x only, cloth 0 reaches cloth 1
+    while(solver.awakeCount > 0){
+        verlet_step(&solver, DT);
+    }
+    SpatialHash hash;
+    spatial_hash_init(&hash, 0.3f, count);
+    spatial_hash_exclude(&hash, count, field.constraints, field.constraintCount);
+    spatial_hash_build(&hash, solver.position, count);
+    verlet_wake_island(&solver, 0);
+    verlet_wake_contacts(&solver, &hash, 0.3f);
+    verlet_step(&solver, DT);
+    printf("  contact wake from one island: %u awake (expected 2)\n", solver.awakeCount);
+    spatial_hash_free(&hash);
+    verlet_free(&solver);
+    job_system_shutdown();
+    cloth_free(&field);
+}
+
+// Copies of each graph side by side in one particle/constraint list
+static void scene_append(Cloth* scene, uint32_t* particleCount, const ParticleGraph* graph, uint32_t copies, float offset){
+    for(uint32_t c = 0; c<copies; ++c){
+        uint32_t first = *particleCount;
+        for(uint32_t i = 0; i<graph->particleCount; ++i){
+            scene->positions.x[first+i] = graph->positions.x[i] + offset*(c+1);
+            scene->positions.y[first+i] = graph->positions.y[i];
+            scene->positions.z[first+i] = graph->positions.z[i];
+        }
+        for(uint32_t i = 0; i<graph->constraintCount; ++i){
+            ParticleConstraint constraint = graph->constraints[i];
+            constraint.a += first;
+            constraint.b += first;
+            scene->constraints[scene->constraintCount++] = constraint;
+        }
+        *particleCount += graph->particleCount;
+    }
+}
+
+static void bench_islands(void){
+    static const char* paths[] = {"../assets/peng.obj", "../assets/Wolf.obj"};
+    const uint32_t copies = 16;
+    ParticleGraph graphs[2];
+    uint32_t particles = 0, constraints = 0;
+    for(int g = 0; g<2; ++g){
+        fastObjMesh* mesh = asset_read_obj(paths[g]);
+        ParticleGraphDesc graphDesc = {0.0f, 0};
+        if(!mesh || !particle_graph_build(mesh, &graphDesc, &graphs[g])){
+            if(mesh){
+                asset_free_obj(mesh);
+            }
+            for(int f = 0; f<g; ++f){
+                particle_graph_free(&graphs[f]);
+            }
+            return;
+        }
+        asset_free_obj(mesh);
+        particles += copies*graphs[g].particleCount;
+        constraints += copies*graphs[g].constraintCount;
+    }
+    Cloth scene = {0};
+    scene.positions.x = (float*)mem_alloc(MEM_TAG_GENERAL, particles*sizeof(float));
+    scene.positions.y = (float*)mem_alloc(MEM_TAG_GENERAL, particles*sizeof(float));
+    scene.positions.z = (float*)mem_alloc(MEM_TAG_GENERAL, particles*sizeof(float));
+    scene.constraints = (ParticleConstraint*)mem_alloc(MEM_TAG_GENERAL, constraints*sizeof(ParticleConstraint));
+    uint32_t count = 0;
+    scene_append(&scene, &count, &graphs[0], copies, 2.0f);
+    scene_append(&scene, &count, &graphs[1], copies, 3.0f);
+
+    VerletDesc desc = {ITERATIONS, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}};
+    VerletSolver solver;
+    verlet_init(&solver, &desc, scene.positions, count, scene.constraints, scene.constraintCount);
+    uint32_t large = 0, smallest = UINT32_MAX, biggest = 0;
+    for(uint32_t k = 0; k<solver.islandCount; ++k){
+        uint32_t n = solver.islands[k].constraintCount;
+        large += n > 4096;
+        smallest = n < smallest ? n : smallest;
+        biggest = n > biggest ? n : biggest;
+    }
+    printf("%u penguins and %u wolves, %u particles, %u constraints, %u islands (%u-%u constraints, %u solved per color)\n",
+           copies, copies, count, scene.constraintCount, solver.islandCount, smallest, biggest, large);
+    verlet_free(&solver);
+
+    unsigned int cores = cpu_core_count();
+    for(unsigned int threads = 1; ; threads = threads*2 < cores ? threads*2 : cores){
+        job_system_init(threads);
+        verlet_init(&solver, &desc, scene.positions, count, scene.constraints, scene.constraintCount);
+        verlet_step(&solver, DT);
+        double ms = time_steps(&solver, 50);
+        printf("  %2u thread(s): %8.3f ms/step  %6.2f ns/particle/step\n", threads, ms, ms*1e6/count);
+        verlet_free(&solver);
+        job_system_shutdown();
+        if(threads == cores){
+            break;
+        }
+    }
+
+    // Cut a 100x100 cloth down the middle, then sew it back together
+    Cloth cloth = cloth_create(100);
+    verlet_init(&solver, &desc, cloth.positions, 100*100, cloth.constraints, cloth.constraintCount);
+    double stepMs = time_steps(&solver, 10);
+    uint32_t cut[2*100];
+    uint32_t cutCount = 0;
+    for(uint32_t i = 0; i<cloth.constraintCount; ++i){
+        uint32_t a = cloth.constraints[i].a % 100, b = cloth.constraints[i].b % 100;
+        if(a == 49 && b == 50){
+            cut[cutCount++] = i;
+            verlet_break_constraint(&solver, i);
+        }
+    }
+    uint64_t start = time_now_ns();
+    verlet_step(&solver, DT);
+    double cutMs = time_ms_since(start);
+    uint32_t halves = solver.islandCount;
+    for(uint32_t i = 0; i<cutCount; ++i){
+        verlet_add_constraint(&solver, cloth.constraints[cut[i]].a, cloth.constraints[cut[i]].b, cloth.constraints[cut[i]].restLength);
+    }
+    verlet_step(&solver, DT);
+    printf("cloth cut along %u constraints: %u islands (expected 2), sewn back: %u (expected 1), "
+           "step %.3f ms, step with the cut %.3f ms\n", cutCount, halves, solver.islandCount, stepMs, cutMs);
+    verlet_free(&solver);
+    cloth_free(&cloth);
+
+    cloth_free(&scene);
+    particle_graph_free(&graphs[0]);
+    particle_graph_free(&graphs[1]);
+}
+
+static void bench_reorder_model(const char* path){
+    fastObjMesh* mesh = asset_read_obj(path);
+    if(!mesh){
+        return;
+    }
+    static const char* orderNames[] = {"OBJ order", "Morton", "RCM"};
+    printf("%s:\n", path);
+    VerletDesc desc = {ITERATIONS, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}};
+    for(int order = PARTICLE_ORDER_NONE; order<=PARTICLE_ORDER_RCM; ++order){
+        ParticleGraphDesc graphDesc = {0.0f, 1, (ParticleOrder)order};
+        ParticleGraph graph;
+        if(!particle_graph_build(mesh, &graphDesc, &graph)){
+            break;
+        }
+        VerletSolver solver;
+        verlet_init_graph(&solver, &desc, &graph);
+        verlet_step(&solver, DT);
+        double ms = 1e30;
+        for(int r = 0; r<3; ++r){
+            double t = time_steps(&solver, 10);
+            ms = t < ms ? t : ms;
+        }
+        printf("  %-10s %7u particles %8u constraints %2u colors%s %8.3f ms/step  %6.2f ns/particle/step\n", orderNames[order],
+               graph.particleCount, graph.constraintCount, solver.colorCount, solver.serialColor ? "+serial" : "       ",
+               ms, ms*1e6/graph.particleCount);
+        verlet_free(&solver);
+        particle_graph_free(&graph);
+    }
+    asset_free_obj(mesh);
+}
+
+// Reordering a running solver only renumbers it, the steps that follow match
+// a solver that was not reordered
+static void validate_runtime_reorder(void){
+    Cloth cloth = cloth_create(100);
+    uint32_t count = 100*100;
+    VerletSolver reference, solver;
+    solver_create(&reference, &cloth);
+    solver_create(&solver, &cloth);
+    uint32_t* oldToNew = (uint32_t*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(uint32_t));
+    for(int s = 0; s<50; ++s){
+        verlet_step(&reference, DT);
+        verlet_step(&solver, DT);
+    }
+    verlet_reorder(&solver, PARTICLE_ORDER_MORTON, oldToNew);
+    for(int s = 0; s<50; ++s){
+        verlet_step(&reference, DT);
+        verlet_step(&solver, DT);
+    }
+    float worst = 0.0f;
+    for(uint32_t i = 0; i<count; ++i){
+        uint32_t j = oldToNew[i];
+        float dx = reference.position.x[i] - solver.position.x[j];
+        float dy = reference.position.y[i] - solver.position.y[j];
+        float dz = reference.position.z[i] - solver.position.z[j];
+        float d = sqrtf(dx*dx + dy*dy + dz*dz);
+        worst = d > worst ? d : worst;
+    }
+    printf("runtime Morton reorder of a hanging cloth, 50 steps later: max difference %g %s\n", worst,
+           worst < 1e-4f ? "OK" : "FAILED");
+    mem_free(oldToNew);
+    verlet_free(&reference);
+    verlet_free(&solver);
+    cloth_free(&cloth);
+}
+
+// A 1M particle cloth in random particle order, the case where a bad order
+// no longer fits in cache, reordered at runtime
+static void bench_reorder_shuffled(void){
+    const uint32_t side = 1000, count = side*side;
+    Cloth cloth = cloth_create(side);
+    uint32_t* shuffle = (uint32_t*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(uint32_t));
+    for(uint32_t i = 0; i<count; ++i){
+        shuffle[i] = i;
+    }
+    uint32_t state = 12345;
+    for(uint32_t i = count-1; i>0; --i){
+        state = state*1664525u + 1013904223u;
+        uint32_t j = (uint32_t)(((uint64_t)state*(i+1)) >> 32);
+        uint32_t t = shuffle[i];
+        shuffle[i] = shuffle[j];
+        shuffle[j] = t;
+    }
+    Vec3Soa shuffled;
+    shuffled.x = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    shuffled.y = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    shuffled.z = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    for(uint32_t i = 0; i<count; ++i){
+        shuffled.x[shuffle[i]] = cloth.positions.x[i];
+        shuffled.y[shuffle[i]] = cloth.positions.y[i];
+        shuffled.z[shuffle[i]] = cloth.positions.z[i];
+    }
+    for(uint32_t i = 0; i<cloth.constraintCount; ++i){
+        cloth.constraints[i].a = shuffle[cloth.constraints[i].a];
+        cloth.constraints[i].b = shuffle[cloth.constraints[i].b];
+    }
+
+    printf("%u particle cloth in random order, reordered at runtime:\n", count);
+    static const char* orderNames[] = {"random", "Morton", "RCM"};
+    VerletDesc desc = {ITERATIONS, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}};
+    for(int order = PARTICLE_ORDER_NONE; order<=PARTICLE_ORDER_RCM; ++order){
+        VerletSolver solver;
+        verlet_init(&solver, &desc, shuffled, count, cloth.constraints, cloth.constraintCount);
+        double reorderMs = 0.0;
+        if(order != PARTICLE_ORDER_NONE){
+            uint64_t start = time_now_ns();
+            verlet_reorder(&solver, (ParticleOrder)order, shuffle);
+            reorderMs = time_ms_since(start);
+        }
+        verlet_step(&solver, DT);
+        double ms = time_steps(&solver, 3);
+        printf("  %-10s %8.3f ms/step  %6.2f ns/particle/step  (reorder %.1f ms)\n", orderNames[order], ms, ms*1e6/count,
+               reorderMs);
+        verlet_free(&solver);
+    }
+    mem_free(shuffled.x);
+    mem_free(shuffled.y);
+    mem_free(shuffled.z);
+    mem_free(shuffle);
+    cloth_free(&cloth);
+}
+
+static void bench_reorder(void){
+    validate_runtime_reorder();
+    bench_reorder_model("../assets/Human.obj");
+    bench_reorder_model("../assets/Tree.obj");
+    bench_reorder_shuffled();
+}
+
+// fp16 integration goes through a chunk of start positions that stays in
+// cache, like a small island job, with the velocity pass right after
+static void integrate_half_chunked(Vec3Soa position, Vec3Soa start, Half3Soa velocity, const float* inverseMass, vec3 step, uint32_t count){
+    for(uint32_t begin = 0; begin<count; begin += 4096){
+        uint32_t n = count-begin < 4096 ? count-begin : 4096;
+        Vec3Soa p = {position.x+begin, position.y+begin, position.z+begin};
+        Half3Soa v = {velocity.x+begin, velocity.y+begin, velocity.z+begin};
+        batch_verlet_integrate_half(p, start, v, inverseMass+begin, step, 0.99f, n);
+        batch_verlet_velocity_half(p, start, v, n);
+    }
+}
+
+static void bench_half_integrate(void){
+    const uint32_t count = 1000000;
+    const int rounds = 20;
+    float* arrays[9];
+    for(int a = 0; a<9; ++a){
+        arrays[a] = (float*)mem_alloc_aligned(MEM_TAG_GENERAL, (a < 6 ? count : 4096)*sizeof(float), 32);
+    }
+    Vec3Soa position = {arrays[0], arrays[1], arrays[2]};
+    Vec3Soa previous = {arrays[3], arrays[4], arrays[5]};
+    Vec3Soa start = {arrays[6], arrays[7], arrays[8]};
+    float* inverseMass = (float*)mem_alloc_aligned(MEM_TAG_GENERAL, count*sizeof(float), 32);
+    uint16_t* halfs = (uint16_t*)mem_alloc_aligned(MEM_TAG_GENERAL, 3*count*sizeof(uint16_t), 32);
+    Half3Soa velocity = {halfs, halfs+count, halfs+2*count};
+    for(uint32_t i = 0; i<count; ++i){
+        position.x[i] = previous.x[i] = (float)(i % 1000);
+        position.y[i] = previous.y[i] = (float)(i / 1000);
+        position.z[i] = previous.z[i] = 0.0f;
+        inverseMass[i] = i % 100 ? 1.0f : 0.0f;
+        velocity.x[i] = velocity.y[i] = velocity.z[i] = 0;
+    }
+    vec3 step = {0.0f, -9.81f*DT*DT, 0.0f};
+    double floatMs = 1e30, halfMs = 1e30;
+    for(int r = 0; r<rounds; ++r){
+        uint64_t begin = time_now_ns();
+        batch_verlet_integrate(position, previous, inverseMass, step, 0.99f, count);
+        double ms = time_ms_since(begin);
+        floatMs = ms < floatMs ? ms : floatMs;
+        begin = time_now_ns();
+        integrate_half_chunked(position, start, velocity, inverseMass, step, count);
+        ms = time_ms_since(begin);
+        halfMs = ms < halfMs ? ms : halfMs;
+    }
+    // Position read and written, previous or velocity read and written, mass read
+    printf("integrate %u particles (%s): fp32 %.3f ms (%.1f GB/s)  fp16 %.3f ms (%.1f GB/s)\n", count,
+           batch_isa_name(batch_isa()), floatMs, 52.0*count/(floatMs*1e6), halfMs, 40.0*count/(halfMs*1e6));
+
+    // Every ISA against the scalar kernels, from the same state
+    float* reference = (float*)mem_alloc(MEM_TAG_GENERAL, 3*count*sizeof(float));
+    for(int isa = 0; isa<BATCH_ISA_COUNT; ++isa){
+        if(!batch_set_isa((BatchIsa)isa)){
+            continue;
+        }
+        for(uint32_t i = 0; i<count; ++i){
+            position.x[i] = (float)(i % 1000);
+            position.y[i] = (float)(i / 1000);
+            position.z[i] = 0.0f;
+            velocity.x[i] = batch_float_to_half(0.01f*(float)(i % 7));
+            velocity.y[i] = batch_float_to_half(-0.02f);
+            velocity.z[i] = batch_float_to_half(0.001f*(float)(i % 13));
+        }
+        for(int r = 0; r<10; ++r){
+            integrate_half_chunked(position, start, velocity, inverseMass, step, count);
+        }
+        float worst = 0.0f;
+        for(uint32_t i = 0; i<count; ++i){
+            float p[3] = {position.x[i], position.y[i], position.z[i]};
+            for(int k = 0; k<3; ++k){
+                if(isa == 0){
+                    reference[3*i+k] = p[k];
+                }
+                float d = fabsf(p[k] - reference[3*i+k]);
+                worst = d > worst ? d : worst;
+            }
+        }
+        if(isa > 0){
+            printf("fp16 integrate %s vs scalar after 10 steps: max difference %g\n", batch_isa_name((BatchIsa)isa), worst);
+        }
+    }
+    batch_init();
+    mem_free(reference);
+    for(int a = 0; a<9; ++a){
+        mem_free(arrays[a]);
+    }
+    mem_free(inverseMass);
+    mem_free(halfs);
+}
+
+static void solver_create_storage(VerletSolver* solver, const Cloth* cloth, VerletStorage storage){
+    VerletDesc desc = {ITERATIONS, 1.0f, 0.99f, {0.0f, -9.81f, 0.0f}};
+    desc.storage = storage;
+    verlet_init(solver, &desc, cloth->positions, cloth->side*cloth->side, cloth->constraints, cloth->constraintCount);
+    for(uint32_t x = 0; x<cloth->side; ++x){
+        solver->inverseMass[x] = 0.0f;
+    }
+}
+
+// One large island, then the field of small cloths solved one job per island
+static void bench_half_step(void){
+    Cloth cloth = cloth_create(316);
+    Cloth field = cloth_field();
+    const char* names[2] = {"fp32", "fp16"};
+    job_system_init(cpu_core_count());
+    for(int s = 0; s<2; ++s){
+        VerletSolver solver;
+        solver_create_storage(&solver, &cloth, (VerletStorage)s);
+        uint32_t count = solver.particleCount;
+        double ms = time_steps(&solver, 40);
+        printf("%u particle cloth, %s state: %.3f ms/step (%.2f ns/particle/step)\n", count, names[s], ms, ms*1e6/count);
+        verlet_free(&solver);
+
+        VerletDesc desc = {ITERATIONS, 1.0f, 0.95f, {0.0f, -9.81f, 0.0f}};
+        desc.storage = (VerletStorage)s;
+        count = OBJECTS_SIDE*OBJECTS_SIDE*OBJECT_SIDE*OBJECT_SIDE;
+        verlet_init(&solver, &desc, field.positions, count, field.constraints, field.constraintCount);
+        ms = time_steps(&solver, 40);
+        printf("%u small cloths, %s state: %.3f ms/step (%.2f ns/particle/step)\n", OBJECTS_SIDE*OBJECTS_SIDE, names[s], ms,
+               ms*1e6/count);
+        verlet_free(&solver);
+    }
+    job_system_shutdown();
+    cloth_free(&field);
+    cloth_free(&cloth);
+}
+
+// Hanging cloth swinging for a minute, fp16 against fp32
+static void bench_half_drift(void){
+    Cloth cloth = cloth_create(64);
+    uint32_t count = 64*64;
+    VerletSolver reference, solver;
+    solver_create_storage(&reference, &cloth, VERLET_STORAGE_FLOAT);
+    solver_create_storage(&solver, &cloth, VERLET_STORAGE_HALF);
+    for(int step = 1; step<=3600; ++step){
+        verlet_step(&reference, DT);
+        verlet_step(&solver, DT);
+        if(step % 900){
+            continue;
+        }
+        float worst = 0.0f;
+        double sum = 0.0;
+        for(uint32_t i = 0; i<count; ++i){
+            float dx = solver.position.x[i] - reference.position.x[i];
+            float dy = solver.position.y[i] - reference.position.y[i];
+            float dz = solver.position.z[i] - reference.position.z[i];
+            float d = sqrtf(dx*dx + dy*dy + dz*dz);
+            worst = d > worst ? d : worst;
+            sum += d;
+        }
+        printf("  cloth after %4d steps: fp16 vs fp32 max %.2e mean %.2e (cloth 10 wide), max stretch %.4f vs %.4f\n",
+               step, worst, sum/count, verlet_max_stretch(&solver), verlet_max_stretch(&reference));
+    }
+    verlet_free(&reference);
+    verlet_free(&solver);
+    cloth_free(&cloth);
+}
+
+// Unconstrained particles without damping or gravity fly in straight lines,
+// the fp16 error is the rounding of the per step displacement
+static void bench_half_free_flight(void){
+    const uint32_t count = 1000;
+    const int steps = 600;
+    Vec3Soa p;
+    p.x = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    p.y = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    p.z = (float*)mem_alloc(MEM_TAG_GENERAL, count*sizeof(float));
+    for(uint32_t i = 0; i<count; ++i){
+        p.x[i] = (float)i;
+        p.y[i] = 0.0f;
+        p.z[i] = 0.0f;
+    }
+    const char* names[2] = {"fp32", "fp16"};
+    for(int s = 0; s<2; ++s){
+        VerletDesc desc = {1, 1.0f, 1.0f, {0.0f, 0.0f, 0.0f}};
+        desc.storage = (VerletStorage)s;
+        VerletSolver solver;
+        verlet_init(&solver, &desc, p, count, NULL, 0);
+        // Speeds from 0.1 to 10 units per second
+        for(uint32_t i = 0; i<count; ++i){
+            float v = 0.1f + 9.9f*(float)i/count;
+            if(s == 0){
+                solver.previous.y[i] = -v*DT;
+            } else {
+                solver.velocity.y[i] = batch_float_to_half(v*DT);
+            }
+        }
+        for(int step = 0; step<steps; ++step){
+            verlet_step(&solver, DT);
+        }
+        float worst = 0.0f;
+        for(uint32_t i = 0; i<count; ++i){
+            float v = 0.1f + 9.9f*(float)i/count;
+            float d = fabsf(solver.position.y[i] - v*DT*steps)/(v*DT*steps);
+            worst = d > worst ? d : worst;
+        }
+        printf("  free flight %s, %d steps: max relative error %.2e\n", names[s], steps, worst);
+        verlet_free(&solver);
+    }
+    mem_free(p.x);
+    mem_free(p.y);
+    mem_free(p.z);
+}
+
+static void bench_half(void){
+    // Position, previous position or fp16 displacement, inverse mass
+    printf("particle state: fp32 %zu bytes, fp16 %zu bytes\n", 7*sizeof(float), 4*sizeof(float) + 3*sizeof(uint16_t));
+    bench_half_integrate();
+    bench_half_step();
+    bench_half_drift();
+    bench_half_free_flight();
+}
+
+int main(void){
+    mem_init(1024*1024);
+    printf("%d iterations, best ISA: %s\n", ITERATIONS, batch_isa_name(batch_isa()));
+    bench_isa_drift();
+    bench_convergence();
+    bench_cloth(100, 200);
+    bench_cloth(316, 40);
+    bench_cloth(1000, 5);
+    bench_sleeping();
+    bench_islands();
+    bench_reorder();
+    bench_half();
+    mem_shutdown();
+    return 0;
+}
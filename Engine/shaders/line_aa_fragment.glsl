@@ -0,0 +1,39 @@
+#version 430 core
+out vec4 FragColor;
+// Only ever pushed back, so the early depth test still holds
+layout(depth_greater) out float gl_FragDepth;
+
+in vec3 Color;
+flat in vec4 Ends;
+
+uniform float halfWidth;
+uniform uint join;
+uniform float feather;      // pixels of soft edge, centered on the line's edge
+uniform float opacity;      // lines thinner than a pixel are drawn a pixel wide and fainter
+
+// Window depth the transparent end of the soft edge sits behind the core
+const float DEPTH_FEATHER = 1.0/65536.0;
+
+void main()
+{
+    // Distance to the segment for round joins and caps, to its line for
+    // miters, whose corners lie on the neighbours' lines as well
+    vec2 p = gl_FragCoord.xy, a = Ends.xy, ab = Ends.zw - Ends.xy;
+    float len2 = max(dot(ab, ab), 1e-12);
+    float d;
+    if(join == 1u){
+        float t = clamp(dot(p - a, ab)/len2, 0.0, 1.0);
+        d = distance(p, a + t*ab);
+    } else {
+        d = abs(dot(p - a, vec2(-ab.y, ab.x)))*inversesqrt(len2);
+    }
+    float coverage = clamp((halfWidth + 0.5*feather - d)/feather, 0.0, 1.0)*opacity;
+    if(coverage < 1.0/255.0){
+        discard;
+    }
+    // Where lines cross at about the same depth the cores win over the soft
+    // edges whatever the draw order, and an edge does not hide what is right
+    // behind it
+    gl_FragDepth = min(gl_FragCoord.z + (1.0 - coverage)*DEPTH_FEATHER, 1.0);
+    FragColor = vec4(Color, coverage);
+}
@@ -0,0 +1,21 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec3 Color;
+flat in vec4 Ends;
+
+uniform float halfWidth;
+uniform uint join;
+
+void main()
+{
+    // Round joins and caps: only what is within half a width of the segment
+    if(join == 1u){
+        vec2 p = gl_FragCoord.xy, a = Ends.xy, ab = Ends.zw - Ends.xy;
+        float t = clamp(dot(p - a, ab)/max(dot(ab, ab), 1e-12), 0.0, 1.0);
+        if(distance(p, a + t*ab) > halfWidth){
+            discard;
+        }
+    }
+    FragColor = vec4(Color, 1.0);
+}
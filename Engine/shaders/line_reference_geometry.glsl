@@ -0,0 +1,98 @@
+#version 430 core
+layout(lines_adjacency) in;
+layout(triangle_strip, max_vertices = 4) out;
+
+layout(std430, binding = 0) readonly buffer Points { vec4 points[]; };
+layout(std430, binding = 1) readonly buffer Normals { vec4 normals[]; };
+
+uniform vec2 viewport;
+uniform float halfWidth;
+uniform uint join;
+uniform float miterLimit;
+uniform uint hasNormals;
+uniform vec3 color;
+uniform vec3 lightPos;
+uniform vec3 viewPos;
+
+flat in uint Index[];
+
+out vec3 Color;
+flat out vec4 Ends;
+
+vec2 window(vec4 clip)
+{
+    return (clip.xy/clip.w*0.5 + 0.5)*viewport;
+}
+
+vec2 left(vec2 a, vec2 b)
+{
+    vec2 d = b - a;
+    float len = length(d);
+    return len > 1e-6 ? vec2(-d.y, d.x)/len : vec2(0.0, 1.0);
+}
+
+vec3 shade(vec3 p, vec3 normal)
+{
+    vec3 lightDir = normalize(lightPos - p);
+    vec3 viewDir = normalize(viewPos - p);
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = pow(max(dot(viewDir, reflect(-lightDir, normal)), 0.0), 32.0);
+    return (0.3 + diff)*color + 0.5*spec;
+}
+
+void main()
+{
+    vec4 ca = gl_in[1].gl_Position, cb = gl_in[2].gl_Position;
+    float da = ca.z + ca.w, db = cb.z + cb.w;
+    if(da < 0.0 && db < 0.0){
+        return;
+    }
+    if(da < 0.0){
+        ca = mix(ca, cb, da/(da - db));
+    } else if(db < 0.0){
+        cb = mix(cb, ca, db/(db - da));
+    }
+    vec2 wa = window(ca), wb = window(cb);
+    vec2 n = left(wa, wb);
+    vec3 pa = points[Index[1]].xyz, pb = points[Index[2]].xyz;
+
+    for(int v = 0; v < 4; ++v){
+        bool atEnd = v >= 2;
+        float side = (v & 1) == 0 ? 1.0 : -1.0;
+        bool clipped = atEnd ? db < 0.0 : da < 0.0;
+        vec2 offset = side*halfWidth*n;
+        int k = atEnd ? 3 : 0;
+        if(join == 1u){
+            offset += (atEnd ? halfWidth : -halfWidth)*vec2(n.y, -n.x);
+        } else if(Index[k] != Index[atEnd ? 2 : 1] && !clipped){
+            vec4 cn = gl_in[k].gl_Position;
+            if(cn.z + cn.w > 0.0){
+                vec2 m = atEnd ? left(wb, window(cn)) : left(window(cn), wa);
+                vec2 miter = n + m;
+                float len = length(miter);
+                if(len > 1e-6){
+                    float cosine = sqrt(max(0.5 + 0.5*dot(n, m), 0.0));
+                    offset = side*halfWidth/max(cosine, 1.0/miterLimit)*(miter/len);
+                }
+            }
+        }
+        vec4 clip = atEnd ? cb : ca;
+        clip.xy += offset/viewport*2.0*clip.w;
+        gl_Position = clip;
+        Ends = vec4(wa, wb);
+
+        vec3 p = atEnd ? pb : pa;
+        vec3 normal;
+        if(hasNormals != 0u){
+            normal = normalize(normals[Index[atEnd ? 2 : 1]].xyz);
+        } else {
+            vec3 toEye = normalize(viewPos - p);
+            vec3 across = cross(pb - pa, toEye);
+            float len = length(across);
+            normal = len > 1e-12 ? normalize(toEye + 0.7*side*across/len) : toEye;
+        }
+        Color = shade(p, normal);
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -0,0 +1,16 @@
+#version 430 core
+
+// Geometry shader version of line_vertex.glsl, kept to compare against in
+// bench_lines. Drawn as GL_LINES_ADJACENCY from the segments, with a missing
+// neighbour given as the end itself.
+layout(std430, binding = 0) readonly buffer Points { vec4 points[]; };
+
+uniform mat4 viewProjection;
+
+flat out uint Index;
+
+void main()
+{
+    Index = uint(gl_VertexID);
+    gl_Position = viewProjection*vec4(points[gl_VertexID].xyz, 1.0);
+}
@@ -0,0 +1,110 @@
+#version 430 core
+
+// Every segment is an instance of a 4 vertex strip: vertices 0 and 1 sit on
+// its start, 2 and 3 on its end, even ones on the left side.
+layout(std430, binding = 0) readonly buffer Points { vec4 points[]; };
+layout(std430, binding = 1) readonly buffer Normals { vec4 normals[]; };
+// previous, start, end, next point, NONE where the strip ends
+layout(std430, binding = 2) readonly buffer Segments { uvec4 segments[]; };
+
+uniform uint firstSegment;  // of the range drawn
+uniform mat4 viewProjection;
+uniform vec2 viewport;      // pixels
+uniform float halfWidth;    // pixels
+uniform float feather;      // pixels of soft edge, centered on the line's edge
+uniform uint join;          // 0 miter, 1 round
+uniform float miterLimit;   // longest miter in half widths
+uniform uint hasNormals;
+uniform vec3 color;
+uniform vec3 lightPos;
+uniform vec3 viewPos;
+
+out vec3 Color;
+flat out vec4 Ends;         // start and end in window coordinates
+
+const uint NONE = 0xffffffffu;
+
+vec2 window(vec4 clip)
+{
+    return (clip.xy/clip.w*0.5 + 0.5)*viewport;
+}
+
+// Unit normal on the left of a to b
+vec2 left(vec2 a, vec2 b)
+{
+    vec2 d = b - a;
+    float len = length(d);
+    return len > 1e-6 ? vec2(-d.y, d.x)/len : vec2(0.0, 1.0);
+}
+
+// Same terms as fragment.glsl, per vertex
+vec3 shade(vec3 p, vec3 normal)
+{
+    vec3 lightDir = normalize(lightPos - p);
+    vec3 viewDir = normalize(viewPos - p);
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = pow(max(dot(viewDir, reflect(-lightDir, normal)), 0.0), 32.0);
+    return (0.3 + diff)*color + 0.5*spec;
+}
+
+void main()
+{
+    uvec4 s = segments[firstSegment + gl_InstanceID];
+    bool atEnd = gl_VertexID >= 2;
+    float side = (gl_VertexID & 1) == 0 ? 1.0 : -1.0;
+    vec3 pa = points[s.y].xyz, pb = points[s.z].xyz;
+    vec4 ca = viewProjection*vec4(pa, 1.0), cb = viewProjection*vec4(pb, 1.0);
+
+    // Clipped to the near plane, a clipped end gets no join
+    float da = ca.z + ca.w, db = cb.z + cb.w;
+    if(da < 0.0 && db < 0.0){
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+    bool clipped = atEnd ? db < 0.0 : da < 0.0;
+    if(da < 0.0){
+        ca = mix(ca, cb, da/(da - db));
+    } else if(db < 0.0){
+        cb = mix(cb, ca, db/(db - da));
+    }
+
+    // Out to where the soft edge ends
+    float reach = halfWidth + 0.5*feather;
+    vec2 wa = window(ca), wb = window(cb);
+    vec2 n = left(wa, wb);
+    vec2 offset = side*reach*n;
+    uint neighbour = atEnd ? s.w : s.x;
+    if(join == 1u){
+        // Half a width past both ends, the fragment shader rounds them
+        offset += (atEnd ? reach : -reach)*vec2(n.y, -n.x);
+    } else if(neighbour != NONE && !clipped){
+        vec4 cn = viewProjection*vec4(points[neighbour].xyz, 1.0);
+        if(cn.z + cn.w > 0.0){
+            // Both segments of the join get the same bisector and length
+            vec2 m = atEnd ? left(wb, window(cn)) : left(window(cn), wa);
+            vec2 miter = n + m;
+            float len = length(miter);
+            if(len > 1e-6){
+                float cosine = sqrt(max(0.5 + 0.5*dot(n, m), 0.0));
+                offset = side*reach/max(cosine, 1.0/miterLimit)*(miter/len);
+            }
+        }
+    }
+    vec4 clip = atEnd ? cb : ca;
+    clip.xy += offset/viewport*2.0*clip.w;
+    gl_Position = clip;
+    Ends = vec4(wa, wb);
+
+    // Without normals the line is lit like a tube facing the camera
+    vec3 p = atEnd ? pb : pa;
+    vec3 normal;
+    if(hasNormals != 0u){
+        normal = normalize(normals[atEnd ? s.z : s.y].xyz);
+    } else {
+        vec3 toEye = normalize(viewPos - p);
+        vec3 across = cross(pb - pa, toEye);
+        float len = length(across);
+        normal = len > 1e-12 ? normalize(toEye + 0.7*side*across/len) : toEye;
+    }
+    Color = shade(p, normal);
+}
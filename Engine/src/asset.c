@@ -0,0 +1,146 @@
+// asset.h pulls in the fast_obj declarations, it must come before the implementation
+#include "asset.h"
+#include "memory.h"
+#define FAST_OBJ_IMPLEMENTATION
+#define FAST_OBJ_REALLOC(ptr, size) mem_realloc(MEM_TAG_MODEL, ptr, size)
+#define FAST_OBJ_FREE mem_free
+#include <fast_obj/fast_obj.h>
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_MALLOC(size) mem_alloc(MEM_TAG_TEXTURE, size)
+#define STBI_REALLOC(ptr, size) mem_realloc(MEM_TAG_TEXTURE, ptr, size)
+#define STBI_FREE mem_free
+#include <stb/stb_image.h>
+#include <stdio.h>
+#include <string.h>
+#include "job.h"
+
+typedef struct {
+    const fastObjMesh* mesh;
+    const uint32_t* faceOffsets;
+    const uint32_t* indexOffsets;
+    float* data;
+} MeshBuild;
+
+static void mesh_build_faces(void* arg, uint32_t begin, uint32_t end){
+    MeshBuild* build = (MeshBuild*)arg;
+    const fastObjMesh* mesh = build->mesh;
+    static const int triangleIndices[][3] = {{0, 1, 2}, {0, 2, 3}};
+
+    for(uint32_t i = begin; i<end; ++i){
+        uint32_t fv = mesh->face_vertices[i];
+        uint32_t indexOffset = build->indexOffsets[i];
+        float* data = build->data + build->faceOffsets[i]*8;
+        uint32_t dataIndex = 0;
+
+        int trianglesToDraw = (fv == 4) ? 2 : 1;
+
+        for (int t = 0; t < trianglesToDraw; ++t) {
+            for (int j = 0; j < 3; ++j) {
+                fastObjIndex idx = mesh->indices[indexOffset + triangleIndices[t][j]];
+
+                // POSITION
+                data[dataIndex++] = mesh->positions[3 * idx.p + 0];
+                data[dataIndex++] = mesh->positions[3 * idx.p + 1];
+                data[dataIndex++] = mesh->positions[3 * idx.p + 2];
+
+                // NORMAL (Check if exists, otherwise default to Up)
+                if (mesh->normal_count > 0) {
+                    data[dataIndex++] = mesh->normals[3 * idx.n + 0];
+                    data[dataIndex++] = mesh->normals[3 * idx.n + 1];
+                    data[dataIndex++] = mesh->normals[3 * idx.n + 2];
+                } else {
+                    data[dataIndex++] = 0.0f;
+                    data[dataIndex++] = 1.0f;
+                    data[dataIndex++] = 0.0f;
+                }
+
+                if (mesh->texcoord_count > 0){
+                    data[dataIndex++] = mesh->texcoords[2*idx.t+0];
+                    data[dataIndex++] = mesh->texcoords[2*idx.t+1];
+                }
+                else{
+                    data[dataIndex++] = 0.0f;
+                    data[dataIndex++] = 0.0f;
+                }
+            }
+        }
+    }
+}
+
+int asset_load_mesh(const char* path, MeshData* out){
+    memset(out, 0, sizeof(*out));
+
+    fastObjMesh* mesh = fast_obj_read(path);
+    if(!mesh){
+        printf("ASSET: Failed to read model %s\n", path);
+        return 0;
+    }
+
+    // Every face expands to 1 or 2 triangles, prefix sum the output offsets so
+    // faces can be written independently
+    uint32_t* faceOffsets = (uint32_t*)mem_alloc(MEM_TAG_MODEL, (mesh->face_count+1)*sizeof(uint32_t));
+    uint32_t* indexOffsets = (uint32_t*)mem_alloc(MEM_TAG_MODEL, (mesh->face_count+1)*sizeof(uint32_t));
+    if(!faceOffsets || !indexOffsets){
+        printf("ASSET: Memory allocation failed for %s\n", path);
+        mem_free(faceOffsets);
+        mem_free(indexOffsets);
+        fast_obj_destroy(mesh);
+        return 0;
+    }
+
+    uint32_t totalVertices = 0;
+    uint32_t totalIndices = 0;
+    for(unsigned int i = 0; i<mesh->face_count; ++i){
+        uint32_t fv = mesh->face_vertices[i];
+        faceOffsets[i] = totalVertices;
+        indexOffsets[i] = totalIndices;
+        totalVertices+=(fv==3)?3:6;
+        totalIndices+=fv;
+    }
+
+    out->vertices = (float*)mem_alloc(MEM_TAG_MODEL, totalVertices*8*sizeof(float));
+    out->vertexCount = totalVertices;
+
+    MeshBuild build = {mesh, faceOffsets, indexOffsets, out->vertices};
+    parallel_for(&build, mesh->face_count, 0, mesh_build_faces);
+    mem_free(faceOffsets);
+    mem_free(indexOffsets);
+    fast_obj_destroy(mesh);
+    return 1;
+}
+
+void asset_free_mesh(MeshData* mesh){
+    mem_free(mesh->vertices);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+fastObjMesh* asset_read_obj(const char* path){
+    fastObjMesh* mesh = fast_obj_read(path);
+    if(!mesh){
+        printf("ASSET: Failed to read model %s\n", path);
+    }
+    return mesh;
+}
+
+void asset_free_obj(fastObjMesh* mesh){
+    if(mesh){
+        fast_obj_destroy(mesh);
+    }
+}
+
+int asset_load_image(const char* path, ImageData* out){
+    memset(out, 0, sizeof(*out));
+    // The flip flag is per thread, images may be decoded on any worker
+    stbi_set_flip_vertically_on_load_thread(1);
+    out->pixels = stbi_load(path, &out->width, &out->height, &out->channels, 0);
+    if(!out->pixels){
+        printf("ASSET: Failed to load image %s (%s)\n", path, stbi_failure_reason());
+        return 0;
+    }
+    return 1;
+}
+
+void asset_free_image(ImageData* image){
+    stbi_image_free(image->pixels);
+    memset(image, 0, sizeof(*image));
+}
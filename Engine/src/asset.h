@@ -0,0 +1,31 @@
+#pragma once
+#include <fast_obj/fast_obj.h>
+#include <stdint.h>
+
+// CPU side asset decoding. Nothing here touches GL, so decoding can run on any
+// job thread; the results are uploaded by model_upload()/texture_upload() on
+// the thread that owns the context.
+
+// Interleaved position/normal/uv, 8 floats per vertex, ready for upload
+typedef struct {
+    float* vertices;
+    uint32_t vertexCount;
+} MeshData;
+
+typedef struct {
+    uint8_t* pixels;
+    int width;
+    int height;
+    int channels;
+} ImageData;
+
+int asset_load_mesh(const char* path, MeshData* mesh);
+void asset_free_mesh(MeshData* mesh);
+
+// Rows are flipped for GL's bottom-up texture origin
+int asset_load_image(const char* path, ImageData* image);
+void asset_free_image(ImageData* image);
+
+// Raw fast_obj mesh for tools that need the topology (e.g. particle_graph_build)
+fastObjMesh* asset_read_obj(const char* path);
+void asset_free_obj(fastObjMesh* mesh);
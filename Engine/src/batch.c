@@ -0,0 +1,398 @@
+#include <string.h>
+#include "batch.h"
+#include "platform.h"
+
+typedef struct {
+    void (*transform)(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count, float w);
+    void (*transformAabbs)(mat4 m, AabbSoa in, AabbSoa out, uint32_t count);
+    void (*project)(Vec3Soa in, const vec3 axis, float offset, float* out, uint32_t count);
+    void (*mat4Mul)(mat4* a, mat4* b, mat4* out, uint32_t count);
+    uint32_t (*spheresInFrustum)(vec4 planes[6], SphereSoa spheres, uint8_t* visible, uint32_t count);
+    void (*verletIntegrate)(Vec3Soa position, Vec3Soa previous, const float* inverseMass, vec3 step, float damping, uint32_t count);
+    void (*verletIntegrateHalf)(Vec3Soa position, Vec3Soa start, Half3Soa velocity, const float* inverseMass, vec3 step, float damping, uint32_t count);
+    void (*verletVelocityHalf)(Vec3Soa position, Vec3Soa start, Half3Soa velocity, uint32_t count);
+} BatchKernels;
+
+// Defined in batch_avx2.c, which is the only file built with AVX2 code generation
+void batch_transform_avx2(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count, float w);
+void batch_transform_aabbs_avx2(mat4 m, AabbSoa in, AabbSoa out, uint32_t count);
+void batch_project_points_avx2(Vec3Soa in, const vec3 axis, float offset, float* out, uint32_t count);
+void batch_mat4_mul_avx2(mat4* a, mat4* b, mat4* out, uint32_t count);
+uint32_t batch_spheres_in_frustum_avx2(vec4 planes[6], SphereSoa spheres, uint8_t* visible, uint32_t count);
+void batch_verlet_integrate_avx2(Vec3Soa position, Vec3Soa previous, const float* inverseMass, vec3 step, float damping, uint32_t count);
+void batch_verlet_integrate_half_avx2(Vec3Soa position, Vec3Soa start, Half3Soa velocity, const float* inverseMass, vec3 step, float damping, uint32_t count);
+void batch_verlet_velocity_half_avx2(Vec3Soa position, Vec3Soa start, Half3Soa velocity, uint32_t count);
+
+// ---------------------------------------------------------
+// Scalar reference
+// ---------------------------------------------------------
+static void transform_scalar(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count, float w){
+    for(uint32_t i = 0; i<count; ++i){
+        float x = in.x[i], y = in.y[i], z = in.z[i];
+        out.x[i] = m[0][0]*x + m[1][0]*y + m[2][0]*z + m[3][0]*w;
+        out.y[i] = m[0][1]*x + m[1][1]*y + m[2][1]*z + m[3][1]*w;
+        out.z[i] = m[0][2]*x + m[1][2]*y + m[2][2]*z + m[3][2]*w;
+    }
+}
+
+static void transform_aabbs_scalar(mat4 m, AabbSoa in, AabbSoa out, uint32_t count){
+    for(uint32_t i = 0; i<count; ++i){
+        float cx = (in.minX[i] + in.maxX[i])*0.5f, ex = (in.maxX[i] - in.minX[i])*0.5f;
+        float cy = (in.minY[i] + in.maxY[i])*0.5f, ey = (in.maxY[i] - in.minY[i])*0.5f;
+        float cz = (in.minZ[i] + in.maxZ[i])*0.5f, ez = (in.maxZ[i] - in.minZ[i])*0.5f;
+
+        float ncx = m[0][0]*cx + m[1][0]*cy + m[2][0]*cz + m[3][0];
+        float ncy = m[0][1]*cx + m[1][1]*cy + m[2][1]*cz + m[3][1];
+        float ncz = m[0][2]*cx + m[1][2]*cy + m[2][2]*cz + m[3][2];
+        float nex = fabsf(m[0][0])*ex + fabsf(m[1][0])*ey + fabsf(m[2][0])*ez;
+        float ney = fabsf(m[0][1])*ex + fabsf(m[1][1])*ey + fabsf(m[2][1])*ez;
+        float nez = fabsf(m[0][2])*ex + fabsf(m[1][2])*ey + fabsf(m[2][2])*ez;
+
+        out.minX[i] = ncx - nex; out.maxX[i] = ncx + nex;
+        out.minY[i] = ncy - ney; out.maxY[i] = ncy + ney;
+        out.minZ[i] = ncz - nez; out.maxZ[i] = ncz + nez;
+    }
+}
+
+static void project_scalar(Vec3Soa in, const vec3 axis, float offset, float* out, uint32_t count){
+    for(uint32_t i = 0; i<count; ++i){
+        out[i] = in.x[i]*axis[0] + in.y[i]*axis[1] + in.z[i]*axis[2] + offset;
+    }
+}
+
+static void mat4_mul_scalar(mat4* a, mat4* b, mat4* out, uint32_t count){
+    for(uint32_t i = 0; i<count; ++i){
+        mat4 r;
+        for(int c = 0; c<4; ++c){
+            for(int row = 0; row<4; ++row){
+                r[c][row] = a[i][0][row]*b[i][c][0] + a[i][1][row]*b[i][c][1]
+                          + a[i][2][row]*b[i][c][2] + a[i][3][row]*b[i][c][3];
+            }
+        }
+        memcpy(out[i], r, sizeof(mat4));
+    }
+}
+
+static uint32_t spheres_in_frustum_scalar(vec4 planes[6], SphereSoa spheres, uint8_t* visible, uint32_t count){
+    uint32_t visibleCount = 0;
+    for(uint32_t i = 0; i<count; ++i){
+        uint8_t inside = 1;
+        for(int p = 0; p<6; ++p){
+            float d = planes[p][0]*spheres.x[i] + planes[p][1]*spheres.y[i] + planes[p][2]*spheres.z[i] + planes[p][3];
+            inside &= d >= -spheres.radius[i];
+        }
+        visible[i] = inside;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
+
+static void verlet_integrate_scalar(Vec3Soa position, Vec3Soa previous, const float* inverseMass, vec3 step, float damping, uint32_t count){
+    for(uint32_t i = 0; i<count; ++i){
+        float x = position.x[i], y = position.y[i], z = position.z[i];
+        if(inverseMass[i] > 0.0f){
+            position.x[i] = x + ((x - previous.x[i])*damping + step[0]);
+            position.y[i] = y + ((y - previous.y[i])*damping + step[1]);
+            position.z[i] = z + ((z - previous.z[i])*damping + step[2]);
+        }
+        previous.x[i] = x;
+        previous.y[i] = y;
+        previous.z[i] = z;
+    }
+}
+
+uint16_t batch_float_to_half(float value){
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t exponent = (x >> 23) & 0xff;
+    uint32_t mantissa = x & 0x7fffff;
+    if(exponent == 0xff){
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+    int32_t e = (int32_t)exponent - 127 + 15;
+    if(e >= 31){
+        return (uint16_t)(sign | 0x7c00);
+    }
+    if(e <= 0){
+        // Subnormal, or zero below half the smallest one
+        if(e < -10){
+            return (uint16_t)sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - e);
+        uint32_t h = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift-1);
+        h += rest > halfway || (rest == halfway && (h & 1));
+        return (uint16_t)(sign | h);
+    }
+    // Rounding may carry into the exponent, up to infinity
+    uint32_t h = ((uint32_t)e << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    h += rest > 0x1000 || (rest == 0x1000 && (h & 1));
+    return (uint16_t)(sign | h);
+}
+
+float batch_half_to_float(uint16_t value){
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t x;
+    if(exponent == 0){
+        float f = mantissa*(1.0f/16777216.0f);
+        return sign ? -f : f;
+    } else if(exponent == 31){
+        x = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static void verlet_integrate_half_scalar(Vec3Soa position, Vec3Soa start, Half3Soa velocity, const float* inverseMass, vec3 step, float damping, uint32_t count){
+    for(uint32_t i = 0; i<count; ++i){
+        float x = position.x[i], y = position.y[i], z = position.z[i];
+        start.x[i] = x;
+        start.y[i] = y;
+        start.z[i] = z;
+        if(inverseMass[i] <= 0.0f){
+            continue;
+        }
+        position.x[i] = x + (batch_half_to_float(velocity.x[i])*damping + step[0]);
+        position.y[i] = y + (batch_half_to_float(velocity.y[i])*damping + step[1]);
+        position.z[i] = z + (batch_half_to_float(velocity.z[i])*damping + step[2]);
+    }
+}
+
+static void verlet_velocity_half_scalar(Vec3Soa position, Vec3Soa start, Half3Soa velocity, uint32_t count){
+    for(uint32_t i = 0; i<count; ++i){
+        velocity.x[i] = batch_float_to_half(position.x[i] - start.x[i]);
+        velocity.y[i] = batch_float_to_half(position.y[i] - start.y[i]);
+        velocity.z[i] = batch_float_to_half(position.z[i] - start.z[i]);
+    }
+}
+
+// ---------------------------------------------------------
+// SSE, 4 lanes. Always available on x64.
+// ---------------------------------------------------------
+static void transform_sse(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count, float w){
+    __m128 m00 = _mm_set1_ps(m[0][0]), m10 = _mm_set1_ps(m[1][0]), m20 = _mm_set1_ps(m[2][0]), m30 = _mm_set1_ps(m[3][0]*w);
+    __m128 m01 = _mm_set1_ps(m[0][1]), m11 = _mm_set1_ps(m[1][1]), m21 = _mm_set1_ps(m[2][1]), m31 = _mm_set1_ps(m[3][1]*w);
+    __m128 m02 = _mm_set1_ps(m[0][2]), m12 = _mm_set1_ps(m[1][2]), m22 = _mm_set1_ps(m[2][2]), m32 = _mm_set1_ps(m[3][2]*w);
+
+    uint32_t i = 0;
+    for(; i+4<=count; i+=4){
+        __m128 x = _mm_loadu_ps(in.x+i), y = _mm_loadu_ps(in.y+i), z = _mm_loadu_ps(in.z+i);
+        __m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_add_ps(_mm_mul_ps(m20, z), m30));
+        __m128 oy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m21, z), m31));
+        __m128 oz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_add_ps(_mm_mul_ps(m22, z), m32));
+        _mm_storeu_ps(out.x+i, ox);
+        _mm_storeu_ps(out.y+i, oy);
+        _mm_storeu_ps(out.z+i, oz);
+    }
+    Vec3Soa tailIn = {in.x+i, in.y+i, in.z+i};
+    Vec3Soa tailOut = {out.x+i, out.y+i, out.z+i};
+    transform_scalar(m, tailIn, tailOut, count-i, w);
+}
+
+static void transform_aabbs_sse(mat4 m, AabbSoa in, AabbSoa out, uint32_t count){
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 M[4][3], A[3][3];
+    for(int c = 0; c<4; ++c){
+        for(int r = 0; r<3; ++r){
+            M[c][r] = _mm_set1_ps(m[c][r]);
+            if(c < 3){
+                A[c][r] = _mm_and_ps(M[c][r], absMask);
+            }
+        }
+    }
+
+    uint32_t i = 0;
+    for(; i+4<=count; i+=4){
+        __m128 mnx = _mm_loadu_ps(in.minX+i), mxx = _mm_loadu_ps(in.maxX+i);
+        __m128 mny = _mm_loadu_ps(in.minY+i), mxy = _mm_loadu_ps(in.maxY+i);
+        __m128 mnz = _mm_loadu_ps(in.minZ+i), mxz = _mm_loadu_ps(in.maxZ+i);
+        __m128 c[3] = {_mm_mul_ps(_mm_add_ps(mnx, mxx), half), _mm_mul_ps(_mm_add_ps(mny, mxy), half), _mm_mul_ps(_mm_add_ps(mnz, mxz), half)};
+        __m128 e[3] = {_mm_mul_ps(_mm_sub_ps(mxx, mnx), half), _mm_mul_ps(_mm_sub_ps(mxy, mny), half), _mm_mul_ps(_mm_sub_ps(mxz, mnz), half)};
+
+        __m128 nc[3], ne[3];
+        for(int r = 0; r<3; ++r){
+            nc[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(M[0][r], c[0]), _mm_mul_ps(M[1][r], c[1])), _mm_add_ps(_mm_mul_ps(M[2][r], c[2]), M[3][r]));
+            ne[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A[0][r], e[0]), _mm_mul_ps(A[1][r], e[1])), _mm_mul_ps(A[2][r], e[2]));
+        }
+        _mm_storeu_ps(out.minX+i, _mm_sub_ps(nc[0], ne[0])); _mm_storeu_ps(out.maxX+i, _mm_add_ps(nc[0], ne[0]));
+        _mm_storeu_ps(out.minY+i, _mm_sub_ps(nc[1], ne[1])); _mm_storeu_ps(out.maxY+i, _mm_add_ps(nc[1], ne[1]));
+        _mm_storeu_ps(out.minZ+i, _mm_sub_ps(nc[2], ne[2])); _mm_storeu_ps(out.maxZ+i, _mm_add_ps(nc[2], ne[2]));
+    }
+    AabbSoa tailIn = {in.minX+i, in.minY+i, in.minZ+i, in.maxX+i, in.maxY+i, in.maxZ+i};
+    AabbSoa tailOut = {out.minX+i, out.minY+i, out.minZ+i, out.maxX+i, out.maxY+i, out.maxZ+i};
+    transform_aabbs_scalar(m, tailIn, tailOut, count-i);
+}
+
+static void project_sse(Vec3Soa in, const vec3 axis, float offset, float* out, uint32_t count){
+    const __m128 ax = _mm_set1_ps(axis[0]), ay = _mm_set1_ps(axis[1]), az = _mm_set1_ps(axis[2]), o = _mm_set1_ps(offset);
+    uint32_t i = 0;
+    for(; i+4<=count; i+=4){
+        __m128 d = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in.x+i), ax), _mm_mul_ps(_mm_loadu_ps(in.y+i), ay));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(in.z+i), az));
+        _mm_storeu_ps(out+i, _mm_add_ps(d, o));
+    }
+    Vec3Soa tail = {in.x+i, in.y+i, in.z+i};
+    project_scalar(tail, axis, offset, out+i, count-i);
+}
+
+static void mat4_mul_sse(mat4* a, mat4* b, mat4* out, uint32_t count){
+    for(uint32_t i = 0; i<count; ++i){
+        __m128 a0 = _mm_loadu_ps(a[i][0]), a1 = _mm_loadu_ps(a[i][1]);
+        __m128 a2 = _mm_loadu_ps(a[i][2]), a3 = _mm_loadu_ps(a[i][3]);
+        __m128 r[4];
+        for(int c = 0; c<4; ++c){
+            __m128 bc = _mm_loadu_ps(b[i][c]);
+            r[c] = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(0,0,0,0))),
+                           _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(1,1,1,1)))),
+                _mm_add_ps(_mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(2,2,2,2))),
+                           _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(3,3,3,3)))));
+        }
+        for(int c = 0; c<4; ++c){
+            _mm_storeu_ps(out[i][c], r[c]);
+        }
+    }
+}
+
+static uint32_t spheres_in_frustum_sse(vec4 planes[6], SphereSoa spheres, uint8_t* visible, uint32_t count){
+    __m128 P[6][4];
+    for(int p = 0; p<6; ++p){
+        for(int k = 0; k<4; ++k){
+            P[p][k] = _mm_set1_ps(planes[p][k]);
+        }
+    }
+
+    uint32_t visibleCount = 0;
+    uint32_t i = 0;
+    for(; i+4<=count; i+=4){
+        __m128 x = _mm_loadu_ps(spheres.x+i), y = _mm_loadu_ps(spheres.y+i), z = _mm_loadu_ps(spheres.z+i);
+        __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius+i));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int p = 0; p<6; ++p){
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(P[p][0], x), _mm_mul_ps(P[p][1], y)), _mm_add_ps(_mm_mul_ps(P[p][2], z), P[p][3]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for(int k = 0; k<4; ++k){
+            visible[i+k] = (uint8_t)((mask >> k) & 1);
+        }
+        visibleCount += (uint32_t)((mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1));
+    }
+    SphereSoa tail = {spheres.x+i, spheres.y+i, spheres.z+i, spheres.radius+i};
+    return visibleCount + spheres_in_frustum_scalar(planes, tail, visible+i, count-i);
+}
+
+static void verlet_integrate_sse(Vec3Soa position, Vec3Soa previous, const float* inverseMass, vec3 step, float damping, uint32_t count){
+    const __m128 d = _mm_set1_ps(damping);
+    const __m128 sx = _mm_set1_ps(step[0]), sy = _mm_set1_ps(step[1]), sz = _mm_set1_ps(step[2]);
+    uint32_t i = 0;
+    for(; i+4<=count; i+=4){
+        __m128 movable = _mm_cmpgt_ps(_mm_loadu_ps(inverseMass+i), _mm_setzero_ps());
+        __m128 x = _mm_loadu_ps(position.x+i), y = _mm_loadu_ps(position.y+i), z = _mm_loadu_ps(position.z+i);
+        __m128 dx = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, _mm_loadu_ps(previous.x+i)), d), sx);
+        __m128 dy = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(y, _mm_loadu_ps(previous.y+i)), d), sy);
+        __m128 dz = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(z, _mm_loadu_ps(previous.z+i)), d), sz);
+        _mm_storeu_ps(previous.x+i, x);
+        _mm_storeu_ps(previous.y+i, y);
+        _mm_storeu_ps(previous.z+i, z);
+        _mm_storeu_ps(position.x+i, _mm_add_ps(x, _mm_and_ps(movable, dx)));
+        _mm_storeu_ps(position.y+i, _mm_add_ps(y, _mm_and_ps(movable, dy)));
+        _mm_storeu_ps(position.z+i, _mm_add_ps(z, _mm_and_ps(movable, dz)));
+    }
+    Vec3Soa tailPosition = {position.x+i, position.y+i, position.z+i};
+    Vec3Soa tailPrevious = {previous.x+i, previous.y+i, previous.z+i};
+    verlet_integrate_scalar(tailPosition, tailPrevious, inverseMass+i, step, damping, count-i);
+}
+
+// ---------------------------------------------------------
+// Dispatch
+// ---------------------------------------------------------
+static const BatchKernels kernelTable[BATCH_ISA_COUNT] = {
+    {transform_scalar, transform_aabbs_scalar, project_scalar, mat4_mul_scalar, spheres_in_frustum_scalar, verlet_integrate_scalar,
+     verlet_integrate_half_scalar, verlet_velocity_half_scalar},
+    {transform_sse, transform_aabbs_sse, project_sse, mat4_mul_sse, spheres_in_frustum_sse, verlet_integrate_sse,
+     verlet_integrate_half_scalar, verlet_velocity_half_scalar},
+    {batch_transform_avx2, batch_transform_aabbs_avx2, batch_project_points_avx2, batch_mat4_mul_avx2, batch_spheres_in_frustum_avx2, batch_verlet_integrate_avx2,
+     batch_verlet_integrate_half_avx2, batch_verlet_velocity_half_avx2},
+};
+
+static const BatchKernels* kernels;
+static BatchIsa currentIsa;
+
+void batch_init(void){
+    currentIsa = cpu_has_avx2() ? BATCH_ISA_AVX2 : BATCH_ISA_SSE;
+    kernels = &kernelTable[currentIsa];
+}
+
+int batch_set_isa(BatchIsa isa){
+    if(isa == BATCH_ISA_AVX2 && !cpu_has_avx2()){
+        return 0;
+    }
+    currentIsa = isa;
+    kernels = &kernelTable[isa];
+    return 1;
+}
+
+BatchIsa batch_isa(void){
+    if(!kernels){
+        batch_init();
+    }
+    return currentIsa;
+}
+
+const char* batch_isa_name(BatchIsa isa){
+    static const char* names[BATCH_ISA_COUNT] = {"scalar", "sse", "avx2"};
+    return names[isa];
+}
+
+static const BatchKernels* batch_kernels(void){
+    if(!kernels){
+        batch_init();
+    }
+    return kernels;
+}
+
+void batch_transform_points(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count){
+    batch_kernels()->transform(m, in, out, count, 1.0f);
+}
+
+void batch_transform_vectors(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count){
+    batch_kernels()->transform(m, in, out, count, 0.0f);
+}
+
+void batch_transform_aabbs(mat4 m, AabbSoa in, AabbSoa out, uint32_t count){
+    batch_kernels()->transformAabbs(m, in, out, count);
+}
+
+void batch_project_points(Vec3Soa in, const vec3 axis, float offset, float* out, uint32_t count){
+    batch_kernels()->project(in, axis, offset, out, count);
+}
+
+void batch_mat4_mul(mat4* a, mat4* b, mat4* out, uint32_t count){
+    batch_kernels()->mat4Mul(a, b, out, count);
+}
+
+uint32_t batch_spheres_in_frustum(vec4 planes[6], SphereSoa spheres, uint8_t* visible, uint32_t count){
+    return batch_kernels()->spheresInFrustum(planes, spheres, visible, count);
+}
+
+void batch_verlet_integrate(Vec3Soa position, Vec3Soa previous, const float* inverseMass, vec3 step, float damping, uint32_t count){
+    batch_kernels()->verletIntegrate(position, previous, inverseMass, step, damping, count);
+}
+
+void batch_verlet_integrate_half(Vec3Soa position, Vec3Soa start, Half3Soa velocity, const float* inverseMass, vec3 step, float damping, uint32_t count){
+    batch_kernels()->verletIntegrateHalf(position, start, velocity, inverseMass, step, damping, count);
+}
+
+void batch_verlet_velocity_half(Vec3Soa position, Vec3Soa start, Half3Soa velocity, uint32_t count){
+    batch_kernels()->verletVelocityHalf(position, start, velocity, count);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cglm/cglm.h>
+#include <stdint.h>
+
+// Batch math kernels over structure-of-arrays data.
+//
+// Each kernel has a scalar reference, an SSE version and an AVX2/FMA version
+// (batch_avx2.c); the widest one the CPU supports is picked at runtime.
+// In and out arrays may alias. Matrices follow cglm (column major).
+
+typedef enum {
+    BATCH_ISA_SCALAR,
+    BATCH_ISA_SSE,
+    BATCH_ISA_AVX2,
+    BATCH_ISA_COUNT
+} BatchIsa;
+
+typedef struct {
+    float* x;
+    float* y;
+    float* z;
+} Vec3Soa;
+
+// Half precision (IEEE fp16) bit patterns
+typedef struct {
+    uint16_t* x;
+    uint16_t* y;
+    uint16_t* z;
+} Half3Soa;
+
+typedef struct {
+    float* minX;
+    float* minY;
+    float* minZ;
+    float* maxX;
+    float* maxY;
+    float* maxZ;
+} AabbSoa;
+
+typedef struct {
+    float* x;
+    float* y;
+    float* z;
+    float* radius;
+} SphereSoa;
+
+// Picks the kernels for this CPU. Called on first use if nobody did earlier.
+void batch_init(void);
+// Benchmarks and tests pin an ISA; returns 0 if the CPU cannot run it.
+int batch_set_isa(BatchIsa isa);
+BatchIsa batch_isa(void);
+const char* batch_isa_name(BatchIsa isa);
+
+// out = m * (p, 1)
+void batch_transform_points(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count);
+// out = m * (v, 0)
+void batch_transform_vectors(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count);
+// Tight bounds of the transformed boxes (center/extent form, no corner loop)
+void batch_transform_aabbs(mat4 m, AabbSoa in, AabbSoa out, uint32_t count);
+// out[i] = dot(in[i], axis) + offset, e.g. the height along axis. Computed
+// as x*axis[0] + y*axis[1] + z*axis[2] + offset in that order without FMA,
+// so every ISA gives the same bits.
+void batch_project_points(Vec3Soa in, const vec3 axis, float offset, float* out, uint32_t count);
+// out[i] = a[i] * b[i]
+void batch_mat4_mul(mat4* a, mat4* b, mat4* out, uint32_t count);
+// Planes as produced by glm_frustum_planes. Writes 1 per visible sphere, returns the visible count.
+uint32_t batch_spheres_in_frustum(vec4 planes[6], SphereSoa spheres, uint8_t* visible, uint32_t count);
+// Position Verlet step: p' = p + (p - prev)*damping + step, prev = p. step is
+// acceleration*dt^2. Particles with zero inverse mass do not move.
+void batch_verlet_integrate(Vec3Soa position, Vec3Soa previous, const float* inverseMass, vec3 step, float damping, uint32_t count);
+// Same step with the velocity kept as the fp16 displacement v = p - prev:
+// start = p, p' = p + v*damping + step. Once the constraints are solved
+// batch_verlet_velocity_half stores v = p - start. The AVX2 kernels convert
+// with F16C, SSE uses the scalar ones.
+void batch_verlet_integrate_half(Vec3Soa position, Vec3Soa start, Half3Soa velocity, const float* inverseMass, vec3 step, float damping, uint32_t count);
+void batch_verlet_velocity_half(Vec3Soa position, Vec3Soa start, Half3Soa velocity, uint32_t count);
+
+// Round to nearest even, same results as F16C
+uint16_t batch_float_to_half(float value);
+float batch_half_to_float(uint16_t value);
@@ -0,0 +1,219 @@
+// AVX2/FMA kernels for batch.c. This file is compiled with AVX2 code generation
+// and must only be entered after the runtime check in batch_init().
+#include <immintrin.h>
+#include <math.h>
+#include "batch.h"
+
+// Lane mask for the last count%8 elements, used with maskload/maskstore for tails
+static __m256i tail_mask(uint32_t remaining){
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32((int)remaining), lanes);
+}
+
+static __m256 load8(const float* p, uint32_t remaining, __m256i mask){
+    return remaining >= 8 ? _mm256_loadu_ps(p) : _mm256_maskload_ps(p, mask);
+}
+
+static void store8(float* p, __m256 v, uint32_t remaining, __m256i mask){
+    if(remaining >= 8){
+        _mm256_storeu_ps(p, v);
+    } else {
+        _mm256_maskstore_ps(p, mask, v);
+    }
+}
+
+void batch_transform_avx2(mat4 m, Vec3Soa in, Vec3Soa out, uint32_t count, float w){
+    __m256 m00 = _mm256_set1_ps(m[0][0]), m10 = _mm256_set1_ps(m[1][0]), m20 = _mm256_set1_ps(m[2][0]), m30 = _mm256_set1_ps(m[3][0]*w);
+    __m256 m01 = _mm256_set1_ps(m[0][1]), m11 = _mm256_set1_ps(m[1][1]), m21 = _mm256_set1_ps(m[2][1]), m31 = _mm256_set1_ps(m[3][1]*w);
+    __m256 m02 = _mm256_set1_ps(m[0][2]), m12 = _mm256_set1_ps(m[1][2]), m22 = _mm256_set1_ps(m[2][2]), m32 = _mm256_set1_ps(m[3][2]*w);
+
+    for(uint32_t i = 0; i<count; i+=8){
+        uint32_t remaining = count - i;
+        __m256i mask = tail_mask(remaining);
+        __m256 x = load8(in.x+i, remaining, mask);
+        __m256 y = load8(in.y+i, remaining, mask);
+        __m256 z = load8(in.z+i, remaining, mask);
+        __m256 ox = _mm256_fmadd_ps(m00, x, _mm256_fmadd_ps(m10, y, _mm256_fmadd_ps(m20, z, m30)));
+        __m256 oy = _mm256_fmadd_ps(m01, x, _mm256_fmadd_ps(m11, y, _mm256_fmadd_ps(m21, z, m31)));
+        __m256 oz = _mm256_fmadd_ps(m02, x, _mm256_fmadd_ps(m12, y, _mm256_fmadd_ps(m22, z, m32)));
+        store8(out.x+i, ox, remaining, mask);
+        store8(out.y+i, oy, remaining, mask);
+        store8(out.z+i, oz, remaining, mask);
+    }
+}
+
+void batch_transform_aabbs_avx2(mat4 m, AabbSoa in, AabbSoa out, uint32_t count){
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 M[4][3], A[3][3];
+    for(int c = 0; c<4; ++c){
+        for(int r = 0; r<3; ++r){
+            M[c][r] = _mm256_set1_ps(m[c][r]);
+            if(c < 3){
+                A[c][r] = _mm256_and_ps(M[c][r], absMask);
+            }
+        }
+    }
+
+    for(uint32_t i = 0; i<count; i+=8){
+        uint32_t remaining = count - i;
+        __m256i mask = tail_mask(remaining);
+        __m256 mnx = load8(in.minX+i, remaining, mask), mxx = load8(in.maxX+i, remaining, mask);
+        __m256 mny = load8(in.minY+i, remaining, mask), mxy = load8(in.maxY+i, remaining, mask);
+        __m256 mnz = load8(in.minZ+i, remaining, mask), mxz = load8(in.maxZ+i, remaining, mask);
+        __m256 c[3] = {_mm256_mul_ps(_mm256_add_ps(mnx, mxx), half), _mm256_mul_ps(_mm256_add_ps(mny, mxy), half), _mm256_mul_ps(_mm256_add_ps(mnz, mxz), half)};
+        __m256 e[3] = {_mm256_mul_ps(_mm256_sub_ps(mxx, mnx), half), _mm256_mul_ps(_mm256_sub_ps(mxy, mny), half), _mm256_mul_ps(_mm256_sub_ps(mxz, mnz), half)};
+
+        __m256 nc[3], ne[3];
+        for(int r = 0; r<3; ++r){
+            nc[r] = _mm256_fmadd_ps(M[0][r], c[0], _mm256_fmadd_ps(M[1][r], c[1], _mm256_fmadd_ps(M[2][r], c[2], M[3][r])));
+            ne[r] = _mm256_fmadd_ps(A[0][r], e[0], _mm256_fmadd_ps(A[1][r], e[1], _mm256_mul_ps(A[2][r], e[2])));
+        }
+        store8(out.minX+i, _mm256_sub_ps(nc[0], ne[0]), remaining, mask);
+        store8(out.maxX+i, _mm256_add_ps(nc[0], ne[0]), remaining, mask);
+        store8(out.minY+i, _mm256_sub_ps(nc[1], ne[1]), remaining, mask);
+        store8(out.maxY+i, _mm256_add_ps(nc[1], ne[1]), remaining, mask);
+        store8(out.minZ+i, _mm256_sub_ps(nc[2], ne[2]), remaining, mask);
+        store8(out.maxZ+i, _mm256_add_ps(nc[2], ne[2]), remaining, mask);
+    }
+}
+
+// Separate multiplies and adds to match the scalar kernel, see CMakeLists.txt
+void batch_project_points_avx2(Vec3Soa in, const vec3 axis, float offset, float* out, uint32_t count){
+    const __m256 ax = _mm256_set1_ps(axis[0]), ay = _mm256_set1_ps(axis[1]), az = _mm256_set1_ps(axis[2]), o = _mm256_set1_ps(offset);
+    for(uint32_t i = 0; i<count; i+=8){
+        uint32_t remaining = count - i;
+        __m256i mask = tail_mask(remaining);
+        __m256 d = _mm256_add_ps(_mm256_mul_ps(load8(in.x+i, remaining, mask), ax), _mm256_mul_ps(load8(in.y+i, remaining, mask), ay));
+        d = _mm256_add_ps(d, _mm256_mul_ps(load8(in.z+i, remaining, mask), az));
+        store8(out+i, _mm256_add_ps(d, o), remaining, mask);
+    }
+}
+
+void batch_mat4_mul_avx2(mat4* a, mat4* b, mat4* out, uint32_t count){
+    // Two result columns per register: lane k of the low half uses b column c,
+    // the high half b column c+1, both combined with a's columns broadcast to both halves.
+    for(uint32_t i = 0; i<count; ++i){
+        __m256 a0 = _mm256_broadcast_ps((const __m128*)a[i][0]);
+        __m256 a1 = _mm256_broadcast_ps((const __m128*)a[i][1]);
+        __m256 a2 = _mm256_broadcast_ps((const __m128*)a[i][2]);
+        __m256 a3 = _mm256_broadcast_ps((const __m128*)a[i][3]);
+        __m256 b01 = _mm256_loadu_ps(b[i][0]);
+        __m256 b23 = _mm256_loadu_ps(b[i][2]);
+
+        __m256 r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, _MM_SHUFFLE(0,0,0,0)));
+        r01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, _MM_SHUFFLE(1,1,1,1)), r01);
+        r01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, _MM_SHUFFLE(2,2,2,2)), r01);
+        r01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, _MM_SHUFFLE(3,3,3,3)), r01);
+
+        __m256 r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, _MM_SHUFFLE(0,0,0,0)));
+        r23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, _MM_SHUFFLE(1,1,1,1)), r23);
+        r23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, _MM_SHUFFLE(2,2,2,2)), r23);
+        r23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, _MM_SHUFFLE(3,3,3,3)), r23);
+
+        _mm256_storeu_ps(out[i][0], r01);
+        _mm256_storeu_ps(out[i][2], r23);
+    }
+}
+
+uint32_t batch_spheres_in_frustum_avx2(vec4 planes[6], SphereSoa spheres, uint8_t* visible, uint32_t count){
+    __m256 P[6][4];
+    for(int p = 0; p<6; ++p){
+        for(int k = 0; k<4; ++k){
+            P[p][k] = _mm256_set1_ps(planes[p][k]);
+        }
+    }
+
+    uint32_t visibleCount = 0;
+    for(uint32_t i = 0; i<count; i+=8){
+        uint32_t remaining = count - i;
+        __m256i mask = tail_mask(remaining);
+        __m256 x = load8(spheres.x+i, remaining, mask);
+        __m256 y = load8(spheres.y+i, remaining, mask);
+        __m256 z = load8(spheres.z+i, remaining, mask);
+        __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), load8(spheres.radius+i, remaining, mask));
+        __m256 inside = _mm256_castsi256_ps(mask);
+        for(int p = 0; p<6; ++p){
+            __m256 d = _mm256_fmadd_ps(P[p][0], x, _mm256_fmadd_ps(P[p][1], y, _mm256_fmadd_ps(P[p][2], z, P[p][3])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+        }
+        int bits = _mm256_movemask_ps(inside);
+        uint32_t lanes = remaining < 8 ? remaining : 8;
+        for(uint32_t k = 0; k<lanes; ++k){
+            visible[i+k] = (uint8_t)((bits >> k) & 1);
+            visibleCount += visible[i+k];
+        }
+    }
+    return visibleCount;
+}
+
+void batch_verlet_integrate_avx2(Vec3Soa position, Vec3Soa previous, const float* inverseMass, vec3 step, float damping, uint32_t count){
+    const __m256 d = _mm256_set1_ps(damping);
+    const __m256 sx = _mm256_set1_ps(step[0]), sy = _mm256_set1_ps(step[1]), sz = _mm256_set1_ps(step[2]);
+    for(uint32_t i = 0; i<count; i+=8){
+        uint32_t remaining = count - i;
+        __m256i mask = tail_mask(remaining);
+        __m256 movable = _mm256_cmp_ps(load8(inverseMass+i, remaining, mask), _mm256_setzero_ps(), _CMP_GT_OQ);
+        __m256 x = load8(position.x+i, remaining, mask);
+        __m256 y = load8(position.y+i, remaining, mask);
+        __m256 z = load8(position.z+i, remaining, mask);
+        __m256 dx = _mm256_fmadd_ps(_mm256_sub_ps(x, load8(previous.x+i, remaining, mask)), d, sx);
+        __m256 dy = _mm256_fmadd_ps(_mm256_sub_ps(y, load8(previous.y+i, remaining, mask)), d, sy);
+        __m256 dz = _mm256_fmadd_ps(_mm256_sub_ps(z, load8(previous.z+i, remaining, mask)), d, sz);
+        store8(previous.x+i, x, remaining, mask);
+        store8(previous.y+i, y, remaining, mask);
+        store8(previous.z+i, z, remaining, mask);
+        store8(position.x+i, _mm256_add_ps(x, _mm256_and_ps(movable, dx)), remaining, mask);
+        store8(position.y+i, _mm256_add_ps(y, _mm256_and_ps(movable, dy)), remaining, mask);
+        store8(position.z+i, _mm256_add_ps(z, _mm256_and_ps(movable, dz)), remaining, mask);
+    }
+}
+
+void batch_verlet_integrate_half_avx2(Vec3Soa position, Vec3Soa start, Half3Soa velocity, const float* inverseMass, vec3 step, float damping, uint32_t count){
+    const __m256 d = _mm256_set1_ps(damping);
+    const __m256 sx = _mm256_set1_ps(step[0]), sy = _mm256_set1_ps(step[1]), sz = _mm256_set1_ps(step[2]);
+    uint32_t i = 0;
+    for(; i+8<=count; i+=8){
+        __m256 movable = _mm256_cmp_ps(_mm256_loadu_ps(inverseMass+i), _mm256_setzero_ps(), _CMP_GT_OQ);
+        __m256 x = _mm256_loadu_ps(position.x+i), y = _mm256_loadu_ps(position.y+i), z = _mm256_loadu_ps(position.z+i);
+        __m256 vx = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(velocity.x+i)));
+        __m256 vy = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(velocity.y+i)));
+        __m256 vz = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(velocity.z+i)));
+        _mm256_storeu_ps(start.x+i, x);
+        _mm256_storeu_ps(start.y+i, y);
+        _mm256_storeu_ps(start.z+i, z);
+        _mm256_storeu_ps(position.x+i, _mm256_add_ps(x, _mm256_and_ps(movable, _mm256_fmadd_ps(vx, d, sx))));
+        _mm256_storeu_ps(position.y+i, _mm256_add_ps(y, _mm256_and_ps(movable, _mm256_fmadd_ps(vy, d, sy))));
+        _mm256_storeu_ps(position.z+i, _mm256_add_ps(z, _mm256_and_ps(movable, _mm256_fmadd_ps(vz, d, sz))));
+    }
+    // Tail with the same FMA, converted one by one
+    for(; i<count; ++i){
+        float x = position.x[i], y = position.y[i], z = position.z[i];
+        start.x[i] = x;
+        start.y[i] = y;
+        start.z[i] = z;
+        if(inverseMass[i] <= 0.0f){
+            continue;
+        }
+        position.x[i] = x + fmaf(batch_half_to_float(velocity.x[i]), damping, step[0]);
+        position.y[i] = y + fmaf(batch_half_to_float(velocity.y[i]), damping, step[1]);
+        position.z[i] = z + fmaf(batch_half_to_float(velocity.z[i]), damping, step[2]);
+    }
+}
+
+void batch_verlet_velocity_half_avx2(Vec3Soa position, Vec3Soa start, Half3Soa velocity, uint32_t count){
+    uint32_t i = 0;
+    for(; i+8<=count; i+=8){
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(position.x+i), _mm256_loadu_ps(start.x+i));
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(position.y+i), _mm256_loadu_ps(start.y+i));
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(position.z+i), _mm256_loadu_ps(start.z+i));
+        _mm_storeu_si128((__m128i*)(velocity.x+i), _mm256_cvtps_ph(dx, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storeu_si128((__m128i*)(velocity.y+i), _mm256_cvtps_ph(dy, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storeu_si128((__m128i*)(velocity.z+i), _mm256_cvtps_ph(dz, _MM_FROUND_TO_NEAREST_INT));
+    }
+    for(; i<count; ++i){
+        velocity.x[i] = batch_float_to_half(position.x[i] - start.x[i]);
+        velocity.y[i] = batch_float_to_half(position.y[i] - start.y[i]);
+        velocity.z[i] = batch_float_to_half(position.z[i] - start.z[i]);
+    }
+}
@@ -0,0 +1,969 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "bvh.h"
+#include "job.h"
+#include "memory.h"
+#include "platform.h"
+
+#define BVH_BINS        16
+#define BVH_STACK       512
+#define BVH_SAH_DEPTH   40      // deeper splits are at the median, which bounds the depth
+#define BVH_MAX_TOP     4096    // binary nodes split on the calling thread
+#define BVH_BUILD_GRAIN 4096
+#define BVH_LEAF_COST   0.5f    // per triangle relative to a node visit, the AVX2 leaf test takes 8 at once
+
+// Defined in bvh_avx2.c, built with AVX2 code generation
+int bvh_raycast_avx2(const Bvh* bvh, Vec3Soa positions, const vec3 origin, const vec3 direction, float maxT, BvhHit* hit);
+uint32_t bvh_raycast_packet_avx2(const Bvh* bvh, Vec3Soa positions, const BvhPacket* packet, BvhHit* hits);
+int bvh_closest_point_avx2(const Bvh* bvh, Vec3Soa positions, const vec3 point, float maxDistance, BvhClosest* closest);
+void bvh_refit_avx2(Bvh* bvh, Vec3Soa positions, uint32_t begin, uint32_t end);
+
+// Triangle being sorted into the tree, moved along by the partitions. The
+// bounds are loaded as SSE vectors, lane 3 is ignored.
+typedef struct {
+    float lo[3];
+    uint32_t triangle;  // BVH_NONE if it is left out
+    float hi[3];
+    float pad;
+} BvhPrim;
+
+// Binary tree of the build, collapsed into wide nodes afterwards
+typedef struct {
+    uint32_t left;
+    uint32_t right;
+    uint32_t first;     // first slot of the node's range
+    uint32_t count;     // triangles of a leaf, 0 for inner nodes
+    float area;         // surface area, guides the collapse
+} BvhBuildNode;
+
+typedef struct {
+    uint32_t begin;
+    uint32_t end;
+    uint32_t depth;
+    uint32_t parent;    // binary node to link to, BVH_NONE for the root
+    int right;
+} BvhTask;
+
+// Binary node waiting to become the wide node at child lane of parent
+typedef struct {
+    uint32_t source;
+    uint32_t parent;
+    uint32_t lane;
+} BvhCollapse;
+
+typedef struct {
+    Vec3Soa positions;
+    const uint32_t* indices;
+    BvhPrim* prims;             // per slot, partitioned by the splits
+    BvhBuildNode* nodes;        // subtree of [begin, end) at 2*begin, top nodes after 2*count
+    uint32_t count;
+    BvhTask* subtrees;
+    uint32_t subtreeCount;
+} BvhBuild;
+
+// Everything a subtree rebuild needs, sized for the largest subtree
+struct BvhScratch {
+    BvhBuild build;
+    BvhCollapse* stack;
+    BvhNode* nodes;
+    uint32_t* indices;
+    uint32_t* triangleId;
+};
+
+typedef struct {
+    Bvh* bvh;
+    Vec3Soa positions;
+    int measure;            // the subtree costs, for rebuilds
+} BvhRefit;
+
+static inline float bvh_area(const float* lo, const float* hi){
+    float dx = hi[0]-lo[0], dy = hi[1]-lo[1], dz = hi[2]-lo[2];
+    return dx < 0.0f ? 0.0f : 2.0f*(dx*dy + dy*dz + dz*dx);
+}
+
+static void bvh_triangle_bounds_range(void* data, uint32_t begin, uint32_t end){
+    BvhBuild* build = (BvhBuild*)data;
+    const float* axis[3] = {build->positions.x, build->positions.y, build->positions.z};
+    for(uint32_t t = begin; t<end; ++t){
+        const uint32_t* v = build->indices + 3*t;
+        BvhPrim* prim = &build->prims[t];
+        int valid = v[0] != BVH_NONE && v[1] != BVH_NONE && v[2] != BVH_NONE && v[0] != v[1] && v[1] != v[2] && v[0] != v[2];
+        prim->triangle = valid ? t : BVH_NONE;
+        if(!valid){
+            continue;
+        }
+        for(int k = 0; k<3; ++k){
+            float a = axis[k][v[0]], b = axis[k][v[1]], c = axis[k][v[2]];
+            float lo = a < b ? a : b, hi = a < b ? b : a;
+            prim->lo[k] = c < lo ? c : lo;
+            prim->hi[k] = c > hi ? c : hi;
+        }
+    }
+}
+
+// Splits [begin, end) at the cheapest of BVH_BINS planes per axis. Returns
+// the first slot of the right half, or begin to make a leaf.
+static uint32_t bvh_split(BvhBuild* build, uint32_t begin, uint32_t end, uint32_t depth, float* area){
+    uint32_t count = end - begin;
+    BvhPrim* prims = build->prims;
+    // Centroids are kept doubled, lo + hi
+    __m128 lo = _mm_set1_ps(FLT_MAX), hi = _mm_set1_ps(-FLT_MAX);
+    __m128 clo = lo, chi = hi;
+    for(uint32_t i = begin; i<end; ++i){
+        __m128 plo = _mm_loadu_ps(prims[i].lo), phi = _mm_loadu_ps(prims[i].hi);
+        __m128 c = _mm_add_ps(plo, phi);
+        lo = _mm_min_ps(lo, plo);
+        hi = _mm_max_ps(hi, phi);
+        clo = _mm_min_ps(clo, c);
+        chi = _mm_max_ps(chi, c);
+    }
+    float box[2][4];
+    _mm_storeu_ps(box[0], lo);
+    _mm_storeu_ps(box[1], hi);
+    *area = bvh_area(box[0], box[1]);
+    if(count <= 2){
+        return begin;
+    }
+
+    int bestAxis = -1;
+    uint32_t bestBin = 0;
+    float bestCost = FLT_MAX;
+    float cmin[4], cmax[4], scale[4];
+    _mm_storeu_ps(cmin, clo);
+    _mm_storeu_ps(cmax, chi);
+    for(int k = 0; k<3; ++k){
+        scale[k] = cmax[k] > cmin[k] ? BVH_BINS/(cmax[k] - cmin[k]) : 0.0f;
+    }
+    scale[3] = 0.0f;
+    __m128 scale4 = _mm_loadu_ps(scale);
+    if(depth < BVH_SAH_DEPTH){
+        // All three axes binned in one pass over the range
+        uint32_t binCount[3][BVH_BINS];
+        __m128 binLo[3][BVH_BINS], binHi[3][BVH_BINS];
+        for(int k = 0; k<3; ++k){
+            for(int b = 0; b<BVH_BINS; ++b){
+                binCount[k][b] = 0;
+                binLo[k][b] = _mm_set1_ps(FLT_MAX);
+                binHi[k][b] = _mm_set1_ps(-FLT_MAX);
+            }
+        }
+        for(uint32_t i = begin; i<end; ++i){
+            __m128 plo = _mm_loadu_ps(prims[i].lo), phi = _mm_loadu_ps(prims[i].hi);
+            int bin[4];
+            _mm_storeu_si128((__m128i*)bin, _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(plo, phi), clo), scale4)));
+            for(int k = 0; k<3; ++k){
+                int b = bin[k] < BVH_BINS ? bin[k] : BVH_BINS-1;
+                binCount[k][b]++;
+                binLo[k][b] = _mm_min_ps(binLo[k][b], plo);
+                binHi[k][b] = _mm_max_ps(binHi[k][b], phi);
+            }
+        }
+        for(int k = 0; k<3; ++k){
+            if(cmax[k] <= cmin[k]){
+                continue;
+            }
+            // Areas and counts left of every plane, then sweep from the right
+            float leftArea[BVH_BINS];
+            uint32_t leftCount[BVH_BINS];
+            __m128 accLo = _mm_set1_ps(FLT_MAX), accHi = _mm_set1_ps(-FLT_MAX);
+            uint32_t acc = 0;
+            for(int b = 0; b<BVH_BINS-1; ++b){
+                accLo = _mm_min_ps(accLo, binLo[k][b]);
+                accHi = _mm_max_ps(accHi, binHi[k][b]);
+                acc += binCount[k][b];
+                _mm_storeu_ps(box[0], accLo);
+                _mm_storeu_ps(box[1], accHi);
+                leftArea[b] = bvh_area(box[0], box[1]);
+                leftCount[b] = acc;
+            }
+            accLo = _mm_set1_ps(FLT_MAX);
+            accHi = _mm_set1_ps(-FLT_MAX);
+            acc = 0;
+            for(int b = BVH_BINS-1; b>0; --b){
+                accLo = _mm_min_ps(accLo, binLo[k][b]);
+                accHi = _mm_max_ps(accHi, binHi[k][b]);
+                acc += binCount[k][b];
+                if(acc == 0 || leftCount[b-1] == 0){
+                    continue;
+                }
+                _mm_storeu_ps(box[0], accLo);
+                _mm_storeu_ps(box[1], accHi);
+                float cost = leftArea[b-1]*leftCount[b-1] + bvh_area(box[0], box[1])*acc;
+                if(cost < bestCost){
+                    bestCost = cost;
+                    bestAxis = k;
+                    bestBin = (uint32_t)b;
+                }
+            }
+        }
+    }
+
+    float leafCost = BVH_LEAF_COST*count;
+    float splitCost = *area > 0.0f ? 1.0f + bestCost / *area : FLT_MAX;
+    if(count <= BVH_MAX_LEAF && (bestAxis < 0 || leafCost <= splitCost)){
+        return begin;
+    }
+    uint32_t mid = begin;
+    if(bestAxis >= 0){
+        int k = bestAxis;
+        uint32_t j = end;
+        while(mid < j){
+            int b = (int)((prims[mid].lo[k] + prims[mid].hi[k] - cmin[k])*scale[k]);
+            b = b < BVH_BINS ? b : BVH_BINS-1;
+            if((uint32_t)b < bestBin){
+                mid++;
+            } else {
+                BvhPrim prim = prims[mid];
+                prims[mid] = prims[--j];
+                prims[j] = prim;
+            }
+        }
+    }
+    // Deep, degenerate, or all centroids in one spot: halve in slot order
+    if(mid == begin || mid == end){
+        mid = begin + count/2;
+    }
+    return mid;
+}
+
+static void bvh_link(BvhBuild* build, const BvhTask* task, uint32_t index){
+    if(task->parent == BVH_NONE){
+        return;
+    }
+    if(task->right){
+        build->nodes[task->parent].right = index;
+    } else {
+        build->nodes[task->parent].left = index;
+    }
+}
+
+// Whole subtree of [begin, end), its nodes from 2*begin on
+static void bvh_build_subtree(BvhBuild* build, const BvhTask* root){
+    BvhTask stack[BVH_STACK];
+    uint32_t top = 0, next = 2*root->begin;
+    stack[top++] = *root;
+    while(top > 0){
+        BvhTask task = stack[--top];
+        uint32_t index = next++;
+        bvh_link(build, &task, index);
+        BvhBuildNode* node = &build->nodes[index];
+        uint32_t mid = bvh_split(build, task.begin, task.end, task.depth, &node->area);
+        node->first = task.begin;
+        if(mid == task.begin){
+            node->count = task.end - task.begin;
+            continue;
+        }
+        node->count = 0;
+        stack[top++] = (BvhTask){mid, task.end, task.depth+1, index, 1};
+        stack[top++] = (BvhTask){task.begin, mid, task.depth+1, index, 0};
+    }
+}
+
+static void bvh_subtrees_range(void* data, uint32_t begin, uint32_t end){
+    BvhBuild* build = (BvhBuild*)data;
+    for(uint32_t i = begin; i<end; ++i){
+        bvh_build_subtree(build, &build->subtrees[i]);
+    }
+}
+
+// Wide node for binary node b: its children, then the largest inner child
+// opened up until there are BVH_WIDTH of them. They end up in slot order.
+static void bvh_collapse_node(const BvhBuild* build, uint32_t b, uint32_t* lanes, uint32_t* laneCount){
+    const BvhBuildNode* nodes = build->nodes;
+    if(nodes[b].count > 0){
+        lanes[0] = b;
+        *laneCount = 1;
+        return;
+    }
+    lanes[0] = nodes[b].left;
+    lanes[1] = nodes[b].right;
+    *laneCount = 2;
+    while(*laneCount < BVH_WIDTH){
+        int open = -1;
+        float largest = -1.0f;
+        for(uint32_t i = 0; i<*laneCount; ++i){
+            if(nodes[lanes[i]].count == 0 && nodes[lanes[i]].area > largest){
+                largest = nodes[lanes[i]].area;
+                open = (int)i;
+            }
+        }
+        if(open < 0){
+            break;
+        }
+        uint32_t inner = lanes[open];
+        lanes[open] = nodes[inner].left;
+        lanes[(*laneCount)++] = nodes[inner].right;
+    }
+    for(uint32_t i = 1; i<*laneCount; ++i){
+        uint32_t lane = lanes[i], j = i;
+        for(; j>0 && nodes[lanes[j-1]].first > nodes[lane].first; --j){
+            lanes[j] = lanes[j-1];
+        }
+        lanes[j] = lane;
+    }
+}
+
+static void bvh_build_alloc(BvhBuild* build, uint32_t capacity){
+    memset(build, 0, sizeof(*build));
+    build->prims = (BvhPrim*)mem_alloc(MEM_TAG_PHYSICS, (capacity+1)*sizeof(BvhPrim));
+    build->nodes = (BvhBuildNode*)mem_alloc(MEM_TAG_PHYSICS, (2*capacity + BVH_MAX_TOP + 1)*sizeof(BvhBuildNode));
+}
+
+static void bvh_build_release(BvhBuild* build){
+    mem_free(build->prims);
+    mem_free(build->nodes);
+    mem_free(build->subtrees);
+}
+
+static void bvh_empty_node(BvhNode* node){
+    memset(node, 0, sizeof(*node));
+    for(uint32_t i = 0; i<BVH_WIDTH; ++i){
+        node->minX[i] = node->minY[i] = node->minZ[i] = FLT_MAX;
+        node->maxX[i] = node->maxY[i] = node->maxZ[i] = -FLT_MAX;
+    }
+}
+
+// Collapses the binary tree under root depth first into nodes, numbered from
+// base on, with leaf slots offset by slot. Returns how many wide nodes it
+// took, or BVH_NONE if they do not fit and grow is not set.
+static uint32_t bvh_collapse(const BvhBuild* build, BvhCollapse* stack, uint32_t root, uint32_t slot, uint32_t base,
+                             BvhNode** nodes, uint32_t* capacity, int grow){
+    uint32_t top = 0, count = 0;
+    stack[top++] = (BvhCollapse){root, BVH_NONE, 0};
+    while(top > 0){
+        BvhCollapse item = stack[--top];
+        if(count == *capacity){
+            if(!grow){
+                return BVH_NONE;
+            }
+            *capacity *= 2;
+            *nodes = (BvhNode*)mem_realloc(MEM_TAG_PHYSICS, *nodes, *capacity*sizeof(BvhNode));
+        }
+        uint32_t n = count++;
+        if(item.parent != BVH_NONE){
+            (*nodes)[item.parent].child[item.lane] = base + n;
+        }
+        uint32_t lanes[BVH_WIDTH], laneCount;
+        bvh_collapse_node(build, item.source, lanes, &laneCount);
+        BvhNode* node = &(*nodes)[n];
+        bvh_empty_node(node);
+        node->childCount = laneCount;
+        for(uint32_t i = laneCount; i-- > 0; ){
+            const BvhBuildNode* child = &build->nodes[lanes[i]];
+            if(child->count > 0){
+                node->child[i] = BVH_LEAF | (slot + child->first);
+                node->count[i] = (uint8_t)child->count;
+            } else {
+                stack[top++] = (BvhCollapse){lanes[i], n, i};
+            }
+        }
+    }
+    return count;
+}
+
+// Cost of nodes [root, end) relative to the box of root: every child box is
+// tested when its parent is visited, and a leaf's triangles when it is entered
+static float bvh_subtree_cost(const Bvh* bvh, uint32_t root, uint32_t end){
+    const BvhNode* node = &bvh->nodes[root];
+    float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for(uint32_t c = 0; c<node->childCount; ++c){
+        lo[0] = node->minX[c] < lo[0] ? node->minX[c] : lo[0];
+        lo[1] = node->minY[c] < lo[1] ? node->minY[c] : lo[1];
+        lo[2] = node->minZ[c] < lo[2] ? node->minZ[c] : lo[2];
+        hi[0] = node->maxX[c] > hi[0] ? node->maxX[c] : hi[0];
+        hi[1] = node->maxY[c] > hi[1] ? node->maxY[c] : hi[1];
+        hi[2] = node->maxZ[c] > hi[2] ? node->maxZ[c] : hi[2];
+    }
+    float rootArea = bvh_area(lo, hi);
+    if(rootArea <= 0.0f){
+        return 0.0f;
+    }
+    double cost = 1.0;
+    for(uint32_t n = root; n<end; ++n){
+        node = &bvh->nodes[n];
+        for(uint32_t c = 0; c<node->childCount; ++c){
+            float clo[3] = {node->minX[c], node->minY[c], node->minZ[c]}, chi[3] = {node->maxX[c], node->maxY[c], node->maxZ[c]};
+            float area = bvh_area(clo, chi);
+            cost += (node->child[c] & BVH_LEAF) ? BVH_LEAF_COST*area*node->count[c]/rootArea : area/rootArea;
+        }
+    }
+    return (float)cost;
+}
+
+// Splits the tree into the refit jobs: nodes BVH_REFIT_DEPTH levels down
+// are subtree roots, the ones above go to top in depth first order
+static void bvh_find_subtrees(Bvh* bvh){
+    uint32_t topMax = 0, level = 1;
+    for(int d = 0; d<BVH_REFIT_DEPTH; ++d){
+        topMax += level;
+        level *= BVH_WIDTH;
+    }
+    bvh->top = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (topMax+1)*sizeof(uint32_t));
+    bvh->subtrees = (BvhSubtree*)mem_alloc(MEM_TAG_PHYSICS, (level+1)*sizeof(BvhSubtree));
+    bvh->degraded = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (level+1)*sizeof(uint32_t));
+    if(bvh->nodeCount == 0){
+        return;
+    }
+    // The last inner child ends where its parent does
+    uint32_t* end = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, bvh->nodeCount*sizeof(uint32_t));
+    for(uint32_t n = bvh->nodeCount; n-- > 0; ){
+        end[n] = n + 1;
+        const BvhNode* node = &bvh->nodes[n];
+        for(uint32_t c = 0; c<node->childCount; ++c){
+            if(!(node->child[c] & BVH_LEAF) && end[node->child[c]] > end[n]){
+                end[n] = end[node->child[c]];
+            }
+        }
+    }
+    uint32_t stack[BVH_STACK][2];
+    uint32_t top = 0;
+    stack[top][0] = 0;
+    stack[top++][1] = 0;
+    while(top > 0){
+        --top;
+        uint32_t n = stack[top][0], depth = stack[top][1];
+        const BvhNode* node = &bvh->nodes[n];
+        if(depth == BVH_REFIT_DEPTH){
+            BvhSubtree* subtree = &bvh->subtrees[bvh->subtreeCount++];
+            memset(subtree, 0, sizeof(*subtree));
+            subtree->root = n;
+            subtree->end = end[n];
+            subtree->first = UINT32_MAX;
+            for(uint32_t i = n; i<end[n]; ++i){
+                for(uint32_t c = 0; c<bvh->nodes[i].childCount; ++c){
+                    uint32_t child = bvh->nodes[i].child[c];
+                    if(child & BVH_LEAF){
+                        subtree->first = (child & ~BVH_LEAF) < subtree->first ? (child & ~BVH_LEAF) : subtree->first;
+                        subtree->count += bvh->nodes[i].count[c];
+                    }
+                }
+            }
+            continue;
+        }
+        bvh->top[bvh->topCount++] = n;
+        for(uint32_t c = node->childCount; c-- > 0; ){
+            if(!(node->child[c] & BVH_LEAF)){
+                stack[top][0] = node->child[c];
+                stack[top++][1] = depth + 1;
+            }
+        }
+    }
+    mem_free(end);
+}
+
+void bvh_build(Bvh* bvh, Vec3Soa positions, const uint32_t* indices, uint32_t triangleCount){
+    memset(bvh, 0, sizeof(*bvh));
+    BvhBuild build;
+    bvh_build_alloc(&build, triangleCount);
+    build.positions = positions;
+    build.indices = indices;
+    parallel_for(&build, triangleCount, BVH_BUILD_GRAIN, bvh_triangle_bounds_range);
+    for(uint32_t t = 0; t<triangleCount; ++t){
+        if(build.prims[t].triangle != BVH_NONE){
+            build.prims[build.count++] = build.prims[t];
+        }
+    }
+    uint32_t count = build.count;
+    build.subtrees = (BvhTask*)mem_alloc(MEM_TAG_PHYSICS, (2*BVH_MAX_TOP + 2)*sizeof(BvhTask));
+
+    // Top levels here until every range is small enough to be one job
+    uint32_t root = BVH_NONE;
+    if(count > 0){
+        uint32_t jobSize = count/(8*job_thread_count());
+        jobSize = jobSize > BVH_BUILD_GRAIN ? jobSize : BVH_BUILD_GRAIN;
+        BvhTask stack[BVH_STACK];
+        uint32_t top = 0, topNodes = 0;
+        stack[top++] = (BvhTask){0, count, 0, BVH_NONE, 0};
+        while(top > 0){
+            BvhTask task = stack[--top];
+            if(task.end - task.begin <= jobSize || topNodes == BVH_MAX_TOP){
+                bvh_link(&build, &task, 2*task.begin);
+                build.subtrees[build.subtreeCount++] = (BvhTask){task.begin, task.end, task.depth, BVH_NONE, 0};
+                root = root == BVH_NONE ? 2*task.begin : root;
+                continue;
+            }
+            uint32_t index = 2*count + topNodes++;
+            bvh_link(&build, &task, index);
+            root = root == BVH_NONE ? index : root;
+            BvhBuildNode* node = &build.nodes[index];
+            uint32_t mid = bvh_split(&build, task.begin, task.end, task.depth, &node->area);
+            node->first = task.begin;
+            node->count = 0;
+            stack[top++] = (BvhTask){mid, task.end, task.depth+1, index, 1};
+            stack[top++] = (BvhTask){task.begin, mid, task.depth+1, index, 0};
+        }
+        parallel_for(&build, build.subtreeCount, 1, bvh_subtrees_range);
+    }
+
+    // Depth first, so children come after their parent and the leaves are
+    // in slot order: a backwards refit walks the triangles in order
+    uint32_t capacity = 64;
+    bvh->nodes = (BvhNode*)mem_alloc_aligned(MEM_TAG_PHYSICS, capacity*sizeof(BvhNode), 32);
+    if(root != BVH_NONE){
+        BvhCollapse* stack = (BvhCollapse*)mem_alloc(MEM_TAG_PHYSICS, (count+1)*sizeof(BvhCollapse));
+        bvh->nodeCount = bvh_collapse(&build, stack, root, 0, 0, &bvh->nodes, &capacity, 1);
+        mem_free(stack);
+    }
+
+    bvh->triangleCount = count;
+    bvh->indices = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (3*count+1)*sizeof(uint32_t));
+    bvh->triangleId = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (count+1)*sizeof(uint32_t));
+    for(uint32_t i = 0; i<count; ++i){
+        bvh->triangleId[i] = build.prims[i].triangle;
+        memcpy(bvh->indices + 3*i, indices + 3*build.prims[i].triangle, 3*sizeof(uint32_t));
+    }
+    bvh_build_release(&build);
+
+    bvh_find_subtrees(bvh);
+    bvh_refit(bvh, positions);
+    for(uint32_t i = 0; i<bvh->subtreeCount; ++i){
+        BvhSubtree* subtree = &bvh->subtrees[i];
+        subtree->cost = bvh_subtree_cost(bvh, subtree->root, subtree->end);
+        subtree->refitCost = subtree->cost;
+    }
+    bvh->rebuildRatio = BVH_REBUILD_RATIO;
+    bvh->rebuildBudget = BVH_REBUILD_BUDGET;
+}
+
+void bvh_free(Bvh* bvh){
+    for(uint32_t i = 0; i<bvh->scratchCount; ++i){
+        BvhScratch* scratch = &bvh->scratch[i];
+        bvh_build_release(&scratch->build);
+        mem_free(scratch->stack);
+        mem_free(scratch->nodes);
+        mem_free(scratch->indices);
+        mem_free(scratch->triangleId);
+    }
+    mem_free(bvh->scratch);
+    mem_free(bvh->indices);
+    mem_free(bvh->triangleId);
+    mem_free(bvh->nodes);
+    mem_free(bvh->subtrees);
+    mem_free(bvh->degraded);
+    mem_free(bvh->top);
+    memset(bvh, 0, sizeof(*bvh));
+}
+
+static void bvh_scratch_alloc(Bvh* bvh, uint32_t threads){
+    uint32_t triangles = 0, nodes = 0;
+    for(uint32_t i = 0; i<bvh->subtreeCount; ++i){
+        const BvhSubtree* subtree = &bvh->subtrees[i];
+        triangles = subtree->count > triangles ? subtree->count : triangles;
+        nodes = subtree->end - subtree->root > nodes ? subtree->end - subtree->root : nodes;
+    }
+    bvh->scratch = (BvhScratch*)mem_realloc(MEM_TAG_PHYSICS, bvh->scratch, threads*sizeof(BvhScratch));
+    for(uint32_t i = bvh->scratchCount; i<threads; ++i){
+        BvhScratch* scratch = &bvh->scratch[i];
+        bvh_build_alloc(&scratch->build, triangles);
+        scratch->stack = (BvhCollapse*)mem_alloc(MEM_TAG_PHYSICS, (triangles+1)*sizeof(BvhCollapse));
+        scratch->nodes = (BvhNode*)mem_alloc_aligned(MEM_TAG_PHYSICS, (nodes+1)*sizeof(BvhNode), 32);
+        scratch->indices = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (3*triangles+1)*sizeof(uint32_t));
+        scratch->triangleId = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (triangles+1)*sizeof(uint32_t));
+    }
+    bvh->scratchCount = threads;
+}
+
+static void bvh_refit_nodes(Bvh* bvh, Vec3Soa positions, uint32_t begin, uint32_t end){
+    if(batch_isa() == BATCH_ISA_AVX2){
+        bvh_refit_avx2(bvh, positions, begin, end);
+        return;
+    }
+    for(uint32_t n = end; n-- > begin; ){
+        BvhNode* node = &bvh->nodes[n];
+        for(uint32_t c = 0; c<node->childCount; ++c){
+            float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+            if(node->child[c] & BVH_LEAF){
+                const uint32_t* v = bvh->indices + 3*(node->child[c] & ~BVH_LEAF);
+                for(uint32_t i = 0; i<3u*node->count[c]; ++i){
+                    float p[3] = {positions.x[v[i]], positions.y[v[i]], positions.z[v[i]]};
+                    for(int k = 0; k<3; ++k){
+                        lo[k] = p[k] < lo[k] ? p[k] : lo[k];
+                        hi[k] = p[k] > hi[k] ? p[k] : hi[k];
+                    }
+                }
+            } else {
+                const BvhNode* child = &bvh->nodes[node->child[c]];
+                for(uint32_t i = 0; i<child->childCount; ++i){
+                    lo[0] = child->minX[i] < lo[0] ? child->minX[i] : lo[0];
+                    lo[1] = child->minY[i] < lo[1] ? child->minY[i] : lo[1];
+                    lo[2] = child->minZ[i] < lo[2] ? child->minZ[i] : lo[2];
+                    hi[0] = child->maxX[i] > hi[0] ? child->maxX[i] : hi[0];
+                    hi[1] = child->maxY[i] > hi[1] ? child->maxY[i] : hi[1];
+                    hi[2] = child->maxZ[i] > hi[2] ? child->maxZ[i] : hi[2];
+                }
+            }
+            node->minX[c] = lo[0]; node->minY[c] = lo[1]; node->minZ[c] = lo[2];
+            node->maxX[c] = hi[0]; node->maxY[c] = hi[1]; node->maxZ[c] = hi[2];
+        }
+    }
+}
+
+// Binned SAH over the subtree's triangles, collapsed into its node range.
+// Nodes left over stay empty; if it needs more, the old subtree is kept.
+static void bvh_rebuild_subtree(Bvh* bvh, Vec3Soa positions, BvhSubtree* subtree, BvhScratch* scratch, float cost){
+    BvhBuild* build = &scratch->build;
+    build->positions = positions;
+    build->indices = bvh->indices + 3*subtree->first;
+    build->count = subtree->count;
+    bvh_triangle_bounds_range(build, 0, subtree->count);
+    BvhTask root = {0, subtree->count, 0, BVH_NONE, 0};
+    bvh_build_subtree(build, &root);
+    uint32_t capacity = subtree->end - subtree->root;
+    uint32_t count = bvh_collapse(build, scratch->stack, 0, subtree->first, subtree->root, &scratch->nodes, &capacity, 0);
+    if(count == BVH_NONE){
+        // Not retried until it degrades by the ratio again
+        subtree->cost = cost;
+        return;
+    }
+    memcpy(bvh->nodes + subtree->root, scratch->nodes, count*sizeof(BvhNode));
+    for(uint32_t n = subtree->root + count; n<subtree->end; ++n){
+        bvh_empty_node(&bvh->nodes[n]);
+    }
+    for(uint32_t i = 0; i<subtree->count; ++i){
+        uint32_t slot = build->prims[i].triangle;
+        memcpy(scratch->indices + 3*i, build->indices + 3*slot, 3*sizeof(uint32_t));
+        scratch->triangleId[i] = bvh->triangleId[subtree->first + slot];
+    }
+    memcpy(bvh->indices + 3*subtree->first, scratch->indices, 3*subtree->count*sizeof(uint32_t));
+    memcpy(bvh->triangleId + subtree->first, scratch->triangleId, subtree->count*sizeof(uint32_t));
+    bvh_refit_nodes(bvh, positions, subtree->root, subtree->end);
+    subtree->cost = bvh_subtree_cost(bvh, subtree->root, subtree->end);
+    subtree->rebuilt = 1;
+}
+
+static void bvh_refit_range(void* data, uint32_t begin, uint32_t end){
+    BvhRefit* refit = (BvhRefit*)data;
+    Bvh* bvh = refit->bvh;
+    for(uint32_t i = begin; i<end; ++i){
+        BvhSubtree* subtree = &bvh->subtrees[i];
+        subtree->rebuilt = 0;
+        bvh_refit_nodes(bvh, refit->positions, subtree->root, subtree->end);
+        if(refit->measure){
+            subtree->refitCost = bvh_subtree_cost(bvh, subtree->root, subtree->end);
+        }
+    }
+}
+
+static void bvh_measure_range(void* data, uint32_t begin, uint32_t end){
+    Bvh* bvh = ((BvhRefit*)data)->bvh;
+    for(uint32_t i = begin; i<end; ++i){
+        BvhSubtree* subtree = &bvh->subtrees[i];
+        subtree->rebuilt = 0;
+        subtree->refitCost = bvh_subtree_cost(bvh, subtree->root, subtree->end);
+    }
+}
+
+static void bvh_rebuild_range(void* data, uint32_t begin, uint32_t end){
+    BvhRefit* refit = (BvhRefit*)data;
+    Bvh* bvh = refit->bvh;
+    for(uint32_t i = begin; i<end; ++i){
+        BvhSubtree* subtree = &bvh->subtrees[bvh->degraded[i]];
+        bvh_rebuild_subtree(bvh, refit->positions, subtree, &bvh->scratch[job_thread_index()], subtree->refitCost);
+    }
+}
+
+// Rebuilds the budget subtrees with the worst cost ratios past rebuildRatio.
+// A rebuild keeps the subtree's triangles and so the bounds of its root, the
+// nodes above it stay valid.
+static uint32_t bvh_rebuild_worst(Bvh* bvh, Vec3Soa positions, uint32_t budget){
+    uint32_t count = 0;
+    budget = budget < bvh->subtreeCount ? budget : bvh->subtreeCount;
+    for(uint32_t i = 0; i<bvh->subtreeCount && budget > 0; ++i){
+        const BvhSubtree* subtree = &bvh->subtrees[i];
+        float ratio = subtree->refitCost/subtree->cost;
+        if(!(ratio > bvh->rebuildRatio)){
+            continue;
+        }
+        uint32_t j = count < budget ? count++ : budget;
+        while(j > 0){
+            const BvhSubtree* other = &bvh->subtrees[bvh->degraded[j-1]];
+            if(ratio <= other->refitCost/other->cost){
+                break;
+            }
+            if(j < budget){
+                bvh->degraded[j] = bvh->degraded[j-1];
+            }
+            --j;
+        }
+        if(j < budget){
+            bvh->degraded[j] = i;
+        }
+    }
+    bvh->rebuildCount = 0;
+    if(count == 0){
+        return 0;
+    }
+    uint32_t threads = job_thread_count() > 0 ? job_thread_count() : 1;
+    if(bvh->scratchCount < threads){
+        bvh_scratch_alloc(bvh, threads);
+    }
+    BvhRefit refit = {bvh, positions, 0};
+    parallel_for(&refit, count, 1, bvh_rebuild_range);
+    for(uint32_t i = 0; i<count; ++i){
+        bvh->rebuildCount += bvh->subtrees[bvh->degraded[i]].rebuilt;
+    }
+    return bvh->rebuildCount;
+}
+
+void bvh_refit(Bvh* bvh, Vec3Soa positions){
+    BvhRefit refit = {bvh, positions, bvh->rebuildRatio > 0.0f && bvh->rebuildBudget > 0};
+    parallel_for(&refit, bvh->subtreeCount, 1, bvh_refit_range);
+    for(uint32_t i = bvh->topCount; i-- > 0; ){
+        bvh_refit_nodes(bvh, positions, bvh->top[i], bvh->top[i] + 1);
+    }
+    bvh->rebuildCount = 0;
+    if(refit.measure){
+        bvh_rebuild_worst(bvh, positions, bvh->rebuildBudget);
+    }
+}
+
+uint32_t bvh_rebuild_degraded(Bvh* bvh, Vec3Soa positions, uint32_t budget){
+    bvh->rebuildCount = 0;
+    if(bvh->rebuildRatio <= 0.0f || budget == 0){
+        return 0;
+    }
+    BvhRefit refit = {bvh, positions, 1};
+    parallel_for(&refit, bvh->subtreeCount, 1, bvh_measure_range);
+    return bvh_rebuild_worst(bvh, positions, budget);
+}
+
+float bvh_sah_cost(const Bvh* bvh){
+    return bvh->nodeCount > 0 ? bvh_subtree_cost(bvh, 0, bvh->nodeCount) : 0.0f;
+}
+
+// ---------------------------------------------------------
+// Triangle tests
+// ---------------------------------------------------------
+int bvh_intersect_triangle(Vec3Soa positions, const uint32_t* v, const float* origin, const float* direction, float maxT,
+                           float* t, float* u, float* w){
+    float p0[3] = {positions.x[v[0]], positions.y[v[0]], positions.z[v[0]]};
+    float e1[3] = {positions.x[v[1]] - p0[0], positions.y[v[1]] - p0[1], positions.z[v[1]] - p0[2]};
+    float e2[3] = {positions.x[v[2]] - p0[0], positions.y[v[2]] - p0[1], positions.z[v[2]] - p0[2]};
+    float p[3] = {direction[1]*e2[2] - direction[2]*e2[1], direction[2]*e2[0] - direction[0]*e2[2], direction[0]*e2[1] - direction[1]*e2[0]};
+    float det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+    if(fabsf(det) < 1e-12f){
+        return 0;
+    }
+    float inv = 1.0f/det;
+    float s[3] = {origin[0] - p0[0], origin[1] - p0[1], origin[2] - p0[2]};
+    float a = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*inv;
+    if(a < 0.0f || a > 1.0f){
+        return 0;
+    }
+    float q[3] = {s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0]};
+    float b = (direction[0]*q[0] + direction[1]*q[1] + direction[2]*q[2])*inv;
+    if(b < 0.0f || a + b > 1.0f){
+        return 0;
+    }
+    float d = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2])*inv;
+    if(d <= 0.0f || d > maxT){
+        return 0;
+    }
+    *t = d;
+    *u = a;
+    *w = b;
+    return 1;
+}
+
+static inline float bvh_dot(const float* a, const float* b){
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// Ericson, Real-Time Collision Detection 5.1.5: Voronoi regions of the
+// vertices, then the edges, then the face
+float bvh_closest_on_triangle(Vec3Soa positions, const uint32_t* v, const float* point, float* closest){
+    float a[3] = {positions.x[v[0]], positions.y[v[0]], positions.z[v[0]]};
+    float b[3] = {positions.x[v[1]], positions.y[v[1]], positions.z[v[1]]};
+    float c[3] = {positions.x[v[2]], positions.y[v[2]], positions.z[v[2]]};
+    float ab[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]}, ac[3] = {c[0]-a[0], c[1]-a[1], c[2]-a[2]};
+    float ap[3] = {point[0]-a[0], point[1]-a[1], point[2]-a[2]};
+    float d1 = bvh_dot(ab, ap), d2 = bvh_dot(ac, ap);
+    float s = 0.0f, t = 0.0f;
+    if(d1 <= 0.0f && d2 <= 0.0f){
+        // a
+    } else {
+        float bp[3] = {point[0]-b[0], point[1]-b[1], point[2]-b[2]};
+        float d3 = bvh_dot(ab, bp), d4 = bvh_dot(ac, bp);
+        float cp[3] = {point[0]-c[0], point[1]-c[1], point[2]-c[2]};
+        float d5 = bvh_dot(ab, cp), d6 = bvh_dot(ac, cp);
+        float vc = d1*d4 - d3*d2, vb = d5*d2 - d1*d6, va = d3*d6 - d5*d4;
+        if(d3 >= 0.0f && d4 <= d3){
+            s = 1.0f;
+        } else if(d6 >= 0.0f && d5 <= d6){
+            t = 1.0f;
+        } else if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f){
+            s = d1/(d1 - d3);
+        } else if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f){
+            t = d2/(d2 - d6);
+        } else if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f){
+            t = (d4 - d3)/((d4 - d3) + (d5 - d6));
+            s = 1.0f - t;
+        } else {
+            float denom = 1.0f/(va + vb + vc);
+            s = vb*denom;
+            t = vc*denom;
+        }
+    }
+    float distanceSq = 0.0f;
+    for(int k = 0; k<3; ++k){
+        closest[k] = a[k] + ab[k]*s + ac[k]*t;
+        float d = point[k] - closest[k];
+        distanceSq += d*d;
+    }
+    return distanceSq;
+}
+
+// ---------------------------------------------------------
+// Scalar traversal, the reference for bvh_avx2.c
+// ---------------------------------------------------------
+typedef struct {
+    uint32_t child;
+    uint32_t count;
+    float t;
+} BvhEntry;
+
+// Entry distance into child c, FLT_MAX if the ray misses it before maxT
+static inline float bvh_slab(const BvhNode* node, uint32_t c, const float* origin, const float* inverse, float maxT){
+    float lo[3] = {node->minX[c], node->minY[c], node->minZ[c]}, hi[3] = {node->maxX[c], node->maxY[c], node->maxZ[c]};
+    float t0 = 0.0f, t1 = maxT;
+    for(int k = 0; k<3; ++k){
+        float a = (lo[k] - origin[k])*inverse[k];
+        float b = (hi[k] - origin[k])*inverse[k];
+        float near = a < b ? a : b, far = a < b ? b : a;
+        t0 = near > t0 ? near : t0;
+        t1 = far < t1 ? far : t1;
+    }
+    return t0 <= t1 ? t0 : FLT_MAX;
+}
+
+// Pushes the children that pass, farthest first so the nearest is popped next
+static inline uint32_t bvh_push_sorted(BvhEntry* stack, uint32_t top, const BvhNode* node, const float* t){
+    uint32_t first = top;
+    for(uint32_t c = 0; c<node->childCount; ++c){
+        if(t[c] == FLT_MAX){
+            continue;
+        }
+        BvhEntry entry = {node->child[c], node->count[c], t[c]};
+        uint32_t i = top++;
+        while(i > first && stack[i-1].t < entry.t){
+            stack[i] = stack[i-1];
+            --i;
+        }
+        stack[i] = entry;
+    }
+    return top;
+}
+
+static int bvh_raycast_scalar(const Bvh* bvh, Vec3Soa positions, const vec3 origin, const vec3 direction, BvhHit* hit){
+    float inverse[3] = {1.0f/direction[0], 1.0f/direction[1], 1.0f/direction[2]};
+    BvhEntry stack[BVH_STACK];
+    uint32_t top = 0;
+    stack[top++] = (BvhEntry){0, 0, 0.0f};
+    while(top > 0){
+        BvhEntry entry = stack[--top];
+        if(entry.t > hit->t){
+            continue;
+        }
+        if(entry.child & BVH_LEAF){
+            uint32_t first = entry.child & ~BVH_LEAF;
+            for(uint32_t i = first; i<first+entry.count; ++i){
+                float t, u, v;
+                if(bvh_intersect_triangle(positions, bvh->indices + 3*i, origin, direction, hit->t, &t, &u, &v)){
+                    hit->t = t;
+                    hit->u = u;
+                    hit->v = v;
+                    hit->triangle = bvh->triangleId[i];
+                }
+            }
+            continue;
+        }
+        const BvhNode* node = &bvh->nodes[entry.child];
+        float t[BVH_WIDTH];
+        for(uint32_t c = 0; c<node->childCount; ++c){
+            t[c] = bvh_slab(node, c, origin, inverse, hit->t);
+        }
+        top = bvh_push_sorted(stack, top, node, t);
+    }
+    return hit->triangle != BVH_NONE;
+}
+
+static int bvh_closest_point_scalar(const Bvh* bvh, Vec3Soa positions, const vec3 point, BvhClosest* closest){
+    BvhEntry stack[BVH_STACK];
+    uint32_t top = 0;
+    stack[top++] = (BvhEntry){0, 0, 0.0f};
+    while(top > 0){
+        BvhEntry entry = stack[--top];
+        if(entry.t >= closest->distanceSq){
+            continue;
+        }
+        if(entry.child & BVH_LEAF){
+            uint32_t first = entry.child & ~BVH_LEAF;
+            for(uint32_t i = first; i<first+entry.count; ++i){
+                float p[3];
+                float d = bvh_closest_on_triangle(positions, bvh->indices + 3*i, point, p);
+                if(d < closest->distanceSq){
+                    closest->distanceSq = d;
+                    memcpy(closest->point, p, sizeof(p));
+                    closest->triangle = bvh->triangleId[i];
+                }
+            }
+            continue;
+        }
+        const BvhNode* node = &bvh->nodes[entry.child];
+        float d[BVH_WIDTH];
+        for(uint32_t c = 0; c<node->childCount; ++c){
+            float dx = fmaxf(fmaxf(node->minX[c] - point[0], point[0] - node->maxX[c]), 0.0f);
+            float dy = fmaxf(fmaxf(node->minY[c] - point[1], point[1] - node->maxY[c]), 0.0f);
+            float dz = fmaxf(fmaxf(node->minZ[c] - point[2], point[2] - node->maxZ[c]), 0.0f);
+            float distanceSq = dx*dx + dy*dy + dz*dz;
+            d[c] = distanceSq < closest->distanceSq ? distanceSq : FLT_MAX;
+        }
+        top = bvh_push_sorted(stack, top, node, d);
+    }
+    return closest->triangle != BVH_NONE;
+}
+
+int bvh_raycast(const Bvh* bvh, Vec3Soa positions, const vec3 origin, const vec3 direction, float maxT, BvhHit* hit){
+    hit->t = maxT;
+    hit->triangle = BVH_NONE;
+    if(bvh->nodeCount == 0){
+        return 0;
+    }
+    if(batch_isa() == BATCH_ISA_AVX2){
+        return bvh_raycast_avx2(bvh, positions, origin, direction, maxT, hit);
+    }
+    return bvh_raycast_scalar(bvh, positions, origin, direction, hit);
+}
+
+uint32_t bvh_raycast_packet(const Bvh* bvh, Vec3Soa positions, const BvhPacket* packet, BvhHit* hits){
+    for(uint32_t r = 0; r<packet->count; ++r){
+        hits[r].t = packet->maxT[r];
+        hits[r].triangle = BVH_NONE;
+    }
+    if(bvh->nodeCount == 0){
+        return 0;
+    }
+    if(batch_isa() == BATCH_ISA_AVX2){
+        return bvh_raycast_packet_avx2(bvh, positions, packet, hits);
+    }
+    uint32_t found = 0;
+    for(uint32_t r = 0; r<packet->count; ++r){
+        vec3 origin = {packet->originX[r], packet->originY[r], packet->originZ[r]};
+        vec3 direction = {packet->directionX[r], packet->directionY[r], packet->directionZ[r]};
+        found += bvh_raycast_scalar(bvh, positions, origin, direction, &hits[r]);
+    }
+    return found;
+}
+
+int bvh_closest_point(const Bvh* bvh, Vec3Soa positions, const vec3 point, float maxDistance, BvhClosest* closest){
+    closest->distanceSq = maxDistance < FLT_MAX ? maxDistance*maxDistance : FLT_MAX;
+    closest->triangle = BVH_NONE;
+    if(bvh->nodeCount == 0){
+        return 0;
+    }
+    if(batch_isa() == BATCH_ISA_AVX2){
+        return bvh_closest_point_avx2(bvh, positions, point, maxDistance, closest);
+    }
+    return bvh_closest_point_scalar(bvh, positions, point, closest);
+}
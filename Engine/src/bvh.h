@@ -0,0 +1,135 @@
+#pragma once
+#include <stdint.h>
+#include "batch.h"
+
+// Bounding volume hierarchy over indexed triangles whose vertices may move,
+// e.g. the particles of a simulated mesh.
+//
+// The builder bins triangle centroids (binned SAH) into a binary tree. The
+// top levels are split on the calling thread until there are enough subtrees
+// for the workers, then every subtree is built as its own job. The binary
+// tree is then collapsed into 8 wide nodes with the child bounds stored as
+// SoA, so one AVX2 instruction tests all eight children. The AVX2 traversal
+// is picked at runtime with the batch ISA (batch_set_isa), the scalar one is
+// the reference.
+//
+// Nodes are laid out depth first, so every subtree is a contiguous range of
+// nodes over a contiguous range of triangle slots. bvh_refit updates the
+// bounds bottom up: the subtrees BVH_REFIT_DEPTH levels below the root are
+// refit as parallel jobs, then the few nodes above them. A subtree whose SAH
+// cost grew past rebuildRatio times its cost when built (the mesh deformed
+// enough that its boxes overlap badly) is rebuilt in place from its own
+// triangles. The rest of the tree keeps its topology. A refit rebuilds no
+// more than rebuildBudget subtrees, the worst cost ratios first; the others
+// stay degraded and come up again on later refits, so a refit costs at
+// most that many rebuilds. With a budget of 0 the refit stays refit only and
+// bvh_rebuild_degraded rebuilds when the caller has the time for it.
+
+#define BVH_NONE          UINT32_MAX
+#define BVH_WIDTH         8
+#define BVH_LEAF          0x80000000u   // child is a leaf, the rest is its first triangle
+#define BVH_MAX_LEAF      8             // triangles per leaf
+#define BVH_PACKET        8             // rays per packet
+#define BVH_REFIT_DEPTH   2             // subtrees this deep are refit as jobs
+#define BVH_REBUILD_RATIO 1.5f          // default rebuildRatio
+#define BVH_REBUILD_BUDGET 1            // default rebuildBudget
+
+typedef struct {
+    float minX[BVH_WIDTH];
+    float minY[BVH_WIDTH];
+    float minZ[BVH_WIDTH];
+    float maxX[BVH_WIDTH];
+    float maxY[BVH_WIDTH];
+    float maxZ[BVH_WIDTH];
+    uint32_t child[BVH_WIDTH];  // node index, or BVH_LEAF | first triangle
+    uint8_t count[BVH_WIDTH];   // triangles of a leaf child
+    uint32_t childCount;        // children are packed at the front, the other lanes are empty boxes
+    uint32_t pad[5];
+} BvhNode;
+
+// Nodes [root, end) over triangle slots [first, first+count)
+typedef struct {
+    uint32_t root;
+    uint32_t end;
+    uint32_t first;
+    uint32_t count;
+    float cost;             // SAH cost when it was last built
+    float refitCost;        // SAH cost after the last refit that measured it
+    uint32_t rebuilt;       // by the last refit
+} BvhSubtree;
+
+typedef struct BvhScratch BvhScratch;
+
+typedef struct {
+    uint32_t triangleCount;
+    uint32_t* indices;      // 3 vertex indices per triangle, in leaf order
+    uint32_t* triangleId;   // triangle as passed to bvh_build, per leaf slot
+    uint32_t nodeCount;
+    BvhNode* nodes;         // 32 byte aligned, the root is nodes[0]
+
+    BvhSubtree* subtrees;
+    uint32_t subtreeCount;
+    uint32_t* top;          // nodes above the subtrees, in depth first order
+    uint32_t topCount;
+    float rebuildRatio;     // BVH_REBUILD_RATIO after bvh_build, 0 never rebuilds
+    uint32_t rebuildBudget; // subtrees rebuilt per refit at most, BVH_REBUILD_BUDGET after bvh_build
+    uint32_t rebuildCount;  // subtrees rebuilt by the last refit or bvh_rebuild_degraded
+    uint32_t* degraded;     // subtrees picked for rebuilding, worst first
+    BvhScratch* scratch;    // subtree rebuilds, per job thread
+    uint32_t scratchCount;
+} Bvh;
+
+typedef struct {
+    float t;                // distance along the ray direction
+    float u, v;             // barycentrics of vertices 1 and 2
+    uint32_t triangle;      // as passed to bvh_build, BVH_NONE for no hit
+} BvhHit;
+
+// Up to BVH_PACKET rays as SoA, lanes from count on are ignored
+typedef struct {
+    float originX[BVH_PACKET];
+    float originY[BVH_PACKET];
+    float originZ[BVH_PACKET];
+    float directionX[BVH_PACKET];
+    float directionY[BVH_PACKET];
+    float directionZ[BVH_PACKET];
+    float maxT[BVH_PACKET];
+    uint32_t count;
+} BvhPacket;
+
+typedef struct {
+    float distanceSq;
+    vec3 point;
+    uint32_t triangle;      // BVH_NONE if nothing is within the search radius
+} BvhClosest;
+
+// Triangles with a vertex index of BVH_NONE or a repeated vertex are left
+// out. Uses parallel_for.
+void bvh_build(Bvh* bvh, Vec3Soa positions, const uint32_t* indices, uint32_t triangleCount);
+void bvh_free(Bvh* bvh);
+// Uses parallel_for. The first rebuild allocates a rebuild scratch per job
+// thread.
+void bvh_refit(Bvh* bvh, Vec3Soa positions);
+// Rebuilds up to budget subtrees whose cost grew past rebuildRatio, worst
+// first, e.g. between frames after a refit with a rebuildBudget of 0.
+// positions have to be the ones of the last refit. Returns how many were
+// rebuilt, also in rebuildCount.
+uint32_t bvh_rebuild_degraded(Bvh* bvh, Vec3Soa positions, uint32_t budget);
+// Surface area heuristic cost of the tree, relative to its root box
+float bvh_sah_cost(const Bvh* bvh);
+
+// Closest hit with t in (0, maxT], returns whether there is one. direction
+// does not have to be normalized, t is in units of its length.
+int bvh_raycast(const Bvh* bvh, Vec3Soa positions, const vec3 origin, const vec3 direction, float maxT, BvhHit* hit);
+// Same for a packet of rays that go through the tree together, best for
+// coherent rays (neighbouring pixels). Returns how many rays hit.
+uint32_t bvh_raycast_packet(const Bvh* bvh, Vec3Soa positions, const BvhPacket* packet, BvhHit* hits);
+// Closest point on the mesh within maxDistance of point
+int bvh_closest_point(const Bvh* bvh, Vec3Soa positions, const vec3 point, float maxDistance, BvhClosest* closest);
+
+// Single triangle tests shared by the traversals. bvh_intersect_triangle is
+// two sided Moller-Trumbore, t in (0, maxT].
+int bvh_intersect_triangle(Vec3Soa positions, const uint32_t* v, const float* origin, const float* direction, float maxT,
+                           float* t, float* u, float* w);
+// Returns the squared distance
+float bvh_closest_on_triangle(Vec3Soa positions, const uint32_t* v, const float* point, float* closest);
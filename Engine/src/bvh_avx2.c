@@ -0,0 +1,361 @@
+// AVX2/FMA traversals for bvh.c. This file is compiled with AVX2 code
+// generation and must only be entered when batch_isa() is BATCH_ISA_AVX2.
+#include <float.h>
+#include <immintrin.h>
+#include <string.h>
+#include "bvh.h"
+
+#define BVH_STACK 512
+
+typedef struct {
+    uint32_t child;
+    uint32_t count;
+    float t;
+} BvhEntry;
+
+static inline __m256i child_mask(const BvhNode* node){
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32((int)node->childCount), lanes);
+}
+
+// Pushes the children in mask, farthest first so the nearest is popped next
+static inline uint32_t push_sorted(BvhEntry* stack, uint32_t top, const BvhNode* node, const float* t, uint32_t mask){
+    uint32_t first = top;
+    for(uint32_t c = 0; c<node->childCount; ++c){
+        if(!(mask & (1u << c))){
+            continue;
+        }
+        BvhEntry entry = {node->child[c], node->count[c], t[c]};
+        uint32_t i = top++;
+        while(i > first && stack[i-1].t < entry.t){
+            stack[i] = stack[i-1];
+            --i;
+        }
+        stack[i] = entry;
+    }
+    return top;
+}
+
+// Entry distances of one ray into all children of a node
+static inline uint32_t slab8(const BvhNode* node, __m256 ox, __m256 oy, __m256 oz, __m256 ix, __m256 iy, __m256 iz,
+                             __m256 maxT, __m256* entry){
+    __m256 ax = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node->minX), ox), ix);
+    __m256 bx = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node->maxX), ox), ix);
+    __m256 ay = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node->minY), oy), iy);
+    __m256 by = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node->maxY), oy), iy);
+    __m256 az = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node->minZ), oz), iz);
+    __m256 bz = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node->maxZ), oz), iz);
+    __m256 t0 = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(ax, bx), _mm256_min_ps(ay, by)),
+                              _mm256_max_ps(_mm256_min_ps(az, bz), _mm256_setzero_ps()));
+    __m256 t1 = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(ax, bx), _mm256_max_ps(ay, by)),
+                              _mm256_min_ps(_mm256_max_ps(az, bz), maxT));
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ), _mm256_castsi256_ps(child_mask(node)));
+    *entry = t0;
+    return (uint32_t)_mm256_movemask_ps(hit);
+}
+
+static inline __m256 gather(const float* base, __m256i index){
+    return _mm256_i32gather_ps(base, index, 4);
+}
+
+// Up to eight leaf triangles against one ray, Moller-Trumbore in lanes
+static void leaf8(const Bvh* bvh, Vec3Soa positions, uint32_t first, uint32_t count, const float* origin, const float* direction,
+                  BvhHit* hit){
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), lanes);
+    // Lanes past the leaf read its first triangle again and are masked off
+    __m256i slot = _mm256_and_si256(valid, _mm256_mullo_epi32(lanes, _mm256_set1_epi32(3)));
+    const int* indices = (const int*)(bvh->indices + 3*first);
+    __m256i i0 = _mm256_i32gather_epi32(indices, slot, 4);
+    __m256i i1 = _mm256_i32gather_epi32(indices + 1, slot, 4);
+    __m256i i2 = _mm256_i32gather_epi32(indices + 2, slot, 4);
+    __m256 p0x = gather(positions.x, i0), p0y = gather(positions.y, i0), p0z = gather(positions.z, i0);
+    __m256 e1x = _mm256_sub_ps(gather(positions.x, i1), p0x);
+    __m256 e1y = _mm256_sub_ps(gather(positions.y, i1), p0y);
+    __m256 e1z = _mm256_sub_ps(gather(positions.z, i1), p0z);
+    __m256 e2x = _mm256_sub_ps(gather(positions.x, i2), p0x);
+    __m256 e2y = _mm256_sub_ps(gather(positions.y, i2), p0y);
+    __m256 e2z = _mm256_sub_ps(gather(positions.z, i2), p0z);
+    __m256 dx = _mm256_set1_ps(direction[0]), dy = _mm256_set1_ps(direction[1]), dz = _mm256_set1_ps(direction[2]);
+
+    __m256 px = _mm256_fmsub_ps(dy, e2z, _mm256_mul_ps(dz, e2y));
+    __m256 py = _mm256_fmsub_ps(dz, e2x, _mm256_mul_ps(dx, e2z));
+    __m256 pz = _mm256_fmsub_ps(dx, e2y, _mm256_mul_ps(dy, e2x));
+    __m256 det = _mm256_fmadd_ps(e1x, px, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1z, pz)));
+    __m256 absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+    __m256 ok = _mm256_and_ps(_mm256_castsi256_ps(valid), _mm256_cmp_ps(absDet, _mm256_set1_ps(1e-12f), _CMP_GE_OQ));
+    __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+    __m256 sx = _mm256_sub_ps(_mm256_set1_ps(origin[0]), p0x);
+    __m256 sy = _mm256_sub_ps(_mm256_set1_ps(origin[1]), p0y);
+    __m256 sz = _mm256_sub_ps(_mm256_set1_ps(origin[2]), p0z);
+    __m256 a = _mm256_mul_ps(_mm256_fmadd_ps(sx, px, _mm256_fmadd_ps(sy, py, _mm256_mul_ps(sz, pz))), inv);
+    __m256 qx = _mm256_fmsub_ps(sy, e1z, _mm256_mul_ps(sz, e1y));
+    __m256 qy = _mm256_fmsub_ps(sz, e1x, _mm256_mul_ps(sx, e1z));
+    __m256 qz = _mm256_fmsub_ps(sx, e1y, _mm256_mul_ps(sy, e1x));
+    __m256 b = _mm256_mul_ps(_mm256_fmadd_ps(dx, qx, _mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dz, qz))), inv);
+    __m256 t = _mm256_mul_ps(_mm256_fmadd_ps(e2x, qx, _mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2z, qz))), inv);
+    __m256 zero = _mm256_setzero_ps();
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(a, zero, _CMP_GE_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(b, zero, _CMP_GE_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_add_ps(a, b), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, _mm256_set1_ps(hit->t), _CMP_LE_OQ));
+    uint32_t mask = (uint32_t)_mm256_movemask_ps(ok);
+    if(!mask){
+        return;
+    }
+    float ts[8], as[8], bs[8];
+    _mm256_storeu_ps(ts, t);
+    _mm256_storeu_ps(as, a);
+    _mm256_storeu_ps(bs, b);
+    for(uint32_t k = 0; k<count; ++k){
+        if((mask & (1u << k)) && ts[k] <= hit->t){
+            hit->t = ts[k];
+            hit->u = as[k];
+            hit->v = bs[k];
+            hit->triangle = bvh->triangleId[first + k];
+        }
+    }
+}
+
+int bvh_raycast_avx2(const Bvh* bvh, Vec3Soa positions, const vec3 origin, const vec3 direction, float maxT, BvhHit* hit){
+    (void)maxT;
+    __m256 ox = _mm256_set1_ps(origin[0]), oy = _mm256_set1_ps(origin[1]), oz = _mm256_set1_ps(origin[2]);
+    __m256 ix = _mm256_set1_ps(1.0f/direction[0]), iy = _mm256_set1_ps(1.0f/direction[1]), iz = _mm256_set1_ps(1.0f/direction[2]);
+    BvhEntry stack[BVH_STACK];
+    uint32_t top = 0;
+    stack[top++] = (BvhEntry){0, 0, 0.0f};
+    while(top > 0){
+        BvhEntry entry = stack[--top];
+        if(entry.t > hit->t){
+            continue;
+        }
+        if(entry.child & BVH_LEAF){
+            leaf8(bvh, positions, entry.child & ~BVH_LEAF, entry.count, origin, direction, hit);
+            continue;
+        }
+        const BvhNode* node = &bvh->nodes[entry.child];
+        __m256 t;
+        uint32_t mask = slab8(node, ox, oy, oz, ix, iy, iz, _mm256_set1_ps(hit->t), &t);
+        float ts[8];
+        _mm256_storeu_ps(ts, t);
+        top = push_sorted(stack, top, node, ts, mask);
+    }
+    return hit->triangle != BVH_NONE;
+}
+
+static inline float hmin(__m256 x){
+    __m128 m = _mm_min_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+    m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+
+static inline float hmax(__m256 x){
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+
+// Nodes [begin, end) backwards. Unused lanes hold empty boxes, so inner
+// children reduce all eight.
+void bvh_refit_avx2(Bvh* bvh, Vec3Soa positions, uint32_t begin, uint32_t end){
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for(uint32_t n = end; n-- > begin; ){
+        BvhNode* node = &bvh->nodes[n];
+        for(uint32_t c = 0; c<node->childCount; ++c){
+            __m256 loX, loY, loZ, hiX, hiY, hiZ;
+            if(node->child[c] & BVH_LEAF){
+                const uint32_t* v = bvh->indices + 3*(node->child[c] & ~BVH_LEAF);
+                uint32_t count = 3u*node->count[c];
+                loX = loY = loZ = _mm256_set1_ps(FLT_MAX);
+                hiX = hiY = hiZ = _mm256_set1_ps(-FLT_MAX);
+                for(uint32_t i = 0; i<count; i += 8){
+                    // Lanes past the leaf repeat its first vertex
+                    __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(count - i)), lanes);
+                    __m256i index = _mm256_blendv_epi8(_mm256_set1_epi32((int)v[0]),
+                                                       _mm256_maskload_epi32((const int*)v + i, valid), valid);
+                    __m256 x = gather(positions.x, index), y = gather(positions.y, index), z = gather(positions.z, index);
+                    loX = _mm256_min_ps(loX, x); hiX = _mm256_max_ps(hiX, x);
+                    loY = _mm256_min_ps(loY, y); hiY = _mm256_max_ps(hiY, y);
+                    loZ = _mm256_min_ps(loZ, z); hiZ = _mm256_max_ps(hiZ, z);
+                }
+            } else {
+                const BvhNode* child = &bvh->nodes[node->child[c]];
+                loX = _mm256_load_ps(child->minX); hiX = _mm256_load_ps(child->maxX);
+                loY = _mm256_load_ps(child->minY); hiY = _mm256_load_ps(child->maxY);
+                loZ = _mm256_load_ps(child->minZ); hiZ = _mm256_load_ps(child->maxZ);
+            }
+            node->minX[c] = hmin(loX); node->minY[c] = hmin(loY); node->minZ[c] = hmin(loZ);
+            node->maxX[c] = hmax(hiX); node->maxY[c] = hmax(hiY); node->maxZ[c] = hmax(hiZ);
+        }
+    }
+}
+
+// ---------------------------------------------------------
+// Packets: one ray per lane, the boxes and triangles broadcast
+// ---------------------------------------------------------
+typedef struct {
+    __m256 ox, oy, oz;
+    __m256 dx, dy, dz;
+    __m256 ix, iy, iz;
+    __m256 t, u, v;
+    __m256i triangle;
+    __m256 active;
+} BvhRays;
+
+// Nearest entry of any active ray into the box, FLT_MAX if all miss
+static inline float packet_slab(const BvhRays* r, float minX, float minY, float minZ, float maxX, float maxY, float maxZ){
+    __m256 ax = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(minX), r->ox), r->ix);
+    __m256 bx = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(maxX), r->ox), r->ix);
+    __m256 ay = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(minY), r->oy), r->iy);
+    __m256 by = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(maxY), r->oy), r->iy);
+    __m256 az = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(minZ), r->oz), r->iz);
+    __m256 bz = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(maxZ), r->oz), r->iz);
+    __m256 t0 = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(ax, bx), _mm256_min_ps(ay, by)),
+                              _mm256_max_ps(_mm256_min_ps(az, bz), _mm256_setzero_ps()));
+    __m256 t1 = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(ax, bx), _mm256_max_ps(ay, by)),
+                              _mm256_min_ps(_mm256_max_ps(az, bz), r->t));
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ), r->active);
+    return _mm256_movemask_ps(hit) ? hmin(_mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), t0, hit)) : FLT_MAX;
+}
+
+static void packet_triangle(const Bvh* bvh, Vec3Soa positions, uint32_t slot, BvhRays* r){
+    const uint32_t* v = bvh->indices + 3*slot;
+    float p0[3] = {positions.x[v[0]], positions.y[v[0]], positions.z[v[0]]};
+    __m256 e1x = _mm256_set1_ps(positions.x[v[1]] - p0[0]), e1y = _mm256_set1_ps(positions.y[v[1]] - p0[1]);
+    __m256 e1z = _mm256_set1_ps(positions.z[v[1]] - p0[2]);
+    __m256 e2x = _mm256_set1_ps(positions.x[v[2]] - p0[0]), e2y = _mm256_set1_ps(positions.y[v[2]] - p0[1]);
+    __m256 e2z = _mm256_set1_ps(positions.z[v[2]] - p0[2]);
+
+    __m256 px = _mm256_fmsub_ps(r->dy, e2z, _mm256_mul_ps(r->dz, e2y));
+    __m256 py = _mm256_fmsub_ps(r->dz, e2x, _mm256_mul_ps(r->dx, e2z));
+    __m256 pz = _mm256_fmsub_ps(r->dx, e2y, _mm256_mul_ps(r->dy, e2x));
+    __m256 det = _mm256_fmadd_ps(e1x, px, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1z, pz)));
+    __m256 absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+    __m256 ok = _mm256_and_ps(r->active, _mm256_cmp_ps(absDet, _mm256_set1_ps(1e-12f), _CMP_GE_OQ));
+    __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+    __m256 sx = _mm256_sub_ps(r->ox, _mm256_set1_ps(p0[0]));
+    __m256 sy = _mm256_sub_ps(r->oy, _mm256_set1_ps(p0[1]));
+    __m256 sz = _mm256_sub_ps(r->oz, _mm256_set1_ps(p0[2]));
+    __m256 a = _mm256_mul_ps(_mm256_fmadd_ps(sx, px, _mm256_fmadd_ps(sy, py, _mm256_mul_ps(sz, pz))), inv);
+    __m256 qx = _mm256_fmsub_ps(sy, e1z, _mm256_mul_ps(sz, e1y));
+    __m256 qy = _mm256_fmsub_ps(sz, e1x, _mm256_mul_ps(sx, e1z));
+    __m256 qz = _mm256_fmsub_ps(sx, e1y, _mm256_mul_ps(sy, e1x));
+    __m256 b = _mm256_mul_ps(_mm256_fmadd_ps(r->dx, qx, _mm256_fmadd_ps(r->dy, qy, _mm256_mul_ps(r->dz, qz))), inv);
+    __m256 t = _mm256_mul_ps(_mm256_fmadd_ps(e2x, qx, _mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2z, qz))), inv);
+    __m256 zero = _mm256_setzero_ps();
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(a, zero, _CMP_GE_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(b, zero, _CMP_GE_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_add_ps(a, b), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, r->t, _CMP_LE_OQ));
+    r->t = _mm256_blendv_ps(r->t, t, ok);
+    r->u = _mm256_blendv_ps(r->u, a, ok);
+    r->v = _mm256_blendv_ps(r->v, b, ok);
+    r->triangle = _mm256_blendv_epi8(r->triangle, _mm256_set1_epi32((int)bvh->triangleId[slot]), _mm256_castps_si256(ok));
+}
+
+uint32_t bvh_raycast_packet_avx2(const Bvh* bvh, Vec3Soa positions, const BvhPacket* packet, BvhHit* hits){
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)packet->count), lanes);
+    BvhRays r;
+    r.active = _mm256_castsi256_ps(active);
+    // Inactive lanes get a harmless ray, they are masked everywhere
+    r.ox = _mm256_and_ps(r.active, _mm256_loadu_ps(packet->originX));
+    r.oy = _mm256_and_ps(r.active, _mm256_loadu_ps(packet->originY));
+    r.oz = _mm256_and_ps(r.active, _mm256_loadu_ps(packet->originZ));
+    r.dx = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_loadu_ps(packet->directionX), r.active);
+    r.dy = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_loadu_ps(packet->directionY), r.active);
+    r.dz = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_loadu_ps(packet->directionZ), r.active);
+    __m256 one = _mm256_set1_ps(1.0f);
+    r.ix = _mm256_div_ps(one, r.dx);
+    r.iy = _mm256_div_ps(one, r.dy);
+    r.iz = _mm256_div_ps(one, r.dz);
+    r.t = _mm256_blendv_ps(_mm256_setzero_ps(), _mm256_loadu_ps(packet->maxT), r.active);
+    r.u = r.v = _mm256_setzero_ps();
+    r.triangle = _mm256_set1_epi32((int)BVH_NONE);
+
+    BvhEntry stack[BVH_STACK];
+    uint32_t top = 0;
+    stack[top++] = (BvhEntry){0, 0, 0.0f};
+    while(top > 0){
+        BvhEntry entry = stack[--top];
+        // Farthest hit so far (inactive lanes are at 0), nothing beyond it matters to any ray
+        float reach = hmax(r.t);
+        if(entry.t > reach){
+            continue;
+        }
+        if(entry.child & BVH_LEAF){
+            uint32_t first = entry.child & ~BVH_LEAF;
+            for(uint32_t i = first; i<first+entry.count; ++i){
+                packet_triangle(bvh, positions, i, &r);
+            }
+            continue;
+        }
+        const BvhNode* node = &bvh->nodes[entry.child];
+        float t[BVH_WIDTH];
+        uint32_t mask = 0;
+        for(uint32_t c = 0; c<node->childCount; ++c){
+            t[c] = packet_slab(&r, node->minX[c], node->minY[c], node->minZ[c], node->maxX[c], node->maxY[c], node->maxZ[c]);
+            mask |= t[c] < FLT_MAX ? 1u << c : 0u;
+        }
+        top = push_sorted(stack, top, node, t, mask);
+    }
+
+    float t[8], u[8], v[8];
+    uint32_t triangle[8];
+    _mm256_storeu_ps(t, r.t);
+    _mm256_storeu_ps(u, r.u);
+    _mm256_storeu_ps(v, r.v);
+    _mm256_storeu_si256((__m256i*)triangle, r.triangle);
+    uint32_t found = 0;
+    for(uint32_t k = 0; k<packet->count; ++k){
+        hits[k].t = t[k];
+        hits[k].u = u[k];
+        hits[k].v = v[k];
+        hits[k].triangle = triangle[k];
+        found += triangle[k] != BVH_NONE;
+    }
+    return found;
+}
+
+int bvh_closest_point_avx2(const Bvh* bvh, Vec3Soa positions, const vec3 point, float maxDistance, BvhClosest* closest){
+    (void)maxDistance;
+    __m256 x = _mm256_set1_ps(point[0]), y = _mm256_set1_ps(point[1]), z = _mm256_set1_ps(point[2]);
+    __m256 zero = _mm256_setzero_ps();
+    BvhEntry stack[BVH_STACK];
+    uint32_t top = 0;
+    stack[top++] = (BvhEntry){0, 0, 0.0f};
+    while(top > 0){
+        BvhEntry entry = stack[--top];
+        if(entry.t >= closest->distanceSq){
+            continue;
+        }
+        if(entry.child & BVH_LEAF){
+            uint32_t first = entry.child & ~BVH_LEAF;
+            for(uint32_t i = first; i<first+entry.count; ++i){
+                float p[3];
+                float d = bvh_closest_on_triangle(positions, bvh->indices + 3*i, point, p);
+                if(d < closest->distanceSq){
+                    closest->distanceSq = d;
+                    memcpy(closest->point, p, sizeof(p));
+                    closest->triangle = bvh->triangleId[i];
+                }
+            }
+            continue;
+        }
+        const BvhNode* node = &bvh->nodes[entry.child];
+        __m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_load_ps(node->minX), x), _mm256_sub_ps(x, _mm256_load_ps(node->maxX))), zero);
+        __m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_load_ps(node->minY), y), _mm256_sub_ps(y, _mm256_load_ps(node->maxY))), zero);
+        __m256 dz = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_load_ps(node->minZ), z), _mm256_sub_ps(z, _mm256_load_ps(node->maxZ))), zero);
+        __m256 d = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+        __m256 near = _mm256_and_ps(_mm256_cmp_ps(d, _mm256_set1_ps(closest->distanceSq), _CMP_LT_OQ),
+                                    _mm256_castsi256_ps(child_mask(node)));
+        float ds[8];
+        _mm256_storeu_ps(ds, d);
+        top = push_sorted(stack, top, node, ds, (uint32_t)_mm256_movemask_ps(near));
+    }
+    return closest->triangle != BVH_NONE;
+}
@@ -0,0 +1,751 @@
+#include <math.h>
+#include <string.h>
+#include "contour.h"
+#include "job.h"
+#include "memory.h"
+#include "sort.h"
+
+#define CONTOUR_VERTEX_GRAIN 4096
+#define CONTOUR_EDGE_NONE    UINT64_MAX
+#define CONTOUR_WALK_CHAIN   0x80000000u     // walk entries that end a polyline
+#define CONTOUR_WALK_LOOP    0x40000000u
+
+// Slot of the segment starting on every edge, valid where edgeStamp is the
+// stamp of the level being linked
+struct ContourScratch {
+    uint32_t* edgeSlot;
+    uint32_t* edgeStamp;
+};
+
+typedef struct {
+    Contour* contour;
+    Vec3Soa positions;
+    vec3 axis;          // scaled to level units
+    float offset;
+    const float* field;
+} ContourJob;
+
+// Both extractors evaluate the height as dot(p, axis) + offset with these
+static void contour_level_axis(const ContourDesc* desc, vec3 axis, float* offset){
+    float inverse = 1.0f/desc->spacing;
+    axis[0] = desc->axis[0]*inverse;
+    axis[1] = desc->axis[1]*inverse;
+    axis[2] = desc->axis[2]*inverse;
+    *offset = -desc->origin*inverse;
+}
+
+static int contour_triangle_valid(const uint32_t* v){
+    return v[0] != CONTOUR_NONE && v[1] != CONTOUR_NONE && v[2] != CONTOUR_NONE && v[0] != v[1] && v[1] != v[2] && v[0] != v[2];
+}
+
+void contour_init(Contour* contour, const ContourDesc* desc, const uint32_t* triangles, uint32_t triangleCount, uint32_t vertexCount){
+    memset(contour, 0, sizeof(*contour));
+    contour->desc = *desc;
+    contour->triangles = triangles;
+    contour->triangleCount = triangleCount;
+    contour->vertexCount = vertexCount;
+
+    // Edges: one key per triangle side, sorted so the sides of an edge are
+    // adjacent, then numbered by run
+    uint32_t sideCount = 3*triangleCount;
+    uint64_t* keys = (uint64_t*)mem_alloc(MEM_TAG_CONTOUR, (sideCount+1)*sizeof(uint64_t));
+    uint32_t* sides = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (sideCount+1)*sizeof(uint32_t));
+    for(uint32_t t = 0; t<triangleCount; ++t){
+        const uint32_t* v = triangles + 3*t;
+        int valid = contour_triangle_valid(v);
+        for(uint32_t k = 0; k<3; ++k){
+            uint32_t a = v[k], b = v[k == 2 ? 0 : k+1];
+            keys[3*t+k] = !valid ? CONTOUR_EDGE_NONE : a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+            sides[3*t+k] = 3*t+k;
+        }
+    }
+    radix_sort_u64(keys, sides, sideCount);
+    contour->triangleEdges = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (sideCount+1)*sizeof(uint32_t));
+    contour->edgeVertices = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (2*sideCount+1)*sizeof(uint32_t));
+    for(uint32_t s = 0; s<sideCount; ++s){
+        if(keys[s] == CONTOUR_EDGE_NONE){
+            contour->triangleEdges[sides[s]] = CONTOUR_NONE;
+            continue;
+        }
+        if(s == 0 || keys[s] != keys[s-1]){
+            contour->edgeVertices[2*contour->edgeCount+0] = (uint32_t)(keys[s] >> 32);
+            contour->edgeVertices[2*contour->edgeCount+1] = (uint32_t)keys[s];
+            contour->edgeCount++;
+        }
+        contour->triangleEdges[sides[s]] = contour->edgeCount-1;
+    }
+    mem_free(keys);
+    mem_free(sides);
+
+    contour->value = (float*)mem_alloc_aligned(MEM_TAG_CONTOUR, (vertexCount+1)*sizeof(float), 32);
+    contour->chunkCount = (triangleCount + CONTOUR_CHUNK-1)/CONTOUR_CHUNK;
+    contour->chunkOffsets = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (contour->chunkCount+1)*sizeof(uint32_t));
+
+    // Triangles around every vertex, for contour_update
+    contour->vertexTriangleOffsets = (uint32_t*)mem_calloc(MEM_TAG_CONTOUR, vertexCount+1, sizeof(uint32_t));
+    contour->vertexTriangles = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (sideCount+1)*sizeof(uint32_t));
+    for(uint32_t t = 0; t<triangleCount; ++t){
+        if(contour->triangleEdges[3*t] != CONTOUR_NONE){
+            for(uint32_t k = 0; k<3; ++k){
+                contour->vertexTriangleOffsets[triangles[3*t+k]]++;
+            }
+        }
+    }
+    uint32_t total = prefix_sum_u32(contour->vertexTriangleOffsets, vertexCount);
+    contour->vertexTriangleOffsets[vertexCount] = total;
+    for(uint32_t t = 0; t<triangleCount; ++t){
+        if(contour->triangleEdges[3*t] != CONTOUR_NONE){
+            for(uint32_t k = 0; k<3; ++k){
+                contour->vertexTriangles[contour->vertexTriangleOffsets[triangles[3*t+k]]++] = t;
+            }
+        }
+    }
+    memmove(contour->vertexTriangleOffsets+1, contour->vertexTriangleOffsets, vertexCount*sizeof(uint32_t));
+    contour->vertexTriangleOffsets[0] = 0;
+
+    size_t size = (vertexCount+1)*sizeof(float);
+    contour->extracted.x = (float*)mem_alloc_aligned(MEM_TAG_CONTOUR, size, 32);
+    contour->extracted.y = (float*)mem_alloc_aligned(MEM_TAG_CONTOUR, size, 32);
+    contour->extracted.z = (float*)mem_alloc_aligned(MEM_TAG_CONTOUR, size, 32);
+    contour->pending = (float*)mem_alloc_aligned(MEM_TAG_CONTOUR, size, 32);
+    contour->moved = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (vertexCount+1)*sizeof(uint32_t));
+    contour->movedCounts = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (vertexCount/CONTOUR_VERTEX_GRAIN+1)*sizeof(uint32_t));
+    contour->triangleDirty = (uint8_t*)mem_calloc(MEM_TAG_CONTOUR, triangleCount+1, 1);
+    contour->dirtyTriangles = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (triangleCount+1)*sizeof(uint32_t));
+}
+
+void contour_init_graph(Contour* contour, const ContourDesc* desc, const ParticleGraph* graph){
+    contour_init(contour, desc, graph->renderToParticle, graph->renderVertexCount/3, graph->particleCount);
+}
+
+void contour_free(Contour* contour){
+    mem_free(contour->edgeVertices);
+    mem_free(contour->triangleEdges);
+    mem_free(contour->value);
+    mem_free(contour->chunkOffsets);
+    mem_free(contour->segments);
+    mem_free(contour->lineVertices);
+    mem_free(contour->lineIndices);
+    mem_free(contour->levels);
+    mem_free(contour->chunkLevels);
+    mem_free(contour->sorted);
+    mem_free(contour->next);
+    mem_free(contour->walk);
+    mem_free(contour->linked);
+    for(uint32_t i = 0; i<contour->scratchCount; ++i){
+        mem_free(contour->scratch[i].edgeSlot);
+        mem_free(contour->scratch[i].edgeStamp);
+    }
+    mem_free(contour->scratch);
+    mem_free(contour->vertexTriangleOffsets);
+    mem_free(contour->vertexTriangles);
+    mem_free(contour->extracted.x);
+    mem_free(contour->extracted.y);
+    mem_free(contour->extracted.z);
+    mem_free(contour->pending);
+    mem_free(contour->moved);
+    mem_free(contour->movedCounts);
+    mem_free(contour->triangleDirty);
+    mem_free(contour->dirtyTriangles);
+    mem_free(contour->dirtyLevels);
+    mem_free(contour->fresh);
+    mem_free(contour->freshSorted);
+    memset(contour, 0, sizeof(*contour));
+}
+
+// ---------------------------------------------------------
+// Field
+// ---------------------------------------------------------
+static void contour_height_range(void* data, uint32_t begin, uint32_t end){
+    ContourJob* job = (ContourJob*)data;
+    Vec3Soa p = {job->positions.x+begin, job->positions.y+begin, job->positions.z+begin};
+    batch_project_points(p, job->axis, job->offset, job->contour->value+begin, end-begin);
+}
+
+void contour_evaluate_height(Contour* contour, Vec3Soa positions){
+    ContourJob job = {contour, positions, {0.0f, 0.0f, 0.0f}, 0.0f, NULL};
+    contour_level_axis(&contour->desc, job.axis, &job.offset);
+    parallel_for(&job, contour->vertexCount, CONTOUR_VERTEX_GRAIN, contour_height_range);
+}
+
+static void contour_field_range(void* data, uint32_t begin, uint32_t end){
+    ContourJob* job = (ContourJob*)data;
+    float inverse = 1.0f/job->contour->desc.spacing, origin = job->contour->desc.origin;
+    for(uint32_t i = begin; i<end; ++i){
+        job->contour->value[i] = (job->field[i] - origin)*inverse;
+    }
+}
+
+void contour_evaluate_field(Contour* contour, const float* field){
+    ContourJob job = {contour, {NULL, NULL, NULL}, {0.0f, 0.0f, 0.0f}, 0.0f, field};
+    parallel_for(&job, contour->vertexCount, CONTOUR_VERTEX_GRAIN, contour_field_range);
+}
+
+// ---------------------------------------------------------
+// Segments
+// ---------------------------------------------------------
+
+// Levels crossing the triangle are first+1..last, returns how many
+static uint32_t contour_triangle_levels(const float* value, const uint32_t* v, int32_t* first){
+    float lo = value[v[0]], hi = lo;
+    lo = value[v[1]] < lo ? value[v[1]] : lo;
+    hi = value[v[1]] > hi ? value[v[1]] : hi;
+    lo = value[v[2]] < lo ? value[v[2]] : lo;
+    hi = value[v[2]] > hi ? value[v[2]] : hi;
+    *first = (int32_t)floorf(lo);
+    return (uint32_t)((int32_t)floorf(hi) - *first);
+}
+
+// Where level crosses the edge a-b, always interpolated from the lower index
+static void contour_crossing(const float* value, Vec3Soa positions, uint32_t a, uint32_t b, float level, float* point){
+    if(a > b){
+        uint32_t swap = a;
+        a = b;
+        b = swap;
+    }
+    float t = (level - value[a])/(value[b] - value[a]);
+    point[0] = positions.x[a] + t*(positions.x[b] - positions.x[a]);
+    point[1] = positions.y[a] + t*(positions.y[b] - positions.y[a]);
+    point[2] = positions.z[a] + t*(positions.z[b] - positions.z[a]);
+}
+
+static ContourSegment* contour_emit_triangle(const Contour* contour, const float* value, Vec3Soa positions, uint32_t t,
+                                             ContourSegment* out){
+    const uint32_t* v = contour->triangles + 3*t;
+    const uint32_t* e = contour->triangleEdges + 3*t;
+    int32_t first;
+    uint32_t count = contour_triangle_levels(value, v, &first);
+    for(uint32_t l = 1; l<=count; ++l){
+        int32_t level = first + (int32_t)l;
+        float at = (float)level;
+        out->level = level;
+        out->triangle = t;
+        for(uint32_t k = 0; k<3; ++k){
+            uint32_t a = v[k], b = v[k == 2 ? 0 : k+1];
+            int aboveA = value[a] >= at, aboveB = value[b] >= at;
+            if(aboveA && !aboveB){
+                contour_crossing(value, positions, a, b, at, out->start);
+                out->startEdge = e[k];
+            } else if(!aboveA && aboveB){
+                contour_crossing(value, positions, a, b, at, out->end);
+                out->endEdge = e[k];
+            }
+        }
+        ++out;
+    }
+    return out;
+}
+
+static void contour_count_range(void* data, uint32_t begin, uint32_t end){
+    Contour* contour = ((ContourJob*)data)->contour;
+    for(uint32_t c = begin; c<end; ++c){
+        uint32_t last = (c+1)*CONTOUR_CHUNK < contour->triangleCount ? (c+1)*CONTOUR_CHUNK : contour->triangleCount;
+        uint32_t count = 0;
+        for(uint32_t t = c*CONTOUR_CHUNK; t<last; ++t){
+            if(contour->triangleEdges[3*t] != CONTOUR_NONE){
+                int32_t first;
+                count += contour_triangle_levels(contour->value, contour->triangles + 3*t, &first);
+            }
+        }
+        contour->chunkOffsets[c] = count;
+    }
+}
+
+static void contour_write_range(void* data, uint32_t begin, uint32_t end){
+    ContourJob* job = (ContourJob*)data;
+    Contour* contour = job->contour;
+    for(uint32_t c = begin; c<end; ++c){
+        uint32_t last = (c+1)*CONTOUR_CHUNK < contour->triangleCount ? (c+1)*CONTOUR_CHUNK : contour->triangleCount;
+        ContourSegment* out = contour->segments + contour->chunkOffsets[c];
+        for(uint32_t t = c*CONTOUR_CHUNK; t<last; ++t){
+            if(contour->triangleEdges[3*t] != CONTOUR_NONE){
+                out = contour_emit_triangle(contour, contour->value, job->positions, t, out);
+            }
+        }
+    }
+}
+
+uint32_t contour_extract(Contour* contour, Vec3Soa positions){
+    ContourJob job = {contour, positions, {0.0f, 0.0f, 0.0f}, 0.0f, NULL};
+    parallel_for(&job, contour->chunkCount, 1, contour_count_range);
+    contour->segmentCount = prefix_sum_u32(contour->chunkOffsets, contour->chunkCount);
+    if(contour->segmentCount > contour->segmentCapacity){
+        contour->segmentCapacity = contour->segmentCount + contour->segmentCount/4;
+        contour->segments = (ContourSegment*)mem_realloc(MEM_TAG_CONTOUR, contour->segments,
+                                                         contour->segmentCapacity*sizeof(ContourSegment));
+    }
+    parallel_for(&job, contour->chunkCount, 1, contour_write_range);
+    if(positions.x != contour->extracted.x){
+        memcpy(contour->extracted.x, positions.x, contour->vertexCount*sizeof(float));
+        memcpy(contour->extracted.y, positions.y, contour->vertexCount*sizeof(float));
+        memcpy(contour->extracted.z, positions.z, contour->vertexCount*sizeof(float));
+    }
+    return contour->segmentCount;
+}
+
+uint32_t contour_extract_reference(const Contour* contour, Vec3Soa positions, ContourSegment* out){
+    vec3 axis;
+    float offset;
+    contour_level_axis(&contour->desc, axis, &offset);
+    float* value = (float*)mem_alloc(MEM_TAG_CONTOUR, (contour->vertexCount+1)*sizeof(float));
+    for(uint32_t i = 0; i<contour->vertexCount; ++i){
+        value[i] = positions.x[i]*axis[0] + positions.y[i]*axis[1] + positions.z[i]*axis[2] + offset;
+    }
+    const float* p[3] = {positions.x, positions.y, positions.z};
+    uint32_t count = 0;
+    for(uint32_t t = 0; t<contour->triangleCount; ++t){
+        const uint32_t* v = contour->triangles + 3*t;
+        if(!contour_triangle_valid(v)){
+            continue;
+        }
+        float lo = fminf(fminf(value[v[0]], value[v[1]]), value[v[2]]);
+        float hi = fmaxf(fmaxf(value[v[0]], value[v[1]]), value[v[2]]);
+        for(int32_t level = (int32_t)floorf(lo) + 1; level <= (int32_t)floorf(hi); ++level){
+            if(out){
+                ContourSegment* segment = &out[count];
+                segment->level = level;
+                segment->triangle = t;
+                for(uint32_t k = 0; k<3; ++k){
+                    uint32_t a = v[k], b = v[(k+1)%3];
+                    if((value[a] >= (float)level) == (value[b] >= (float)level)){
+                        continue;
+                    }
+                    int down = value[a] >= (float)level;
+                    uint32_t i = a < b ? a : b, j = a < b ? b : a;
+                    float s = ((float)level - value[i])/(value[j] - value[i]);
+                    for(int c = 0; c<3; ++c){
+                        (down ? segment->start : segment->end)[c] = p[c][i] + s*(p[c][j] - p[c][i]);
+                    }
+                    *(down ? &segment->startEdge : &segment->endEdge) = contour->triangleEdges[3*t+k];
+                }
+            }
+            count++;
+        }
+    }
+    mem_free(value);
+    return count;
+}
+
+// ---------------------------------------------------------
+// Stitching
+// ---------------------------------------------------------
+static void* contour_grow(void* buffer, uint32_t* capacity, uint32_t count, size_t size){
+    if(count <= *capacity){
+        return buffer;
+    }
+    *capacity = count + count/4;
+    return mem_realloc(MEM_TAG_CONTOUR, buffer, (size_t)*capacity*size);
+}
+
+// Room a level gets to grow in before contour_update has to stitch everything again
+static uint32_t contour_slack(uint32_t count){
+    return count + count/4 + 16;
+}
+
+static uint32_t contour_chunk_end(const Contour* contour, uint32_t c){
+    return c+1 < contour->chunkCount ? contour->chunkOffsets[c+1] : contour->segmentCount;
+}
+
+static void contour_level_histogram(void* data, uint32_t begin, uint32_t end){
+    Contour* contour = (Contour*)data;
+    for(uint32_t c = begin; c<end; ++c){
+        uint32_t* counts = contour->chunkLevels + (size_t)c*contour->levelCount;
+        memset(counts, 0, contour->levelCount*sizeof(uint32_t));
+        for(uint32_t i = contour->chunkOffsets[c]; i<contour_chunk_end(contour, c); ++i){
+            counts[contour->segments[i].level - contour->firstLevel]++;
+        }
+    }
+}
+
+static void contour_level_scatter(void* data, uint32_t begin, uint32_t end){
+    Contour* contour = (Contour*)data;
+    for(uint32_t c = begin; c<end; ++c){
+        uint32_t* slots = contour->chunkLevels + (size_t)c*contour->levelCount;
+        for(uint32_t i = contour->chunkOffsets[c]; i<contour_chunk_end(contour, c); ++i){
+            contour->sorted[slots[contour->segments[i].level - contour->firstLevel]++] = contour->segments[i];
+        }
+    }
+}
+
+// Links every slot of level l to the slot starting where it ends. A slot
+// that two others end on keeps the first link.
+static void contour_link_level(Contour* contour, uint32_t l){
+    ContourScratch* scratch = &contour->scratch[job_thread_index()];
+    uint32_t stamp = contour->stamp + l + 1;
+    uint32_t begin = contour->levels[l].firstSlot, end = begin + contour->levels[l].slotCount;
+    for(uint32_t s = begin; s<end; ++s){
+        uint32_t edge = contour->sorted[s].startEdge;
+        if(scratch->edgeStamp[edge] != stamp){
+            scratch->edgeStamp[edge] = stamp;
+            scratch->edgeSlot[edge] = s;
+        }
+        contour->linked[s] = 0;
+    }
+    for(uint32_t s = begin; s<end; ++s){
+        uint32_t edge = contour->sorted[s].endEdge;
+        contour->next[s] = CONTOUR_NONE;
+        if(scratch->edgeStamp[edge] == stamp){
+            uint32_t to = scratch->edgeSlot[edge];
+            if(to != s && !contour->linked[to]){
+                contour->next[s] = to;
+                contour->linked[to] = 1;
+            }
+        }
+    }
+}
+
+// Walks the chains of level l, then its loops, into walk in strip order.
+// Every segment gives its start, a chain adds the end of its last segment
+// and a loop its first vertex again, then comes a restart.
+static void contour_walk_level(Contour* contour, uint32_t l){
+    ContourLevel* level = &contour->levels[l];
+    uint32_t begin = level->firstSlot, end = begin + level->slotCount;
+    uint32_t* walk = contour->walk;
+    uint32_t w = begin, chains = 0, loops = 0;
+    for(int closed = 0; closed<2; ++closed){
+        for(uint32_t head = begin; head<end; ++head){
+            // Chains start on the slots nothing links to
+            if((contour->linked[head] & 2) || (!closed && (contour->linked[head] & 1))){
+                continue;
+            }
+            uint32_t s = head;
+            do {
+                contour->linked[s] |= 2;
+                walk[w++] = s;
+                s = contour->next[s];
+            } while(s != CONTOUR_NONE && s != head);
+            walk[w-1] |= closed ? CONTOUR_WALK_LOOP : CONTOUR_WALK_CHAIN;
+            chains += !closed;
+            loops += closed;
+        }
+    }
+    level->chains = chains;
+    level->loops = loops;
+    level->vertexCount = level->slotCount + chains;
+    level->indexCount = level->slotCount + 2*chains + 2*loops;
+}
+
+// Fills the level's vertices and indices, restarts up to its index capacity
+static void contour_write_level(Contour* contour, uint32_t l){
+    const ContourLevel* level = &contour->levels[l];
+    uint32_t v = level->firstVertex, n = level->firstIndex, first = v;
+    for(uint32_t w = level->firstSlot; w<level->firstSlot + level->slotCount; ++w){
+        const ContourSegment* segment = &contour->sorted[contour->walk[w] & ~(CONTOUR_WALK_CHAIN | CONTOUR_WALK_LOOP)];
+        memcpy(contour->lineVertices + 3*v, segment->start, 3*sizeof(float));
+        contour->lineIndices[n++] = v++;
+        if(contour->walk[w] & CONTOUR_WALK_CHAIN){
+            memcpy(contour->lineVertices + 3*v, segment->end, 3*sizeof(float));
+            contour->lineIndices[n++] = v++;
+        } else if(contour->walk[w] & CONTOUR_WALK_LOOP){
+            contour->lineIndices[n++] = first;
+        } else {
+            continue;
+        }
+        contour->lineIndices[n++] = CONTOUR_RESTART;
+        first = v;
+    }
+    for(; n<level->firstIndex + level->indexCapacity; ++n){
+        contour->lineIndices[n] = CONTOUR_RESTART;
+    }
+}
+
+static void contour_count_levels(void* data, uint32_t begin, uint32_t end){
+    Contour* contour = (Contour*)data;
+    for(uint32_t l = begin; l<end; ++l){
+        contour_link_level(contour, l);
+        contour_walk_level(contour, l);
+    }
+}
+
+static void contour_write_levels(void* data, uint32_t begin, uint32_t end){
+    Contour* contour = (Contour*)data;
+    for(uint32_t l = begin; l<end; ++l){
+        contour_write_level(contour, l);
+    }
+}
+
+static void contour_scratch_alloc(Contour* contour, uint32_t threads){
+    contour->scratch = (ContourScratch*)mem_realloc(MEM_TAG_CONTOUR, contour->scratch, threads*sizeof(ContourScratch));
+    for(uint32_t i = contour->scratchCount; i<threads; ++i){
+        contour->scratch[i].edgeSlot = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, (contour->edgeCount+1)*sizeof(uint32_t));
+        contour->scratch[i].edgeStamp = (uint32_t*)mem_calloc(MEM_TAG_CONTOUR, contour->edgeCount+1, sizeof(uint32_t));
+    }
+    contour->scratchCount = threads;
+}
+
+// Scratch for every job thread and stamps for every level
+static void contour_scratch_prepare(Contour* contour){
+    uint32_t threads = job_thread_count() > 0 ? job_thread_count() : 1;
+    if(contour->scratchCount < threads){
+        contour_scratch_alloc(contour, threads);
+    }
+    if(contour->stamp > UINT32_MAX - contour->levelCount - 1){
+        for(uint32_t i = 0; i<contour->scratchCount; ++i){
+            memset(contour->scratch[i].edgeStamp, 0, contour->edgeCount*sizeof(uint32_t));
+        }
+        contour->stamp = 0;
+    }
+}
+
+static void contour_line_totals(Contour* contour){
+    contour->lineSegmentCount = 0;
+    contour->polylineCount = 0;
+    contour->loopCount = 0;
+    for(uint32_t l = 0; l<contour->levelCount; ++l){
+        contour->lineSegmentCount += contour->levels[l].slotCount;
+        contour->polylineCount += contour->levels[l].chains;
+        contour->loopCount += contour->levels[l].loops;
+    }
+}
+
+uint32_t contour_stitch(Contour* contour){
+    int32_t lo = INT32_MAX, hi = INT32_MIN;
+    for(uint32_t i = 0; i<contour->segmentCount; ++i){
+        lo = contour->segments[i].level < lo ? contour->segments[i].level : lo;
+        hi = contour->segments[i].level > hi ? contour->segments[i].level : hi;
+    }
+    contour->firstLevel = lo;
+    contour->levelCount = contour->segmentCount ? (uint32_t)(hi - lo) + 1 : 0;
+    contour_scratch_prepare(contour);
+    if(contour->levelCount > contour->levelCapacity){
+        contour->levelCapacity = contour->levelCount + contour->levelCount/4;
+        contour->levels = (ContourLevel*)mem_realloc(MEM_TAG_CONTOUR, contour->levels, contour->levelCapacity*sizeof(ContourLevel));
+        contour->dirtyLevels = (uint32_t*)mem_realloc(MEM_TAG_CONTOUR, contour->dirtyLevels, contour->levelCapacity*sizeof(uint32_t));
+        contour->chunkLevels = (uint32_t*)mem_realloc(MEM_TAG_CONTOUR, contour->chunkLevels,
+                                                      (size_t)(contour->chunkCount+1)*contour->levelCapacity*sizeof(uint32_t));
+    }
+    // Without segments nothing is allocated per level, levels and chunkLevels may be NULL
+    if(contour->levelCount > 0){
+        memset(contour->levels, 0, contour->levelCount*sizeof(ContourLevel));
+    }
+
+    // Counting sort by level, stable so every level keeps triangle order.
+    // Every level gets room to grow.
+    parallel_for(contour, contour->levelCount > 0 ? contour->chunkCount : 0, 1, contour_level_histogram);
+    uint32_t slot = 0;
+    for(uint32_t l = 0; l<contour->levelCount; ++l){
+        ContourLevel* level = &contour->levels[l];
+        level->firstSlot = slot;
+        for(uint32_t c = 0; c<contour->chunkCount; ++c){
+            uint32_t count = contour->chunkLevels[(size_t)c*contour->levelCount + l];
+            contour->chunkLevels[(size_t)c*contour->levelCount + l] = slot;
+            slot += count;
+        }
+        level->slotCount = slot - level->firstSlot;
+        level->slotCapacity = contour_slack(level->slotCount);
+        slot = level->firstSlot + level->slotCapacity;
+    }
+    if(slot > contour->slotCapacity){
+        contour->slotCapacity = slot + slot/4;
+        contour->sorted = (ContourSegment*)mem_realloc(MEM_TAG_CONTOUR, contour->sorted, contour->slotCapacity*sizeof(ContourSegment));
+        contour->next = (uint32_t*)mem_realloc(MEM_TAG_CONTOUR, contour->next, contour->slotCapacity*sizeof(uint32_t));
+        contour->walk = (uint32_t*)mem_realloc(MEM_TAG_CONTOUR, contour->walk, contour->slotCapacity*sizeof(uint32_t));
+        contour->linked = (uint8_t*)mem_realloc(MEM_TAG_CONTOUR, contour->linked, contour->slotCapacity);
+    }
+    parallel_for(contour, contour->levelCount > 0 ? contour->chunkCount : 0, 1, contour_level_scatter);
+
+    // Link and count per level, then write
+    parallel_for(contour, contour->levelCount, 1, contour_count_levels);
+    contour->stamp += contour->levelCount;
+    uint32_t vertex = 0, index = 0;
+    for(uint32_t l = 0; l<contour->levelCount; ++l){
+        ContourLevel* level = &contour->levels[l];
+        level->firstVertex = vertex;
+        level->vertexCapacity = contour_slack(level->vertexCount);
+        level->firstIndex = index;
+        level->indexCapacity = contour_slack(level->indexCount);
+        vertex += level->vertexCapacity;
+        index += level->indexCapacity;
+    }
+    contour->lineVertexCount = vertex;
+    contour->lineIndexCount = index;
+    contour->lineVertices = (float*)contour_grow(contour->lineVertices, &contour->vertexCapacity, 3*vertex, sizeof(float));
+    contour->lineIndices = (uint32_t*)contour_grow(contour->lineIndices, &contour->indexCapacity, index, sizeof(uint32_t));
+    parallel_for(contour, contour->levelCount, 1, contour_write_levels);
+    contour_line_totals(contour);
+    return contour->lineIndexCount;
+}
+
+// ---------------------------------------------------------
+// Updates
+// ---------------------------------------------------------
+
+// Snapshots the vertices of every vertex chunk that moved further than
+// epsilon or to another level, into moved at the chunk's first vertex
+static void contour_detect_range(void* data, uint32_t begin, uint32_t end){
+    ContourJob* job = (ContourJob*)data;
+    Contour* contour = job->contour;
+    Vec3Soa p = job->positions, q = contour->extracted;
+    float epsilon2 = contour->desc.epsilon*contour->desc.epsilon;
+    for(uint32_t c = begin; c<end; ++c){
+        uint32_t first = c*CONTOUR_VERTEX_GRAIN;
+        uint32_t last = first + CONTOUR_VERTEX_GRAIN < contour->vertexCount ? first + CONTOUR_VERTEX_GRAIN : contour->vertexCount;
+        Vec3Soa chunk = {p.x+first, p.y+first, p.z+first};
+        batch_project_points(chunk, job->axis, job->offset, contour->pending+first, last-first);
+        uint32_t count = 0;
+        for(uint32_t i = first; i<last; ++i){
+            float dx = p.x[i] - q.x[i], dy = p.y[i] - q.y[i], dz = p.z[i] - q.z[i];
+            if(dx*dx + dy*dy + dz*dz > epsilon2 || floorf(contour->pending[i]) != floorf(contour->value[i])){
+                contour->moved[first + count++] = i;
+            }
+        }
+        contour->movedCounts[c] = count;
+    }
+}
+
+// Marks the levels a dirty triangle crosses with its current values
+static int contour_mark_levels(Contour* contour, uint32_t t, int counting){
+    int32_t first;
+    uint32_t count = contour_triangle_levels(contour->value, contour->triangles + 3*t, &first);
+    if(count && (first + 1 < contour->firstLevel || first + (int32_t)count >= contour->firstLevel + (int32_t)contour->levelCount)){
+        return 0;
+    }
+    for(uint32_t k = 1; k<=count; ++k){
+        uint32_t l = (uint32_t)(first + (int32_t)k - contour->firstLevel);
+        ContourLevel* level = &contour->levels[l];
+        if(!level->dirty){
+            level->dirty = 1;
+            level->freshCount = 0;
+            contour->dirtyLevels[contour->dirtyLevelCount++] = l;
+        }
+        level->freshCount += counting;
+    }
+    contour->freshCount += counting ? count : 0;
+    return 1;
+}
+
+// Rebuilds every dirty level from its clean slots and fresh segments, then
+// links, walks and writes it if it still fits its room
+static void contour_update_levels(void* data, uint32_t begin, uint32_t end){
+    Contour* contour = (Contour*)data;
+    for(uint32_t i = begin; i<end; ++i){
+        uint32_t l = contour->dirtyLevels[i];
+        ContourLevel* level = &contour->levels[l];
+        uint32_t first = level->firstSlot, count = 0;
+        for(uint32_t s = first; s<first + level->slotCount; ++s){
+            if(!contour->triangleDirty[contour->sorted[s].triangle]){
+                contour->sorted[first + count++] = contour->sorted[s];
+            }
+        }
+        level->slotCount = count + level->freshCount;
+        if(level->slotCount > level->slotCapacity){
+            continue;
+        }
+        memcpy(contour->sorted + first + count, contour->freshSorted + level->freshFirst, level->freshCount*sizeof(ContourSegment));
+        contour_link_level(contour, l);
+        contour_walk_level(contour, l);
+        if(level->vertexCount <= level->vertexCapacity && level->indexCount <= level->indexCapacity){
+            contour_write_level(contour, l);
+        }
+    }
+}
+
+static void contour_update_clear(Contour* contour){
+    for(uint32_t i = 0; i<contour->dirtyTriangleCount; ++i){
+        contour->triangleDirty[contour->dirtyTriangles[i]] = 0;
+    }
+    for(uint32_t i = 0; i<contour->dirtyLevelCount; ++i){
+        contour->levels[contour->dirtyLevels[i]].dirty = 0;
+    }
+}
+
+static uint32_t contour_rebuild(Contour* contour, Vec3Soa positions){
+    contour_update_clear(contour);
+    contour_evaluate_height(contour, positions);
+    contour_extract(contour, positions);
+    contour_stitch(contour);
+    contour->rebuildCount++;
+    // Nothing is left to clear, the next update starts from a clean slate
+    contour->dirtyTriangleCount = 0;
+    contour->dirtyLevelCount = 0;
+    contour->updatedLevelCount = contour->levelCount;
+    return contour->triangleCount;
+}
+
+uint32_t contour_update(Contour* contour, Vec3Soa positions){
+    if(contour->levelCount == 0){
+        return contour_rebuild(contour, positions);
+    }
+    ContourJob job = {contour, positions, {0.0f, 0.0f, 0.0f}, 0.0f, NULL};
+    contour_level_axis(&contour->desc, job.axis, &job.offset);
+    uint32_t vertexChunks = (contour->vertexCount + CONTOUR_VERTEX_GRAIN-1)/CONTOUR_VERTEX_GRAIN;
+    parallel_for(&job, vertexChunks, 1, contour_detect_range);
+
+    // Triangles around the moved vertices, and the levels they crossed
+    contour->movedCount = 0;
+    contour->dirtyTriangleCount = 0;
+    contour->dirtyLevelCount = 0;
+    contour->updatedLevelCount = 0;
+    contour->freshCount = 0;
+    for(uint32_t c = 0; c<vertexChunks; ++c){
+        for(uint32_t i = 0; i<contour->movedCounts[c]; ++i){
+            uint32_t v = contour->moved[c*CONTOUR_VERTEX_GRAIN + i];
+            for(uint32_t k = contour->vertexTriangleOffsets[v]; k<contour->vertexTriangleOffsets[v+1]; ++k){
+                uint32_t t = contour->vertexTriangles[k];
+                if(!contour->triangleDirty[t]){
+                    contour->triangleDirty[t] = 1;
+                    contour->dirtyTriangles[contour->dirtyTriangleCount++] = t;
+                    contour_mark_levels(contour, t, 0);
+                }
+            }
+        }
+        contour->movedCount += contour->movedCounts[c];
+    }
+    if(contour->movedCount == 0){
+        return 0;
+    }
+
+    // New values, then the levels and segments of the dirty triangles, from
+    // the snapshot so they meet the clean ones bit for bit
+    Vec3Soa p = positions, q = contour->extracted;
+    for(uint32_t c = 0; c<vertexChunks; ++c){
+        for(uint32_t i = 0; i<contour->movedCounts[c]; ++i){
+            uint32_t v = contour->moved[c*CONTOUR_VERTEX_GRAIN + i];
+            contour->value[v] = contour->pending[v];
+            q.x[v] = p.x[v];
+            q.y[v] = p.y[v];
+            q.z[v] = p.z[v];
+        }
+    }
+    for(uint32_t i = 0; i<contour->dirtyTriangleCount; ++i){
+        // A level outside the stitched ones needs a new layout
+        if(!contour_mark_levels(contour, contour->dirtyTriangles[i], 1)){
+            return contour_rebuild(contour, positions);
+        }
+    }
+    if(contour->freshCount > contour->freshCapacity){
+        contour->freshCapacity = contour->freshCount + contour->freshCount/4;
+        contour->fresh = (ContourSegment*)mem_realloc(MEM_TAG_CONTOUR, contour->fresh, contour->freshCapacity*sizeof(ContourSegment));
+        contour->freshSorted = (ContourSegment*)mem_realloc(MEM_TAG_CONTOUR, contour->freshSorted, contour->freshCapacity*sizeof(ContourSegment));
+    }
+    ContourSegment* out = contour->fresh;
+    for(uint32_t i = 0; i<contour->dirtyTriangleCount; ++i){
+        out = contour_emit_triangle(contour, contour->value, q, contour->dirtyTriangles[i], out);
+    }
+    uint32_t fresh = 0;
+    for(uint32_t i = 0; i<contour->dirtyLevelCount; ++i){
+        ContourLevel* level = &contour->levels[contour->dirtyLevels[i]];
+        level->freshFirst = fresh;
+        fresh += level->freshCount;
+        level->freshCount = 0;
+    }
+    for(uint32_t i = 0; i<contour->freshCount; ++i){
+        ContourLevel* level = &contour->levels[contour->fresh[i].level - contour->firstLevel];
+        contour->freshSorted[level->freshFirst + level->freshCount++] = contour->fresh[i];
+    }
+
+    contour_scratch_prepare(contour);
+    parallel_for(contour, contour->dirtyLevelCount, 1, contour_update_levels);
+    contour->stamp += contour->levelCount;
+    for(uint32_t i = 0; i<contour->dirtyLevelCount; ++i){
+        const ContourLevel* level = &contour->levels[contour->dirtyLevels[i]];
+        if(level->slotCount > level->slotCapacity || level->vertexCount > level->vertexCapacity ||
+           level->indexCount > level->indexCapacity){
+            return contour_rebuild(contour, positions);
+        }
+    }
+    contour_update_clear(contour);
+    contour_line_totals(contour);
+    contour->updatedLevelCount = contour->dirtyLevelCount;
+    return contour->dirtyTriangleCount;
+}
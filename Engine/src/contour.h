@@ -0,0 +1,187 @@
+#pragma once
+#include <stdint.h>
+#include <cglm/cglm.h>
+#include "batch.h"
+#include "particle_graph.h"
+
+// Contour lines of a scalar field over a triangle mesh, like the lines of
+// equal height on a topographic map.
+//
+// The field has one value per vertex, by default the height along an axis,
+// and the iso-levels are origin + k*spacing for every integer k. Values are
+// kept in level units, (field - origin)/spacing, so level k sits at k. A
+// vertex counts as above level k if its value is >= k. That makes every
+// triangle crossed by level k exactly once (one vertex on one side, two on
+// the other), so it gives one segment per crossing level and no special
+// cases for vertices that lie on a level.
+//
+// A segment runs from the side of the triangle where the field goes down
+// (in winding order) to the side where it goes up, so the higher side is on
+// its left seen from the front. Both ends name the mesh edge they cross, and
+// the crossing point is computed from the edge's vertices in index order.
+// Neighbouring triangles therefore agree on it bit for bit, and the end of
+// one segment is the start of the next one across the edge.
+//
+// Extraction evaluates the field with a batch kernel, counts the segments of
+// every chunk of CONTOUR_CHUNK triangles, prefix sums the counts and writes
+// the chunks in parallel into one buffer. Segments come out ordered by
+// triangle, then level, whatever the thread count or ISA;
+// contour_extract_reference is the scalar single threaded version that has
+// to produce the same bits.
+//
+// Stitching joins the segments into polylines for GL_LINE_STRIP with
+// primitive restart: every crossing becomes one vertex instead of two line
+// ends. The segments are counting sorted by level, then every level is a
+// job that links each segment to the one starting on the edge it ends on,
+// looked up in a per thread table indexed by edge id. Chains are emitted
+// first, from the segments nothing links to (they end on the mesh border),
+// then the closed loops, which repeat their first vertex at the end. Like
+// the extraction, levels are counted, prefix summed and then written. Every
+// level gets a quarter more room than it needs in each buffer, the unused
+// indices are restarts so the whole index buffer still draws in one call.
+//
+// contour_update follows a deforming mesh without redoing all of that. It
+// snapshots the vertices that moved further than desc.epsilon or to another
+// level since their last snapshot, and re-extracts only the triangles around
+// them, from the snapshot positions, so the new segments meet the untouched
+// ones bit for bit. The levels those triangles crossed before or cross now
+// drop their old segments, take the new ones and are linked and written
+// again in their room. Only when a level outgrows its room or a new level
+// appears does it extract and stitch everything.
+
+#define CONTOUR_NONE    UINT32_MAX
+#define CONTOUR_CHUNK   4096        // triangles per extraction job
+#define CONTOUR_RESTART 0xffffffffu // GL_PRIMITIVE_RESTART_FIXED_INDEX for 32 bit indices
+
+typedef struct {
+    vec3 axis;          // the default field is dot(position, axis)
+    float spacing;      // field units between levels
+    float origin;       // field value of level 0
+    float epsilon;      // contour_update ignores vertices that moved less, unless they changed level
+} ContourDesc;
+
+typedef struct {
+    float start[3];
+    float end[3];
+    uint32_t startEdge;     // mesh edges crossed at start and end
+    uint32_t endEdge;
+    int32_t level;          // field value origin + level*spacing
+    uint32_t triangle;
+} ContourSegment;
+
+// Where a level lives in sorted, walk, lineVertices and lineIndices
+typedef struct {
+    uint32_t firstSlot;
+    uint32_t slotCount;
+    uint32_t slotCapacity;
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t vertexCapacity;
+    uint32_t firstIndex;
+    uint32_t indexCount;        // the rest up to indexCapacity are restarts
+    uint32_t indexCapacity;
+    uint32_t chains;
+    uint32_t loops;
+    uint32_t freshFirst;        // contour_update's new segments for the level
+    uint32_t freshCount;
+    uint32_t dirty;
+} ContourLevel;
+
+typedef struct ContourScratch ContourScratch;
+
+typedef struct {
+    ContourDesc desc;
+    const uint32_t* triangles;  // 3 vertices per triangle, kept by the caller
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+
+    // Unique edges, CONTOUR_NONE for the sides of triangles that are left out
+    uint32_t edgeCount;
+    uint32_t* edgeVertices;     // 2 per edge, lower index first
+    uint32_t* triangleEdges;    // 3 per triangle: sides v0v1, v1v2, v2v0
+
+    float* value;               // per vertex, in level units
+    uint32_t chunkCount;
+    uint32_t* chunkOffsets;     // first segment of every chunk
+
+    ContourSegment* segments;
+    uint32_t segmentCount;
+    uint32_t segmentCapacity;
+
+    // Stitched polylines: 3 floats per vertex, strips separated by CONTOUR_RESTART
+    float* lineVertices;
+    uint32_t lineVertexCount;   // including the room of every level
+    uint32_t* lineIndices;
+    uint32_t lineIndexCount;    // to draw, including the restarts in the room of every level
+    uint32_t lineSegmentCount;  // in the strips, contour_update keeps it current
+    uint32_t polylineCount;     // open ones, the rest are loops
+    uint32_t loopCount;
+
+    int32_t firstLevel;         // of the last stitch
+    uint32_t levelCount;
+    ContourLevel* levels;
+    uint32_t* chunkLevels;      // per chunk and level, where the chunk's segments go in order
+    ContourSegment* sorted;     // the segments by level, after a stitch a level's slots are in triangle order
+    uint32_t* next;             // per slot, the slot it links to or CONTOUR_NONE
+    uint8_t* linked;            // per slot, whether a slot links to it
+    uint32_t* walk;             // the slots of every level in strip order
+    uint32_t levelCapacity;
+    uint32_t slotCapacity;
+    uint32_t vertexCapacity;
+    uint32_t indexCapacity;
+    ContourScratch* scratch;    // edge tables, per job thread
+    uint32_t scratchCount;
+    uint32_t stamp;             // tells the levels of every stitch apart in the edge tables
+
+    // contour_update
+    Vec3Soa extracted;          // per vertex, the snapshot the segments come from
+    uint32_t* vertexTriangleOffsets;    // vertexCount+1
+    uint32_t* vertexTriangles;
+    float* pending;             // per vertex, the value of the new positions
+    uint32_t* moved;            // the moved vertices of every vertex chunk, from its first vertex
+    uint32_t* movedCounts;
+    uint32_t movedCount;
+    uint8_t* triangleDirty;
+    uint32_t* dirtyTriangles;
+    uint32_t dirtyTriangleCount;
+    uint32_t* dirtyLevels;
+    uint32_t dirtyLevelCount;
+    ContourSegment* fresh;      // the dirty triangles' segments in triangle order
+    ContourSegment* freshSorted;    // and by level
+    uint32_t freshCount;
+    uint32_t freshCapacity;
+    uint32_t updatedLevelCount; // levels stitched again by the last contour_update, all of them after a rebuild
+    uint32_t rebuildCount;      // updates that extracted and stitched everything
+} Contour;
+
+// Triangles with a vertex of CONTOUR_NONE or a repeated vertex are left out
+void contour_init(Contour* contour, const ContourDesc* desc, const uint32_t* triangles, uint32_t triangleCount, uint32_t vertexCount);
+// Triangles of the graph's render vertices, the graph has to outlive the contour
+void contour_init_graph(Contour* contour, const ContourDesc* desc, const ParticleGraph* graph);
+void contour_free(Contour* contour);
+
+// Height along desc.axis into value, as a batch kernel over parallel_for ranges
+void contour_evaluate_height(Contour* contour, Vec3Soa positions);
+// Any other per vertex field into value
+void contour_evaluate_field(Contour* contour, const float* field);
+
+// Segments of the current values into segments, returns segmentCount.
+// Uses parallel_for, the buffer only grows. Takes the positions as the
+// snapshot for contour_update.
+uint32_t contour_extract(Contour* contour, Vec3Soa positions);
+// Plain loops from the positions, for checking contour_evaluate_height and
+// contour_extract. out needs room for every segment; returns the count, or
+// only counts if out is NULL.
+uint32_t contour_extract_reference(const Contour* contour, Vec3Soa positions, ContourSegment* out);
+
+// Polylines of the current segments into lineVertices and lineIndices,
+// returns lineIndexCount. Uses parallel_for, the buffers only grow. On a mesh that is
+// not oriented consistently, segments that cannot be linked start polylines
+// of their own.
+uint32_t contour_stitch(Contour* contour);
+
+// Brings the strips of the height field up to new positions, re-extracting
+// only the triangles around the vertices that moved (see above). Extracts
+// and stitches everything if nothing was stitched yet. Leaves segments as
+// the last contour_extract made them. Returns the triangles re-extracted.
+uint32_t contour_update(Contour* contour, Vec3Soa positions);
@@ -0,0 +1,165 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "contour_renderer.h"
+#include "memory.h"
+
+int contour_renderer_init(ContourRenderer* renderer, const LineStyle* style, const ContourLodDesc* desc){
+    memset(renderer, 0, sizeof(*renderer));
+    renderer->desc = *desc;
+    return line_renderer_init(&renderer->lines, style);
+}
+
+void contour_renderer_free(ContourRenderer* renderer){
+    line_renderer_free(&renderer->lines);
+    mem_free(renderer->levelSegments);
+    mem_free(renderer->indices);
+    mem_free(renderer->ranges);
+    memset(renderer, 0, sizeof(*renderer));
+}
+
+// Bounding sphere and mean segment length of the vertices the strips use
+static void contour_renderer_bounds(ContourRenderer* renderer, const Contour* contour){
+    vec3 lo = {FLT_MAX, FLT_MAX, FLT_MAX}, hi = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    double length = 0.0;
+    uint32_t segments = 0;
+    for(uint32_t i = 0; i<contour->lineIndexCount; ++i){
+        uint32_t a = contour->lineIndices[i];
+        if(a == CONTOUR_RESTART){
+            continue;
+        }
+        const float* p = contour->lineVertices + 3*a;
+        glm_vec3_minv(lo, (float*)p, lo);
+        glm_vec3_maxv(hi, (float*)p, hi);
+        if(i+1 < contour->lineIndexCount && contour->lineIndices[i+1] != CONTOUR_RESTART){
+            length += glm_vec3_distance((float*)p, contour->lineVertices + 3*contour->lineIndices[i+1]);
+            ++segments;
+        }
+    }
+    if(segments == 0){
+        glm_vec3_zero(renderer->center);
+        renderer->radius = 0.0f;
+        renderer->segmentLength = 0.0f;
+        return;
+    }
+    glm_vec3_center(lo, hi, renderer->center);
+    renderer->radius = 0.5f*glm_vec3_distance(lo, hi);
+    renderer->segmentLength = (float)(length/segments);
+}
+
+// The level's strips at every stride-th vertex into indices from n, returns the new n
+static uint32_t contour_renderer_stride(ContourRenderer* renderer, const Contour* contour, uint32_t l, uint32_t stride,
+                                        uint32_t n, uint32_t* segments){
+    const uint32_t* s = contour->lineIndices + contour->levels[l].firstIndex;
+    uint32_t count = contour->levels[l].indexCount;
+    for(uint32_t begin = 0; begin<count; ){
+        uint32_t end = begin;
+        while(end<count && s[end] != CONTOUR_RESTART){
+            ++end;
+        }
+        uint32_t length = end - begin;
+        if(length >= 2){
+            // Loops keep at least 3 segments to stay loops
+            uint32_t step = stride;
+            if(length > 3 && s[begin] == s[end-1] && step > (length-1)/3){
+                step = (length-1)/3 > 0 ? (length-1)/3 : 1;
+            }
+            uint32_t first = n;
+            for(uint32_t i = begin; i+1<end; i += step){
+                renderer->indices[n++] = s[i];
+            }
+            renderer->indices[n++] = s[end-1];
+            *segments += n - first - 1;
+            renderer->indices[n++] = CONTOUR_RESTART;
+        }
+        begin = end + 1;
+    }
+    return n;
+}
+
+void contour_renderer_set(ContourRenderer* renderer, const Contour* contour){
+    renderer->spacing = contour->desc.spacing;
+    renderer->firstLevel = contour->firstLevel;
+    renderer->levelCount = contour->levelCount;
+    contour_renderer_bounds(renderer, contour);
+    if(renderer->rangeCapacity < contour->levelCount){
+        renderer->rangeCapacity = contour->levelCount;
+        mem_free(renderer->levelSegments);
+        mem_free(renderer->ranges);
+        renderer->levelSegments = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR,
+                                                        (size_t)CONTOUR_LOD_STRIDES*(contour->levelCount+1)*sizeof(uint32_t));
+        renderer->ranges = (LineRange*)mem_alloc(MEM_TAG_CONTOUR, (size_t)contour->levelCount*sizeof(LineRange));
+    }
+
+    uint32_t n = 0, total = 0, previous = UINT32_MAX;
+    renderer->strideCount = 0;
+    for(uint32_t j = 0; j<CONTOUR_LOD_STRIDES && contour->levelCount > 0; ++j){
+        uint32_t* offsets = renderer->levelSegments + j*(contour->levelCount+1);
+        uint32_t start = n, segments = 0;
+        for(uint32_t l = 0; l<contour->levelCount; ++l){
+            offsets[l] = total + segments;
+            // No stride makes a strip longer than the level has it
+            if(renderer->indexCapacity < n + contour->levels[l].indexCount){
+                renderer->indexCapacity = n + contour->levels[l].indexCount + (n + contour->levels[l].indexCount)/2;
+                renderer->indices = (uint32_t*)mem_realloc(MEM_TAG_CONTOUR, renderer->indices,
+                                                           (size_t)renderer->indexCapacity*sizeof(uint32_t));
+            }
+            n = contour_renderer_stride(renderer, contour, l, 1u << j, n, &segments);
+        }
+        offsets[contour->levelCount] = total + segments;
+        if(segments == previous){
+            n = start;
+            break;
+        }
+        total += segments;
+        previous = segments;
+        renderer->strideCount = j+1;
+    }
+    line_renderer_set_strips(&renderer->lines, contour->lineVertices, NULL, contour->lineVertexCount, renderer->indices, n);
+}
+
+uint32_t contour_renderer_draw(ContourRenderer* renderer, mat4 view, mat4 projection, const vec3 lightPos,
+                               const vec3 viewPos, float width, float height){
+    renderer->drawnLevels = 0;
+    renderer->drawnSegments = 0;
+    if(renderer->strideCount == 0){
+        return 0;
+    }
+    // Pixels per unit at the nearest point of the bounds, the camera looks down -z
+    vec4 center = {renderer->center[0], renderer->center[1], renderer->center[2], 1.0f};
+    vec4 eye, clip;
+    glm_mat4_mulv(view, center, eye);
+    eye[2] += renderer->radius;
+    glm_mat4_mulv(projection, eye, clip);
+    float w = clip[3] > 1e-6f ? clip[3] : 1e-6f;
+    float pixelsPerUnit = projection[1][1]*0.5f*height/w;
+
+    float lod = log2f(renderer->desc.minSpacing/(renderer->spacing*pixelsPerUnit));
+    lod = lod > 0.0f ? (lod < 30.0f ? lod : 30.0f) : 0.0f;
+    uint32_t k = (uint32_t)lod;
+    float fade = 1.0f - (lod - (float)k);
+    float strideLod = log2f(renderer->desc.minSegment/(renderer->segmentLength*pixelsPerUnit));
+    uint32_t stride = strideLod > 0.0f ? (uint32_t)strideLod : 0;
+    stride = stride < renderer->strideCount ? stride : renderer->strideCount-1;
+    renderer->levelLod = lod;
+    renderer->stride = stride;
+
+    const uint32_t* offsets = renderer->levelSegments + stride*(renderer->levelCount+1);
+    uint32_t step = 1u << k, count = 0;
+    for(uint32_t l = 0; l<renderer->levelCount; ++l){
+        uint32_t level = (uint32_t)(renderer->firstLevel + (int32_t)l);
+        if(level & (step-1)){
+            continue;
+        }
+        float lineWidth = level & step ? renderer->lines.style.width*fade : renderer->lines.style.width;
+        LineRange range = {offsets[l], offsets[l+1] - offsets[l], lineWidth};
+        if(range.segmentCount == 0){
+            continue;
+        }
+        renderer->ranges[count++] = range;
+        renderer->drawnSegments += range.segmentCount;
+    }
+    renderer->drawnLevels = count;
+    line_renderer_draw_ranges(&renderer->lines, view, projection, lightPos, viewPos, width, height, renderer->ranges, count);
+    return renderer->drawnSegments;
+}
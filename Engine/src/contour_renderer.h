@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <cglm/cglm.h>
+#include "contour.h"
+#include "line_renderer.h"
+
+// A Contour's strips drawn through a LineRenderer at a density that follows
+// the object's size on screen.
+//
+// Far away the levels of a fine contour crowd closer than a pixel and
+// millions of segments merge into grey. The levels are thinned out
+// hierarchically: with lod = log2(minSpacing / the level spacing on screen)
+// and k its integer part, only the levels that are multiples of 2^k are
+// drawn, and the odd multiples of 2^k narrow down to nothing while lod goes
+// up to k+1, where the multiples of 2^(k+1) are all that is left. Nothing
+// pops, and the full width levels stay between one and two minSpacing
+// apart on screen. Level numbers count from the field's origin, so a level
+// keeps its place in the hierarchy when the contour changes.
+//
+// Thinning the levels alone would still leave every level with all its
+// segments, so the strips are also kept at every 2^j-th vertex for j up to
+// CONTOUR_LOD_STRIDES-1, each stride a copy of the segments in the same
+// LineRenderer. The stride drawn keeps the mean segment at least
+// minSegment pixels long, it only changes once segments are a few pixels,
+// so it moves the lines by less than a pixel. Together the segments per
+// screen area stay about the same at any distance.
+//
+// The lod is per object, from the point of its bounding sphere nearest to
+// the camera, so no part of it gets too few lines. Objects large on screen
+// can be split into several contours to get it per part.
+
+#define CONTOUR_LOD_STRIDES 8   // along the strips every 1st up to 128th vertex
+
+typedef struct {
+    float minSpacing;   // pixels between the full width levels at least
+    float minSegment;   // pixels a segment along the strips is long at least, on average
+} ContourLodDesc;
+
+typedef struct {
+    ContourLodDesc desc;
+    LineRenderer lines;
+    float spacing;              // of the contour's levels, in field units
+    int32_t firstLevel;
+    uint32_t levelCount;
+    uint32_t strideCount;       // strides built, fewer if the strips got no shorter
+    uint32_t* levelSegments;    // per stride levelCount+1 offsets into the renderer's segments
+    float segmentLength;        // mean of the full detail segments
+    vec3 center;                // bounding sphere of the strips
+    float radius;
+    uint32_t* indices;          // strips of all strides, for set_strips
+    uint32_t indexCapacity;
+    LineRange* ranges;
+    uint32_t rangeCapacity;
+
+    // Of the last draw
+    float levelLod;
+    uint32_t stride;
+    uint32_t drawnLevels;
+    uint32_t drawnSegments;
+} ContourRenderer;
+
+// Returns 0 if the line shaders fail to build
+int contour_renderer_init(ContourRenderer* renderer, const LineStyle* style, const ContourLodDesc* desc);
+void contour_renderer_free(ContourRenderer* renderer);
+
+// Uploads the contour's strips, again after every contour_stitch or contour_update
+void contour_renderer_set(ContourRenderer* renderer, const Contour* contour);
+// Into the current framebuffer of width x height pixels, returns the segments drawn
+uint32_t contour_renderer_draw(ContourRenderer* renderer, mat4 view, mat4 projection, const vec3 lightPos,
+                               const vec3 viewPos, float width, float height);
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include "gpu_contour.h"
+#include "memory.h"
+#include "shader.h"
+
+#define GPU_CONTOUR_GROUP 256
+
+typedef struct {
+    uint32_t vertices[4];   // the last is the triangle id
+    uint32_t edges[4];
+} GpuContourTriangle;
+
+typedef struct {
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t first;
+    uint32_t baseInstance;
+    uint32_t required;
+} GpuContourCommand;
+
+static GLuint gpu_contour_buffer(GLenum target, GLsizeiptr size, const void* data, GLenum usage){
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, size, data, usage);
+    glBindBuffer(target, 0);
+    return buffer;
+}
+
+int gpu_contour_init(GpuContour* gpu, const Contour* contour, uint32_t capacity){
+    memset(gpu, 0, sizeof(*gpu));
+    gpu->fieldProgram = shader_create_compute(SHADER_DIR "contour_field.comp");
+    gpu->extractProgram = shader_create_compute(SHADER_DIR "contour_extract.comp");
+    gpu->commandProgram = shader_create_compute(SHADER_DIR "contour_command.comp");
+    if(!gpu->fieldProgram || !gpu->extractProgram || !gpu->commandProgram){
+        printf("GPU_CONTOUR: Failed to build the compute shaders\n");
+        gpu_contour_free(gpu);
+        return 0;
+    }
+    gpu->fieldCountLoc = glGetUniformLocation(gpu->fieldProgram, "vertexCount");
+    gpu->fieldAxisLoc = glGetUniformLocation(gpu->fieldProgram, "axis");
+    gpu->fieldOffsetLoc = glGetUniformLocation(gpu->fieldProgram, "offset");
+    gpu->extractCountLoc = glGetUniformLocation(gpu->extractProgram, "triangleCount");
+    gpu->extractCapacityLoc = glGetUniformLocation(gpu->extractProgram, "capacity");
+    gpu->commandCapacityLoc = glGetUniformLocation(gpu->commandProgram, "capacity");
+
+    gpu->desc = contour->desc;
+    gpu->vertexCount = contour->vertexCount;
+    gpu->capacity = capacity;
+    GpuContourTriangle* triangles = (GpuContourTriangle*)mem_alloc(MEM_TAG_CONTOUR, (contour->triangleCount+1)*sizeof(GpuContourTriangle));
+    for(uint32_t t = 0; t<contour->triangleCount; ++t){
+        if(contour->triangleEdges[3*t] == CONTOUR_NONE){
+            continue;
+        }
+        GpuContourTriangle* triangle = &triangles[gpu->triangleCount++];
+        memcpy(triangle->vertices, contour->triangles + 3*t, 3*sizeof(uint32_t));
+        memcpy(triangle->edges, contour->triangleEdges + 3*t, 3*sizeof(uint32_t));
+        triangle->vertices[3] = t;
+        triangle->edges[3] = 0;
+    }
+    gpu->triangles = gpu_contour_buffer(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(gpu->triangleCount+1)*sizeof(GpuContourTriangle),
+                                        triangles, GL_STATIC_DRAW);
+    mem_free(triangles);
+    gpu->values = gpu_contour_buffer(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(gpu->vertexCount+1)*sizeof(float), NULL, GL_DYNAMIC_COPY);
+    gpu->points = gpu_contour_buffer(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(capacity+1)*8*sizeof(float), NULL, GL_DYNAMIC_COPY);
+    gpu->edges = gpu_contour_buffer(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(capacity+1)*2*sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+    GpuContourCommand command = {0, 1, 0, 0, 0};
+    gpu->command = gpu_contour_buffer(GL_DRAW_INDIRECT_BUFFER, sizeof(command), &command, GL_DYNAMIC_COPY);
+
+    glGenVertexArrays(1, &gpu->vao);
+    glBindVertexArray(gpu->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, gpu->points);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 1;
+}
+
+void gpu_contour_free(GpuContour* gpu){
+    glDeleteVertexArrays(1, &gpu->vao);
+    glDeleteBuffers(1, &gpu->triangles);
+    glDeleteBuffers(1, &gpu->values);
+    glDeleteBuffers(1, &gpu->points);
+    glDeleteBuffers(1, &gpu->edges);
+    glDeleteBuffers(1, &gpu->command);
+    glDeleteProgram(gpu->fieldProgram);
+    glDeleteProgram(gpu->extractProgram);
+    glDeleteProgram(gpu->commandProgram);
+    memset(gpu, 0, sizeof(*gpu));
+}
+
+void gpu_contour_extract(GpuContour* gpu, GLuint particles){
+    // Same level units as contour_evaluate_height
+    float inverse = 1.0f/gpu->desc.spacing;
+    vec3 axis = {gpu->desc.axis[0]*inverse, gpu->desc.axis[1]*inverse, gpu->desc.axis[2]*inverse};
+    GpuContourCommand command = {0, 1, 0, 0, 0};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu->command);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command), &command);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gpu->values);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gpu->triangles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, gpu->points);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, gpu->edges);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, gpu->command);
+    if(gpu->vertexCount){
+        glUseProgram(gpu->fieldProgram);
+        glUniform1ui(gpu->fieldCountLoc, gpu->vertexCount);
+        glUniform3fv(gpu->fieldAxisLoc, 1, axis);
+        glUniform1f(gpu->fieldOffsetLoc, -gpu->desc.origin*inverse);
+        glDispatchCompute((gpu->vertexCount + GPU_CONTOUR_GROUP-1)/GPU_CONTOUR_GROUP, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    if(gpu->triangleCount){
+        glUseProgram(gpu->extractProgram);
+        glUniform1ui(gpu->extractCountLoc, gpu->triangleCount);
+        glUniform1ui(gpu->extractCapacityLoc, gpu->capacity);
+        glDispatchCompute((gpu->triangleCount + GPU_CONTOUR_GROUP-1)/GPU_CONTOUR_GROUP, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    glUseProgram(gpu->commandProgram);
+    glUniform1ui(gpu->commandCapacityLoc, gpu->capacity);
+    glDispatchCompute(1, 1, 1);
+    // The next draw sources the command and the points
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void gpu_contour_draw(const GpuContour* gpu){
+    glBindVertexArray(gpu->vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gpu->command);
+    glDrawArraysIndirect(GL_LINES, (void*)0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+uint32_t gpu_contour_read_segments(const GpuContour* gpu, ContourSegment* out){
+    GpuContourCommand command;
+    glBindBuffer(GL_COPY_READ_BUFFER, gpu->command);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(command), &command);
+    uint32_t count = command.required < gpu->capacity ? command.required : gpu->capacity;
+    float* points = (float*)mem_alloc(MEM_TAG_CONTOUR, ((size_t)count*8+1)*sizeof(float));
+    uint32_t* edges = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, ((size_t)count*2+1)*sizeof(uint32_t));
+    glBindBuffer(GL_COPY_READ_BUFFER, gpu->points);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)count*8*sizeof(float), points);
+    glBindBuffer(GL_COPY_READ_BUFFER, gpu->edges);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)count*2*sizeof(uint32_t), edges);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    for(uint32_t i = 0; i<count; ++i){
+        const float* p = points + 8*i;
+        memcpy(out[i].start, p, 3*sizeof(float));
+        memcpy(out[i].end, p + 4, 3*sizeof(float));
+        memcpy(&out[i].level, p + 3, sizeof(int32_t));
+        memcpy(&out[i].triangle, p + 7, sizeof(uint32_t));
+        out[i].startEdge = edges[2*i];
+        out[i].endEdge = edges[2*i+1];
+    }
+    mem_free(points);
+    mem_free(edges);
+    return command.required;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <glad/glad.h>
+#include <stdint.h>
+#include "contour.h"
+
+// Contour segments in compute shaders, needs GL 4.3.
+//
+// Reads the positions straight from a particle SSBO laid out like GpuVerlet's
+// (vec4, xyz position), so contours of a GPU simulation never round trip
+// through the CPU. One dispatch evaluates the height per vertex the way
+// contour_evaluate_height does, the next one takes a triangle per invocation
+// and appends its segments: every group sums its triangles' counts in shared
+// memory and reserves room with one atomic on the command buffer. A last
+// single invocation dispatch writes the vertex count of the
+// DrawArraysIndirectCommand, so drawing the segments as GL_LINES needs no
+// readback either.
+//
+// The triangles and edge ids come from a CPU Contour, and the values and
+// crossings are computed in the same order without fused multiply-adds, so
+// a GPU with IEEE division gives the CPU segments bit for bit. Only their
+// order differs, it depends on how the groups hit the atomic. Segments past
+// capacity are dropped; the command buffer still counts them (required).
+
+typedef struct {
+    ContourDesc desc;
+    uint32_t vertexCount;
+    uint32_t triangleCount;     // valid ones, only those are uploaded
+    uint32_t capacity;          // segments
+
+    GLuint triangles;
+    GLuint values;
+    GLuint points;              // 2 vec4 per segment, also the vertex buffer
+    GLuint edges;
+    GLuint command;             // DrawArraysIndirectCommand, then required
+
+    GLuint fieldProgram;
+    GLint fieldCountLoc, fieldAxisLoc, fieldOffsetLoc;
+    GLuint extractProgram;
+    GLint extractCountLoc, extractCapacityLoc;
+    GLuint commandProgram;
+    GLint commandCapacityLoc;
+    GLuint vao;                 // points at attribute 0
+} GpuContour;
+
+// Takes desc, triangles and edges from the contour, which may be freed
+// after. Returns 0 if the shaders fail to build.
+int gpu_contour_init(GpuContour* gpu, const Contour* contour, uint32_t capacity);
+void gpu_contour_free(GpuContour* gpu);
+
+// Segments of the positions in particles, from gpu->desc
+void gpu_contour_extract(GpuContour* gpu, GLuint particles);
+// The segments of the last extract as GL_LINES, from the indirect command
+void gpu_contour_draw(const GpuContour* gpu);
+
+// Blocks. For checks against the CPU: copies the segments that fit into out,
+// which needs room for capacity, and returns how many the triangles asked for.
+uint32_t gpu_contour_read_segments(const GpuContour* gpu, ContourSegment* out);
@@ -0,0 +1,286 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "gpu_verlet.h"
+#include "memory.h"
+#include "shader.h"
+
+#define GPU_VERLET_GROUP 256
+#define GPU_VERLET_UPLOAD_CHUNK 4096
+
+typedef struct {
+    uint32_t a;
+    uint32_t b;
+    float restLength;
+    float compliance;
+} GpuConstraint;
+
+static GLuint gpu_verlet_buffer(GLsizeiptr size, const void* data, GLenum usage){
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, usage);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+int gpu_verlet_init(GpuVerlet* gpu, const VerletSolver* solver){
+    memset(gpu, 0, sizeof(*gpu));
+    gpu->integrateProgram = shader_create_compute(SHADER_DIR "verlet_integrate.comp");
+    gpu->constraintProgram = shader_create_compute(SHADER_DIR "verlet_constraints.comp");
+    if(!gpu->integrateProgram || !gpu->constraintProgram){
+        printf("GPU_VERLET: Failed to build the compute shaders\n");
+        gpu_verlet_free(gpu);
+        return 0;
+    }
+    gpu->integrateCountLoc = glGetUniformLocation(gpu->integrateProgram, "particleCount");
+    gpu->integrateStepLoc = glGetUniformLocation(gpu->integrateProgram, "step");
+    gpu->integrateDampingLoc = glGetUniformLocation(gpu->integrateProgram, "damping");
+    gpu->constraintFirstLoc = glGetUniformLocation(gpu->constraintProgram, "first");
+    gpu->constraintCountLoc = glGetUniformLocation(gpu->constraintProgram, "count");
+    gpu->constraintSerialLoc = glGetUniformLocation(gpu->constraintProgram, "serial");
+    gpu->constraintStiffnessLoc = glGetUniformLocation(gpu->constraintProgram, "stiffness");
+    gpu->constraintXpbdLoc = glGetUniformLocation(gpu->constraintProgram, "xpbd");
+    gpu->constraintAlphaScaleLoc = glGetUniformLocation(gpu->constraintProgram, "alphaScale");
+
+    gpu->desc = solver->desc;
+    gpu->particleCount = solver->particleCount;
+    gpu->constraintCount = solver->constraintCount;
+
+    uint32_t n = solver->particleCount;
+    float* current = (float*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*4*sizeof(float));
+    float* previous = (float*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*4*sizeof(float));
+    for(uint32_t i = 0; i<n; ++i){
+        current[i*4+0] = solver->position.x[i];
+        current[i*4+1] = solver->position.y[i];
+        current[i*4+2] = solver->position.z[i];
+        current[i*4+3] = solver->inverseMass[i];
+        verlet_get_previous(solver, i, previous + i*4);
+        previous[i*4+3] = solver->inverseMass[i];
+    }
+    gpu->particles[0] = gpu_verlet_buffer((GLsizeiptr)n*4*sizeof(float), current, GL_DYNAMIC_COPY);
+    gpu->particles[1] = gpu_verlet_buffer((GLsizeiptr)n*4*sizeof(float), previous, GL_DYNAMIC_COPY);
+    mem_free(current);
+    mem_free(previous);
+
+    // The CPU keeps constraints by island, one dispatch per color needs them
+    // by color. Counting sort keeps the island order within a color.
+    uint32_t counts[VERLET_MAX_COLORS+1] = {0};
+    for(uint32_t i = 0; i<solver->constraintCount; ++i){
+        counts[solver->constraintColor[solver->constraintId[i]]]++;
+    }
+    uint32_t offset = 0;
+    for(uint32_t c = 0; c<=VERLET_MAX_COLORS; ++c){
+        if(counts[c] == 0){
+            continue;
+        }
+        gpu->colorOffsets[gpu->colorCount++] = offset;
+        uint32_t count = counts[c];
+        counts[c] = offset;
+        offset += count;
+        gpu->serialColor = c == VERLET_MAX_COLORS;
+    }
+    gpu->colorOffsets[gpu->colorCount] = offset;
+    GpuConstraint* constraints = (GpuConstraint*)mem_alloc(MEM_TAG_PHYSICS, (solver->constraintCount+1)*sizeof(GpuConstraint));
+    for(uint32_t i = 0; i<solver->constraintCount; ++i){
+        GpuConstraint* c = &constraints[counts[solver->constraintColor[solver->constraintId[i]]]++];
+        c->a = solver->constraintA[i];
+        c->b = solver->constraintB[i];
+        c->restLength = solver->restLength[i];
+        c->compliance = solver->compliance[i];
+    }
+    gpu->constraints = gpu_verlet_buffer((GLsizeiptr)(solver->constraintCount+1)*sizeof(GpuConstraint), constraints, GL_STATIC_DRAW);
+    mem_free(constraints);
+    gpu->lambdas = gpu_verlet_buffer((GLsizeiptr)(solver->constraintCount+1)*sizeof(float), NULL, GL_DYNAMIC_COPY);
+
+    glGenVertexArrays(2, gpu->vao);
+    for(int i = 0; i<2; ++i){
+        glBindVertexArray(gpu->vao[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, gpu->particles[i]);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 1;
+}
+
+void gpu_verlet_free(GpuVerlet* gpu){
+    if(gpu->readbackFence){
+        glDeleteSync(gpu->readbackFence);
+    }
+    glDeleteVertexArrays(2, gpu->vao);
+    glDeleteBuffers(2, gpu->particles);
+    glDeleteBuffers(1, &gpu->constraints);
+    glDeleteBuffers(1, &gpu->lambdas);
+    glDeleteBuffers(1, &gpu->indices);
+    glDeleteBuffers(1, &gpu->readback);
+    glDeleteProgram(gpu->integrateProgram);
+    glDeleteProgram(gpu->constraintProgram);
+    memset(gpu, 0, sizeof(*gpu));
+}
+
+void gpu_verlet_set_indices(GpuVerlet* gpu, const uint32_t* indices, uint32_t count){
+    uint32_t* clamped = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (count+1)*sizeof(uint32_t));
+    for(uint32_t i = 0; i<count; ++i){
+        clamped[i] = indices[i] < gpu->particleCount ? indices[i] : 0;
+    }
+    if(!gpu->indices){
+        glGenBuffers(1, &gpu->indices);
+    }
+    // The element buffer binding is VAO state, attach it to both
+    glBindVertexArray(gpu->vao[0]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu->indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)count*sizeof(uint32_t), clamped, GL_STATIC_DRAW);
+    glBindVertexArray(gpu->vao[1]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu->indices);
+    glBindVertexArray(0);
+    gpu->indexCount = count;
+    mem_free(clamped);
+}
+
+void gpu_verlet_step(GpuVerlet* gpu, float dt){
+    if(gpu->particleCount == 0){
+        return;
+    }
+    // Same substep, damping and gravity split as verlet_step
+    uint32_t substeps = gpu->desc.substeps > 1 ? gpu->desc.substeps : 1;
+    float h = dt/substeps;
+    float damping = substeps > 1 ? powf(gpu->desc.damping, 1.0f/substeps) : gpu->desc.damping;
+    int xpbd = gpu->desc.mode == VERLET_XPBD;
+    vec3 step;
+    glm_vec3_scale(gpu->desc.gravity, h*h, step);
+
+    glUseProgram(gpu->constraintProgram);
+    glUniform1f(gpu->constraintStiffnessLoc, gpu->desc.stiffness);
+    glUniform1ui(gpu->constraintXpbdLoc, xpbd);
+    glUniform1f(gpu->constraintAlphaScaleLoc, 1.0f/(h*h));
+    glUseProgram(gpu->integrateProgram);
+    glUniform1ui(gpu->integrateCountLoc, gpu->particleCount);
+    glUniform3fv(gpu->integrateStepLoc, 1, step);
+    glUniform1f(gpu->integrateDampingLoc, damping);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gpu->constraints);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, gpu->lambdas);
+
+    for(uint32_t sub = 0; sub<substeps; ++sub){
+        GLuint current = gpu->particles[gpu->current];
+        GLuint next = gpu->particles[gpu->current^1];
+        glUseProgram(gpu->integrateProgram);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, current);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, next);
+        glDispatchCompute((gpu->particleCount + GPU_VERLET_GROUP-1)/GPU_VERLET_GROUP, 1, 1);
+        gpu->current ^= 1;
+        if(xpbd){
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu->lambdas);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, NULL);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(gpu->constraintProgram);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, next);
+        for(uint32_t it = 0; it<gpu->desc.iterations; ++it){
+            for(uint32_t c = 0; c<gpu->colorCount; ++c){
+                uint32_t count = gpu->colorOffsets[c+1] - gpu->colorOffsets[c];
+                int serial = gpu->serialColor && c == gpu->colorCount-1;
+                glUniform1ui(gpu->constraintFirstLoc, gpu->colorOffsets[c]);
+                glUniform1ui(gpu->constraintCountLoc, count);
+                glUniform1ui(gpu->constraintSerialLoc, serial);
+                glDispatchCompute(serial ? 1 : (count + GPU_VERLET_GROUP-1)/GPU_VERLET_GROUP, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            }
+        }
+    }
+    // The next draw sources the particles as vertices
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void gpu_verlet_draw(const GpuVerlet* gpu, GLenum mode){
+    glBindVertexArray(gpu->vao[gpu->current]);
+    if(gpu->indexCount){
+        glDrawElements(mode, gpu->indexCount, GL_UNSIGNED_INT, (void*)0);
+    } else {
+        glDrawArrays(mode, 0, gpu->particleCount);
+    }
+    glBindVertexArray(0);
+}
+
+GLuint gpu_verlet_positions(const GpuVerlet* gpu){
+    return gpu->particles[gpu->current];
+}
+
+void gpu_verlet_upload_awake(GpuVerlet* gpu, const VerletSolver* solver){
+    float* staging = (float*)mem_frame_alloc(GPU_VERLET_UPLOAD_CHUNK*4*sizeof(float), 16);
+    if(!staging){
+        return;
+    }
+    GLuint buffers[2] = {gpu->particles[gpu->current], gpu->particles[gpu->current^1]};
+    for(int b = 0; b<2; ++b){
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[b]);
+        for(uint32_t k = 0; k<solver->awakeCount; ++k){
+            const VerletIsland* island = &solver->islands[solver->awakeIslands[k]];
+            for(uint32_t r = island->firstRun; r<island->firstRun+island->runCount; ++r){
+                for(uint32_t begin = solver->runs[r].begin; begin<solver->runs[r].end; begin += GPU_VERLET_UPLOAD_CHUNK){
+                    uint32_t end = begin + GPU_VERLET_UPLOAD_CHUNK < solver->runs[r].end ? begin + GPU_VERLET_UPLOAD_CHUNK : solver->runs[r].end;
+                    for(uint32_t i = begin; i<end; ++i){
+                        float* v = staging + (i-begin)*4;
+                        if(b == 0){
+                            v[0] = solver->position.x[i];
+                            v[1] = solver->position.y[i];
+                            v[2] = solver->position.z[i];
+                        } else {
+                            verlet_get_previous(solver, i, v);
+                        }
+                        v[3] = solver->inverseMass[i];
+                    }
+                    glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)begin*4*sizeof(float), (GLsizeiptr)(end-begin)*4*sizeof(float), staging);
+                }
+            }
+        }
+    }
+}
+
+void gpu_verlet_request_readback(GpuVerlet* gpu){
+    if(gpu->readbackFence){
+        return;
+    }
+    GLsizeiptr size = (GLsizeiptr)gpu->particleCount*4*sizeof(float);
+    if(!gpu->readback){
+        glGenBuffers(1, &gpu->readback);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, gpu->readback);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_READ);
+    }
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, gpu->particles[gpu->current]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, gpu->readback);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    gpu->readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Make sure the fence gets submitted, otherwise polling never sees it
+    glFlush();
+}
+
+int gpu_verlet_poll_readback(GpuVerlet* gpu, Vec3Soa positions){
+    if(!gpu->readbackFence){
+        return 0;
+    }
+    GLenum status = glClientWaitSync(gpu->readbackFence, 0, 0);
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED){
+        return 0;
+    }
+    glDeleteSync(gpu->readbackFence);
+    gpu->readbackFence = 0;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, gpu->readback);
+    const float* mapped = (const float*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)gpu->particleCount*4*sizeof(float), GL_MAP_READ_BIT);
+    if(mapped){
+        for(uint32_t i = 0; i<gpu->particleCount; ++i){
+            positions.x[i] = mapped[i*4+0];
+            positions.y[i] = mapped[i*4+1];
+            positions.z[i] = mapped[i*4+2];
+        }
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return mapped != NULL;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <glad/glad.h>
+#include <stdint.h>
+#include "verlet.h"
+
+// Verlet/PBD solver in compute shaders, needs GL 4.3.
+//
+// Built from a CPU VerletSolver so both share the constraint coloring, the
+// constraints are regrouped by color across islands. Particles are vec4 (xyz
+// position, w inverse mass) in two SSBOs that swap roles every step:
+// integration reads the current buffer and writes the new positions over the
+// previous ones. Constraints are one dispatch per
+// color with a barrier in between. The particle buffers are also the vertex
+// buffers, so drawing never goes through the CPU. Positions only come back on
+// request, asynchronously, e.g. for picking.
+
+typedef struct {
+    VerletDesc desc;
+    uint32_t particleCount;
+    uint32_t constraintCount;
+    uint32_t colorCount;
+    uint32_t colorOffsets[VERLET_MAX_COLORS+2];
+    int serialColor;
+
+    GLuint particles[2];
+    uint32_t current;       // index into particles of the latest positions
+    GLuint constraints;
+    GLuint lambdas;
+
+    GLuint integrateProgram;
+    GLint integrateCountLoc, integrateStepLoc, integrateDampingLoc;
+    GLuint constraintProgram;
+    GLint constraintFirstLoc, constraintCountLoc, constraintSerialLoc, constraintStiffnessLoc;
+    GLint constraintXpbdLoc, constraintAlphaScaleLoc;
+
+    // One VAO per particle buffer, position at attribute 0
+    GLuint vao[2];
+    GLuint indices;
+    uint32_t indexCount;
+
+    GLuint readback;
+    GLsync readbackFence;
+} GpuVerlet;
+
+// Uploads the solver's current state, including its mode, substeps and per
+// constraint compliance. Constraints added or broken since its last step are
+// not picked up. Returns 0 if the shaders fail to build.
+int gpu_verlet_init(GpuVerlet* gpu, const VerletSolver* solver);
+void gpu_verlet_free(GpuVerlet* gpu);
+
+// Element buffer for gpu_verlet_draw, e.g. ParticleGraph.renderToParticle.
+// PARTICLE_NONE entries are drawn at particle 0.
+void gpu_verlet_set_indices(GpuVerlet* gpu, const uint32_t* indices, uint32_t count);
+
+void gpu_verlet_step(GpuVerlet* gpu, float dt);
+// Draws the indices if set, otherwise every particle in order
+void gpu_verlet_draw(const GpuVerlet* gpu, GLenum mode);
+GLuint gpu_verlet_positions(const GpuVerlet* gpu);
+
+// Mirrors a CPU simulated solver: uploads the particles the solver's last
+// verlet_step moved, i.e. the islands awake at its start. Sleeping islands
+// cost no upload. Call after verlet_step, needs the same particle count.
+void gpu_verlet_upload_awake(GpuVerlet* gpu, const VerletSolver* solver);
+
+// Copies the current positions to a staging buffer and fences it. Ignored
+// while a readback is still in flight.
+void gpu_verlet_request_readback(GpuVerlet* gpu);
+// Returns 1 and fills positions once the requested copy is done, never blocks
+int gpu_verlet_poll_readback(GpuVerlet* gpu, Vec3Soa positions);
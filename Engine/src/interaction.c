@@ -0,0 +1,136 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "interaction.h"
+#include "memory.h"
+
+void interaction_init(Interaction* interaction, VerletSolver* solver, const uint32_t* triangles, uint32_t triangleCount){
+    memset(interaction, 0, sizeof(*interaction));
+    interaction->solver = solver;
+    interaction->triangles = triangles;
+    interaction->triangleCount = triangleCount;
+    interaction->grabbed = INTERACTION_NONE;
+    interaction->found = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, INTERACTION_MAX_IMPULSE*sizeof(uint32_t));
+    bvh_build(&interaction->bvh, solver->position, triangles, triangleCount);
+    interaction->bvh.rebuildBudget = 0;
+}
+
+void interaction_init_graph(Interaction* interaction, VerletSolver* solver, const ParticleGraph* graph){
+    interaction_init(interaction, solver, graph->renderToParticle, graph->renderVertexCount/3);
+}
+
+void interaction_free(Interaction* interaction){
+    interaction_release(interaction);
+    bvh_free(&interaction->bvh);
+    mem_free(interaction->found);
+    memset(interaction, 0, sizeof(*interaction));
+}
+
+void interaction_update(Interaction* interaction){
+    bvh_refit(&interaction->bvh, interaction->solver->position);
+}
+
+uint32_t interaction_rebuild(Interaction* interaction){
+    return bvh_rebuild_degraded(&interaction->bvh, interaction->solver->position, INTERACTION_REBUILD_BUDGET);
+}
+
+void interaction_ray(const mat4 view, const mat4 projection, float cursorX, float cursorY, float width, float height,
+                     vec3 origin, vec3 direction){
+    mat4 viewProjection, inverse;
+    glm_mat4_mul((vec4*)projection, (vec4*)view, viewProjection);
+    glm_mat4_inv(viewProjection, inverse);
+    float x = 2.0f*cursorX/width - 1.0f;
+    float y = 1.0f - 2.0f*cursorY/height;
+    vec4 nearClip = {x, y, -1.0f, 1.0f}, farClip = {x, y, 1.0f, 1.0f};
+    vec4 nearWorld, farWorld;
+    glm_mat4_mulv(inverse, nearClip, nearWorld);
+    glm_mat4_mulv(inverse, farClip, farWorld);
+    for(int k = 0; k<3; ++k){
+        origin[k] = nearWorld[k]/nearWorld[3];
+        direction[k] = farWorld[k]/farWorld[3] - origin[k];
+    }
+    glm_vec3_normalize(direction);
+}
+
+int interaction_pick(const Interaction* interaction, const vec3 origin, const vec3 direction, InteractionHit* hit){
+    BvhHit bvhHit;
+    if(!bvh_raycast(&interaction->bvh, interaction->solver->position, origin, direction, FLT_MAX, &bvhHit)){
+        return 0;
+    }
+    hit->t = bvhHit.t;
+    glm_vec3_copy((float*)origin, hit->point);
+    glm_vec3_muladds((float*)direction, bvhHit.t, hit->point);
+    hit->triangle = bvhHit.triangle;
+    const uint32_t* v = interaction->triangles + 3*bvhHit.triangle;
+    float w[3] = {1.0f - bvhHit.u - bvhHit.v, bvhHit.u, bvhHit.v};
+    int nearest = w[1] > w[0] ? 1 : 0;
+    nearest = w[2] > w[nearest] ? 2 : nearest;
+    hit->particle = v[nearest];
+    return 1;
+}
+
+int interaction_grab(Interaction* interaction, const vec3 origin, const vec3 direction){
+    interaction_release(interaction);
+    InteractionHit hit;
+    if(!interaction_pick(interaction, origin, direction, &hit)){
+        return 0;
+    }
+    VerletSolver* solver = interaction->solver;
+    interaction->grabbed = hit.particle;
+    interaction->grabInverseMass = solver->inverseMass[hit.particle];
+    interaction->grabDistance = hit.t;
+    glm_vec3_zero(interaction->grabMove);
+    solver->inverseMass[hit.particle] = 0.0f;
+    verlet_wake_particle(solver, hit.particle);
+    return 1;
+}
+
+void interaction_drag(Interaction* interaction, const vec3 origin, const vec3 direction){
+    uint32_t p = interaction->grabbed;
+    if(p == INTERACTION_NONE){
+        return;
+    }
+    VerletSolver* solver = interaction->solver;
+    vec3 target;
+    glm_vec3_copy((float*)origin, target);
+    glm_vec3_muladds((float*)direction, interaction->grabDistance, target);
+    interaction->grabMove[0] = target[0] - solver->position.x[p];
+    interaction->grabMove[1] = target[1] - solver->position.y[p];
+    interaction->grabMove[2] = target[2] - solver->position.z[p];
+    verlet_move_particle(solver, p, target);
+}
+
+void interaction_release(Interaction* interaction){
+    uint32_t p = interaction->grabbed;
+    if(p == INTERACTION_NONE){
+        return;
+    }
+    // Pinned, the steps since the last drag left it without velocity
+    interaction->solver->inverseMass[p] = interaction->grabInverseMass;
+    if(interaction->grabInverseMass > 0.0f){
+        verlet_add_displacement(interaction->solver, p, interaction->grabMove);
+    }
+    interaction->grabbed = INTERACTION_NONE;
+}
+
+uint32_t interaction_impulse(Interaction* interaction, const SpatialHash* hash, const vec3 center, float radius, float strength){
+    VerletSolver* solver = interaction->solver;
+    uint32_t count = spatial_hash_query(hash, center, radius, interaction->found, INTERACTION_MAX_IMPULSE);
+    count = count < INTERACTION_MAX_IMPULSE ? count : INTERACTION_MAX_IMPULSE;
+    uint32_t moved = 0;
+    for(uint32_t i = 0; i<count; ++i){
+        uint32_t p = interaction->found[i];
+        if(solver->inverseMass[p] <= 0.0f){
+            continue;
+        }
+        vec3 d = {solver->position.x[p] - center[0], solver->position.y[p] - center[1], solver->position.z[p] - center[2]};
+        float distance = glm_vec3_norm(d);
+        if(distance < 1e-6f){
+            continue;
+        }
+        glm_vec3_scale(d, strength*(1.0f - distance/radius)/distance, d);
+        verlet_add_displacement(solver, p, d);
+        moved++;
+    }
+    return moved;
+}
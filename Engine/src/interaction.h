@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <cglm/cglm.h>
+#include "bvh.h"
+#include "particle_graph.h"
+#include "spatial_hash.h"
+#include "verlet.h"
+
+// Mouse interaction with a simulated mesh.
+//
+// A ray from the cursor through view and projection is cast against the
+// mesh triangles in a BVH over the particles, refit from the solver positions
+// by interaction_update every frame. The refit never rebuilds subtrees
+// (a rebuildBudget of 0), so picking stays within its 0.5 ms budget however
+// much the mesh deforms. interaction_rebuild rebuilds the worst degraded
+// subtree instead, once the frame's picks are done. The picked particle is the triangle
+// vertex nearest to the hit. Grabbing holds it as a drag constraint: it is
+// pinned while held and moved to the cursor ray at its grab distance before
+// every step, so the constraints drag the rest of the mesh after it; on
+// release it keeps the velocity of the last drag. Impulses push the particles
+// within a radius of a point away from it, or pull them in, found with a
+// spatial hash query.
+
+#define INTERACTION_NONE        UINT32_MAX
+#define INTERACTION_MAX_IMPULSE 4096    // particles one impulse reaches
+#define INTERACTION_REBUILD_BUDGET 1    // BVH subtrees per interaction_rebuild
+
+typedef struct {
+    float t;                // along the ray direction
+    vec3 point;
+    uint32_t triangle;
+    uint32_t particle;      // vertex of the triangle nearest to the point
+} InteractionHit;
+
+typedef struct {
+    VerletSolver* solver;
+    const uint32_t* triangles;  // 3 particles per triangle, kept by the caller
+    uint32_t triangleCount;
+    Bvh bvh;
+
+    uint32_t grabbed;       // INTERACTION_NONE when nothing is held
+    float grabInverseMass;  // restored on release
+    float grabDistance;
+    vec3 grabMove;          // last drag movement, the velocity on release
+
+    uint32_t* found;        // impulse query results
+} Interaction;
+
+void interaction_init(Interaction* interaction, VerletSolver* solver, const uint32_t* triangles, uint32_t triangleCount);
+// Triangles of the graph's render vertices, the graph has to outlive the interaction
+void interaction_init_graph(Interaction* interaction, VerletSolver* solver, const ParticleGraph* graph);
+void interaction_free(Interaction* interaction);
+
+// Refits the BVH to the current positions, once per frame after verlet_step
+void interaction_update(Interaction* interaction);
+// Rebuilds up to INTERACTION_REBUILD_BUDGET degraded BVH subtrees, after the
+// frame's picks and before the next verlet_step. Returns how many.
+uint32_t interaction_rebuild(Interaction* interaction);
+
+// World space ray through a cursor position in window pixels, y down.
+// direction is normalized.
+void interaction_ray(const mat4 view, const mat4 projection, float cursorX, float cursorY, float width, float height,
+                     vec3 origin, vec3 direction);
+int interaction_pick(const Interaction* interaction, const vec3 origin, const vec3 direction, InteractionHit* hit);
+
+// Returns whether a particle was grabbed. Grabbing again releases the
+// particle held so far.
+int interaction_grab(Interaction* interaction, const vec3 origin, const vec3 direction);
+// Moves the held particle onto the ray, before verlet_step
+void interaction_drag(Interaction* interaction, const vec3 origin, const vec3 direction);
+void interaction_release(Interaction* interaction);
+
+// Moves every particle within radius of center away from it by up to
+// strength per step (negative pulls), falling off linearly with distance.
+// hash has to be built from the solver positions. Returns how many particles
+// were moved.
+uint32_t interaction_impulse(Interaction* interaction, const SpatialHash* hash, const vec3 center, float radius, float strength);
@@ -0,0 +1,362 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "job.h"
+#include "memory.h"
+#include "platform.h"
+
+#define JOB_DEQUE_SIZE        4096
+#define JOB_MAX_CONTINUATIONS 4
+#define JOB_SPIN_COUNT        2048
+#define JOB_CHUNKS_PER_THREAD 8
+#define JOB_MAX_CHUNKS        (JOB_POOL_SIZE/4)
+
+typedef struct {
+    JobRangeFunc func;
+    void* data;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t grain;
+} JobRange;
+
+struct ALIGNED(CACHE_LINE_SIZE) Job {
+    JobFunc func;
+    void* data;
+    Job* parent;
+    volatile int32_t unfinished;  // self + children still running
+    volatile int32_t pending;     // job_run() + predecessors still to come
+    int32_t continuationCount;
+    Job* continuations[JOB_MAX_CONTINUATIONS];
+    JobRange range;               // inline payload for parallel_for
+};
+
+typedef struct {
+    volatile int64_t top;
+    char pad0[CACHE_LINE_SIZE - sizeof(int64_t)];
+    volatile int64_t bottom;
+    char pad1[CACHE_LINE_SIZE - sizeof(int64_t)];
+    Job* volatile* buffer;
+} JobDeque;
+
+typedef struct {
+    JobDeque deque;
+    Job* pool;
+    uint32_t allocated;
+    uint32_t rng;
+    Thread thread;
+    void* block;
+} JobWorker;
+
+typedef struct {
+    JobWorker* workers;
+    unsigned int threadCount;
+    volatile int32_t sleeping;
+    volatile int32_t shutdown;
+    Semaphore wake;
+} JobSystem;
+
+static JobSystem jobs;
+static THREAD_LOCAL int jobThreadIndex = -1;
+
+// ---------------------------------------------------------
+// Chase-Lev deque: the owner pushes and pops at the bottom, thieves take from the top.
+// ---------------------------------------------------------
+static int deque_push(JobDeque* deque, Job* job){
+    int64_t b = deque->bottom;
+    int64_t t = atomic_load_i64(&deque->top);
+    if(b - t >= JOB_DEQUE_SIZE){
+        return 0;
+    }
+    deque->buffer[b & (JOB_DEQUE_SIZE-1)] = job;
+    atomic_store_release_i64(&deque->bottom, b+1);
+    return 1;
+}
+
+static Job* deque_pop(JobDeque* deque){
+    int64_t b = deque->bottom - 1;
+    atomic_store_i64(&deque->bottom, b);
+    int64_t t = atomic_load_i64(&deque->top);
+    if(t > b){
+        atomic_store_release_i64(&deque->bottom, b+1);
+        return NULL;
+    }
+
+    Job* job = deque->buffer[b & (JOB_DEQUE_SIZE-1)];
+    if(t != b){
+        return job;
+    }
+    // Last job: race the thieves for it
+    if(!atomic_cas_i64(&deque->top, t, t+1)){
+        job = NULL;
+    }
+    atomic_store_release_i64(&deque->bottom, b+1);
+    return job;
+}
+
+static Job* deque_steal(JobDeque* deque){
+    int64_t t = atomic_load_i64(&deque->top);
+    atomic_fence();
+    int64_t b = atomic_load_i64(&deque->bottom);
+    if(t >= b){
+        return NULL;
+    }
+    Job* job = deque->buffer[t & (JOB_DEQUE_SIZE-1)];
+    if(!atomic_cas_i64(&deque->top, t, t+1)){
+        return NULL;
+    }
+    return job;
+}
+
+// ---------------------------------------------------------
+// Scheduling
+// ---------------------------------------------------------
+static JobWorker* job_current_worker(void){
+    assert(jobThreadIndex >= 0 && "job API used from a thread the job system does not own");
+    return &jobs.workers[jobThreadIndex];
+}
+
+static Job* job_fetch(JobWorker* worker){
+    Job* job = deque_pop(&worker->deque);
+    if(job || jobs.threadCount < 2){
+        return job;
+    }
+
+    // xorshift to spread thieves across victims
+    worker->rng ^= worker->rng << 13;
+    worker->rng ^= worker->rng >> 17;
+    worker->rng ^= worker->rng << 5;
+    unsigned int start = worker->rng % jobs.threadCount;
+    for(unsigned int i = 0; i<jobs.threadCount; ++i){
+        JobWorker* victim = &jobs.workers[(start + i) % jobs.threadCount];
+        if(victim == worker){
+            continue;
+        }
+        job = deque_steal(&victim->deque);
+        if(job){
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void job_execute(Job* job);
+
+static void job_finish(Job* job){
+    if(atomic_fetch_add_i32(&job->unfinished, -1) != 1){
+        return;
+    }
+    for(int32_t i = 0; i<job->continuationCount; ++i){
+        job_run(job->continuations[i]);
+    }
+    if(job->parent){
+        job_finish(job->parent);
+    }
+}
+
+static void job_execute(Job* job){
+    job->func(job, job->data);
+    job_finish(job);
+}
+
+static void job_worker_main(void* arg){
+    jobThreadIndex = (int)(intptr_t)arg;
+    JobWorker* worker = &jobs.workers[jobThreadIndex];
+    unsigned int idle = 0;
+
+    while(!atomic_load_i32(&jobs.shutdown)){
+        Job* job = job_fetch(worker);
+        if(job){
+            job_execute(job);
+            idle = 0;
+            continue;
+        }
+        if(++idle < JOB_SPIN_COUNT){
+            cpu_relax();
+            continue;
+        }
+
+        // Announce we are going to sleep, then look once more so a push that
+        // raced with us is either seen here or sees us sleeping.
+        atomic_fetch_add_i32(&jobs.sleeping, 1);
+        job = job_fetch(worker);
+        if(!job && !atomic_load_i32(&jobs.shutdown)){
+            semaphore_wait(&jobs.wake);
+        }
+        atomic_fetch_add_i32(&jobs.sleeping, -1);
+        if(job){
+            job_execute(job);
+        }
+        idle = 0;
+    }
+}
+
+void job_system_init(unsigned int threadCount){
+    if(threadCount == 0){
+        threadCount = cpu_core_count();
+    }
+
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.threadCount = threadCount;
+    jobs.workers = (JobWorker*)mem_calloc(MEM_TAG_JOBS, threadCount, sizeof(JobWorker));
+    semaphore_init(&jobs.wake, 0);
+
+    for(unsigned int i = 0; i<threadCount; ++i){
+        JobWorker* worker = &jobs.workers[i];
+        // One block per thread: cache line aligned job ring followed by the deque buffer
+        size_t poolBytes = JOB_POOL_SIZE*sizeof(Job);
+        worker->block = mem_alloc_aligned(MEM_TAG_JOBS, poolBytes + JOB_DEQUE_SIZE*sizeof(Job*), CACHE_LINE_SIZE);
+        memset(worker->block, 0, poolBytes + JOB_DEQUE_SIZE*sizeof(Job*));
+        worker->pool = (Job*)worker->block;
+        worker->deque.buffer = (Job* volatile*)((uint8_t*)worker->block + poolBytes);
+        worker->rng = 0x9E3779B9u * (i+1);
+    }
+
+    jobThreadIndex = 0;
+    for(unsigned int i = 1; i<threadCount; ++i){
+        if(!thread_create(&jobs.workers[i].thread, job_worker_main, (void*)(intptr_t)i)){
+            printf("JOB_SYSTEM: Failed to start worker %u, running with %u threads\n", i, i);
+            jobs.threadCount = i;
+            break;
+        }
+        thread_pin(jobs.workers[i].thread, i % cpu_core_count());
+    }
+
+    printf("JOB_SYSTEM: Started %u threads.\n", jobs.threadCount);
+}
+
+void job_system_shutdown(void){
+    if(!jobs.workers){
+        return;
+    }
+    atomic_store_i32(&jobs.shutdown, 1);
+    semaphore_post(&jobs.wake, jobs.threadCount);
+    for(unsigned int i = 1; i<jobs.threadCount; ++i){
+        thread_join(jobs.workers[i].thread);
+    }
+    for(unsigned int i = 0; i<jobs.threadCount; ++i){
+        mem_free(jobs.workers[i].block);
+    }
+    mem_free(jobs.workers);
+    semaphore_destroy(&jobs.wake);
+    memset(&jobs, 0, sizeof(jobs));
+    jobThreadIndex = -1;
+}
+
+unsigned int job_thread_count(void){
+    return jobs.threadCount ? jobs.threadCount : 1;
+}
+
+unsigned int job_thread_index(void){
+    return jobThreadIndex > 0 ? (unsigned int)jobThreadIndex : 0;
+}
+
+Job* job_create(JobFunc func, void* data){
+    JobWorker* worker = job_current_worker();
+    Job* job = &worker->pool[worker->allocated++ & (JOB_POOL_SIZE-1)];
+    job->func = func;
+    job->data = data;
+    job->parent = NULL;
+    job->unfinished = 1;
+    job->pending = 1;
+    job->continuationCount = 0;
+    return job;
+}
+
+Job* job_create_child(Job* parent, JobFunc func, void* data){
+    atomic_fetch_add_i32(&parent->unfinished, 1);
+    Job* job = job_create(func, data);
+    job->parent = parent;
+    return job;
+}
+
+void job_add_dependency(Job* job, Job* before){
+    assert(before->continuationCount < JOB_MAX_CONTINUATIONS);
+    atomic_fetch_add_i32(&job->pending, 1);
+    before->continuations[before->continuationCount++] = job;
+}
+
+void job_run(Job* job){
+    if(atomic_fetch_add_i32(&job->pending, -1) != 1){
+        return;
+    }
+    JobWorker* worker = job_current_worker();
+    if(!deque_push(&worker->deque, job)){
+        // Deque full: nobody is keeping up, just do the work here
+        job_execute(job);
+        return;
+    }
+    atomic_fence();
+    if(atomic_load_i32(&jobs.sleeping) > 0){
+        semaphore_post(&jobs.wake, 1);
+    }
+}
+
+void job_wait(Job* job){
+    JobWorker* worker = job_current_worker();
+    while(atomic_load_i32(&job->unfinished) > 0){
+        Job* next = job_fetch(worker);
+        if(next){
+            job_execute(next);
+        } else {
+            cpu_relax();
+        }
+    }
+}
+
+int job_is_done(Job* job){
+    return atomic_load_i32(&job->unfinished) == 0;
+}
+
+// ---------------------------------------------------------
+// Parallel for
+// ---------------------------------------------------------
+static void job_range_split(Job* job, void* data){
+    JobRange* range = (JobRange*)data;
+    // Hand the right halves to thieves, keep the leftmost piece for ourselves
+    while(range->end - range->begin > range->grain){
+        uint32_t mid = range->begin + (range->end - range->begin)/2;
+        Job* right = job_create_child(job, job_range_split, NULL);
+        right->range = *range;
+        right->range.begin = mid;
+        right->data = &right->range;
+        job_run(right);
+        range->end = mid;
+    }
+    range->func(range->data, range->begin, range->end);
+}
+
+static uint32_t job_grain_size(uint32_t count, uint32_t grain){
+    if(grain == 0){
+        grain = count / (job_thread_count()*JOB_CHUNKS_PER_THREAD);
+    }
+    // Keep the number of chunks well inside the job ring
+    uint32_t minimum = (count + JOB_MAX_CHUNKS-1) / JOB_MAX_CHUNKS;
+    if(grain < minimum){
+        grain = minimum;
+    }
+    return grain > 0 ? grain : 1;
+}
+
+Job* job_parallel_for(void* data, uint32_t count, uint32_t grain, JobRangeFunc func){
+    Job* job = job_create(job_range_split, NULL);
+    job->range.func = func;
+    job->range.data = data;
+    job->range.begin = 0;
+    job->range.end = count;
+    job->range.grain = job_grain_size(count, grain);
+    job->data = &job->range;
+    job_run(job);
+    return job;
+}
+
+void parallel_for(void* data, uint32_t count, uint32_t grain, JobRangeFunc func){
+    if(count == 0){
+        return;
+    }
+    // Tools and early startup code may run without a job system
+    if(jobThreadIndex < 0 || jobs.threadCount < 2){
+        func(data, 0, count);
+        return;
+    }
+    job_wait(job_parallel_for(data, count, grain, func));
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+// Work-stealing job system.
+//
+// One worker per core (pinned) plus the main thread, each owning a Chase-Lev
+// deque. Jobs are fixed size and come from a per-thread ring, so a Job* is only
+// valid until that thread has created JOB_POOL_SIZE more jobs; keep the number of
+// in-flight jobs per thread below that.
+//
+// A job finishes once its function returned and all of its children finished.
+// Dependencies are declared with job_add_dependency() before the predecessor is
+// run; a job only gets queued once job_run() was called AND every predecessor is
+// done.
+
+#define JOB_POOL_SIZE 4096
+
+typedef struct Job Job;
+typedef void (*JobFunc)(Job* job, void* data);
+typedef void (*JobRangeFunc)(void* data, uint32_t begin, uint32_t end);
+
+// threadCount includes the calling thread, 0 uses every core.
+void job_system_init(unsigned int threadCount);
+void job_system_shutdown(void);
+unsigned int job_thread_count(void);
+// 0 on the thread that called job_system_init, 1..n-1 on workers.
+unsigned int job_thread_index(void);
+
+Job* job_create(JobFunc func, void* data);
+Job* job_create_child(Job* parent, JobFunc func, void* data);
+void job_add_dependency(Job* job, Job* before);
+void job_run(Job* job);
+// Executes other jobs while waiting, so it is safe to call from inside a job.
+void job_wait(Job* job);
+int  job_is_done(Job* job);
+
+// Splits [0, count) recursively until ranges are at most grain long.
+// grain 0 picks a size giving every thread several chunks to steal.
+Job* job_parallel_for(void* data, uint32_t count, uint32_t grain, JobRangeFunc func);
+void parallel_for(void* data, uint32_t count, uint32_t grain, JobRangeFunc func);
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include "line_renderer.h"
+#include "memory.h"
+#include "shader.h"
+
+static int line_program_init(LineProgram* program, const char* fragmentPath){
+    program->program = shader_create_program(SHADER_DIR "line_vertex.glsl", fragmentPath);
+    if(!program->program){
+        return 0;
+    }
+    // Uniforms of both stages that share a name are one location
+    program->firstSegmentLoc = glGetUniformLocation(program->program, "firstSegment");
+    program->viewProjectionLoc = glGetUniformLocation(program->program, "viewProjection");
+    program->viewportLoc = glGetUniformLocation(program->program, "viewport");
+    program->halfWidthLoc = glGetUniformLocation(program->program, "halfWidth");
+    program->featherLoc = glGetUniformLocation(program->program, "feather");
+    program->opacityLoc = glGetUniformLocation(program->program, "opacity");
+    program->joinLoc = glGetUniformLocation(program->program, "join");
+    program->miterLimitLoc = glGetUniformLocation(program->program, "miterLimit");
+    program->hasNormalsLoc = glGetUniformLocation(program->program, "hasNormals");
+    program->colorLoc = glGetUniformLocation(program->program, "color");
+    program->lightPosLoc = glGetUniformLocation(program->program, "lightPos");
+    program->viewPosLoc = glGetUniformLocation(program->program, "viewPos");
+    return 1;
+}
+
+int line_renderer_init(LineRenderer* lines, const LineStyle* style){
+    memset(lines, 0, sizeof(*lines));
+    lines->style = *style;
+    if(!line_program_init(&lines->hard, SHADER_DIR "line_fragment.glsl") ||
+       !line_program_init(&lines->feathered, SHADER_DIR "line_aa_fragment.glsl")){
+        printf("LINE_RENDERER: Failed to build the line shaders\n");
+        return 0;
+    }
+    glGenBuffers(1, &lines->points);
+    glGenBuffers(1, &lines->normals);
+    glGenBuffers(1, &lines->segments);
+    glGenVertexArrays(1, &lines->vao);
+    return 1;
+}
+
+void line_renderer_free(LineRenderer* lines){
+    glDeleteVertexArrays(1, &lines->vao);
+    glDeleteBuffers(1, &lines->points);
+    glDeleteBuffers(1, &lines->normals);
+    glDeleteBuffers(1, &lines->segments);
+    glDeleteProgram(lines->hard.program);
+    glDeleteProgram(lines->feathered.program);
+    memset(lines, 0, sizeof(*lines));
+}
+
+// Uploads count vec4 into buffer, reallocating it past capacity
+static void line_upload(GLuint buffer, const void* data, uint32_t count, uint32_t* capacity){
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if(count > *capacity){
+        *capacity = count + count/4;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)*capacity*16, NULL, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)count*16, data);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void line_renderer_set_strips(LineRenderer* lines, const float* vertices, const float* normals, uint32_t vertexCount,
+                              const uint32_t* indices, uint32_t indexCount){
+    float* packed = (float*)mem_alloc(MEM_TAG_CONTOUR, ((size_t)vertexCount*4+1)*sizeof(float));
+    for(uint32_t i = 0; i<vertexCount; ++i){
+        memcpy(packed + 4*i, vertices + 3*i, 3*sizeof(float));
+        packed[4*i+3] = 1.0f;
+    }
+    line_upload(lines->points, packed, vertexCount, &lines->pointCapacity);
+    lines->hasNormals = normals != NULL;
+    if(normals){
+        for(uint32_t i = 0; i<vertexCount; ++i){
+            memcpy(packed + 4*i, normals + 3*i, 3*sizeof(float));
+            packed[4*i+3] = 0.0f;
+        }
+        line_upload(lines->normals, packed, vertexCount, &lines->normalCapacity);
+    }
+    mem_free(packed);
+    lines->pointCount = vertexCount;
+
+    // Segments with their neighbours, a closed strip wraps around
+    uint32_t* segments = (uint32_t*)mem_alloc(MEM_TAG_CONTOUR, ((size_t)indexCount*4+1)*sizeof(uint32_t));
+    uint32_t count = 0;
+    for(uint32_t begin = 0; begin<indexCount; ){
+        uint32_t end = begin;
+        while(end<indexCount && indices[end] != LINE_RESTART){
+            ++end;
+        }
+        uint32_t n = end - begin;
+        int closed = n > 3 && indices[begin] == indices[end-1];
+        for(uint32_t i = begin; i+1<end; ++i){
+            uint32_t* s = segments + 4*count++;
+            s[0] = i > begin ? indices[i-1] : closed ? indices[end-2] : LINE_NONE;
+            s[1] = indices[i];
+            s[2] = indices[i+1];
+            s[3] = i+2 < end ? indices[i+2] : closed ? indices[begin+1] : LINE_NONE;
+        }
+        begin = end + 1;
+    }
+    line_upload(lines->segments, segments, count, &lines->segmentCapacity);
+    lines->segmentCount = count;
+    mem_free(segments);
+}
+
+// Below a pixel feathered lines stay a pixel wide and fade instead
+static void line_width(const LineProgram* program, float width, int feathered){
+    glUniform1f(program->halfWidthLoc, feathered && width < 1.0f ? 0.5f : 0.5f*width);
+    glUniform1f(program->opacityLoc, feathered && width < 1.0f ? width : 1.0f);
+}
+
+void line_renderer_draw_ranges(const LineRenderer* lines, mat4 view, mat4 projection, const vec3 lightPos,
+                               const vec3 viewPos, float width, float height, const LineRange* ranges, uint32_t rangeCount){
+    if(rangeCount == 0){
+        return;
+    }
+    const LineStyle* style = &lines->style;
+    int feathered = style->feather > 0.0f;
+    const LineProgram* program = feathered ? &lines->feathered : &lines->hard;
+    mat4 viewProjection;
+    glm_mat4_mul(projection, view, viewProjection);
+    glUseProgram(program->program);
+    glUniformMatrix4fv(program->viewProjectionLoc, 1, GL_FALSE, (float*)viewProjection);
+    glUniform2f(program->viewportLoc, width, height);
+    glUniform1f(program->featherLoc, feathered ? style->feather : 0.0f);
+    glUniform1ui(program->joinLoc, style->join);
+    glUniform1f(program->miterLimitLoc, style->miterLimit);
+    glUniform1ui(program->hasNormalsLoc, lines->hasNormals);
+    glUniform3fv(program->colorLoc, 1, style->color);
+    glUniform3fv(program->lightPosLoc, 1, lightPos);
+    glUniform3fv(program->viewPosLoc, 1, viewPos);
+    if(feathered){
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lines->points);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, lines->hasNormals ? lines->normals : lines->points);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, lines->segments);
+    glBindVertexArray(lines->vao);
+    float lastWidth = -1.0f;
+    for(uint32_t i = 0; i<rangeCount; ++i){
+        if(ranges[i].segmentCount == 0){
+            continue;
+        }
+        if(ranges[i].width != lastWidth){
+            line_width(program, ranges[i].width, feathered);
+            lastWidth = ranges[i].width;
+        }
+        glUniform1ui(program->firstSegmentLoc, ranges[i].firstSegment);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ranges[i].segmentCount);
+    }
+    glBindVertexArray(0);
+    if(feathered){
+        glDisable(GL_BLEND);
+    }
+}
+
+void line_renderer_draw(const LineRenderer* lines, mat4 view, mat4 projection, const vec3 lightPos, const vec3 viewPos,
+                        float width, float height){
+    LineRange all = {0, lines->segmentCount, lines->style.width};
+    line_renderer_draw_ranges(lines, view, projection, lightPos, viewPos, width, height, &all, 1);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <glad/glad.h>
+#include <stdint.h>
+#include <cglm/cglm.h>
+
+// Thick polylines without a geometry shader, needs GL 4.3.
+//
+// Every segment is an instance of a 4 vertex triangle strip with no vertex
+// buffers: the vertex shader pulls the segment's ends and the points before
+// and after it from SSBOs by gl_InstanceID, projects them and pushes the
+// corners half the width out in pixels, so lines keep their width on
+// screen at any distance. Miter joins put the shared corners on the bisector
+// of both segments, computed the same way on both sides, and are cut at
+// miterLimit half widths. Round joins extend every segment by half its width
+// at both ends and the fragment shader drops what is further than that from
+// the segment, so the overlapping ends make discs and the strip ends round
+// caps. Lighting is per vertex, from the normals if given, otherwise like a
+// tube facing the camera.
+//
+// With a feather the edges are antialiased without a multisampled
+// framebuffer: the quads reach half the feather further and the fragment
+// shader (line_aa_fragment.glsl) blends in the coverage from the distance to
+// the centerline, a ramp feather pixels wide across the line's edge. Lines
+// thinner than a pixel are drawn a pixel wide at their width as opacity.
+// Depth is still tested and written, but the edge is pushed behind the core
+// by its transparency, so crossing lines keep their cores in any order and
+// a soft edge does not cut into the line right behind it.
+//
+// Takes strips like Contour's lineVertices and lineIndices: indices
+// separated by LINE_RESTART, a strip ending on its first index is closed.
+
+#define LINE_RESTART 0xffffffffu
+#define LINE_NONE    0xffffffffu
+
+typedef enum {
+    LINE_JOIN_MITER,
+    LINE_JOIN_ROUND
+} LineJoin;
+
+typedef struct {
+    float width;        // pixels
+    LineJoin join;
+    float miterLimit;   // longest miter, in half widths
+    vec3 color;
+    float feather;      // pixels of soft edge, 0 for hard, aliased edges
+} LineStyle;
+
+// Segments of a draw, in the order set_strips made them
+typedef struct {
+    uint32_t firstSegment;
+    uint32_t segmentCount;
+    float width;        // pixels, instead of the style's
+} LineRange;
+
+typedef struct {
+    GLuint program;
+    GLint firstSegmentLoc, viewProjectionLoc, viewportLoc, halfWidthLoc, featherLoc, opacityLoc, joinLoc, miterLimitLoc;
+    GLint hasNormalsLoc, colorLoc, lightPosLoc, viewPosLoc;
+} LineProgram;
+
+typedef struct {
+    LineStyle style;
+    uint32_t pointCount;
+    uint32_t segmentCount;
+    uint32_t pointCapacity;
+    uint32_t normalCapacity;
+    uint32_t segmentCapacity;
+    int hasNormals;
+
+    GLuint points;      // vec4 per point
+    GLuint normals;     // vec4 per point
+    GLuint segments;    // uvec4 per segment: previous, start, end, next point
+
+    LineProgram hard;
+    LineProgram feathered;
+    GLuint vao;         // empty, the shader pulls everything
+} LineRenderer;
+
+// Returns 0 if the shaders fail to build
+int line_renderer_init(LineRenderer* lines, const LineStyle* style);
+void line_renderer_free(LineRenderer* lines);
+
+// 3 floats per vertex, normals may be NULL. The buffers only grow.
+void line_renderer_set_strips(LineRenderer* lines, const float* vertices, const float* normals, uint32_t vertexCount,
+                              const uint32_t* indices, uint32_t indexCount);
+// Into the current framebuffer of width x height pixels. Feathered lines
+// blend, the blend state is left disabled.
+void line_renderer_draw(const LineRenderer* lines, mat4 view, mat4 projection, const vec3 lightPos, const vec3 viewPos,
+                        float width, float height);
+// Only the ranges, each at its width, one instanced draw per range
+void line_renderer_draw_ranges(const LineRenderer* lines, mat4 view, mat4 projection, const vec3 lightPos,
+                               const vec3 viewPos, float width, float height, const LineRange* ranges, uint32_t rangeCount);
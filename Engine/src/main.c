@@ -1,11 +1,14 @@
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <cglm/cglm.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "job.h"
+#include "memory.h"
 #include "model.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "shader.h"
 
 // Camera state
 vec3 cameraPos   = {0.291234f, 22.452366f, 24.892710f};
@@ -20,95 +23,6 @@ float yaw   = -90.0f; // -90 points to negative Z (forward)
 float pitch =  0.0f;
 int firstMouse = 1; // bool to check if it's the very first frame
 
-char* readShaderSource(const char* filePath){
-    FILE* file = fopen(filePath, "rb");
-    if(!file){
-        printf("Error, file not found: %s\n", filePath);
-        return NULL;
-    }
-    //count bytes
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    char* buffer = (char*)malloc(length+1);
-    if(!buffer){
-        printf("Memory allocation failed!\n");
-        fclose(file);
-        return NULL;
-    }
-
-    fread(buffer, 1, length, file);
-    buffer[length] = '\0';
-    fclose(file);
-    return buffer;
-}
-
-GLuint compile_shader(const char* source, GLenum type){
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
-    glCompileShader(shader);
-
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if(!success){
-        char info_log[512];
-        glGetShaderInfoLog(shader, 512, NULL, info_log);
-        fprintf(stderr, "SHADER_LOADER: Shader compilation failed:%s\n", info_log);
-        return 0;
-    }
-    return shader;
-}
-
-GLuint shader_create_program(const char* vertex_path, const char* fragment_path){
-    // Read shader files from disk
-    char* vertex_source = readShaderSource(vertex_path);
-    char* fragment_source = readShaderSource(fragment_path);
-    if(!vertex_source || !fragment_source){
-        free(vertex_source);
-        free(fragment_source);
-        return 0;
-    }
-
-    // Compile shaders
-    GLuint vertex_shader = compile_shader(vertex_source, GL_VERTEX_SHADER);
-    GLuint fragment_shader = compile_shader(fragment_source, GL_FRAGMENT_SHADER);
-    free(vertex_source);
-    free(fragment_source);
-    if(vertex_shader==0 || fragment_shader==0){
-        glDeleteShader(vertex_shader);
-        glDeleteShader(fragment_shader);
-        return 0;
-    }
-
-    // Link shaders to a program
-    GLuint program = glCreateProgram();
-    glAttachShader(program,vertex_shader);
-    glAttachShader(program,fragment_shader);
-    glLinkProgram(program);
-
-    // Check for success
-    GLuint success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if(!success){
-        char info_log[512];
-        glGetProgramInfoLog(program, 512, NULL, info_log);
-        fprintf(stderr, "SHADER_LOADER: Shader program linking failed:\n%s\n", info_log);
-    }
-
-    // Delete individual shaders as they are now linked to the program
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
-    
-    if(!success){
-        glDeleteProgram(program);
-        return 0;
-    }
-
-    printf("SHADER_LOADER: Successfully created shader program.\n");
-    return program;
-}
-
 void mouse_callback(GLFWwindow* window, double xpos, double ypos){
     if(firstMouse){
         lastX = xpos;
@@ -144,37 +58,29 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos){
 
 }
 
-GLuint load_texture(const char* path){
+GLuint texture_upload(const ImageData* image){
     GLuint textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrChannels;
-
-    stbi_set_flip_vertically_on_load(1);
-
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if(data){
-        GLenum format = (nrChannels==4)?GL_RGBA:GL_RGB;
+    GLenum format = (image->channels==4)?GL_RGBA:(image->channels==1)?GL_RED:GL_RGB;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image->width, image->height, 0, format, GL_UNSIGNED_BYTE, image->pixels);
+    glGenerateMipmap(GL_TEXTURE_2D);
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        printf("Texture failed to load at path: %s\n", path);
-        stbi_image_free(data);
-    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     return textureID;
 }
 
-int main(){
+int main(int argc, char** argv){
+    mem_init(16*1024*1024);
+    job_system_init(0);
+
     if(!glfwInit()){
         printf("Failed to init GLFW\n");
         return -1;
@@ -201,8 +107,8 @@ int main(){
     printf("OpenGL Version: %s\n", glGetString(GL_VERSION));
 
     GLuint shaderProgram = shader_create_program(
-        "../shaders/vertex.glsl",
-        "../shaders/fragment.glsl"
+        SHADER_DIR "vertex.glsl",
+        SHADER_DIR "fragment.glsl"
     );
     glUseProgram(shaderProgram);
     glUniform1i(glGetUniformLocation(shaderProgram, "texture1"), 0);
@@ -211,26 +117,58 @@ int main(){
     GLuint projLoc  = glGetUniformLocation(shaderProgram, "projection");
     GLuint lightLoc = glGetUniformLocation(shaderProgram, "lightPos");
 
-    Model myModel = load_model("../assets/peng.obj");  
-    GLuint diffuseMap = load_texture("../assets/peng.png");
-
-    // GLuint VBO, VAO;
-    // glGenVertexArrays(1, &VAO);
-    // glGenBuffers(1, &VBO);
-
-    // glBindVertexArray(VAO);
-    // glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    // glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
-    // glEnableVertexAttribArray(0);
+    const char* scenePath = argc > 1 ? argv[1] : "../assets/default.scene";
+    SceneFile sceneFile;
+    if(!scene_file_parse(scenePath, &sceneFile)){
+        glfwTerminate();
+        return -1;
+    }
+    scene_file_load(&sceneFile, 1);
+    scene_file_report(&sceneFile);
+
+    // Upload on the GL thread, then drop the CPU copies
+    Model* models = (Model*)mem_calloc(MEM_TAG_MODEL, sceneFile.assetCount, sizeof(Model));
+    GLuint* textures = (GLuint*)mem_calloc(MEM_TAG_TEXTURE, sceneFile.assetCount, sizeof(GLuint));
+    for(uint32_t i = 0; i<sceneFile.assetCount; ++i){
+        SceneAsset* asset = &sceneFile.assets[i];
+        if(!asset->loaded){
+            continue;
+        }
+        if(asset->kind == SCENE_ASSET_MESH){
+            models[i] = model_upload(&asset->mesh);
+        } else {
+            textures[i] = texture_upload(&asset->image);
+        }
+    }
+    scene_file_free_assets(&sceneFile);
 
-    // glBindBuffer(GL_ARRAY_BUFFER, 0);
-    // glBindVertexArray(0);
+    // Untextured instances sample plain white
+    const uint8_t white[3] = {255, 255, 255};
+    ImageData whiteImage = {(uint8_t*)white, 1, 1, 3};
+    GLuint whiteTexture = texture_upload(&whiteImage);
 
     vec3 lightPos = {2.0f, 2.0f, 2.0f};
+    if(sceneFile.lightCount > 0){
+        glm_vec3_copy(sceneFile.lights[0].position, lightPos);
+    }
+
+    Scene scene;
+    scene_init(&scene, sceneFile.instanceCount);
+    SceneNode* instanceNodes = (SceneNode*)mem_alloc(MEM_TAG_SCENE, (sceneFile.instanceCount+1)*sizeof(SceneNode));
+    for(uint32_t i = 0; i<sceneFile.instanceCount; ++i){
+        SceneInstance* instance = &sceneFile.instances[i];
+        vec3 radians = {glm_rad(instance->rotation[0]), glm_rad(instance->rotation[1]), glm_rad(instance->rotation[2])};
+        versor rotation;
+        glm_euler_xyz_quat(radians, rotation);
+        instanceNodes[i] = scene_create_node(&scene, SCENE_NONE);
+        scene_set_position(&scene, instanceNodes[i], instance->position);
+        scene_set_rotation(&scene, instanceNodes[i], rotation);
+        scene_set_scale(&scene, instanceNodes[i], instance->scale);
+    }
 
     while(!glfwWindowShouldClose(window)){
+        mem_frame_begin();
+        scene_update(&scene);
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
@@ -284,21 +222,40 @@ int main(){
         glm_lookat(cameraPos, center, cameraUp, view);
         glUniformMatrix4fv(viewLoc, 1, GL_FALSE, (float*)view);
 
-        mat4 model;
-        glm_mat4_identity(model);
-        //glm_rotate(model, (float)glfwGetTime(), (vec3){0.5f, 1.0f, 0.0f});
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, (float*)model);
-
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-
-        glBindVertexArray(myModel.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, myModel.vertexCount);
+        for(uint32_t i = 0; i<sceneFile.instanceCount; ++i){
+            SceneInstance* instance = &sceneFile.instances[i];
+            Model* model = &models[instance->mesh];
+            if(model->vertexCount == 0){
+                continue;
+            }
+            GLuint texture = instance->texture != SCENE_FILE_NONE && textures[instance->texture] ? textures[instance->texture] : whiteTexture;
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, (float*)scene_world(&scene, instanceNodes[i]));
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glBindVertexArray(model->VAO);
+            glDrawArrays(GL_TRIANGLES, 0, model->vertexCount);
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
     
+    for(uint32_t i = 0; i<sceneFile.assetCount; ++i){
+        if(models[i].VAO){
+            model_free(&models[i]);
+        }
+        if(textures[i]){
+            glDeleteTextures(1, &textures[i]);
+        }
+    }
+    glDeleteTextures(1, &whiteTexture);
+    mem_free(models);
+    mem_free(textures);
+    mem_free(instanceNodes);
+    scene_free(&scene);
+    scene_file_free(&sceneFile);
     glfwTerminate();
+    job_system_shutdown();
+    mem_shutdown();
     return 0;
 }
\ No newline at end of file
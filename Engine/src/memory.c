@@ -0,0 +1,364 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memory.h"
+#include "platform.h"
+
+// Sits right in front of every pointer handed out by mem_alloc
+typedef struct {
+    uint64_t size;
+    uint16_t tag;
+    uint16_t alignment;
+    uint32_t offset;   // distance back to the pointer malloc returned
+} MemHeader;
+
+typedef struct {
+    volatile int64_t current;
+    volatile int64_t peak;
+    volatile int64_t allocations;
+    volatile int64_t frameAllocations;
+} MemCounters;
+
+struct PoolChunk {
+    PoolChunk* next;
+};
+
+static MemCounters counters[MEM_TAG_COUNT];
+static Arena frameArenas[2];
+static int frameIndex;
+static uint32_t framesSinceWarmup;
+
+static const char* tagNames[MEM_TAG_COUNT] = {
+    "general",
+    "jobs",
+    "model",
+    "texture",
+    "shader",
+    "frame",
+    "scene",
+    "physics",
+    "contour",
+    "sdf",
+};
+
+static void mem_track(MemTag tag, int64_t size){
+    MemCounters* c = &counters[tag];
+    int64_t now = atomic_fetch_add_i64(&c->current, size) + size;
+    if(size <= 0){
+        return;
+    }
+    atomic_fetch_add_i64(&c->allocations, 1);
+    atomic_fetch_add_i64(&c->frameAllocations, 1);
+    int64_t peak = atomic_load_i64(&c->peak);
+    while(now > peak && !atomic_cas_i64(&c->peak, peak, now)){
+        peak = atomic_load_i64(&c->peak);
+    }
+}
+
+void* mem_alloc_aligned(MemTag tag, size_t size, size_t alignment){
+    if(alignment < MEM_DEFAULT_ALIGNMENT){
+        alignment = MEM_DEFAULT_ALIGNMENT;
+    }
+    assert((alignment & (alignment-1)) == 0 && alignment <= 0x8000);
+
+    uint8_t* raw = (uint8_t*)malloc(size + sizeof(MemHeader) + alignment-1);
+    if(!raw){
+        printf("MEMORY: Allocation of %zu bytes failed (%s)\n", size, tagNames[tag]);
+        return NULL;
+    }
+    uintptr_t user = ((uintptr_t)raw + sizeof(MemHeader) + alignment-1) & ~(uintptr_t)(alignment-1);
+    MemHeader* header = (MemHeader*)user - 1;
+    header->size = size;
+    header->tag = (uint16_t)tag;
+    header->alignment = (uint16_t)alignment;
+    header->offset = (uint32_t)(user - (uintptr_t)raw);
+
+    mem_track(tag, (int64_t)size);
+    return (void*)user;
+}
+
+void* mem_alloc(MemTag tag, size_t size){
+    return mem_alloc_aligned(tag, size, MEM_DEFAULT_ALIGNMENT);
+}
+
+void* mem_calloc(MemTag tag, size_t count, size_t size){
+    void* ptr = mem_alloc(tag, count*size);
+    if(ptr){
+        memset(ptr, 0, count*size);
+    }
+    return ptr;
+}
+
+void* mem_realloc(MemTag tag, void* ptr, size_t size){
+    if(!ptr){
+        return mem_alloc(tag, size);
+    }
+    if(size == 0){
+        mem_free(ptr);
+        return NULL;
+    }
+    MemHeader* header = (MemHeader*)ptr - 1;
+    void* moved = mem_alloc_aligned((MemTag)header->tag, size, header->alignment);
+    if(moved){
+        memcpy(moved, ptr, header->size < size ? header->size : size);
+        mem_free(ptr);
+    }
+    return moved;
+}
+
+void mem_free(void* ptr){
+    if(!ptr){
+        return;
+    }
+    MemHeader* header = (MemHeader*)ptr - 1;
+    mem_track((MemTag)header->tag, -(int64_t)header->size);
+    free((uint8_t*)ptr - header->offset);
+}
+
+MemStats mem_stats(MemTag tag){
+    MemStats stats;
+    stats.current = atomic_load_i64(&counters[tag].current);
+    stats.peak = atomic_load_i64(&counters[tag].peak);
+    stats.allocations = atomic_load_i64(&counters[tag].allocations);
+    return stats;
+}
+
+const char* mem_tag_name(MemTag tag){
+    return tagNames[tag];
+}
+
+void mem_report(void){
+    printf("MEMORY: %-10s %12s %12s %10s\n", "tag", "current", "peak", "allocs");
+    for(int i = 0; i<MEM_TAG_COUNT; ++i){
+        MemStats stats = mem_stats((MemTag)i);
+        printf("MEMORY: %-10s %12lld %12lld %10lld\n", tagNames[i],
+            (long long)stats.current, (long long)stats.peak, (long long)stats.allocations);
+    }
+    if(frameArenas[0].base){
+        size_t peak = frameArenas[0].peak > frameArenas[1].peak ? frameArenas[0].peak : frameArenas[1].peak;
+        printf("MEMORY: frame arena peak %zu of %zu bytes\n", peak, frameArenas[0].capacity);
+    }
+}
+
+void mem_init(size_t frameArenaSize){
+    arena_init(&frameArenas[0], MEM_TAG_FRAME, frameArenaSize);
+    arena_init(&frameArenas[1], MEM_TAG_FRAME, frameArenaSize);
+    frameIndex = 0;
+    framesSinceWarmup = 0;
+}
+
+void mem_shutdown(void){
+#ifdef WOVEN_MEMORY_DEBUG
+    mem_report();
+#endif
+    arena_destroy(&frameArenas[0]);
+    arena_destroy(&frameArenas[1]);
+#ifdef WOVEN_MEMORY_DEBUG
+    for(int i = 0; i<MEM_TAG_COUNT; ++i){
+        int64_t current = atomic_load_i64(&counters[i].current);
+        if(current != 0){
+            printf("MEMORY: %lld bytes still allocated under '%s'\n", (long long)current, tagNames[i]);
+        }
+    }
+#endif
+}
+
+// ---------------------------------------------------------
+// Arenas
+// ---------------------------------------------------------
+void arena_init(Arena* arena, MemTag tag, size_t capacity){
+    arena->base = (uint8_t*)mem_alloc_aligned(tag, capacity, CACHE_LINE_SIZE);
+    arena->capacity = arena->base ? capacity : 0;
+    arena->offset = 0;
+    arena->peak = 0;
+    arena->tag = tag;
+}
+
+void arena_destroy(Arena* arena){
+    mem_free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment){
+    if(alignment < MEM_DEFAULT_ALIGNMENT){
+        alignment = MEM_DEFAULT_ALIGNMENT;
+    }
+    // Reserve enough to align inside our slice, so concurrent callers never need a CAS loop
+    int64_t reserve = (int64_t)(size + alignment-1);
+    int64_t start = atomic_fetch_add_i64(&arena->offset, reserve);
+    if(start + reserve > (int64_t)arena->capacity){
+        printf("MEMORY: %s arena exhausted (%zu bytes)\n", tagNames[arena->tag], arena->capacity);
+        assert(0 && "arena exhausted");
+        return NULL;
+    }
+    uintptr_t ptr = ((uintptr_t)arena->base + (uintptr_t)start + alignment-1) & ~(uintptr_t)(alignment-1);
+    return (void*)ptr;
+}
+
+void arena_reset(Arena* arena){
+    int64_t used = atomic_load_i64(&arena->offset);
+    if((size_t)used > arena->peak){
+        arena->peak = (size_t)used;
+    }
+    atomic_store_i64(&arena->offset, 0);
+}
+
+void mem_frame_begin(void){
+    frameIndex ^= 1;
+    arena_reset(&frameArenas[frameIndex]);
+
+#ifdef WOVEN_MEMORY_DEBUG
+    int64_t heapAllocations = 0;
+    for(int i = 0; i<MEM_TAG_COUNT; ++i){
+        heapAllocations += atomic_load_i64(&counters[i].frameAllocations);
+    }
+    if(framesSinceWarmup >= MEM_WARMUP_FRAMES && heapAllocations != 0){
+        printf("MEMORY: %lld heap allocations during a steady state frame:\n", (long long)heapAllocations);
+        for(int i = 0; i<MEM_TAG_COUNT; ++i){
+            int64_t count = atomic_load_i64(&counters[i].frameAllocations);
+            if(count){
+                printf("MEMORY:   %-10s %lld\n", tagNames[i], (long long)count);
+            }
+        }
+        assert(0 && "heap allocation in steady state frame, use mem_frame_alloc");
+    }
+#endif
+    for(int i = 0; i<MEM_TAG_COUNT; ++i){
+        atomic_store_i64(&counters[i].frameAllocations, 0);
+    }
+    ++framesSinceWarmup;
+}
+
+void* mem_frame_alloc(size_t size, size_t alignment){
+    return arena_alloc(&frameArenas[frameIndex], size, alignment);
+}
+
+void mem_debug_restart_warmup(void){
+    framesSinceWarmup = 0;
+}
+
+// ---------------------------------------------------------
+// Pools
+// ---------------------------------------------------------
+#define POOL_POISON 0xDD        // free blocks
+#define POOL_FRESH  0xCD        // allocated blocks, until written
+
+static size_t pool_chunk_header(void){
+    return (sizeof(PoolChunk) + MEM_DEFAULT_ALIGNMENT-1) & ~(size_t)(MEM_DEFAULT_ALIGNMENT-1);
+}
+
+#ifdef WOVEN_MEMORY_DEBUG
+// Whether block is the start of a block in one of the pool's chunks
+static int pool_owns(const Pool* pool, const void* block){
+    for(const PoolChunk* chunk = pool->chunks; chunk; chunk = chunk->next){
+        uintptr_t first = (uintptr_t)chunk + pool_chunk_header();
+        uintptr_t end = first + pool->blockSize*pool->blocksPerChunk;
+        if((uintptr_t)block >= first && (uintptr_t)block < end){
+            return ((uintptr_t)block - first) % pool->blockSize == 0;
+        }
+    }
+    return 0;
+}
+
+// Whether the block past its free list link still holds the poison
+static int pool_poisoned(const Pool* pool, const void* block){
+    const uint8_t* bytes = (const uint8_t*)block;
+    for(size_t i = sizeof(void*); i<pool->blockSize; ++i){
+        if(bytes[i] != POOL_POISON){
+            return 0;
+        }
+    }
+    return 1;
+}
+#endif
+
+void pool_init(Pool* pool, MemTag tag, size_t blockSize, uint32_t blocksPerChunk){
+    // Blocks hold the free list link while unused
+    if(blockSize < sizeof(void*)){
+        blockSize = sizeof(void*);
+    }
+    pool->tag = tag;
+    pool->blockSize = (blockSize + MEM_DEFAULT_ALIGNMENT-1) & ~(size_t)(MEM_DEFAULT_ALIGNMENT-1);
+    pool->blocksPerChunk = blocksPerChunk > 0 ? blocksPerChunk : 64;
+    pool->freeList = NULL;
+    pool->chunks = NULL;
+    pool->used = 0;
+    pool->peak = 0;
+}
+
+void pool_destroy(Pool* pool){
+    PoolChunk* chunk = pool->chunks;
+    while(chunk){
+        PoolChunk* next = chunk->next;
+        mem_free(chunk);
+        chunk = next;
+    }
+    pool->chunks = NULL;
+    pool->freeList = NULL;
+    pool->used = 0;
+}
+
+static int pool_grow(Pool* pool){
+    size_t headerSize = pool_chunk_header();
+    PoolChunk* chunk = (PoolChunk*)mem_alloc(pool->tag, headerSize + pool->blockSize*pool->blocksPerChunk);
+    if(!chunk){
+        return 0;
+    }
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+
+    // Thread the new blocks onto the free list in address order
+    uint8_t* blocks = (uint8_t*)chunk + headerSize;
+    for(uint32_t i = pool->blocksPerChunk; i-- > 0;){
+        void** block = (void**)(blocks + i*pool->blockSize);
+#ifdef WOVEN_MEMORY_DEBUG
+        memset(block, POOL_POISON, pool->blockSize);
+#endif
+        *block = pool->freeList;
+        pool->freeList = block;
+    }
+    return 1;
+}
+
+void* pool_alloc(Pool* pool){
+    if(!pool->freeList && !pool_grow(pool)){
+        return NULL;
+    }
+    void** block = (void**)pool->freeList;
+#ifdef WOVEN_MEMORY_DEBUG
+    if(!pool_poisoned(pool, block)){
+        printf("MEMORY: %s pool block %p written after pool_free\n", tagNames[pool->tag], (void*)block);
+        assert(0 && "pool block written after pool_free");
+    }
+#endif
+    pool->freeList = *block;
+#ifdef WOVEN_MEMORY_DEBUG
+    memset(block, POOL_FRESH, pool->blockSize);
+#endif
+    if(++pool->used > pool->peak){
+        pool->peak = pool->used;
+    }
+    return block;
+}
+
+void pool_free(Pool* pool, void* block){
+    if(!block){
+        return;
+    }
+#ifdef WOVEN_MEMORY_DEBUG
+    if(!pool_owns(pool, block)){
+        printf("MEMORY: %p is not a block of this %s pool\n", block, tagNames[pool->tag]);
+        assert(0 && "pool_free of a foreign block");
+    }
+    // A block already on the free list still holds the poison and a link into the pool
+    if(pool_poisoned(pool, block) && (*(void**)block == NULL || pool_owns(pool, *(void**)block))){
+        printf("MEMORY: %s pool block %p freed twice\n", tagNames[pool->tag], block);
+        assert(0 && "pool block freed twice");
+    }
+    memset(block, POOL_POISON, pool->blockSize);
+#endif
+    *(void**)block = pool->freeList;
+    pool->freeList = block;
+    --pool->used;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Engine memory layer.
+//
+// Every heap allocation carries a tag so usage can be tracked per subsystem.
+// Per-frame scratch memory comes from two linear arenas that swap every frame:
+// anything allocated in frame N stays valid through frame N+1 (handy for
+// data handed to the GPU) and is recycled at the start of frame N+2.
+//
+// With WOVEN_MEMORY_DEBUG defined, mem_frame_begin() asserts that no tagged
+// heap allocation happened during the previous frame once the warm-up frames
+// are over, and mem_shutdown() reports leaks.
+
+#define MEM_DEFAULT_ALIGNMENT 16
+#define MEM_WARMUP_FRAMES     8
+
+typedef enum {
+    MEM_TAG_GENERAL,
+    MEM_TAG_JOBS,
+    MEM_TAG_MODEL,
+    MEM_TAG_TEXTURE,
+    MEM_TAG_SHADER,
+    MEM_TAG_FRAME,
+    MEM_TAG_SCENE,
+    MEM_TAG_PHYSICS,
+    MEM_TAG_CONTOUR,
+    MEM_TAG_SDF,
+    MEM_TAG_COUNT
+} MemTag;
+
+typedef struct {
+    int64_t current;
+    int64_t peak;
+    int64_t allocations;
+} MemStats;
+
+void mem_init(size_t frameArenaSize);
+void mem_shutdown(void);
+
+void* mem_alloc(MemTag tag, size_t size);
+void* mem_alloc_aligned(MemTag tag, size_t size, size_t alignment);
+void* mem_calloc(MemTag tag, size_t count, size_t size);
+// Keeps the tag and alignment of the original block.
+void* mem_realloc(MemTag tag, void* ptr, size_t size);
+void  mem_free(void* ptr);
+
+MemStats mem_stats(MemTag tag);
+const char* mem_tag_name(MemTag tag);
+void mem_report(void);
+
+// ---------------------------------------------------------
+// Linear arena. arena_alloc is lock-free and may be called from jobs.
+// ---------------------------------------------------------
+typedef struct {
+    uint8_t* base;
+    size_t capacity;
+    volatile int64_t offset;
+    size_t peak;
+    MemTag tag;
+} Arena;
+
+void arena_init(Arena* arena, MemTag tag, size_t capacity);
+void arena_destroy(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size, size_t alignment);
+void arena_reset(Arena* arena);
+
+// Swaps the frame arenas and resets the one becoming current.
+void mem_frame_begin(void);
+void* mem_frame_alloc(size_t size, size_t alignment);
+// Call before deliberately allocating mid-run (e.g. loading), restarts the steady state check.
+void mem_debug_restart_warmup(void);
+
+// ---------------------------------------------------------
+// Fixed-size block pool for small engine objects. Not thread-safe.
+// Blocks come from chunks of blocksPerChunk, chunks are only returned by
+// pool_destroy. With WOVEN_MEMORY_DEBUG free blocks are poisoned, and
+// pool_free asserts on foreign and double frees, pool_alloc on blocks
+// written after they were freed.
+// ---------------------------------------------------------
+typedef struct PoolChunk PoolChunk;
+
+typedef struct {
+    MemTag tag;
+    size_t blockSize;
+    uint32_t blocksPerChunk;
+    void* freeList;
+    PoolChunk* chunks;
+    uint32_t used;
+    uint32_t peak;
+} Pool;
+
+void pool_init(Pool* pool, MemTag tag, size_t blockSize, uint32_t blocksPerChunk);
+void pool_destroy(Pool* pool);
+void* pool_alloc(Pool* pool);
+void pool_free(Pool* pool, void* block);
@@ -1,77 +1,17 @@
-#define FAST_OBJ_IMPLEMENTATION
-#include <fast_obj/fast_obj.h>
 #include <glad/glad.h>
 #include <stdio.h>
 #include "model.h"
 
-Model load_model(const char* filepath){
+Model model_upload(const MeshData* mesh){
     Model m = {0};
-
-    fastObjMesh* mesh = fast_obj_read(filepath);
-    if(!mesh){
-        printf("Error model load failed!\n");
-        return m;
-    }
-
-    GLuint totalVertices = 0;
-    for(unsigned int i = 0; i<mesh->face_count; ++i){
-        GLuint fv = mesh->face_vertices[i];
-        totalVertices+=(fv==3)?3:6;
-    }
-
-    m.vertexCount = totalVertices;
-
-    float* data = (float*)malloc(totalVertices*8*sizeof(float));
-
-    GLuint dataIndex = 0;
-    GLuint indexOffset = 0;
-
-    for(unsigned int i = 0; i<mesh->face_count; ++i){
-        GLuint fv = mesh->face_vertices[i];
-
-        int triangleIndices[][3] = {{0, 1, 2}, {0, 2, 3}};
-        int trianglesToDraw = (fv == 4) ? 2 : 1;
-
-        for (int t = 0; t < trianglesToDraw; ++t) {
-            for (int j = 0; j < 3; ++j) {
-                fastObjIndex idx = mesh->indices[indexOffset + triangleIndices[t][j]];
-
-                // POSITION
-                data[dataIndex++] = mesh->positions[3 * idx.p + 0];
-                data[dataIndex++] = mesh->positions[3 * idx.p + 1];
-                data[dataIndex++] = mesh->positions[3 * idx.p + 2];
-
-                // NORMAL (Check if exists, otherwise default to Up)
-                if (mesh->normal_count > 0) {
-                    data[dataIndex++] = mesh->normals[3 * idx.n + 0];
-                    data[dataIndex++] = mesh->normals[3 * idx.n + 1];
-                    data[dataIndex++] = mesh->normals[3 * idx.n + 2];
-                } else {
-                    data[dataIndex++] = 0.0f; 
-                    data[dataIndex++] = 1.0f; 
-                    data[dataIndex++] = 0.0f;
-                }
-
-                if (mesh->texcoord_count > 0){
-                    data[dataIndex++] = mesh->texcoords[2*idx.t+0];
-                    data[dataIndex++] = mesh->texcoords[2*idx.t+1];
-                }
-                else{
-                    data[dataIndex++] = 0.0f;
-                    data[dataIndex++] = 0.0f;
-                }
-            }
-        }
-
-        indexOffset += fv;
-    }
+    m.vertexCount = mesh->vertexCount;
 
     glGenVertexArrays(1, &m.VAO);
     glGenBuffers(1, &m.VBO);
 
     glBindVertexArray(m.VAO);
     glBindBuffer(GL_ARRAY_BUFFER, m.VBO);
-    glBufferData(GL_ARRAY_BUFFER, totalVertices*8*sizeof(float), data, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, mesh->vertexCount*8*sizeof(float), mesh->vertices, GL_STATIC_DRAW);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -84,11 +24,28 @@ Model load_model(const char* filepath){
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    return m;
+}
 
-    fast_obj_destroy(mesh);
-    free(data);
+Model load_model(const char* filepath){
+    Model m = {0};
+
+    MeshData mesh;
+    if(!asset_load_mesh(filepath, &mesh)){
+        printf("Error model load failed!\n");
+        return m;
+    }
+    m = model_upload(&mesh);
+    asset_free_mesh(&mesh);
 
-    printf("Loaded Model: %s (%d vertices)\n", filepath, totalVertices);
+    printf("Loaded Model: %s (%d vertices)\n", filepath, m.vertexCount);
     return m;
 }
 
+void model_free(Model* m){
+    glDeleteBuffers(1, &m->VBO);
+    glDeleteVertexArrays(1, &m->VAO);
+    m->VAO = 0;
+    m->VBO = 0;
+    m->vertexCount = 0;
+}
@@ -1,3 +1,6 @@
+#pragma once
+#include "asset.h"
+
 typedef struct 
 {
     unsigned int VAO;
@@ -6,5 +9,7 @@ typedef struct
 } Model;
 
 Model load_model(const char* filepath);
+// Uploads decoded mesh data, must be called on the GL thread
+Model model_upload(const MeshData* mesh);
 void model_draw(Model* m, unsigned int shaderProgram);
 void model_free(Model* m);
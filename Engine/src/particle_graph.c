@@ -0,0 +1,695 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "job.h"
+#include "memory.h"
+#include "particle_graph.h"
+#include "sort.h"
+
+// Cell coordinates are 10 bits per axis; weld candidates in a cell are
+// compared exhaustively, so this only needs to keep cells small on average.
+// Keys stay within 31 bits, including the sentinel, which keeps the radix
+// sort at 4 passes
+#define GRAPH_CELL_BITS     10
+#define GRAPH_CELL_MAX      ((1u << GRAPH_CELL_BITS) - 1)
+#define GRAPH_CELL_NONE     ((uint64_t)1 << (3*GRAPH_CELL_BITS))
+#define GRAPH_CHUNK_SIZE    8192
+#define GRAPH_CELL_EPSILONS 8.0f
+#define GRAPH_MORTON_BITS   21
+
+typedef struct {
+    const fastObjMesh* mesh;
+    ParticleGraph* graph;
+    int bending;
+
+    uint32_t* indexOffsets;
+    uint32_t* triangleOffsets;
+    uint32_t* renderOffsets;
+
+    // Welding: positions sorted by grid cell
+    uint8_t* referenced;
+    uint64_t* cellKeys;
+    uint32_t* cellPositions;
+    uint32_t cellCount;
+    uint32_t* representative;
+    vec3 origin;
+    float cellSize;
+    float epsilon;
+
+    // Edges: one key per triangle side, sorted so duplicates are adjacent
+    uint64_t* edgeKeys;
+    uint32_t* edgeOpposite;
+    uint32_t edgeKeyCount;
+    int particleBits;
+    uint64_t edgeNone;
+    uint32_t chunkCount;
+    uint32_t* chunkEdges;
+    uint32_t* chunkBends;
+} GraphBuild;
+
+static uint64_t graph_cell_key(uint32_t x, uint32_t y, uint32_t z){
+    return ((uint64_t)x << (2*GRAPH_CELL_BITS)) | ((uint64_t)y << GRAPH_CELL_BITS) | z;
+}
+
+static uint32_t graph_cell_coord(float value, float origin, float cellSize){
+    float c = (value - origin) / cellSize;
+    if(c <= 0.0f){
+        return 0;
+    }
+    return c >= (float)GRAPH_CELL_MAX ? GRAPH_CELL_MAX : (uint32_t)c;
+}
+
+// Packed as a:b with just enough bits per particle index, degenerate edges
+// get a key above every real one
+static uint64_t graph_edge_key(const GraphBuild* build, uint32_t a, uint32_t b){
+    if(a == b){
+        return build->edgeNone;
+    }
+    return a < b ? ((uint64_t)a << build->particleBits) | b : ((uint64_t)b << build->particleBits) | a;
+}
+
+static float graph_distance(const Vec3Soa* p, uint32_t a, uint32_t b){
+    float dx = p->x[a] - p->x[b];
+    float dy = p->y[a] - p->y[b];
+    float dz = p->z[a] - p->z[b];
+    return sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+static void graph_mark_referenced(void* data, uint32_t begin, uint32_t end){
+    GraphBuild* build = (GraphBuild*)data;
+    const fastObjMesh* mesh = build->mesh;
+    for(uint32_t f = begin; f<end; ++f){
+        const fastObjIndex* idx = mesh->indices + build->indexOffsets[f];
+        for(uint32_t k = 0; k<mesh->face_vertices[f]; ++k){
+            // Racing stores all write the same value
+            build->referenced[idx[k].p] = 1;
+        }
+    }
+}
+
+static void graph_cell_keys(void* data, uint32_t begin, uint32_t end){
+    GraphBuild* build = (GraphBuild*)data;
+    const float* positions = build->mesh->positions;
+    for(uint32_t i = begin; i<end; ++i){
+        build->cellPositions[i] = i;
+        if(!build->referenced[i]){
+            build->cellKeys[i] = GRAPH_CELL_NONE;
+            continue;
+        }
+        build->cellKeys[i] = graph_cell_key(graph_cell_coord(positions[3*i+0], build->origin[0], build->cellSize),
+                                            graph_cell_coord(positions[3*i+1], build->origin[1], build->cellSize),
+                                            graph_cell_coord(positions[3*i+2], build->origin[2], build->cellSize));
+    }
+}
+
+static uint32_t graph_lower_bound(const uint64_t* keys, uint32_t count, uint64_t key){
+    uint32_t lo = 0, hi = count;
+    while(lo < hi){
+        uint32_t mid = lo + (hi - lo)/2;
+        if(keys[mid] < key){
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int graph_within(const float* a, const float* b, float epsilon){
+    float dx = a[0] - b[0];
+    float dy = a[1] - b[1];
+    float dz = a[2] - b[2];
+    return dx*dx + dy*dy + dz*dz <= epsilon*epsilon;
+}
+
+// Neighbouring cells along one axis that may hold a position within epsilon
+static void graph_cell_span(float value, float origin, float cellSize, float epsilon, uint32_t cell, int* lo, int* hi){
+    float offset = value - (origin + cell*cellSize);
+    *lo = offset < epsilon && cell > 0 ? (int)cell-1 : (int)cell;
+    *hi = cellSize - offset < epsilon && cell < GRAPH_CELL_MAX ? (int)cell+1 : (int)cell;
+}
+
+// Every position looks for the lowest indexed position within epsilon. Cells
+// are several epsilon wide, so most positions only search their own cell.
+// Keys are z minor, so a run of z neighbours is one contiguous key range.
+static void graph_weld(void* data, uint32_t begin, uint32_t end){
+    GraphBuild* build = (GraphBuild*)data;
+    const float* positions = build->mesh->positions;
+    const uint64_t mask = GRAPH_CELL_MAX;
+    for(uint32_t s = begin; s<end; ++s){
+        uint64_t key = build->cellKeys[s];
+        uint32_t p = build->cellPositions[s];
+        const float* position = positions + 3*p;
+        uint32_t best = p;
+        int x0, x1, y0, y1, z0, z1;
+        graph_cell_span(position[0], build->origin[0], build->cellSize, build->epsilon, (uint32_t)((key >> (2*GRAPH_CELL_BITS)) & mask), &x0, &x1);
+        graph_cell_span(position[1], build->origin[1], build->cellSize, build->epsilon, (uint32_t)((key >> GRAPH_CELL_BITS) & mask), &y0, &y1);
+        graph_cell_span(position[2], build->origin[2], build->cellSize, build->epsilon, (uint32_t)(key & mask), &z0, &z1);
+        if(x0 == x1 && y0 == y1 && z0 == z1){
+            // Own cell only, its entries are right around s
+            uint32_t n = s;
+            while(n > 0 && build->cellKeys[n-1] == key){
+                --n;
+            }
+            for(; n<build->cellCount && build->cellKeys[n] == key; ++n){
+                uint32_t q = build->cellPositions[n];
+                if(q < best && graph_within(position, positions + 3*q, build->epsilon)){
+                    best = q;
+                }
+            }
+            build->representative[p] = best;
+            continue;
+        }
+        for(int x = x0; x<=x1; ++x){
+            for(int y = y0; y<=y1; ++y){
+                uint64_t first = graph_cell_key((uint32_t)x, (uint32_t)y, (uint32_t)z0);
+                uint64_t last = graph_cell_key((uint32_t)x, (uint32_t)y, (uint32_t)z1);
+                for(uint32_t n = graph_lower_bound(build->cellKeys, build->cellCount, first);
+                    n<build->cellCount && build->cellKeys[n] <= last; ++n){
+                    uint32_t q = build->cellPositions[n];
+                    if(q < best && graph_within(position, positions + 3*q, build->epsilon)){
+                        best = q;
+                    }
+                }
+            }
+        }
+        build->representative[p] = best;
+    }
+}
+
+static void graph_emit_edges(void* data, uint32_t begin, uint32_t end){
+    GraphBuild* build = (GraphBuild*)data;
+    const fastObjMesh* mesh = build->mesh;
+    const uint32_t* particleOf = build->graph->positionToParticle;
+    for(uint32_t f = begin; f<end; ++f){
+        const fastObjIndex* idx = mesh->indices + build->indexOffsets[f];
+        uint32_t out = build->triangleOffsets[f]*3;
+        for(uint32_t k = 1; k+1<mesh->face_vertices[f]; ++k){
+            uint32_t a = particleOf[idx[0].p], b = particleOf[idx[k].p], c = particleOf[idx[k+1].p];
+            build->edgeKeys[out] = graph_edge_key(build, a, b);
+            build->edgeOpposite[out++] = c;
+            build->edgeKeys[out] = graph_edge_key(build, b, c);
+            build->edgeOpposite[out++] = a;
+            build->edgeKeys[out] = graph_edge_key(build, c, a);
+            build->edgeOpposite[out++] = b;
+        }
+    }
+}
+
+// End of the run of equal keys starting at s, or 0 if s is not the head of a
+// run. Runs belong to the chunk holding their head and may extend past it.
+static uint32_t graph_run_end(const GraphBuild* build, uint32_t s){
+    uint64_t key = build->edgeKeys[s];
+    if(key == build->edgeNone || (s > 0 && build->edgeKeys[s-1] == key)){
+        return 0;
+    }
+    uint32_t runEnd = s+1;
+    while(runEnd<build->edgeKeyCount && build->edgeKeys[runEnd] == key){
+        ++runEnd;
+    }
+    return runEnd;
+}
+
+// An edge shared by exactly two triangles gets a constraint across it
+static int graph_is_bend(const GraphBuild* build, uint32_t s, uint32_t runEnd){
+    return build->bending && runEnd - s == 2 && build->edgeOpposite[s] != build->edgeOpposite[s+1];
+}
+
+static void graph_count_unique(void* data, uint32_t begin, uint32_t end){
+    GraphBuild* build = (GraphBuild*)data;
+    for(uint32_t c = begin; c<end; ++c){
+        uint32_t edges = 0, bends = 0;
+        uint32_t last = (c+1)*GRAPH_CHUNK_SIZE < build->edgeKeyCount ? (c+1)*GRAPH_CHUNK_SIZE : build->edgeKeyCount;
+        for(uint32_t s = c*GRAPH_CHUNK_SIZE; s<last; ++s){
+            uint32_t runEnd = graph_run_end(build, s);
+            if(runEnd){
+                edges++;
+                bends += graph_is_bend(build, s, runEnd);
+            }
+        }
+        build->chunkEdges[c] = edges;
+        build->chunkBends[c] = bends;
+    }
+}
+
+static void graph_write_unique(void* data, uint32_t begin, uint32_t end){
+    GraphBuild* build = (GraphBuild*)data;
+    ParticleGraph* graph = build->graph;
+    for(uint32_t c = begin; c<end; ++c){
+        ParticleConstraint* edge = graph->constraints + build->chunkEdges[c];
+        ParticleConstraint* bend = graph->constraints + graph->edgeCount + build->chunkBends[c];
+        uint32_t last = (c+1)*GRAPH_CHUNK_SIZE < build->edgeKeyCount ? (c+1)*GRAPH_CHUNK_SIZE : build->edgeKeyCount;
+        for(uint32_t s = c*GRAPH_CHUNK_SIZE; s<last; ++s){
+            uint32_t runEnd = graph_run_end(build, s);
+            if(!runEnd){
+                continue;
+            }
+            edge->a = (uint32_t)(build->edgeKeys[s] >> build->particleBits);
+            edge->b = (uint32_t)(build->edgeKeys[s] & (((uint64_t)1 << build->particleBits) - 1));
+            edge->restLength = graph_distance(&graph->positions, edge->a, edge->b);
+            ++edge;
+            if(graph_is_bend(build, s, runEnd)){
+                uint32_t a = build->edgeOpposite[s], b = build->edgeOpposite[s+1];
+                bend->a = a < b ? a : b;
+                bend->b = a < b ? b : a;
+                bend->restLength = graph_distance(&graph->positions, a, b);
+                ++bend;
+            }
+        }
+    }
+}
+
+// Same expansion as asset_load_mesh: triangles as is, anything else as the quad 012 023
+static void graph_render_remap(void* data, uint32_t begin, uint32_t end){
+    GraphBuild* build = (GraphBuild*)data;
+    const fastObjMesh* mesh = build->mesh;
+    static const int triangleIndices[6] = {0, 1, 2, 0, 2, 3};
+    for(uint32_t f = begin; f<end; ++f){
+        const fastObjIndex* idx = mesh->indices + build->indexOffsets[f];
+        uint32_t* out = build->graph->renderToParticle + build->renderOffsets[f];
+        uint32_t corners = mesh->face_vertices[f] == 3 ? 3 : 6;
+        for(uint32_t k = 0; k<corners; ++k){
+            out[k] = build->graph->positionToParticle[idx[triangleIndices[k]].p];
+        }
+    }
+}
+
+int particle_graph_build(const fastObjMesh* mesh, const ParticleGraphDesc* desc, ParticleGraph* graph){
+    memset(graph, 0, sizeof(*graph));
+    if(!mesh || mesh->position_count == 0){
+        return 0;
+    }
+
+    GraphBuild build;
+    memset(&build, 0, sizeof(build));
+    build.mesh = mesh;
+    build.graph = graph;
+    build.bending = desc->bending;
+
+    // ---------------------------------------------------------
+    // Per face offsets into the index, triangle and render vertex streams
+    // ---------------------------------------------------------
+    const uint32_t faceCount = mesh->face_count;
+    build.indexOffsets = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (faceCount+1)*sizeof(uint32_t));
+    build.triangleOffsets = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (faceCount+1)*sizeof(uint32_t));
+    build.renderOffsets = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (faceCount+1)*sizeof(uint32_t));
+    uint32_t indexCount = 0, triangleCount = 0, renderCount = 0;
+    for(uint32_t f = 0; f<faceCount; ++f){
+        uint32_t fv = mesh->face_vertices[f];
+        build.indexOffsets[f] = indexCount;
+        build.triangleOffsets[f] = triangleCount;
+        build.renderOffsets[f] = renderCount;
+        indexCount += fv;
+        triangleCount += fv >= 3 ? fv-2 : 0;
+        renderCount += fv == 3 ? 3 : 6;
+    }
+
+    // ---------------------------------------------------------
+    // Weld positions: sort by grid cell, search neighbouring cells
+    // ---------------------------------------------------------
+    const uint32_t positionCount = mesh->position_count;
+    build.referenced = (uint8_t*)mem_calloc(MEM_TAG_PHYSICS, positionCount, 1);
+    parallel_for(&build, faceCount, 0, graph_mark_referenced);
+
+    vec3 lo = {INFINITY, INFINITY, INFINITY}, hi = {-INFINITY, -INFINITY, -INFINITY};
+    for(uint32_t i = 0; i<positionCount; ++i){
+        if(build.referenced[i]){
+            glm_vec3_minv(lo, (float*)&mesh->positions[3*i], lo);
+            glm_vec3_maxv(hi, (float*)&mesh->positions[3*i], hi);
+        }
+    }
+    float epsilon = desc->weldEpsilon;
+    if(epsilon <= 0.0f){
+        epsilon = 1e-6f*glm_vec3_distance(lo, hi);
+    }
+    float extent = glm_max(glm_max(hi[0]-lo[0], hi[1]-lo[1]), hi[2]-lo[2]);
+    glm_vec3_copy(lo, build.origin);
+    // Cells wider than epsilon so welded pairs are never more than one cell
+    // apart, and only positions close to a cell border look at neighbours
+    build.cellSize = glm_max(GRAPH_CELL_EPSILONS*epsilon, extent / (float)GRAPH_CELL_MAX);
+    if(build.cellSize <= 0.0f){
+        build.cellSize = 1.0f;
+    }
+    build.epsilon = epsilon;
+
+    build.cellKeys = (uint64_t*)mem_alloc(MEM_TAG_PHYSICS, positionCount*sizeof(uint64_t));
+    build.cellPositions = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, positionCount*sizeof(uint32_t));
+    build.representative = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, positionCount*sizeof(uint32_t));
+    parallel_for(&build, positionCount, 0, graph_cell_keys);
+    radix_sort_u64(build.cellKeys, build.cellPositions, positionCount);
+    // Unreferenced positions sorted to the end
+    build.cellCount = graph_lower_bound(build.cellKeys, positionCount, GRAPH_CELL_NONE);
+    parallel_for(&build, build.cellCount, 0, graph_weld);
+
+    // Representatives always have a lower index, so one ascending pass
+    // resolves chains and numbers the particles in position order
+    graph->positionCount = positionCount;
+    graph->positionToParticle = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, positionCount*sizeof(uint32_t));
+    uint32_t particleCount = 0;
+    for(uint32_t i = 0; i<positionCount; ++i){
+        if(!build.referenced[i]){
+            graph->positionToParticle[i] = PARTICLE_NONE;
+            continue;
+        }
+        uint32_t r = build.representative[i];
+        if(r == i){
+            graph->positionToParticle[i] = particleCount++;
+        } else {
+            build.representative[i] = build.representative[r];
+            graph->positionToParticle[i] = graph->positionToParticle[r];
+        }
+    }
+    graph->particleCount = particleCount;
+    graph->positions.x = (float*)mem_alloc_aligned(MEM_TAG_PHYSICS, particleCount*sizeof(float), 32);
+    graph->positions.y = (float*)mem_alloc_aligned(MEM_TAG_PHYSICS, particleCount*sizeof(float), 32);
+    graph->positions.z = (float*)mem_alloc_aligned(MEM_TAG_PHYSICS, particleCount*sizeof(float), 32);
+    for(uint32_t i = 0; i<positionCount; ++i){
+        if(build.referenced[i] && build.representative[i] == i){
+            uint32_t p = graph->positionToParticle[i];
+            graph->positions.x[p] = mesh->positions[3*i+0];
+            graph->positions.y[p] = mesh->positions[3*i+1];
+            graph->positions.z[p] = mesh->positions[3*i+2];
+        }
+    }
+
+    // ---------------------------------------------------------
+    // Edges: one key per triangle side, sort, keep run heads
+    // ---------------------------------------------------------
+    build.edgeKeyCount = triangleCount*3;
+    build.particleBits = 1;
+    while(build.particleBits < 32 && ((uint64_t)1 << build.particleBits) <= particleCount){
+        build.particleBits++;
+    }
+    build.edgeNone = (uint64_t)particleCount << build.particleBits;
+    build.edgeKeys = (uint64_t*)mem_alloc(MEM_TAG_PHYSICS, (build.edgeKeyCount+1)*sizeof(uint64_t));
+    build.edgeOpposite = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (build.edgeKeyCount+1)*sizeof(uint32_t));
+    parallel_for(&build, faceCount, 0, graph_emit_edges);
+    radix_sort_u64(build.edgeKeys, build.edgeOpposite, build.edgeKeyCount);
+
+    build.chunkCount = (build.edgeKeyCount + GRAPH_CHUNK_SIZE-1)/GRAPH_CHUNK_SIZE;
+    build.chunkEdges = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (build.chunkCount+1)*sizeof(uint32_t));
+    build.chunkBends = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (build.chunkCount+1)*sizeof(uint32_t));
+    parallel_for(&build, build.chunkCount, 1, graph_count_unique);
+    graph->edgeCount = prefix_sum_u32(build.chunkEdges, build.chunkCount);
+    graph->bendCount = prefix_sum_u32(build.chunkBends, build.chunkCount);
+    graph->constraintCount = graph->edgeCount + graph->bendCount;
+    graph->constraints = (ParticleConstraint*)mem_alloc(MEM_TAG_PHYSICS, (graph->constraintCount+1)*sizeof(ParticleConstraint));
+    parallel_for(&build, build.chunkCount, 1, graph_write_unique);
+
+    // ---------------------------------------------------------
+    // Render vertex -> particle
+    // ---------------------------------------------------------
+    graph->renderVertexCount = renderCount;
+    graph->renderToParticle = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (renderCount+1)*sizeof(uint32_t));
+    parallel_for(&build, faceCount, 0, graph_render_remap);
+
+    mem_free(build.indexOffsets);
+    mem_free(build.triangleOffsets);
+    mem_free(build.renderOffsets);
+    mem_free(build.referenced);
+    mem_free(build.cellKeys);
+    mem_free(build.cellPositions);
+    mem_free(build.representative);
+    mem_free(build.edgeKeys);
+    mem_free(build.edgeOpposite);
+    mem_free(build.chunkEdges);
+    mem_free(build.chunkBends);
+
+    if(desc->order != PARTICLE_ORDER_NONE){
+        uint32_t* oldToNew = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint32_t));
+        particle_order_compute(desc->order, graph->positions, particleCount, graph->constraints, graph->constraintCount, oldToNew);
+        particle_graph_reorder(graph, oldToNew);
+        mem_free(oldToNew);
+    }
+    return 1;
+}
+
+void particle_graph_free(ParticleGraph* graph){
+    mem_free(graph->positions.x);
+    mem_free(graph->positions.y);
+    mem_free(graph->positions.z);
+    mem_free(graph->constraints);
+    mem_free(graph->positionToParticle);
+    mem_free(graph->renderToParticle);
+    memset(graph, 0, sizeof(*graph));
+}
+
+// ---------------------------------------------------------
+// Reordering
+// ---------------------------------------------------------
+typedef struct {
+    Vec3Soa positions;
+    vec3 origin;
+    vec3 scale;
+    uint64_t* keys;
+    uint32_t* values;
+} MortonKeys;
+
+// Spreads 21 bits to every third bit
+static uint64_t graph_morton_spread(uint32_t v){
+    uint64_t x = v & 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+static uint32_t graph_morton_coord(float value, float origin, float scale){
+    float c = (value - origin)*scale;
+    const float top = (float)((1u << GRAPH_MORTON_BITS) - 1);
+    return c <= 0.0f ? 0 : c >= top ? (uint32_t)top : (uint32_t)c;
+}
+
+static void graph_morton_keys(void* data, uint32_t begin, uint32_t end){
+    MortonKeys* morton = (MortonKeys*)data;
+    for(uint32_t i = begin; i<end; ++i){
+        uint32_t x = graph_morton_coord(morton->positions.x[i], morton->origin[0], morton->scale[0]);
+        uint32_t y = graph_morton_coord(morton->positions.y[i], morton->origin[1], morton->scale[1]);
+        uint32_t z = graph_morton_coord(morton->positions.z[i], morton->origin[2], morton->scale[2]);
+        morton->keys[i] = graph_morton_spread(x) << 2 | graph_morton_spread(y) << 1 | graph_morton_spread(z);
+        morton->values[i] = i;
+    }
+}
+
+static void graph_order_morton(Vec3Soa positions, uint32_t particleCount, uint32_t* oldToNew){
+    MortonKeys morton;
+    morton.positions = positions;
+    vec3 lo = {INFINITY, INFINITY, INFINITY}, hi = {-INFINITY, -INFINITY, -INFINITY};
+    for(uint32_t i = 0; i<particleCount; ++i){
+        vec3 p = {positions.x[i], positions.y[i], positions.z[i]};
+        glm_vec3_minv(lo, p, lo);
+        glm_vec3_maxv(hi, p, hi);
+    }
+    // One scale for all axes keeps the cells cubic
+    float extent = glm_max(glm_max(hi[0]-lo[0], hi[1]-lo[1]), hi[2]-lo[2]);
+    float scale = extent > 0.0f ? (float)(1u << GRAPH_MORTON_BITS) / extent : 0.0f;
+    glm_vec3_copy(lo, morton.origin);
+    glm_vec3_fill(morton.scale, scale);
+    morton.keys = (uint64_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint64_t));
+    morton.values = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint32_t));
+    parallel_for(&morton, particleCount, 0, graph_morton_keys);
+    radix_sort_u64(morton.keys, morton.values, particleCount);
+    for(uint32_t i = 0; i<particleCount; ++i){
+        oldToNew[morton.values[i]] = i;
+    }
+    mem_free(morton.keys);
+    mem_free(morton.values);
+}
+
+typedef struct {
+    uint32_t* offsets;      // CSR adjacency
+    uint32_t* neighbours;
+    uint32_t* mark;         // BFS stamp per particle
+    uint32_t stamp;
+    uint32_t* queue;
+    uint32_t* level;
+} GraphAdjacency;
+
+static uint32_t graph_degree(const GraphAdjacency* adj, uint32_t p){
+    return adj->offsets[p+1] - adj->offsets[p];
+}
+
+// Level structure from start over unvisited particles. Returns the depth and
+// the lowest degree particle of the last level.
+static uint32_t graph_bfs_depth(GraphAdjacency* adj, const uint8_t* visited, uint32_t start, uint32_t* farthest){
+    uint32_t head = 0, tail = 0;
+    adj->stamp++;
+    adj->mark[start] = adj->stamp;
+    adj->level[start] = 0;
+    adj->queue[tail++] = start;
+    uint32_t depth = 0;
+    *farthest = start;
+    while(head < tail){
+        uint32_t p = adj->queue[head++];
+        uint32_t l = adj->level[p];
+        if(l > depth || (l == depth && graph_degree(adj, p) < graph_degree(adj, *farthest))){
+            depth = l;
+            *farthest = p;
+        }
+        for(uint32_t i = adj->offsets[p]; i<adj->offsets[p+1]; ++i){
+            uint32_t q = adj->neighbours[i];
+            if(!visited[q] && adj->mark[q] != adj->stamp){
+                adj->mark[q] = adj->stamp;
+                adj->level[q] = l+1;
+                adj->queue[tail++] = q;
+            }
+        }
+    }
+    return depth;
+}
+
+// Reverse Cuthill-McKee: breadth first from a pseudo-peripheral particle of
+// each component, neighbours by increasing degree, then the order reversed
+static void graph_order_rcm(uint32_t particleCount, const ParticleConstraint* constraints, uint32_t constraintCount,
+                            uint32_t* oldToNew){
+    GraphAdjacency adj = {0};
+    adj.offsets = (uint32_t*)mem_calloc(MEM_TAG_PHYSICS, particleCount+1, sizeof(uint32_t));
+    adj.neighbours = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (2*constraintCount+1)*sizeof(uint32_t));
+    for(uint32_t i = 0; i<constraintCount; ++i){
+        adj.offsets[constraints[i].a]++;
+        adj.offsets[constraints[i].b]++;
+    }
+    adj.offsets[particleCount] = prefix_sum_u32(adj.offsets, particleCount);
+    uint32_t* cursor = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint32_t));
+    memcpy(cursor, adj.offsets, particleCount*sizeof(uint32_t));
+    for(uint32_t i = 0; i<constraintCount; ++i){
+        adj.neighbours[cursor[constraints[i].a]++] = constraints[i].b;
+        adj.neighbours[cursor[constraints[i].b]++] = constraints[i].a;
+    }
+    mem_free(cursor);
+    adj.mark = (uint32_t*)mem_calloc(MEM_TAG_PHYSICS, particleCount+1, sizeof(uint32_t));
+    adj.queue = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint32_t));
+    adj.level = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint32_t));
+    uint8_t* visited = (uint8_t*)mem_calloc(MEM_TAG_PHYSICS, particleCount+1, 1);
+    uint32_t* order = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint32_t));
+
+    // Components are started from their lowest degree particle
+    uint64_t* degreeKeys = (uint64_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint64_t));
+    uint32_t* byDegree = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint32_t));
+    for(uint32_t i = 0; i<particleCount; ++i){
+        degreeKeys[i] = graph_degree(&adj, i);
+        byDegree[i] = i;
+    }
+    radix_sort_u64(degreeKeys, byDegree, particleCount);
+
+    uint32_t count = 0;
+    for(uint32_t s = 0; s<particleCount; ++s){
+        uint32_t start = byDegree[s];
+        if(visited[start]){
+            continue;
+        }
+        // A few rounds towards the far end of the component
+        uint32_t farthest;
+        uint32_t depth = graph_bfs_depth(&adj, visited, start, &farthest);
+        for(int round = 0; round<4 && farthest != start; ++round){
+            uint32_t next;
+            uint32_t d = graph_bfs_depth(&adj, visited, farthest, &next);
+            if(d <= depth){
+                break;
+            }
+            start = farthest;
+            farthest = next;
+            depth = d;
+        }
+
+        uint32_t head = count;
+        visited[start] = 1;
+        order[count++] = start;
+        while(head < count){
+            uint32_t p = order[head++];
+            uint32_t first = count;
+            for(uint32_t i = adj.offsets[p]; i<adj.offsets[p+1]; ++i){
+                uint32_t q = adj.neighbours[i];
+                if(!visited[q]){
+                    visited[q] = 1;
+                    order[count++] = q;
+                }
+            }
+            for(uint32_t i = first+1; i<count; ++i){
+                uint32_t q = order[i];
+                uint32_t j = i;
+                while(j > first && graph_degree(&adj, order[j-1]) > graph_degree(&adj, q)){
+                    order[j] = order[j-1];
+                    --j;
+                }
+                order[j] = q;
+            }
+        }
+    }
+    for(uint32_t i = 0; i<particleCount; ++i){
+        oldToNew[order[i]] = particleCount-1-i;
+    }
+
+    mem_free(adj.offsets);
+    mem_free(adj.neighbours);
+    mem_free(adj.mark);
+    mem_free(adj.queue);
+    mem_free(adj.level);
+    mem_free(visited);
+    mem_free(order);
+    mem_free(degreeKeys);
+    mem_free(byDegree);
+}
+
+void particle_order_compute(ParticleOrder order, Vec3Soa positions, uint32_t particleCount,
+                            const ParticleConstraint* constraints, uint32_t constraintCount, uint32_t* oldToNew){
+    if(order == PARTICLE_ORDER_MORTON){
+        graph_order_morton(positions, particleCount, oldToNew);
+    } else if(order == PARTICLE_ORDER_RCM){
+        graph_order_rcm(particleCount, constraints, constraintCount, oldToNew);
+    } else {
+        for(uint32_t i = 0; i<particleCount; ++i){
+            oldToNew[i] = i;
+        }
+    }
+}
+
+static void graph_permute_floats(float* values, const uint32_t* oldToNew, uint32_t count, float* scratch){
+    for(uint32_t i = 0; i<count; ++i){
+        scratch[oldToNew[i]] = values[i];
+    }
+    memcpy(values, scratch, count*sizeof(float));
+}
+
+// Remapped constraints with a < b, sorted by (a, b)
+static void graph_sort_constraints(ParticleConstraint* constraints, uint32_t count, const uint32_t* oldToNew){
+    uint64_t* keys = (uint64_t*)mem_alloc(MEM_TAG_PHYSICS, (count+1)*sizeof(uint64_t));
+    uint32_t* values = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (count+1)*sizeof(uint32_t));
+    ParticleConstraint* sorted = (ParticleConstraint*)mem_alloc(MEM_TAG_PHYSICS, (count+1)*sizeof(ParticleConstraint));
+    for(uint32_t i = 0; i<count; ++i){
+        uint32_t a = oldToNew[constraints[i].a], b = oldToNew[constraints[i].b];
+        constraints[i].a = a < b ? a : b;
+        constraints[i].b = a < b ? b : a;
+        keys[i] = (uint64_t)constraints[i].a << 32 | constraints[i].b;
+        values[i] = i;
+    }
+    radix_sort_u64(keys, values, count);
+    for(uint32_t i = 0; i<count; ++i){
+        sorted[i] = constraints[values[i]];
+    }
+    memcpy(constraints, sorted, count*sizeof(ParticleConstraint));
+    mem_free(keys);
+    mem_free(values);
+    mem_free(sorted);
+}
+
+void particle_graph_reorder(ParticleGraph* graph, const uint32_t* oldToNew){
+    uint32_t n = graph->particleCount;
+    float* scratch = (float*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*sizeof(float));
+    graph_permute_floats(graph->positions.x, oldToNew, n, scratch);
+    graph_permute_floats(graph->positions.y, oldToNew, n, scratch);
+    graph_permute_floats(graph->positions.z, oldToNew, n, scratch);
+    mem_free(scratch);
+    graph_sort_constraints(graph->constraints, graph->edgeCount, oldToNew);
+    graph_sort_constraints(graph->constraints + graph->edgeCount, graph->bendCount, oldToNew);
+    for(uint32_t i = 0; i<graph->positionCount; ++i){
+        uint32_t p = graph->positionToParticle[i];
+        graph->positionToParticle[i] = p == PARTICLE_NONE ? PARTICLE_NONE : oldToNew[p];
+    }
+    for(uint32_t i = 0; i<graph->renderVertexCount; ++i){
+        uint32_t p = graph->renderToParticle[i];
+        graph->renderToParticle[i] = p == PARTICLE_NONE ? PARTICLE_NONE : oldToNew[p];
+    }
+}
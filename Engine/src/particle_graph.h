@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include "asset.h"
+#include "batch.h"
+
+// Particle/constraint topology of a mesh for the Verlet simulation.
+//
+// Positions closer than weldEpsilon become one particle (OBJ exports often
+// split vertices along UV seams). Every edge of the fan triangulated faces
+// becomes exactly one distance constraint. With bending enabled, every edge
+// shared by exactly two triangles also gets a constraint between the two
+// vertices opposite that edge.
+//
+// Welding and edge deduplication are sort based (radix sort of cell / edge
+// keys), all passes over faces and keys run as parallel_for jobs.
+//
+// Particles come out in OBJ position order, which follows how the model was
+// authored. A reorder pass renumbers them for cache locality, either along a
+// Morton curve through the bounding box or by reverse Cuthill-McKee over the
+// constraint graph, which keeps the two ends of a constraint close in index.
+
+#define PARTICLE_NONE UINT32_MAX
+
+typedef struct {
+    uint32_t a;
+    uint32_t b;
+    float restLength;
+} ParticleConstraint;
+
+typedef enum {
+    PARTICLE_ORDER_NONE,
+    PARTICLE_ORDER_MORTON,
+    PARTICLE_ORDER_RCM,
+} ParticleOrder;
+
+typedef struct {
+    float weldEpsilon;  // <= 0 uses 1e-6 of the bounding box diagonal
+    int bending;
+    ParticleOrder order;
+} ParticleGraphDesc;
+
+typedef struct {
+    uint32_t particleCount;
+    Vec3Soa positions;
+
+    // Edge constraints sorted by (a, b), then bending constraints
+    uint32_t constraintCount;
+    uint32_t edgeCount;
+    uint32_t bendCount;
+    ParticleConstraint* constraints;
+
+    uint32_t positionCount;
+    uint32_t* positionToParticle;   // per fast_obj position, PARTICLE_NONE if unused
+    uint32_t renderVertexCount;
+    uint32_t* renderToParticle;     // per vertex of the asset_load_mesh triangle soup
+} ParticleGraph;
+
+int particle_graph_build(const fastObjMesh* mesh, const ParticleGraphDesc* desc, ParticleGraph* graph);
+void particle_graph_free(ParticleGraph* graph);
+
+// Fills oldToNew (particleCount entries) with the new index of every particle
+void particle_order_compute(ParticleOrder order, Vec3Soa positions, uint32_t particleCount,
+                            const ParticleConstraint* constraints, uint32_t constraintCount, uint32_t* oldToNew);
+// Renumbers the particles, constraints and index maps, edges and bends are
+// sorted by (a, b) again
+void particle_graph_reorder(ParticleGraph* graph, const uint32_t* oldToNew);
@@ -0,0 +1,217 @@
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include "platform.h"
+
+#if !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+static void cpuid(unsigned int leaf, unsigned int regs[4]){
+#if defined(_MSC_VER)
+    __cpuidex((int*)regs, (int)leaf, 0);
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t xgetbv0(void){
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+int cpu_has_avx2(void){
+    unsigned int regs[4];
+    cpuid(0, regs);
+    if(regs[0] < 7){
+        return 0;
+    }
+    cpuid(1, regs);
+    int osxsave = (regs[2] >> 27) & 1;
+    int fma = (regs[2] >> 12) & 1;
+    int f16c = (regs[2] >> 29) & 1;
+    if(!osxsave || !fma || !f16c || (xgetbv0() & 6) != 6){
+        return 0;
+    }
+    cpuid(7, regs);
+    return (regs[1] >> 5) & 1;
+}
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef struct {
+    ThreadFunc func;
+    void* arg;
+} ThreadStart;
+
+static DWORD WINAPI thread_entry(LPVOID param){
+    ThreadStart start = *(ThreadStart*)param;
+    HeapFree(GetProcessHeap(), 0, param);
+    start.func(start.arg);
+    return 0;
+}
+
+int thread_create(Thread* thread, ThreadFunc func, void* arg){
+    ThreadStart* start = (ThreadStart*)HeapAlloc(GetProcessHeap(), 0, sizeof(ThreadStart));
+    if(!start){
+        return 0;
+    }
+    start->func = func;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+    if(!*thread){
+        HeapFree(GetProcessHeap(), 0, start);
+        return 0;
+    }
+    return 1;
+}
+
+void thread_join(Thread thread){
+    WaitForSingleObject((HANDLE)thread, INFINITE);
+    CloseHandle((HANDLE)thread);
+}
+
+void thread_pin(Thread thread, unsigned int core){
+    if(core < sizeof(DWORD_PTR)*8){
+        SetThreadAffinityMask((HANDLE)thread, (DWORD_PTR)1 << core);
+    }
+}
+
+Thread thread_current(void){
+    return GetCurrentThread();
+}
+
+void thread_yield(void){
+    SwitchToThread();
+}
+
+void semaphore_init(Semaphore* sem, unsigned int initial){
+    *sem = CreateSemaphoreA(NULL, (LONG)initial, 0x7fffffff, NULL);
+}
+
+void semaphore_destroy(Semaphore* sem){
+    CloseHandle((HANDLE)*sem);
+}
+
+void semaphore_post(Semaphore* sem, unsigned int count){
+    ReleaseSemaphore((HANDLE)*sem, (LONG)count, NULL);
+}
+
+void semaphore_wait(Semaphore* sem){
+    WaitForSingleObject((HANDLE)*sem, INFINITE);
+}
+
+unsigned int cpu_core_count(void){
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors : 1;
+}
+
+uint64_t time_now_ns(void){
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if(frequency.QuadPart == 0){
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    // Split to avoid overflowing the multiplication on long uptimes
+    uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+    uint64_t rest = counter.QuadPart % frequency.QuadPart;
+    return seconds*1000000000ull + rest*1000000000ull/frequency.QuadPart;
+}
+
+#else
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    ThreadFunc func;
+    void* arg;
+} ThreadStart;
+
+static void* thread_entry(void* param){
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return NULL;
+}
+
+int thread_create(Thread* thread, ThreadFunc func, void* arg){
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if(!start){
+        return 0;
+    }
+    start->func = func;
+    start->arg = arg;
+    if(pthread_create(thread, NULL, thread_entry, start) != 0){
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void thread_join(Thread thread){
+    pthread_join(thread, NULL);
+}
+
+void thread_pin(Thread thread, unsigned int core){
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+    (void)thread;
+    (void)core;
+#endif
+}
+
+Thread thread_current(void){
+    return pthread_self();
+}
+
+void thread_yield(void){
+    sched_yield();
+}
+
+void semaphore_init(Semaphore* sem, unsigned int initial){
+    sem_init(sem, 0, initial);
+}
+
+void semaphore_destroy(Semaphore* sem){
+    sem_destroy(sem);
+}
+
+void semaphore_post(Semaphore* sem, unsigned int count){
+    for(unsigned int i = 0; i<count; ++i){
+        sem_post(sem);
+    }
+}
+
+void semaphore_wait(Semaphore* sem){
+    while(sem_wait(sem) != 0){
+        // retry on EINTR
+    }
+}
+
+unsigned int cpu_core_count(void){
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int)count : 1;
+}
+
+uint64_t time_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#endif
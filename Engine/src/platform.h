@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+
+// Thin layer over the OS and compiler so the engine modules can stay portable
+// between MSVC/Win32 and GCC/Clang/pthreads.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#define ALIGNED(n) __declspec(align(n))
+#else
+#include <immintrin.h>
+#define THREAD_LOCAL __thread
+#define ALIGNED(n) __attribute__((aligned(n)))
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+// ---------------------------------------------------------
+// Atomics (sequentially consistent unless the name says otherwise)
+// ---------------------------------------------------------
+#if defined(_MSC_VER)
+static inline int32_t atomic_load_i32(volatile int32_t* p){ int32_t v = *p; _ReadWriteBarrier(); return v; }
+static inline int64_t atomic_load_i64(volatile int64_t* p){ int64_t v = *p; _ReadWriteBarrier(); return v; }
+static inline void* atomic_load_ptr(void* volatile* p){ void* v = *p; _ReadWriteBarrier(); return v; }
+static inline void atomic_store_i32(volatile int32_t* p, int32_t v){ _InterlockedExchange((volatile long*)p, v); }
+static inline void atomic_store_i64(volatile int64_t* p, int64_t v){ _InterlockedExchange64((volatile long long*)p, v); }
+static inline void atomic_store_ptr(void* volatile* p, void* v){ _InterlockedExchangePointer(p, v); }
+// Store with release semantics only, for the owner side of lock-free queues.
+static inline void atomic_store_release_i64(volatile int64_t* p, int64_t v){ _ReadWriteBarrier(); *p = v; }
+static inline int32_t atomic_fetch_add_i32(volatile int32_t* p, int32_t v){ return _InterlockedExchangeAdd((volatile long*)p, v); }
+static inline int64_t atomic_fetch_add_i64(volatile int64_t* p, int64_t v){ return _InterlockedExchangeAdd64((volatile long long*)p, v); }
+static inline int atomic_cas_i32(volatile int32_t* p, int32_t expected, int32_t desired){
+    return _InterlockedCompareExchange((volatile long*)p, desired, expected) == expected;
+}
+static inline int atomic_cas_i64(volatile int64_t* p, int64_t expected, int64_t desired){
+    return _InterlockedCompareExchange64((volatile long long*)p, desired, expected) == expected;
+}
+static inline void atomic_fence(void){ _mm_mfence(); }
+#else
+static inline int32_t atomic_load_i32(volatile int32_t* p){ return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline int64_t atomic_load_i64(volatile int64_t* p){ return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void* atomic_load_ptr(void* volatile* p){ return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void atomic_store_i32(volatile int32_t* p, int32_t v){ __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+static inline void atomic_store_i64(volatile int64_t* p, int64_t v){ __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+static inline void atomic_store_ptr(void* volatile* p, void* v){ __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+static inline void atomic_store_release_i64(volatile int64_t* p, int64_t v){ __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline int32_t atomic_fetch_add_i32(volatile int32_t* p, int32_t v){ return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+static inline int64_t atomic_fetch_add_i64(volatile int64_t* p, int64_t v){ return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+static inline int atomic_cas_i32(volatile int32_t* p, int32_t expected, int32_t desired){
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+static inline int atomic_cas_i64(volatile int64_t* p, int64_t expected, int64_t desired){
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+static inline void atomic_fence(void){ __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#endif
+
+static inline void cpu_relax(void){ _mm_pause(); }
+
+// ---------------------------------------------------------
+// Threads
+// ---------------------------------------------------------
+#if defined(_WIN32)
+typedef void* Thread;
+typedef void* Semaphore;
+#else
+#include <pthread.h>
+#include <semaphore.h>
+typedef pthread_t Thread;
+typedef sem_t Semaphore;
+#endif
+
+typedef void (*ThreadFunc)(void* arg);
+
+int  thread_create(Thread* thread, ThreadFunc func, void* arg);
+void thread_join(Thread thread);
+// Pins the thread to one logical core. Best effort: silently ignored where unsupported.
+void thread_pin(Thread thread, unsigned int core);
+Thread thread_current(void);
+void thread_yield(void);
+
+void semaphore_init(Semaphore* sem, unsigned int initial);
+void semaphore_destroy(Semaphore* sem);
+void semaphore_post(Semaphore* sem, unsigned int count);
+void semaphore_wait(Semaphore* sem);
+
+unsigned int cpu_core_count(void);
+// AVX2 + FMA + F16C usable, i.e. supported by the CPU and enabled by the OS.
+int cpu_has_avx2(void);
+
+// Monotonic high resolution clock.
+uint64_t time_now_ns(void);
+static inline double time_ms_since(uint64_t start){ return (double)(time_now_ns() - start) * 1e-6; }
@@ -0,0 +1,372 @@
+#include <stdlib.h>
+#include <string.h>
+#include "job.h"
+#include "memory.h"
+#include "scene.h"
+
+// Subtrees up to this many nodes are updated by one job
+#define SCENE_UPDATE_GRAIN 512
+
+typedef struct {
+    Scene* scene;
+    uint32_t begin;
+    uint32_t end;
+} SceneTask;
+
+typedef struct {
+    Scene* scene;
+    uint32_t firstRange;
+    uint32_t lastRange;
+} SceneGroup;
+
+#define SCENE_ARRAY_COUNT 16
+
+typedef struct {
+    void** ptr;
+    size_t size;
+} SceneArray;
+
+// Every per slot array, so growing and shifting can treat them alike
+static void scene_arrays(Scene* scene, SceneArray arrays[SCENE_ARRAY_COUNT]){
+    int n = 0;
+#define SCENE_ARRAY(field) arrays[n].ptr = (void**)&scene->field; arrays[n++].size = sizeof(*scene->field)
+    SCENE_ARRAY(parent);
+    SCENE_ARRAY(subtreeEnd);
+    SCENE_ARRAY(posX);
+    SCENE_ARRAY(posY);
+    SCENE_ARRAY(posZ);
+    SCENE_ARRAY(rotX);
+    SCENE_ARRAY(rotY);
+    SCENE_ARRAY(rotZ);
+    SCENE_ARRAY(rotW);
+    SCENE_ARRAY(scaleX);
+    SCENE_ARRAY(scaleY);
+    SCENE_ARRAY(scaleZ);
+    SCENE_ARRAY(world);
+    SCENE_ARRAY(dirty);
+    SCENE_ARRAY(queued);
+    SCENE_ARRAY(idOf);
+#undef SCENE_ARRAY
+}
+
+static void scene_reserve(Scene* scene, uint32_t capacity){
+    if(capacity <= scene->capacity){
+        return;
+    }
+    SceneArray arrays[SCENE_ARRAY_COUNT];
+    scene_arrays(scene, arrays);
+    for(int i = 0; i<SCENE_ARRAY_COUNT; ++i){
+        void* grown = mem_alloc_aligned(MEM_TAG_SCENE, capacity*arrays[i].size, 32);
+        if(*arrays[i].ptr){
+            memcpy(grown, *arrays[i].ptr, scene->count*arrays[i].size);
+            mem_free(*arrays[i].ptr);
+        }
+        *arrays[i].ptr = grown;
+    }
+    scene->slotOf = (uint32_t*)mem_realloc(MEM_TAG_SCENE, scene->slotOf, capacity*sizeof(uint32_t));
+    scene->dirtyRoots = (uint32_t*)mem_realloc(MEM_TAG_SCENE, scene->dirtyRoots, capacity*sizeof(uint32_t));
+    scene->updatedRanges = (uint32_t*)mem_realloc(MEM_TAG_SCENE, scene->updatedRanges, capacity*2*sizeof(uint32_t));
+    scene->capacity = capacity;
+}
+
+void scene_init(Scene* scene, uint32_t capacity){
+    memset(scene, 0, sizeof(*scene));
+    scene_reserve(scene, capacity > 0 ? capacity : 64);
+}
+
+void scene_free(Scene* scene){
+    SceneArray arrays[SCENE_ARRAY_COUNT];
+    scene_arrays(scene, arrays);
+    for(int i = 0; i<SCENE_ARRAY_COUNT; ++i){
+        mem_free(*arrays[i].ptr);
+    }
+    mem_free(scene->slotOf);
+    mem_free(scene->dirtyRoots);
+    mem_free(scene->updatedRanges);
+    memset(scene, 0, sizeof(*scene));
+}
+
+// Opens a hole at slot pos, fixing up every slot reference
+static void scene_insert_slot(Scene* scene, uint32_t pos, uint32_t parentSlot){
+    uint32_t moved = scene->count - pos;
+    if(moved > 0){
+        SceneArray arrays[SCENE_ARRAY_COUNT];
+        scene_arrays(scene, arrays);
+        for(int i = 0; i<SCENE_ARRAY_COUNT; ++i){
+            uint8_t* base = (uint8_t*)*arrays[i].ptr;
+            size_t size = arrays[i].size;
+            memmove(base + (pos+1)*size, base + pos*size, moved*size);
+        }
+        for(uint32_t i = 0; i<scene->count+1; ++i){
+            if(i == pos){
+                continue;
+            }
+            if(scene->parent[i] != SCENE_NONE && scene->parent[i] >= pos){
+                scene->parent[i]++;
+            }
+            if(scene->subtreeEnd[i] > pos){
+                scene->subtreeEnd[i]++;
+            }
+        }
+        for(uint32_t i = pos+1; i<scene->count+1; ++i){
+            scene->slotOf[scene->idOf[i]] = i;
+        }
+        for(uint32_t i = 0; i<scene->updatedRangeCount*2; ++i){
+            if(scene->updatedRanges[i] > pos || (i%2 == 0 && scene->updatedRanges[i] == pos)){
+                scene->updatedRanges[i]++;
+            }
+        }
+    }
+    // Ancestors whose subtree ended right where we inserted now include the new slot
+    for(uint32_t a = parentSlot; a != SCENE_NONE; a = scene->parent[a]){
+        if(scene->subtreeEnd[a] == pos){
+            scene->subtreeEnd[a]++;
+        }
+    }
+    scene->count++;
+}
+
+SceneNode scene_create_node(Scene* scene, SceneNode parent){
+    if(scene->count == scene->capacity){
+        scene_reserve(scene, scene->capacity*2);
+    }
+
+    SceneNode id = scene->count;
+    uint32_t parentSlot = parent == SCENE_NONE ? SCENE_NONE : scene->slotOf[parent];
+    uint32_t slot = parentSlot == SCENE_NONE ? scene->count : scene->subtreeEnd[parentSlot];
+    scene_insert_slot(scene, slot, parentSlot);
+
+    scene->parent[slot] = parentSlot;
+    scene->subtreeEnd[slot] = slot+1;
+    scene->posX[slot] = scene->posY[slot] = scene->posZ[slot] = 0.0f;
+    scene->rotX[slot] = scene->rotY[slot] = scene->rotZ[slot] = 0.0f;
+    scene->rotW[slot] = 1.0f;
+    scene->scaleX[slot] = scene->scaleY[slot] = scene->scaleZ[slot] = 1.0f;
+    scene->dirty[slot] = 0;
+    scene->idOf[slot] = id;
+    scene->slotOf[id] = slot;
+
+    // New nodes need a world matrix too
+    scene->queued[slot] = 1;
+    scene->dirtyRoots[scene->dirtyRootCount++] = id;
+    return id;
+}
+
+static void scene_queue(Scene* scene, uint32_t slot){
+    if(!scene->queued[slot]){
+        scene->queued[slot] = 1;
+        scene->dirtyRoots[scene->dirtyRootCount++] = scene->idOf[slot];
+    }
+}
+
+void scene_set_position(Scene* scene, SceneNode node, vec3 position){
+    uint32_t slot = scene->slotOf[node];
+    scene->posX[slot] = position[0];
+    scene->posY[slot] = position[1];
+    scene->posZ[slot] = position[2];
+    scene_queue(scene, slot);
+}
+
+void scene_set_rotation(Scene* scene, SceneNode node, versor rotation){
+    uint32_t slot = scene->slotOf[node];
+    scene->rotX[slot] = rotation[0];
+    scene->rotY[slot] = rotation[1];
+    scene->rotZ[slot] = rotation[2];
+    scene->rotW[slot] = rotation[3];
+    scene_queue(scene, slot);
+}
+
+void scene_set_scale(Scene* scene, SceneNode node, vec3 scale){
+    uint32_t slot = scene->slotOf[node];
+    scene->scaleX[slot] = scale[0];
+    scene->scaleY[slot] = scale[1];
+    scene->scaleZ[slot] = scale[2];
+    scene_queue(scene, slot);
+}
+
+vec4* scene_world(Scene* scene, SceneNode node){
+    return scene->world[scene->slotOf[node]];
+}
+
+int scene_world_changed(const Scene* scene, SceneNode node){
+    return scene->dirty[scene->slotOf[node]];
+}
+
+// ---------------------------------------------------------
+// Update
+// ---------------------------------------------------------
+static void scene_compute_world(Scene* scene, uint32_t i){
+    float x = scene->rotX[i], y = scene->rotY[i], z = scene->rotZ[i], w = scene->rotW[i];
+    float sx = scene->scaleX[i], sy = scene->scaleY[i], sz = scene->scaleZ[i];
+    float xx = x*x, yy = y*y, zz = z*z;
+    float xy = x*y, xz = x*z, yz = y*z;
+    float wx = w*x, wy = w*y, wz = w*z;
+
+    // T * R * S
+    mat4 local;
+    local[0][0] = (1.0f - 2.0f*(yy + zz))*sx;
+    local[0][1] = 2.0f*(xy + wz)*sx;
+    local[0][2] = 2.0f*(xz - wy)*sx;
+    local[0][3] = 0.0f;
+    local[1][0] = 2.0f*(xy - wz)*sy;
+    local[1][1] = (1.0f - 2.0f*(xx + zz))*sy;
+    local[1][2] = 2.0f*(yz + wx)*sy;
+    local[1][3] = 0.0f;
+    local[2][0] = 2.0f*(xz + wy)*sz;
+    local[2][1] = 2.0f*(yz - wx)*sz;
+    local[2][2] = (1.0f - 2.0f*(xx + yy))*sz;
+    local[2][3] = 0.0f;
+    local[3][0] = scene->posX[i];
+    local[3][1] = scene->posY[i];
+    local[3][2] = scene->posZ[i];
+    local[3][3] = 1.0f;
+
+    uint32_t parent = scene->parent[i];
+    if(parent == SCENE_NONE){
+        glm_mat4_copy(local, scene->world[i]);
+    } else {
+        glm_mat4_mul(scene->world[parent], local, scene->world[i]);
+    }
+    scene->dirty[i] = 1;
+}
+
+static void scene_update_linear(Scene* scene, uint32_t begin, uint32_t end){
+    for(uint32_t i = begin; i<end; ++i){
+        scene_compute_world(scene, i);
+    }
+}
+
+static void scene_update_task(Job* job, void* data);
+
+static void scene_spawn(Job* parent, Scene* scene, uint32_t begin, uint32_t end){
+    if(!parent){
+        SceneTask task = {scene, begin, end};
+        scene_update_task(NULL, &task);
+        return;
+    }
+    SceneTask* task = (SceneTask*)mem_frame_alloc(sizeof(SceneTask), 0);
+    task->scene = scene;
+    task->begin = begin;
+    task->end = end;
+    job_run(job_create_child(parent, scene_update_task, task));
+}
+
+// [begin, end) is a run of complete sibling subtrees whose parent is already up to date.
+// Small runs are done here, big subtrees are descended into and the rest handed out.
+static void scene_update_task(Job* job, void* data){
+    SceneTask* task = (SceneTask*)data;
+    Scene* scene = task->scene;
+    uint32_t begin = task->begin;
+    uint32_t end = task->end;
+
+    while(begin < end){
+        if(end - begin <= SCENE_UPDATE_GRAIN){
+            scene_update_linear(scene, begin, end);
+            return;
+        }
+
+        uint32_t first = scene->subtreeEnd[begin];
+        if(first - begin > SCENE_UPDATE_GRAIN){
+            // One big subtree: do its root, leave the siblings to someone else and descend
+            scene_compute_world(scene, begin);
+            if(first < end){
+                scene_spawn(job, scene, first, end);
+            }
+            end = first;
+            begin = begin+1;
+            continue;
+        }
+
+        // Batch small sibling subtrees up to the grain
+        uint32_t batchEnd = begin;
+        while(batchEnd < end && scene->subtreeEnd[batchEnd] - begin <= SCENE_UPDATE_GRAIN){
+            batchEnd = scene->subtreeEnd[batchEnd];
+        }
+        if(batchEnd == end){
+            scene_update_linear(scene, begin, end);
+            return;
+        }
+        scene_spawn(job, scene, begin, batchEnd);
+        begin = batchEnd;
+    }
+}
+
+static void scene_update_group(Job* job, void* data){
+    SceneGroup* group = (SceneGroup*)data;
+    Scene* scene = group->scene;
+    for(uint32_t r = group->firstRange; r<group->lastRange; ++r){
+        SceneTask task = {scene, scene->updatedRanges[2*r], scene->updatedRanges[2*r+1]};
+        scene_update_task(job, &task);
+    }
+}
+
+static int compare_slots(const void* a, const void* b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void scene_update_root(Job* job, void* data){
+    (void)job;
+    (void)data;
+}
+
+void scene_update(Scene* scene){
+    for(uint32_t r = 0; r<scene->updatedRangeCount; ++r){
+        uint32_t begin = scene->updatedRanges[2*r];
+        memset(scene->dirty + begin, 0, scene->updatedRanges[2*r+1] - begin);
+    }
+    scene->updatedRangeCount = 0;
+    scene->updatedNodes = 0;
+    if(scene->dirtyRootCount == 0){
+        return;
+    }
+
+    uint32_t* roots = scene->dirtyRoots;
+    for(uint32_t i = 0; i<scene->dirtyRootCount; ++i){
+        roots[i] = scene->slotOf[roots[i]];
+        scene->queued[roots[i]] = 0;
+    }
+    qsort(roots, scene->dirtyRootCount, sizeof(uint32_t), compare_slots);
+
+    // Roots inside an already queued subtree are covered by it
+    uint32_t coveredEnd = 0;
+    for(uint32_t i = 0; i<scene->dirtyRootCount; ++i){
+        uint32_t slot = roots[i];
+        if(slot < coveredEnd){
+            continue;
+        }
+        coveredEnd = scene->subtreeEnd[slot];
+        scene->updatedRanges[2*scene->updatedRangeCount] = slot;
+        scene->updatedRanges[2*scene->updatedRangeCount+1] = coveredEnd;
+        scene->updatedRangeCount++;
+        scene->updatedNodes += coveredEnd - slot;
+    }
+    scene->dirtyRootCount = 0;
+
+    if(scene->updatedNodes <= SCENE_UPDATE_GRAIN || job_thread_count() < 2){
+        for(uint32_t r = 0; r<scene->updatedRangeCount; ++r){
+            scene_spawn(NULL, scene, scene->updatedRanges[2*r], scene->updatedRanges[2*r+1]);
+        }
+        return;
+    }
+
+    // Pack neighbouring small ranges into one job, big ones split further inside their job
+    Job* root = job_create(scene_update_root, NULL);
+    uint32_t firstRange = 0;
+    uint32_t groupNodes = 0;
+    for(uint32_t r = 0; r<scene->updatedRangeCount; ++r){
+        groupNodes += scene->updatedRanges[2*r+1] - scene->updatedRanges[2*r];
+        if(groupNodes < SCENE_UPDATE_GRAIN && r+1 < scene->updatedRangeCount){
+            continue;
+        }
+        SceneGroup* group = (SceneGroup*)mem_frame_alloc(sizeof(SceneGroup), 0);
+        group->scene = scene;
+        group->firstRange = firstRange;
+        group->lastRange = r+1;
+        job_run(job_create_child(root, scene_update_group, group));
+        firstRange = r+1;
+        groupNodes = 0;
+    }
+    job_run(root);
+    job_wait(root);
+}
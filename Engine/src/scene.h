@@ -0,0 +1,66 @@
+#pragma once
+#include <cglm/cglm.h>
+#include <stdint.h>
+
+// Flat transform hierarchy.
+//
+// Nodes live in depth-first order, so a parent always comes before its
+// children and every subtree is one contiguous slot range [slot, subtreeEnd).
+// Local TRS is stored per component, world matrices in one mat4 array ready
+// for upload. Setting a local transform only queues the node; scene_update()
+// recomputes the queued subtrees (in parallel for big ones) and nothing else.
+//
+// SceneNode ids are stable. Slots move when a node is inserted in front of
+// them (creating a child of a node that is not on the last branch), which is
+// an O(n) operation; building a hierarchy depth first only ever appends.
+
+#define SCENE_NONE UINT32_MAX
+
+typedef uint32_t SceneNode;
+
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+
+    // Indexed by slot
+    uint32_t* parent;       // slot of the parent or SCENE_NONE
+    uint32_t* subtreeEnd;   // one past the last slot of this subtree
+    float* posX;
+    float* posY;
+    float* posZ;
+    float* rotX;
+    float* rotY;
+    float* rotZ;
+    float* rotW;
+    float* scaleX;
+    float* scaleY;
+    float* scaleZ;
+    mat4* world;
+    uint8_t* dirty;         // world was recomputed by the last scene_update
+    uint8_t* queued;
+    uint32_t* idOf;
+
+    // Indexed by SceneNode
+    uint32_t* slotOf;
+
+    uint32_t* dirtyRoots;   // queued SceneNodes
+    uint32_t dirtyRootCount;
+    uint32_t* updatedRanges; // begin/end pairs recomputed by the last update
+    uint32_t updatedRangeCount;
+    uint32_t updatedNodes;
+} Scene;
+
+void scene_init(Scene* scene, uint32_t capacity);
+void scene_free(Scene* scene);
+
+SceneNode scene_create_node(Scene* scene, SceneNode parent);
+
+void scene_set_position(Scene* scene, SceneNode node, vec3 position);
+void scene_set_rotation(Scene* scene, SceneNode node, versor rotation);
+void scene_set_scale(Scene* scene, SceneNode node, vec3 scale);
+
+// Recomputes world matrices below every node changed since the last call.
+void scene_update(Scene* scene);
+
+vec4* scene_world(Scene* scene, SceneNode node);
+int scene_world_changed(const Scene* scene, SceneNode node);
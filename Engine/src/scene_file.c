@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "job.h"
+#include "memory.h"
+#include "platform.h"
+#include "scene_file.h"
+
+#define SCENE_FILE_NAME_MAX 64
+
+typedef struct {
+    char name[SCENE_FILE_NAME_MAX];
+    SceneAssetKind kind;
+    uint32_t asset;
+} SceneName;
+
+typedef struct {
+    SceneName* names;
+    uint32_t nameCount;
+    uint32_t nameCapacity;
+    uint32_t assetCapacity;
+    uint32_t instanceCapacity;
+    uint32_t lightCapacity;
+} SceneParse;
+
+static void* scene_file_grow(void* array, uint32_t count, uint32_t* capacity, size_t size){
+    if(count < *capacity){
+        return array;
+    }
+    *capacity = *capacity ? *capacity*2 : 16;
+    return mem_realloc(MEM_TAG_SCENE, array, *capacity*size);
+}
+
+// Splits off the next whitespace separated token, NULL at the end of the line
+static char* scene_file_token(char** cursor){
+    char* c = *cursor;
+    while(*c == ' ' || *c == '\t' || *c == '\r'){
+        ++c;
+    }
+    if(*c == '\0' || *c == '#'){
+        *cursor = c;
+        return NULL;
+    }
+    char* token = c;
+    while(*c && *c != ' ' && *c != '\t' && *c != '\r'){
+        ++c;
+    }
+    if(*c){
+        *c++ = '\0';
+    }
+    *cursor = c;
+    return token;
+}
+
+// Up to count numbers, returns how many. Stops in front of the first token
+// that is not a number and leaves it for the caller.
+static int scene_file_floats(char** cursor, float* out, int count){
+    for(int i = 0; i<count; ++i){
+        char* c = *cursor;
+        while(*c == ' ' || *c == '\t' || *c == '\r'){
+            ++c;
+        }
+        char* end = c;
+        float value = *c != '\0' && *c != '#' ? strtof(c, &end) : 0.0f;
+        if(end == c || (*end != '\0' && *end != ' ' && *end != '\t' && *end != '\r')){
+            return i;
+        }
+        scene_file_token(cursor);
+        out[i] = value;
+    }
+    return count;
+}
+
+// Meshes and textures have separate namespaces
+static uint32_t scene_file_find_name(SceneParse* parse, const char* name, SceneAssetKind kind){
+    for(uint32_t i = 0; i<parse->nameCount; ++i){
+        if(parse->names[i].kind == kind && strcmp(parse->names[i].name, name) == 0){
+            return parse->names[i].asset;
+        }
+    }
+    return SCENE_FILE_NONE;
+}
+
+static uint32_t scene_file_add_asset(SceneFile* file, SceneParse* parse, const char* directory, const char* path, SceneAssetKind kind){
+    char resolved[SCENE_FILE_PATH_MAX];
+    int absolute = path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':');
+    snprintf(resolved, sizeof(resolved), "%s%s", absolute ? "" : directory, path);
+
+    // The same file behind several names is loaded once and shared
+    for(uint32_t i = 0; i<file->assetCount; ++i){
+        if(file->assets[i].kind == kind && strcmp(file->assets[i].path, resolved) == 0){
+            return i;
+        }
+    }
+    file->assets = (SceneAsset*)scene_file_grow(file->assets, file->assetCount, &parse->assetCapacity, sizeof(SceneAsset));
+    SceneAsset* asset = &file->assets[file->assetCount];
+    memset(asset, 0, sizeof(*asset));
+    snprintf(asset->path, sizeof(asset->path), "%s", resolved);
+    asset->kind = kind;
+    return file->assetCount++;
+}
+
+static int scene_file_parse_line(SceneFile* file, SceneParse* parse, const char* directory, char* line){
+    char* cursor = line;
+    char* keyword = scene_file_token(&cursor);
+    if(!keyword){
+        return 1;
+    }
+
+    if(strcmp(keyword, "mesh") == 0 || strcmp(keyword, "texture") == 0){
+        char* name = scene_file_token(&cursor);
+        char* path = scene_file_token(&cursor);
+        if(!name || !path || strlen(name) >= SCENE_FILE_NAME_MAX){
+            return 0;
+        }
+        SceneAssetKind kind = keyword[0] == 'm' ? SCENE_ASSET_MESH : SCENE_ASSET_IMAGE;
+        if(scene_file_find_name(parse, name, kind) != SCENE_FILE_NONE){
+            printf("SCENE_FILE: %s '%s' is declared twice\n", keyword, name);
+            return 0;
+        }
+        parse->names = (SceneName*)scene_file_grow(parse->names, parse->nameCount, &parse->nameCapacity, sizeof(SceneName));
+        SceneName* entry = &parse->names[parse->nameCount++];
+        snprintf(entry->name, sizeof(entry->name), "%s", name);
+        entry->kind = kind;
+        entry->asset = scene_file_add_asset(file, parse, directory, path, kind);
+        return 1;
+    }
+
+    if(strcmp(keyword, "instance") == 0){
+        char* meshName = scene_file_token(&cursor);
+        char* textureName = scene_file_token(&cursor);
+        if(!meshName || !textureName){
+            return 0;
+        }
+        SceneInstance instance = {SCENE_FILE_NONE, SCENE_FILE_NONE, {0, 0, 0}, {0, 0, 0}, {1, 1, 1}};
+        instance.mesh = scene_file_find_name(parse, meshName, SCENE_ASSET_MESH);
+        if(instance.mesh == SCENE_FILE_NONE){
+            printf("SCENE_FILE: '%s' is not a declared mesh\n", meshName);
+            return 0;
+        }
+        if(strcmp(textureName, "-") != 0){
+            instance.texture = scene_file_find_name(parse, textureName, SCENE_ASSET_IMAGE);
+            if(instance.texture == SCENE_FILE_NONE){
+                printf("SCENE_FILE: '%s' is not a declared texture\n", textureName);
+                return 0;
+            }
+        }
+
+        char* field;
+        while((field = scene_file_token(&cursor))){
+            if(strcmp(field, "position") == 0){
+                if(scene_file_floats(&cursor, instance.position, 3) != 3){
+                    return 0;
+                }
+            } else if(strcmp(field, "rotation") == 0){
+                if(scene_file_floats(&cursor, instance.rotation, 3) != 3){
+                    return 0;
+                }
+            } else if(strcmp(field, "scale") == 0){
+                // One value is a uniform scale, three are per axis
+                int n = scene_file_floats(&cursor, instance.scale, 3);
+                if(n == 1){
+                    instance.scale[1] = instance.scale[2] = instance.scale[0];
+                } else if(n != 3){
+                    return 0;
+                }
+            } else {
+                printf("SCENE_FILE: Unknown instance field '%s'\n", field);
+                return 0;
+            }
+        }
+        file->instances = (SceneInstance*)scene_file_grow(file->instances, file->instanceCount, &parse->instanceCapacity, sizeof(SceneInstance));
+        file->instances[file->instanceCount++] = instance;
+        return 1;
+    }
+
+    if(strcmp(keyword, "light") == 0){
+        SceneLight light;
+        if(scene_file_floats(&cursor, light.position, 3) != 3){
+            return 0;
+        }
+        file->lights = (SceneLight*)scene_file_grow(file->lights, file->lightCount, &parse->lightCapacity, sizeof(SceneLight));
+        file->lights[file->lightCount++] = light;
+        return 1;
+    }
+
+    printf("SCENE_FILE: Unknown statement '%s'\n", keyword);
+    return 0;
+}
+
+int scene_file_parse(const char* path, SceneFile* file){
+    memset(file, 0, sizeof(*file));
+
+    FILE* f = fopen(path, "rb");
+    if(!f){
+        printf("SCENE_FILE: File not found: %s\n", path);
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* text = (char*)mem_alloc(MEM_TAG_SCENE, length+1);
+    fread(text, 1, length, f);
+    text[length] = '\0';
+    fclose(f);
+
+    // Asset paths are relative to the directory holding the scene file
+    char directory[SCENE_FILE_PATH_MAX] = "";
+    const char* slash = NULL;
+    for(const char* c = path; *c; ++c){
+        if(*c == '/' || *c == '\\'){
+            slash = c;
+        }
+    }
+    if(slash && (size_t)(slash - path + 1) < sizeof(directory)){
+        memcpy(directory, path, slash - path + 1);
+        directory[slash - path + 1] = '\0';
+    }
+
+    SceneParse parse = {0};
+    int ok = 1;
+    int lineNumber = 1;
+    char* line = text;
+    while(line && ok){
+        char* next = strchr(line, '\n');
+        if(next){
+            *next++ = '\0';
+        }
+        if(!scene_file_parse_line(file, &parse, directory, line)){
+            printf("SCENE_FILE: %s:%d: invalid statement\n", path, lineNumber);
+            ok = 0;
+        }
+        line = next;
+        ++lineNumber;
+    }
+    mem_free(parse.names);
+    mem_free(text);
+
+    if(!ok){
+        scene_file_free(file);
+        return 0;
+    }
+    return 1;
+}
+
+static void scene_file_load_asset(SceneAsset* asset){
+    uint64_t start = time_now_ns();
+    if(asset->kind == SCENE_ASSET_MESH){
+        asset->loaded = asset_load_mesh(asset->path, &asset->mesh);
+    } else {
+        asset->loaded = asset_load_image(asset->path, &asset->image);
+    }
+    asset->loadMs = time_ms_since(start);
+}
+
+static void scene_file_asset_job(Job* job, void* data){
+    (void)job;
+    scene_file_load_asset((SceneAsset*)data);
+}
+
+// Root of the load graph, every asset is a child so waiting on the root waits on all of them
+static void scene_file_load_job(Job* job, void* data){
+    SceneFile* file = (SceneFile*)data;
+    for(uint32_t i = 0; i<file->assetCount; ++i){
+        job_run(job_create_child(job, scene_file_asset_job, &file->assets[i]));
+    }
+}
+
+uint32_t scene_file_load(SceneFile* file, int parallel){
+    mem_debug_restart_warmup();
+    uint64_t start = time_now_ns();
+    if(parallel && job_thread_count() > 1){
+        Job* root = job_create(scene_file_load_job, file);
+        job_run(root);
+        job_wait(root);
+    } else {
+        for(uint32_t i = 0; i<file->assetCount; ++i){
+            scene_file_load_asset(&file->assets[i]);
+        }
+    }
+    file->loadMs = time_ms_since(start);
+
+    uint32_t failed = 0;
+    for(uint32_t i = 0; i<file->assetCount; ++i){
+        failed += !file->assets[i].loaded;
+    }
+    return failed;
+}
+
+void scene_file_report(const SceneFile* file){
+    double sum = 0.0;
+    for(uint32_t i = 0; i<file->assetCount; ++i){
+        const SceneAsset* asset = &file->assets[i];
+        if(!asset->loaded){
+            printf("SCENE_FILE: %8s  %-7s %s\n", "FAILED", asset->kind == SCENE_ASSET_MESH ? "mesh" : "texture", asset->path);
+            continue;
+        }
+        if(asset->kind == SCENE_ASSET_MESH){
+            printf("SCENE_FILE: %8.2f ms  mesh    %s (%u vertices)\n", asset->loadMs, asset->path, asset->mesh.vertexCount);
+        } else {
+            printf("SCENE_FILE: %8.2f ms  texture %s (%dx%d)\n", asset->loadMs, asset->path, asset->image.width, asset->image.height);
+        }
+        sum += asset->loadMs;
+    }
+    printf("SCENE_FILE: %u assets, %u instances loaded in %.2f ms (%.2f ms of asset work)\n",
+           file->assetCount, file->instanceCount, file->loadMs, sum);
+}
+
+void scene_file_free_assets(SceneFile* file){
+    for(uint32_t i = 0; i<file->assetCount; ++i){
+        SceneAsset* asset = &file->assets[i];
+        if(asset->kind == SCENE_ASSET_MESH){
+            asset_free_mesh(&asset->mesh);
+        } else {
+            asset_free_image(&asset->image);
+        }
+    }
+}
+
+void scene_file_free(SceneFile* file){
+    scene_file_free_assets(file);
+    mem_free(file->assets);
+    mem_free(file->instances);
+    mem_free(file->lights);
+    memset(file, 0, sizeof(*file));
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cglm/cglm.h>
+#include <stdint.h>
+#include "asset.h"
+
+// Text scene description. One statement per line, '#' starts a comment:
+//
+//   mesh     <name> <path>
+//   texture  <name> <path>
+//   instance <mesh> <texture|-> [position x y z] [rotation x y z] [scale s | scale x y z]
+//   light    x y z
+//
+// Paths are relative to the scene file. Rotation is XYZ euler in degrees.
+// Names must be declared before an instance uses them. Every distinct path
+// becomes one SceneAsset no matter how many names or instances refer to it.
+//
+// Assets are independent leaves of the load graph: scene_file_load() decodes
+// each one in its own job (meshes further split their face expansion with
+// parallel_for), and the caller uploads the results once everything is done.
+
+#define SCENE_FILE_NONE UINT32_MAX
+#define SCENE_FILE_PATH_MAX 260
+
+typedef enum {
+    SCENE_ASSET_MESH,
+    SCENE_ASSET_IMAGE
+} SceneAssetKind;
+
+typedef struct {
+    char path[SCENE_FILE_PATH_MAX];
+    SceneAssetKind kind;
+    MeshData mesh;
+    ImageData image;
+    int loaded;
+    double loadMs;
+} SceneAsset;
+
+typedef struct {
+    uint32_t mesh;      // asset index
+    uint32_t texture;   // asset index or SCENE_FILE_NONE
+    vec3 position;
+    vec3 rotation;
+    vec3 scale;
+} SceneInstance;
+
+typedef struct {
+    vec3 position;
+} SceneLight;
+
+typedef struct {
+    SceneAsset* assets;
+    uint32_t assetCount;
+    SceneInstance* instances;
+    uint32_t instanceCount;
+    SceneLight* lights;
+    uint32_t lightCount;
+    double loadMs;      // wall time of the last scene_file_load
+} SceneFile;
+
+int scene_file_parse(const char* path, SceneFile* file);
+// Decodes every asset, in parallel jobs or one after another on the calling
+// thread. Returns the number of assets that failed.
+uint32_t scene_file_load(SceneFile* file, int parallel);
+void scene_file_report(const SceneFile* file);
+// Releases the decoded CPU data, typically right after the GPU upload
+void scene_file_free_assets(SceneFile* file);
+void scene_file_free(SceneFile* file);
@@ -0,0 +1,290 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "sdf.h"
+#include "bvh.h"
+#include "job.h"
+#include "memory.h"
+#include "platform.h"
+
+#define SDF_MAX_HITS 1024   // per row, a row with more does not vote
+#define SDF_VOTE     4      // added per vote, the low bits count the votes for inside
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t resolution;
+    float padding;
+    float band;
+    float origin[3];
+    float voxelSize;
+    uint32_t pad;
+} SdfFileHeader;
+
+typedef struct {
+    Sdf* sdf;
+    const Bvh* bvh;
+    Vec3Soa positions;
+    uint8_t* votes;             // per voxel, SDF_VOTE per row that voted plus the ones for inside
+    uint32_t axis;              // of the rows
+    float band;                 // world units, 0 for exact distances everywhere
+    uint32_t bricks;            // per side
+    volatile int32_t nearBricks;
+} SdfBake;
+
+static int sdf_triangle_valid(const uint32_t* v){
+    return v[0] != UINT32_MAX && v[1] != UINT32_MAX && v[2] != UINT32_MAX && v[0] != v[1] && v[1] != v[2] && v[0] != v[2];
+}
+
+uint64_t sdf_mesh_hash(Vec3Soa positions, const uint32_t* indices, uint32_t triangleCount){
+    uint64_t hash = 14695981039346656037ull;
+    for(uint32_t t = 0; t<triangleCount; ++t){
+        const uint32_t* v = indices + 3*t;
+        if(!sdf_triangle_valid(v)){
+            continue;
+        }
+        for(int c = 0; c<3; ++c){
+            float p[3] = {positions.x[v[c]], positions.y[v[c]], positions.z[v[c]]};
+            const uint8_t* bytes = (const uint8_t*)p;
+            for(size_t i = 0; i<sizeof(p); ++i){
+                hash = (hash ^ bytes[i])*1099511628211ull;
+            }
+        }
+    }
+    return hash;
+}
+
+// Rows along bake->axis, row u + v*resolution runs through voxel u of the
+// next axis and v of the one after
+static void sdf_parity_range(void* data, uint32_t begin, uint32_t end){
+    SdfBake* bake = (SdfBake*)data;
+    const Sdf* sdf = bake->sdf;
+    uint32_t n = sdf->resolution;
+    uint32_t a = bake->axis, b = (a+1)%3, c = (a+2)%3;
+    size_t stride[3] = {1, n, (size_t)n*n};
+    float maxT = (n+1)*sdf->voxelSize;
+    float hits[SDF_MAX_HITS];
+    for(uint32_t row = begin; row<end; ++row){
+        uint32_t u = row%n, w = row/n;
+        // From a voxel before the grid, outside the mesh
+        vec3 origin, direction = {0.0f, 0.0f, 0.0f};
+        origin[a] = sdf->origin[a] - sdf->voxelSize;
+        origin[b] = sdf->origin[b] + u*sdf->voxelSize;
+        origin[c] = sdf->origin[c] + w*sdf->voxelSize;
+        direction[a] = 1.0f;
+        uint32_t hitCount = 0;
+        float base = 0.0f;
+        while(hitCount < SDF_MAX_HITS && base < maxT){
+            vec3 from = {origin[0], origin[1], origin[2]};
+            from[a] += base;
+            BvhHit hit;
+            if(!bvh_raycast(bake->bvh, bake->positions, from, direction, maxT - base, &hit)){
+                break;
+            }
+            base += hit.t;
+            hits[hitCount++] = base;
+            base += 1e-4f*sdf->voxelSize;
+        }
+        // A row that leaves the mesh inside went through an open surface
+        // on the way and says nothing
+        if(hitCount & 1 || hitCount == SDF_MAX_HITS){
+            continue;
+        }
+        uint8_t* votes = bake->votes + u*stride[b] + w*stride[c];
+        uint32_t h = 0;
+        for(uint32_t i = 0; i<n; ++i){
+            float t = (i+1)*sdf->voxelSize;
+            while(h<hitCount && hits[h] < t){
+                ++h;
+            }
+            votes[i*stride[a]] += SDF_VOTE | (h & 1);
+        }
+    }
+}
+
+static void sdf_brick_range(void* data, uint32_t begin, uint32_t end){
+    SdfBake* bake = (SdfBake*)data;
+    Sdf* sdf = bake->sdf;
+    uint32_t n = sdf->resolution, bricks = bake->bricks;
+    for(uint32_t brick = begin; brick<end; ++brick){
+        uint32_t lo[3] = {brick%bricks*SDF_BRICK, brick/bricks%bricks*SDF_BRICK, brick/(bricks*bricks)*SDF_BRICK};
+        uint32_t hi[3];
+        vec3 center;
+        float radiusSq = 0.0f;
+        for(int c = 0; c<3; ++c){
+            hi[c] = lo[c] + SDF_BRICK < n ? lo[c] + SDF_BRICK : n;
+            center[c] = sdf->origin[c] + 0.5f*(lo[c] + hi[c] - 1)*sdf->voxelSize;
+            float half = 0.5f*(hi[c] - lo[c] - 1)*sdf->voxelSize;
+            radiusSq += half*half;
+        }
+        BvhClosest closest;
+        bvh_closest_point(bake->bvh, bake->positions, center, FLT_MAX, &closest);
+        float distance = sqrtf(closest.distanceSq);
+        int far = bake->band > 0.0f && distance - sqrtf(radiusSq) > bake->band;
+        if(!far){
+            atomic_fetch_add_i32(&bake->nearBricks, 1);
+        }
+        for(uint32_t z = lo[2]; z<hi[2]; ++z){
+            for(uint32_t y = lo[1]; y<hi[1]; ++y){
+                for(uint32_t x = lo[0]; x<hi[0]; ++x){
+                    size_t i = x + n*(y + (size_t)n*z);
+                    vec3 p = {sdf->origin[0] + x*sdf->voxelSize, sdf->origin[1] + y*sdf->voxelSize,
+                              sdf->origin[2] + z*sdf->voxelSize};
+                    float d;
+                    if(far){
+                        d = distance - glm_vec3_distance(p, center);
+                    } else {
+                        // The center's closest point bounds the search
+                        float bound = glm_vec3_distance(p, closest.point);
+                        BvhClosest near;
+                        d = bvh_closest_point(bake->bvh, bake->positions, p, bound*1.0001f + 1e-6f*sdf->voxelSize, &near) ?
+                            sqrtf(near.distanceSq) : bound;
+                    }
+                    uint32_t inside = bake->votes[i] & (SDF_VOTE-1), votes = bake->votes[i]/SDF_VOTE;
+                    sdf->distance[i] = 2*inside > votes ? -d : d;
+                }
+            }
+        }
+    }
+}
+
+static void sdf_cache_path(char* path, size_t size, const SdfDesc* desc, uint64_t hash){
+    snprintf(path, size, "%s/%016llx-%u.sdf", desc->cacheDir, (unsigned long long)hash, desc->resolution);
+}
+
+static void sdf_header(const Sdf* sdf, const SdfDesc* desc, SdfFileHeader* header){
+    memset(header, 0, sizeof(*header));
+    header->magic = SDF_FILE_MAGIC;
+    header->version = SDF_FILE_VERSION;
+    header->hash = sdf->hash;
+    header->resolution = sdf->resolution;
+    header->padding = desc->padding;
+    header->band = desc->band;
+    memcpy(header->origin, sdf->origin, sizeof(header->origin));
+    header->voxelSize = sdf->voxelSize;
+}
+
+// Returns 0 if there is no file baked from the same mesh with the same settings
+static int sdf_cache_read(Sdf* sdf, const SdfDesc* desc, const char* path){
+    FILE* f = fopen(path, "rb");
+    if(!f){
+        return 0;
+    }
+    SdfFileHeader expected, header;
+    sdf_header(sdf, desc, &expected);
+    size_t count = (size_t)sdf->resolution*sdf->resolution*sdf->resolution;
+    int ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(&header, &expected, sizeof(header)) == 0 &&
+             fread(sdf->distance, sizeof(float), count, f) == count;
+    fclose(f);
+    return ok;
+}
+
+static void sdf_cache_write(const Sdf* sdf, const SdfDesc* desc, const char* path){
+    FILE* f = fopen(path, "wb");
+    if(!f){
+        printf("SDF: Failed to open %s for writing\n", path);
+        return;
+    }
+    SdfFileHeader header;
+    sdf_header(sdf, desc, &header);
+    size_t count = (size_t)sdf->resolution*sdf->resolution*sdf->resolution;
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(sdf->distance, sizeof(float), count, f) == count;
+    if(fclose(f) != 0 || !ok){
+        printf("SDF: Failed to write %s\n", path);
+        remove(path);
+    }
+}
+
+int sdf_bake(Sdf* sdf, const SdfDesc* desc, Vec3Soa positions, const uint32_t* indices, uint32_t triangleCount){
+    uint64_t start = time_now_ns();
+    memset(sdf, 0, sizeof(*sdf));
+    vec3 lo = {FLT_MAX, FLT_MAX, FLT_MAX}, hi = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for(uint32_t t = 0; t<triangleCount; ++t){
+        const uint32_t* v = indices + 3*t;
+        for(int c = 0; c<3 && sdf_triangle_valid(v); ++c){
+            vec3 p = {positions.x[v[c]], positions.y[v[c]], positions.z[v[c]]};
+            glm_vec3_minv(lo, p, lo);
+            glm_vec3_maxv(hi, p, hi);
+        }
+    }
+    float padding = desc->padding > 1.0f ? desc->padding : 1.0f;
+    if(lo[0] > hi[0] || desc->resolution <= 2.0f*padding + 1.0f){
+        printf("SDF: Nothing to bake at resolution %u\n", desc->resolution);
+        return 0;
+    }
+
+    uint32_t n = desc->resolution;
+    vec3 extent, center;
+    glm_vec3_sub(hi, lo, extent);
+    glm_vec3_center(lo, hi, center);
+    sdf->resolution = n;
+    sdf->voxelSize = glm_vec3_max(extent)/(n - 1 - 2.0f*padding);
+    sdf->voxelSize = sdf->voxelSize > 0.0f ? sdf->voxelSize : 1.0f;
+    for(int c = 0; c<3; ++c){
+        sdf->origin[c] = center[c] - 0.5f*(n-1)*sdf->voxelSize;
+    }
+    size_t count = (size_t)n*n*n;
+    sdf->distance = (float*)mem_alloc(MEM_TAG_SDF, count*sizeof(float));
+    sdf->hash = sdf_mesh_hash(positions, indices, triangleCount);
+
+    char path[512];
+    if(desc->cacheDir){
+        sdf_cache_path(path, sizeof(path), desc, sdf->hash);
+        if(sdf_cache_read(sdf, desc, path)){
+            sdf->fromCache = 1;
+            sdf->bakeMs = time_ms_since(start);
+            return 1;
+        }
+    }
+
+    Bvh bvh;
+    bvh_build(&bvh, positions, indices, triangleCount);
+    SdfBake bake = {sdf, &bvh, positions};
+    bake.votes = (uint8_t*)mem_calloc(MEM_TAG_SDF, count, 1);
+    bake.band = desc->band > 0.0f ? desc->band*sdf->voxelSize : 0.0f;
+    bake.bricks = (n + SDF_BRICK-1)/SDF_BRICK;
+    for(bake.axis = 0; bake.axis<3; ++bake.axis){
+        parallel_for(&bake, n*n, 16, sdf_parity_range);
+    }
+    uint32_t brickCount = bake.bricks*bake.bricks*bake.bricks;
+    parallel_for(&bake, brickCount, 1, sdf_brick_range);
+    sdf->nearBricks = (uint32_t)bake.nearBricks;
+    sdf->farBricks = brickCount - sdf->nearBricks;
+    mem_free(bake.votes);
+    bvh_free(&bvh);
+
+    if(desc->cacheDir){
+        sdf_cache_write(sdf, desc, path);
+    }
+    sdf->bakeMs = time_ms_since(start);
+    return 1;
+}
+
+void sdf_free(Sdf* sdf){
+    mem_free(sdf->distance);
+    memset(sdf, 0, sizeof(*sdf));
+}
+
+float sdf_sample(const Sdf* sdf, const vec3 point){
+    uint32_t n = sdf->resolution;
+    float g[3], outside = 0.0f;
+    uint32_t i[3];
+    for(int c = 0; c<3; ++c){
+        float x = (point[c] - sdf->origin[c])/sdf->voxelSize;
+        float clamped = x < 0.0f ? 0.0f : (x > n-1 ? (float)(n-1) : x);
+        outside += (x - clamped)*(x - clamped);
+        i[c] = (uint32_t)clamped < n-1 ? (uint32_t)clamped : n-2;
+        g[c] = clamped - i[c];
+    }
+    const float* d = sdf->distance + i[0] + n*(i[1] + (size_t)n*i[2]);
+    size_t dy = n, dz = (size_t)n*n;
+    float x00 = d[0] + (d[1] - d[0])*g[0];
+    float x10 = d[dy] + (d[dy+1] - d[dy])*g[0];
+    float x01 = d[dz] + (d[dz+1] - d[dz])*g[0];
+    float x11 = d[dy+dz] + (d[dy+dz+1] - d[dy+dz])*g[0];
+    float y0 = x00 + (x10 - x00)*g[1];
+    float y1 = x01 + (x11 - x01)*g[1];
+    return y0 + (y1 - y0)*g[2] + sqrtf(outside)*sdf->voxelSize;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <cglm/cglm.h>
+#include "batch.h"
+
+// Signed distance field of a triangle mesh on a voxel grid, for ray marched
+// shadows. Negative inside.
+//
+// The grid is a cube of resolution^3 voxels around the mesh's bounds,
+// padding voxels of room on every side. The sign comes from ray parity: a
+// ray along every row of voxels in x, y and z collects its hits with the
+// mesh through the BVH, and a voxel is inside on its row if an odd number of
+// hits lie before it. A row with an odd number of hits in all went through
+// an open surface (a hole, a single sided leaf) or grazed an edge, and does
+// not vote. A voxel is inside if most of its rows that vote say so.
+//
+// Distances are computed brick by brick (SDF_BRICK^3 voxels, one
+// parallel_for item each). A brick first finds the closest point to its
+// center. If the brick lies further than band voxels from the surface, its
+// voxels get the distance to the center minus their offset from it, a lower
+// bound that keeps sphere tracing safe and costs nothing more. Otherwise
+// every voxel searches the BVH for its closest point, no further than the
+// center's closest point, so the search stays local.
+//
+// With a cache directory sdf_bake first looks for the field in
+// <cacheDir>/<mesh hash>-<resolution>.sdf and writes it there after
+// baking. The hash covers the positions of every triangle, so an edited
+// mesh bakes again; a file baked with other settings is baked over.
+
+#define SDF_BRICK       8       // voxels per brick side
+#define SDF_FILE_MAGIC  0x46445357u     // "WSDF"
+#define SDF_FILE_VERSION 1
+
+typedef struct {
+    uint32_t resolution;    // voxels per side of the cube
+    float padding;          // voxels between the mesh bounds and the cube's sides, at least 1
+    float band;             // voxels from the surface with exact distances, 0 for all of them
+    const char* cacheDir;   // NULL for no cache
+} SdfDesc;
+
+typedef struct {
+    uint32_t resolution;
+    vec3 origin;            // center of voxel 0
+    float voxelSize;
+    float* distance;        // x fastest, then y, then z
+
+    // Of the last sdf_bake
+    uint64_t hash;
+    int fromCache;
+    uint32_t nearBricks;    // with exact distances in every voxel
+    uint32_t farBricks;
+    double bakeMs;          // including the BVH build and the cache
+} Sdf;
+
+// Field of the triangles, 3 indices each into positions. Triangles with an
+// index of UINT32_MAX or a repeated index are left out. Uses parallel_for.
+// Returns 0 if there are no triangles.
+int sdf_bake(Sdf* sdf, const SdfDesc* desc, Vec3Soa positions, const uint32_t* indices, uint32_t triangleCount);
+void sdf_free(Sdf* sdf);
+
+// FNV-1a over the positions of every triangle's corners
+uint64_t sdf_mesh_hash(Vec3Soa positions, const uint32_t* indices, uint32_t triangleCount);
+// Trilinear, outside the grid plus the distance to it
+float sdf_sample(const Sdf* sdf, const vec3 point);
@@ -0,0 +1,121 @@
+#include <glad/glad.h>
+#include <stdio.h>
+#include "memory.h"
+#include "shader.h"
+
+char* readShaderSource(const char* filePath){
+    FILE* file = fopen(filePath, "rb");
+    if(!file){
+        printf("Error, file not found: %s\n", filePath);
+        return NULL;
+    }
+    //count bytes
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* buffer = (char*)mem_alloc(MEM_TAG_SHADER, length+1);
+    if(!buffer){
+        printf("Memory allocation failed!\n");
+        fclose(file);
+        return NULL;
+    }
+
+    fread(buffer, 1, length, file);
+    buffer[length] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+GLuint compile_shader(const char* source, GLenum type){
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if(!success){
+        char info_log[512];
+        glGetShaderInfoLog(shader, 512, NULL, info_log);
+        fprintf(stderr, "SHADER_LOADER: Shader compilation failed:%s\n", info_log);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint shader_create_program(const char* vertex_path, const char* fragment_path){
+    // Read shader files from disk
+    char* vertex_source = readShaderSource(vertex_path);
+    char* fragment_source = readShaderSource(fragment_path);
+    if(!vertex_source || !fragment_source){
+        mem_free(vertex_source);
+        mem_free(fragment_source);
+        return 0;
+    }
+
+    // Compile shaders
+    GLuint vertex_shader = compile_shader(vertex_source, GL_VERTEX_SHADER);
+    GLuint fragment_shader = compile_shader(fragment_source, GL_FRAGMENT_SHADER);
+    mem_free(vertex_source);
+    mem_free(fragment_source);
+    if(vertex_shader==0 || fragment_shader==0){
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        return 0;
+    }
+
+    // Link shaders to a program
+    GLuint program = glCreateProgram();
+    glAttachShader(program,vertex_shader);
+    glAttachShader(program,fragment_shader);
+    glLinkProgram(program);
+
+    // Check for success
+    GLuint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success){
+        char info_log[512];
+        glGetProgramInfoLog(program, 512, NULL, info_log);
+        fprintf(stderr, "SHADER_LOADER: Shader program linking failed:\n%s\n", info_log);
+    }
+
+    // Delete individual shaders as they are now linked to the program
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    
+    if(!success){
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    printf("SHADER_LOADER: Successfully created shader program.\n");
+    return program;
+}
+
+GLuint shader_create_compute(const char* compute_path){
+    char* source = readShaderSource(compute_path);
+    if(!source){
+        return 0;
+    }
+    GLuint shader = compile_shader(source, GL_COMPUTE_SHADER);
+    mem_free(source);
+    if(shader==0){
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success){
+        char info_log[512];
+        glGetProgramInfoLog(program, 512, NULL, info_log);
+        fprintf(stderr, "SHADER_LOADER: Compute program linking failed (%s):\n%s\n", compute_path, info_log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
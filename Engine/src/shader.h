@@ -0,0 +1,12 @@
+#pragma once
+#include <glad/glad.h>
+
+// Shaders are loaded relative to the working directory, which is the build dir
+#define SHADER_DIR "../shaders/"
+
+// Returns the file contents null terminated, free with mem_free
+char* readShaderSource(const char* filePath);
+GLuint compile_shader(const char* source, GLenum type);
+GLuint shader_create_program(const char* vertex_path, const char* fragment_path);
+// Compute shaders need GL 4.3
+GLuint shader_create_compute(const char* compute_path);
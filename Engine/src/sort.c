@@ -0,0 +1,159 @@
+#include <string.h>
+#include "job.h"
+#include "memory.h"
+#include "sort.h"
+
+#define SORT_RADIX          256
+#define SORT_CHUNK_MIN      16384
+#define SORT_MAX_CHUNKS     64
+
+typedef struct {
+    const uint64_t* keys;
+    const uint32_t* values;
+    uint64_t* outKeys;
+    uint32_t* outValues;
+    uint32_t count;
+    uint32_t chunkSize;
+    int shift;
+    uint32_t (*histograms)[SORT_RADIX];
+    uint64_t (*bits)[2];
+} SortPass;
+
+// AND and OR of every key per chunk, bytes where they agree need no pass
+static void sort_key_bits(void* data, uint32_t begin, uint32_t end){
+    SortPass* pass = (SortPass*)data;
+    for(uint32_t c = begin; c<end; ++c){
+        uint64_t all = ~(uint64_t)0, any = 0;
+        uint32_t first = c*pass->chunkSize;
+        uint32_t last = first + pass->chunkSize < pass->count ? first + pass->chunkSize : pass->count;
+        for(uint32_t i = first; i<last; ++i){
+            all &= pass->keys[i];
+            any |= pass->keys[i];
+        }
+        pass->bits[c][0] = all;
+        pass->bits[c][1] = any;
+    }
+}
+
+static void sort_histogram(void* data, uint32_t begin, uint32_t end){
+    SortPass* pass = (SortPass*)data;
+    for(uint32_t c = begin; c<end; ++c){
+        uint32_t* histogram = pass->histograms[c];
+        memset(histogram, 0, SORT_RADIX*sizeof(uint32_t));
+        uint32_t first = c*pass->chunkSize;
+        uint32_t last = first + pass->chunkSize < pass->count ? first + pass->chunkSize : pass->count;
+        for(uint32_t i = first; i<last; ++i){
+            histogram[(pass->keys[i] >> pass->shift) & (SORT_RADIX-1)]++;
+        }
+    }
+}
+
+static void sort_scatter(void* data, uint32_t begin, uint32_t end){
+    SortPass* pass = (SortPass*)data;
+    for(uint32_t c = begin; c<end; ++c){
+        uint32_t* offsets = pass->histograms[c];
+        uint32_t first = c*pass->chunkSize;
+        uint32_t last = first + pass->chunkSize < pass->count ? first + pass->chunkSize : pass->count;
+        for(uint32_t i = first; i<last; ++i){
+            uint32_t slot = offsets[(pass->keys[i] >> pass->shift) & (SORT_RADIX-1)]++;
+            pass->outKeys[slot] = pass->keys[i];
+            if(pass->values){
+                pass->outValues[slot] = pass->values[i];
+            }
+        }
+    }
+}
+
+void radix_scratch_init(RadixScratch* scratch, uint32_t capacity){
+    scratch->capacity = capacity;
+    scratch->keys = (uint64_t*)mem_alloc(MEM_TAG_GENERAL, (capacity+1)*sizeof(uint64_t));
+    scratch->values = (uint32_t*)mem_alloc(MEM_TAG_GENERAL, (capacity+1)*sizeof(uint32_t));
+    scratch->histograms = (uint32_t(*)[SORT_RADIX])mem_alloc(MEM_TAG_GENERAL, SORT_MAX_CHUNKS*sizeof(*scratch->histograms));
+    scratch->bits = (uint64_t(*)[2])mem_alloc(MEM_TAG_GENERAL, SORT_MAX_CHUNKS*sizeof(*scratch->bits));
+}
+
+void radix_scratch_free(RadixScratch* scratch){
+    mem_free(scratch->keys);
+    mem_free(scratch->values);
+    mem_free(scratch->histograms);
+    mem_free(scratch->bits);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+void radix_sort_u64_scratch(uint64_t* keys, uint32_t* values, uint32_t count, RadixScratch* scratch){
+    if(count < 2){
+        return;
+    }
+    uint32_t threads = job_thread_count() > 0 ? job_thread_count() : 1;
+    uint32_t chunkCount = threads*4;
+    if(chunkCount > SORT_MAX_CHUNKS){
+        chunkCount = SORT_MAX_CHUNKS;
+    }
+    if(count/chunkCount < SORT_CHUNK_MIN){
+        chunkCount = (count + SORT_CHUNK_MIN-1)/SORT_CHUNK_MIN;
+    }
+
+    uint32_t (*histograms)[SORT_RADIX] = scratch->histograms;
+    uint64_t (*bits)[2] = scratch->bits;
+
+    SortPass pass = {keys, values, scratch->keys, values ? scratch->values : NULL, count, (count + chunkCount-1)/chunkCount, 0, histograms, bits};
+    parallel_for(&pass, chunkCount, 1, sort_key_bits);
+    uint64_t all = ~(uint64_t)0, any = 0;
+    for(uint32_t c = 0; c<chunkCount; ++c){
+        all &= bits[c][0];
+        any |= bits[c][1];
+    }
+    uint64_t varying = all ^ any;
+
+    for(pass.shift = 0; pass.shift<64; pass.shift += 8){
+        if(((varying >> pass.shift) & (SORT_RADIX-1)) == 0){
+            continue;
+        }
+        parallel_for(&pass, chunkCount, 1, sort_histogram);
+
+        // Turn the per chunk counts into scatter offsets: digit major, chunk minor
+        uint32_t total = 0;
+        for(uint32_t d = 0; d<SORT_RADIX; ++d){
+            for(uint32_t c = 0; c<chunkCount; ++c){
+                uint32_t n = histograms[c][d];
+                histograms[c][d] = total;
+                total += n;
+            }
+        }
+
+        parallel_for(&pass, chunkCount, 1, sort_scatter);
+        const uint64_t* k = pass.keys;
+        const uint32_t* v = pass.values;
+        pass.keys = pass.outKeys;
+        pass.values = pass.outValues;
+        pass.outKeys = (uint64_t*)k;
+        pass.outValues = (uint32_t*)v;
+    }
+
+    if(pass.keys != keys){
+        memcpy(keys, pass.keys, count*sizeof(uint64_t));
+        if(values){
+            memcpy(values, pass.values, count*sizeof(uint32_t));
+        }
+    }
+}
+
+void radix_sort_u64(uint64_t* keys, uint32_t* values, uint32_t count){
+    if(count < 2){
+        return;
+    }
+    RadixScratch scratch;
+    radix_scratch_init(&scratch, count);
+    radix_sort_u64_scratch(keys, values, count, &scratch);
+    radix_scratch_free(&scratch);
+}
+
+uint32_t prefix_sum_u32(uint32_t* values, uint32_t count){
+    uint32_t total = 0;
+    for(uint32_t i = 0; i<count; ++i){
+        uint32_t n = values[i];
+        values[i] = total;
+        total += n;
+    }
+    return total;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// Parallel LSD radix sort of 64 bit keys, 8 bits per pass. Stable. values may
+// be NULL, otherwise it is permuted along with the keys. Bytes that are the same
+// in every key are skipped, so small keys only pay for the bytes they use.
+void radix_sort_u64(uint64_t* keys, uint32_t* values, uint32_t count);
+
+// Temporaries for radix_sort_u64_scratch, so sorts that run every frame do
+// not touch the heap
+typedef struct {
+    uint32_t capacity;
+    uint64_t* keys;
+    uint32_t* values;
+    uint32_t (*histograms)[256];
+    uint64_t (*bits)[2];
+} RadixScratch;
+
+void radix_scratch_init(RadixScratch* scratch, uint32_t capacity);
+void radix_scratch_free(RadixScratch* scratch);
+// count must not exceed the scratch capacity
+void radix_sort_u64_scratch(uint64_t* keys, uint32_t* values, uint32_t count, RadixScratch* scratch);
+
+// Exclusive prefix sum in place, returns the total
+uint32_t prefix_sum_u32(uint32_t* values, uint32_t count);
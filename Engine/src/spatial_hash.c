@@ -0,0 +1,221 @@
+#include <math.h>
+#include <string.h>
+#include "job.h"
+#include "memory.h"
+#include "spatial_hash.h"
+
+#define SPATIAL_HASH_GRAIN  4096
+#define SPATIAL_HASH_NONE   UINT32_MAX
+
+typedef struct {
+    SpatialHash* hash;
+    Vec3Soa positions;
+} HashBuild;
+
+static inline int32_t hash_cell(float v, float inverseCellSize){
+    return (int32_t)floorf(v*inverseCellSize);
+}
+
+static inline uint32_t hash_bucket(const SpatialHash* hash, int32_t x, int32_t y, int32_t z){
+    uint32_t m = hash->axisMask;
+    return (((uint32_t)z & m) << (2*hash->axisBits)) | (((uint32_t)y & m) << hash->axisBits) | ((uint32_t)x & m);
+}
+
+void spatial_hash_init(SpatialHash* hash, float cellSize, uint32_t capacity){
+    memset(hash, 0, sizeof(*hash));
+    hash->cellSize = cellSize;
+    hash->inverseCellSize = 1.0f/cellSize;
+    hash->capacity = capacity;
+    hash->axisBits = 3;
+    while(hash->axisBits < 10 && ((uint64_t)1 << (3*hash->axisBits)) < 2*(uint64_t)capacity){
+        hash->axisBits++;
+    }
+    hash->axisMask = (1u << hash->axisBits) - 1;
+    hash->bucketCount = 1u << (3*hash->axisBits);
+    hash->bucketStart = (uint32_t*)mem_calloc(MEM_TAG_PHYSICS, hash->bucketCount+1, sizeof(uint32_t));
+    hash->keys = (uint64_t*)mem_alloc(MEM_TAG_PHYSICS, (capacity+1)*sizeof(uint64_t));
+    hash->sortedParticle = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (capacity+1)*sizeof(uint32_t));
+    hash->particleSlot = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (capacity+1)*sizeof(uint32_t));
+    hash->sorted.x = (float*)mem_alloc_aligned(MEM_TAG_PHYSICS, (capacity+1)*sizeof(float), 32);
+    hash->sorted.y = (float*)mem_alloc_aligned(MEM_TAG_PHYSICS, (capacity+1)*sizeof(float), 32);
+    hash->sorted.z = (float*)mem_alloc_aligned(MEM_TAG_PHYSICS, (capacity+1)*sizeof(float), 32);
+    radix_scratch_init(&hash->scratch, capacity);
+}
+
+void spatial_hash_free(SpatialHash* hash){
+    mem_free(hash->bucketStart);
+    mem_free(hash->keys);
+    mem_free(hash->sortedParticle);
+    mem_free(hash->particleSlot);
+    mem_free(hash->sorted.x);
+    mem_free(hash->sorted.y);
+    mem_free(hash->sorted.z);
+    mem_free(hash->excludeOffsets);
+    mem_free(hash->exclude);
+    radix_scratch_free(&hash->scratch);
+    memset(hash, 0, sizeof(*hash));
+}
+
+void spatial_hash_exclude(SpatialHash* hash, uint32_t particleCount, const ParticleConstraint* constraints, uint32_t constraintCount){
+    mem_free(hash->excludeOffsets);
+    mem_free(hash->exclude);
+    hash->excludeOffsets = (uint32_t*)mem_calloc(MEM_TAG_PHYSICS, particleCount+1, sizeof(uint32_t));
+    hash->exclude = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (2*constraintCount+1)*sizeof(uint32_t));
+    uint32_t* offsets = hash->excludeOffsets;
+    for(uint32_t i = 0; i<constraintCount; ++i){
+        offsets[constraints[i].a]++;
+        offsets[constraints[i].b]++;
+    }
+    offsets[particleCount] = prefix_sum_u32(offsets, particleCount);
+
+    // Fill through a cursor per particle, then sort each short list
+    uint32_t* cursor = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (particleCount+1)*sizeof(uint32_t));
+    memcpy(cursor, offsets, particleCount*sizeof(uint32_t));
+    for(uint32_t i = 0; i<constraintCount; ++i){
+        hash->exclude[cursor[constraints[i].a]++] = constraints[i].b;
+        hash->exclude[cursor[constraints[i].b]++] = constraints[i].a;
+    }
+    mem_free(cursor);
+    for(uint32_t p = 0; p<particleCount; ++p){
+        uint32_t* list = hash->exclude + offsets[p];
+        uint32_t n = offsets[p+1] - offsets[p];
+        for(uint32_t i = 1; i<n; ++i){
+            uint32_t v = list[i];
+            uint32_t j = i;
+            while(j > 0 && list[j-1] > v){
+                list[j] = list[j-1];
+                --j;
+            }
+            list[j] = v;
+        }
+    }
+}
+
+static void hash_keys_range(void* data, uint32_t begin, uint32_t end){
+    HashBuild* build = (HashBuild*)data;
+    SpatialHash* hash = build->hash;
+    float inv = hash->inverseCellSize;
+    for(uint32_t i = begin; i<end; ++i){
+        int32_t x = hash_cell(build->positions.x[i], inv);
+        int32_t y = hash_cell(build->positions.y[i], inv);
+        int32_t z = hash_cell(build->positions.z[i], inv);
+        hash->keys[i] = hash_bucket(hash, x, y, z);
+        hash->sortedParticle[i] = i;
+    }
+}
+
+// Every bucket from the previous key up to this one starts here, so the
+// offsets come out dense without clearing the table first. Also copies the
+// positions into bucket order.
+static void hash_cells_range(void* data, uint32_t begin, uint32_t end){
+    HashBuild* build = (HashBuild*)data;
+    SpatialHash* hash = build->hash;
+    const uint64_t* keys = hash->keys;
+    uint32_t count = hash->particleCount;
+    for(uint32_t i = begin; i<end; ++i){
+        uint32_t key = (uint32_t)keys[i];
+        uint32_t from = i == 0 ? 0 : (uint32_t)keys[i-1]+1;
+        for(uint32_t b = from; b<=key; ++b){
+            hash->bucketStart[b] = i;
+        }
+        if(i+1 == count){
+            for(uint32_t b = key+1; b<=hash->bucketCount; ++b){
+                hash->bucketStart[b] = count;
+            }
+        }
+        uint32_t p = hash->sortedParticle[i];
+        hash->particleSlot[p] = i;
+        hash->sorted.x[i] = build->positions.x[p];
+        hash->sorted.y[i] = build->positions.y[p];
+        hash->sorted.z[i] = build->positions.z[p];
+    }
+}
+
+void spatial_hash_build(SpatialHash* hash, Vec3Soa positions, uint32_t count){
+    HashBuild build = {hash, positions};
+    hash->particleCount = count;
+    if(count == 0){
+        memset(hash->bucketStart, 0, (hash->bucketCount+1)*sizeof(uint32_t));
+        return;
+    }
+    parallel_for(&build, count, SPATIAL_HASH_GRAIN, hash_keys_range);
+    radix_sort_u64_scratch(hash->keys, hash->sortedParticle, count, &hash->scratch);
+    parallel_for(&build, count, SPATIAL_HASH_GRAIN, hash_cells_range);
+}
+
+static int hash_excluded(const SpatialHash* hash, uint32_t a, uint32_t b){
+    if(!hash->excludeOffsets){
+        return 0;
+    }
+    for(uint32_t i = hash->excludeOffsets[a]; i<hash->excludeOffsets[a+1]; ++i){
+        if(hash->exclude[i] >= b){
+            return hash->exclude[i] == b;
+        }
+    }
+    return 0;
+}
+
+static uint32_t hash_query(const SpatialHash* hash, float cx, float cy, float cz, float radius, uint32_t self,
+                           uint32_t* out, uint32_t maxOut){
+    float inv = hash->inverseCellSize;
+    float r2 = radius*radius;
+    int32_t x0 = hash_cell(cx - radius, inv), x1 = hash_cell(cx + radius, inv);
+    int32_t y0 = hash_cell(cy - radius, inv), y1 = hash_cell(cy + radius, inv);
+    int32_t z0 = hash_cell(cz - radius, inv), z1 = hash_cell(cz + radius, inv);
+    uint32_t found = 0;
+    for(int32_t z = z0; z<=z1; ++z){
+        for(int32_t y = y0; y<=y1; ++y){
+            // The row [x0, x1] is one range of buckets, or two if it wraps
+            uint32_t first = hash_bucket(hash, x0, y, z), last = hash_bucket(hash, x1, y, z);
+            uint32_t ranges[2][2];
+            uint32_t rangeCount = 1;
+            if((uint32_t)(x1 - x0) >= hash->axisMask){
+                first = hash_bucket(hash, 0, y, z);
+                last = first + hash->axisMask;
+            }
+            if(first <= last){
+                ranges[0][0] = hash->bucketStart[first];
+                ranges[0][1] = hash->bucketStart[last+1];
+            } else {
+                uint32_t rowStart = first & ~hash->axisMask;
+                ranges[0][0] = hash->bucketStart[first];
+                ranges[0][1] = hash->bucketStart[rowStart + hash->axisMask + 1];
+                ranges[1][0] = hash->bucketStart[rowStart];
+                ranges[1][1] = hash->bucketStart[last+1];
+                rangeCount = 2;
+            }
+            for(uint32_t r = 0; r<rangeCount; ++r){
+                for(uint32_t i = ranges[r][0]; i<ranges[r][1]; ++i){
+                    float px = hash->sorted.x[i], py = hash->sorted.y[i], pz = hash->sorted.z[i];
+                    float dx = px - cx, dy = py - cy, dz = pz - cz;
+                    if(dx*dx + dy*dy + dz*dz > r2){
+                        continue;
+                    }
+                    // Cells further away that wrapped onto these buckets
+                    int32_t x = hash_cell(px, inv);
+                    if(x < x0 || x > x1 || hash_cell(py, inv) != y || hash_cell(pz, inv) != z){
+                        continue;
+                    }
+                    uint32_t p = hash->sortedParticle[i];
+                    if(self != SPATIAL_HASH_NONE && (p == self || hash_excluded(hash, self, p))){
+                        continue;
+                    }
+                    if(found < maxOut){
+                        out[found] = p;
+                    }
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+uint32_t spatial_hash_query(const SpatialHash* hash, const vec3 center, float radius, uint32_t* out, uint32_t maxOut){
+    return hash_query(hash, center[0], center[1], center[2], radius, SPATIAL_HASH_NONE, out, maxOut);
+}
+
+uint32_t spatial_hash_query_particle(const SpatialHash* hash, uint32_t particle, float radius, uint32_t* out, uint32_t maxOut){
+    uint32_t slot = hash->particleSlot[particle];
+    return hash_query(hash, hash->sorted.x[slot], hash->sorted.y[slot], hash->sorted.z[slot], radius, particle, out, maxOut);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include "batch.h"
+#include "particle_graph.h"
+#include "sort.h"
+
+// Hashed uniform grid over particle positions, rebuilt every step.
+//
+// Cell coordinates wrap around a grid of 2^k cells per axis with at least
+// twice as many cells as particles, which works as a hash for unbounded
+// space that keeps neighbouring cells in x next to each other. A radix
+// (counting) sort by bucket groups the particles, then one parallel pass
+// writes the bucket offsets and copies the positions into bucket order as
+// SoA. A query scans one contiguous range per row of cells. Cells that wrap
+// onto the same bucket are filtered by distance and by cell. All buffers are
+// sized at init, building allocates nothing.
+//
+// Query results are in bucket order, which only depends on the positions, so
+// they are the same for any thread count.
+
+typedef struct {
+    float cellSize;
+    float inverseCellSize;
+    uint32_t capacity;
+    uint32_t axisBits;
+    uint32_t axisMask;
+    uint32_t bucketCount;
+    uint32_t* bucketStart;      // bucketCount+1 offsets into the sorted entries
+
+    uint32_t particleCount;
+    uint64_t* keys;             // bucket per sorted entry
+    uint32_t* sortedParticle;   // particle per sorted entry
+    uint32_t* particleSlot;     // sorted entry per particle
+    Vec3Soa sorted;
+    RadixScratch scratch;
+
+    // Particles that share a constraint never report each other, CSR lists
+    uint32_t* excludeOffsets;
+    uint32_t* exclude;
+} SpatialHash;
+
+// cellSize should be about the largest query radius
+void spatial_hash_init(SpatialHash* hash, float cellSize, uint32_t capacity);
+void spatial_hash_free(SpatialHash* hash);
+
+// Pairs connected by one of the constraints are skipped by
+// spatial_hash_query_particle
+void spatial_hash_exclude(SpatialHash* hash, uint32_t particleCount, const ParticleConstraint* constraints, uint32_t constraintCount);
+
+// count must not exceed the capacity
+void spatial_hash_build(SpatialHash* hash, Vec3Soa positions, uint32_t count);
+
+// Particles within radius of the point. Returns how many there are, at most
+// maxOut of them are written.
+uint32_t spatial_hash_query(const SpatialHash* hash, const vec3 center, float radius, uint32_t* out, uint32_t maxOut);
+// Same around a particle, without the particle itself and the ones it is
+// excluded with. Going through particles in hash->sortedParticle order keeps
+// consecutive queries on nearby memory.
+uint32_t spatial_hash_query_particle(const SpatialHash* hash, uint32_t particle, float radius, uint32_t* out, uint32_t maxOut);
@@ -0,0 +1,925 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "job.h"
+#include "memory.h"
+#include "platform.h"
+#include "sort.h"
+#include "verlet.h"
+
+#define VERLET_INTEGRATE_GRAIN  4096
+#define VERLET_SOLVE_GRAIN      512
+#define VERLET_ISLAND_JOB       4096    // islands with more constraints are solved per color
+#define VERLET_BATCH_WORK       2048    // particles plus constraints per small island job
+#define VERLET_CONTACT_MAX      32
+#define VERLET_ISLAND_PARTICLES (VERLET_ISLAND_JOB+1)   // most particles a small island can connect
+
+typedef struct {
+    VerletSolver* solver;
+    vec3 step;
+    float damping;
+} VerletIntegrate;
+
+typedef struct {
+    VerletSolver* solver;
+    uint32_t first;
+    float alphaScale;   // 1/h^2, turns compliance into the XPBD alpha~
+} VerletColor;
+
+// Runs func over every range of a work list
+typedef struct {
+    const VerletRange* chunks;
+    JobRangeFunc func;
+    void* data;
+} VerletChunks;
+
+// Everything a small island job needs for a whole step
+typedef struct {
+    VerletSolver* solver;
+    VerletIntegrate* integrate;
+    JobRangeFunc solve;
+    float alphaScale;
+    uint32_t substeps;
+    int xpbd;
+} VerletIslandStep;
+
+typedef struct {
+    VerletSolver* solver;
+    float inverseStep;
+} VerletEnergy;
+
+typedef struct {
+    VerletSolver* solver;
+    const SpatialHash* hash;
+    float radius;
+} VerletContacts;
+
+static float* verlet_alloc_floats(uint32_t count){
+    return (float*)mem_alloc_aligned(MEM_TAG_PHYSICS, (count+1)*sizeof(float), 32);
+}
+
+static uint16_t* verlet_alloc_halfs(uint32_t count){
+    return (uint16_t*)mem_calloc(MEM_TAG_PHYSICS, count+1, sizeof(uint16_t));
+}
+
+static void verlet_grow_constraints(VerletSolver* solver, uint32_t capacity){
+    size_t size = (capacity+1)*sizeof(uint32_t);
+    solver->constraintA = (uint32_t*)mem_realloc(MEM_TAG_PHYSICS, solver->constraintA, size);
+    solver->constraintB = (uint32_t*)mem_realloc(MEM_TAG_PHYSICS, solver->constraintB, size);
+    solver->constraintId = (uint32_t*)mem_realloc(MEM_TAG_PHYSICS, solver->constraintId, size);
+    solver->order = (uint32_t*)mem_realloc(MEM_TAG_PHYSICS, solver->order, size);
+    solver->spareOrder = (uint32_t*)mem_realloc(MEM_TAG_PHYSICS, solver->spareOrder, size);
+    if(!solver->restLength){
+        solver->restLength = verlet_alloc_floats(capacity);
+        solver->compliance = verlet_alloc_floats(capacity);
+        solver->lambda = verlet_alloc_floats(capacity);
+    } else {
+        solver->restLength = (float*)mem_realloc(MEM_TAG_PHYSICS, solver->restLength, (capacity+1)*sizeof(float));
+        solver->compliance = (float*)mem_realloc(MEM_TAG_PHYSICS, solver->compliance, (capacity+1)*sizeof(float));
+        solver->lambda = (float*)mem_realloc(MEM_TAG_PHYSICS, solver->lambda, (capacity+1)*sizeof(float));
+    }
+    // One chunk per span at most plus the full ones, spans never outnumber constraints
+    solver->constraintChunks = (VerletRange*)mem_realloc(MEM_TAG_PHYSICS, solver->constraintChunks,
+        (capacity + capacity/VERLET_SOLVE_GRAIN + 2)*sizeof(VerletRange));
+    solver->spans = (VerletSpan*)mem_realloc(MEM_TAG_PHYSICS, solver->spans, (capacity+1)*sizeof(VerletSpan));
+    solver->constraintCapacity = capacity;
+}
+
+static void verlet_grow_ids(VerletSolver* solver, uint32_t capacity){
+    solver->constraintSlot = (uint32_t*)mem_realloc(MEM_TAG_PHYSICS, solver->constraintSlot, (capacity+1)*sizeof(uint32_t));
+    solver->constraintColor = (uint8_t*)mem_realloc(MEM_TAG_PHYSICS, solver->constraintColor, capacity+1);
+    solver->idCapacity = capacity;
+}
+
+static inline int verlet_slot_alive(const VerletSolver* solver, uint32_t slot){
+    return solver->constraintSlot[solver->constraintId[slot]] == slot;
+}
+
+static uint32_t verlet_find(uint32_t* parent, uint32_t i){
+    while(parent[i] != i){
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// The lower particle becomes the root, so every root is the lowest particle
+// of its island
+static void verlet_union(uint32_t* parent, uint32_t a, uint32_t b){
+    a = verlet_find(parent, a);
+    b = verlet_find(parent, b);
+    if(a < b){
+        parent[b] = a;
+    } else if(b < a){
+        parent[a] = b;
+    }
+}
+
+// Particle runs of consecutive particles in one island, bucketed by island
+static void verlet_build_runs(VerletSolver* solver){
+    uint32_t n = solver->particleCount;
+    for(uint32_t i = 0; i<n; ++i){
+        uint32_t island = solver->particleIsland[i];
+        if(i == 0 || solver->particleIsland[i-1] != island){
+            solver->islands[island].runCount++;
+        }
+    }
+    uint32_t offset = 0;
+    for(uint32_t k = 0; k<solver->islandCount; ++k){
+        solver->islands[k].firstRun = offset;
+        offset += solver->islands[k].runCount;
+        solver->islands[k].runCount = 0;
+    }
+    solver->runCount = offset;
+    for(uint32_t i = 0; i<n; ){
+        uint32_t island = solver->particleIsland[i];
+        uint32_t end = i+1;
+        while(end < n && solver->particleIsland[end] == island){
+            ++end;
+        }
+        VerletIsland* k = &solver->islands[island];
+        solver->runs[k->firstRun + k->runCount++] = (VerletRange){i, end};
+        i = end;
+    }
+}
+
+// Gathers one constraint array into the new order
+static void verlet_permute(void* array, uint32_t* scratch, const uint32_t* order, uint32_t count){
+    const uint32_t* from = (const uint32_t*)array;
+    for(uint32_t i = 0; i<count; ++i){
+        scratch[i] = from[order[i]];
+    }
+    memcpy(array, scratch, count*sizeof(uint32_t));
+}
+
+// Applies the constraints added and broken since the last step: broken
+// islands find their components again, new constraints merge islands, then
+// islands are renumbered and the constraints sorted by island and color.
+// Islands keep sleeping unless they changed. Allocates nothing.
+static void verlet_update_islands(VerletSolver* solver){
+    uint32_t n = solver->particleCount;
+    uint32_t* parent = solver->parent;
+    for(uint32_t k = 0; k<solver->islandCount; ++k){
+        const VerletIsland* island = &solver->islands[k];
+        if(!island->split){
+            continue;
+        }
+        for(uint32_t r = island->firstRun; r<island->firstRun+island->runCount; ++r){
+            for(uint32_t p = solver->runs[r].begin; p<solver->runs[r].end; ++p){
+                parent[p] = p;
+            }
+        }
+    }
+    for(uint32_t k = 0; k<solver->islandCount; ++k){
+        const VerletIsland* island = &solver->islands[k];
+        if(!island->split){
+            continue;
+        }
+        for(uint32_t i = island->firstConstraint; i<island->firstConstraint+island->constraintCount; ++i){
+            if(verlet_slot_alive(solver, i)){
+                verlet_union(parent, solver->constraintA[i], solver->constraintB[i]);
+            }
+        }
+    }
+    for(uint32_t i = solver->sortedCount; i<solver->constraintCount; ++i){
+        if(verlet_slot_alive(solver, i)){
+            verlet_union(parent, solver->constraintA[i], solver->constraintB[i]);
+        }
+    }
+
+    // Renumber by root. Roots come before the rest of their island, so a
+    // particle's root already has its new number.
+    VerletIsland* old = solver->islands;
+    solver->islands = solver->spareIslands;
+    solver->spareIslands = old;
+    uint32_t islandCount = 0;
+    for(uint32_t p = 0; p<n; ++p){
+        uint32_t root = verlet_find(parent, p);
+        const VerletIsland* from = &old[solver->particleIsland[p]];
+        uint32_t k;
+        if(root == p){
+            k = islandCount++;
+            memset(&solver->islands[k], 0, sizeof(VerletIsland));
+            solver->islands[k].asleep = 1;
+            solver->islands[k].quietTime = FLT_MAX;
+        } else {
+            k = solver->particleIsland[root];
+        }
+        VerletIsland* island = &solver->islands[k];
+        island->asleep &= from->asleep && !from->split;
+        island->quietTime = from->quietTime < island->quietTime ? from->quietTime : island->quietTime;
+        island->particleCount++;
+        solver->particleIsland[p] = k;
+    }
+    solver->islandCount = islandCount;
+    for(uint32_t i = solver->sortedCount; i<solver->constraintCount; ++i){
+        if(verlet_slot_alive(solver, i)){
+            solver->islands[solver->particleIsland[solver->constraintA[i]]].asleep = 0;
+        }
+    }
+    verlet_build_runs(solver);
+
+    // Stable counting sorts, by color then by island
+    uint32_t colorOffsets[VERLET_MAX_COLORS+2] = {0};
+    uint32_t alive = 0;
+    for(uint32_t i = 0; i<solver->constraintCount; ++i){
+        if(verlet_slot_alive(solver, i)){
+            colorOffsets[solver->constraintColor[solver->constraintId[i]]]++;
+            alive++;
+        }
+    }
+    prefix_sum_u32(colorOffsets, VERLET_MAX_COLORS+1);
+    for(uint32_t i = 0; i<solver->constraintCount; ++i){
+        if(verlet_slot_alive(solver, i)){
+            solver->spareOrder[colorOffsets[solver->constraintColor[solver->constraintId[i]]]++] = i;
+        }
+    }
+    uint32_t* islandOffsets = solver->islandOffsets;
+    memset(islandOffsets, 0, (islandCount+1)*sizeof(uint32_t));
+    for(uint32_t i = 0; i<alive; ++i){
+        islandOffsets[solver->particleIsland[solver->constraintA[solver->spareOrder[i]]]]++;
+    }
+    prefix_sum_u32(islandOffsets, islandCount);
+    for(uint32_t i = 0; i<alive; ++i){
+        uint32_t slot = solver->spareOrder[i];
+        solver->order[islandOffsets[solver->particleIsland[solver->constraintA[slot]]]++] = slot;
+    }
+
+    void* arrays[] = {solver->constraintA, solver->constraintB, solver->restLength, solver->compliance, solver->lambda,
+                      solver->constraintId};
+    for(size_t a = 0; a<sizeof(arrays)/sizeof(arrays[0]); ++a){
+        verlet_permute(arrays[a], solver->spareOrder, solver->order, alive);
+    }
+    solver->constraintCount = alive;
+    solver->sortedCount = alive;
+
+    // Island constraint ranges and one span per island and color
+    solver->spanCount = 0;
+    solver->colorCount = 0;
+    solver->serialColor = 0;
+    for(uint32_t i = 0; i<alive; ++i){
+        uint32_t id = solver->constraintId[i];
+        uint32_t color = solver->constraintColor[id];
+        uint32_t k = solver->particleIsland[solver->constraintA[i]];
+        VerletIsland* island = &solver->islands[k];
+        solver->constraintSlot[id] = i;
+        if(island->constraintCount == 0){
+            island->firstConstraint = i;
+            island->firstSpan = solver->spanCount;
+        }
+        island->constraintCount++;
+        if(island->spanCount == 0 || solver->spans[solver->spanCount-1].color != color){
+            solver->spans[solver->spanCount++] = (VerletSpan){i, i, color};
+            island->spanCount++;
+        }
+        solver->spans[solver->spanCount-1].end = i+1;
+        if(color == VERLET_MAX_COLORS){
+            solver->serialColor = 1;
+        } else if(color+1 > solver->colorCount){
+            solver->colorCount = color+1;
+        }
+    }
+    solver->dirty = 0;
+}
+
+void verlet_init(VerletSolver* solver, const VerletDesc* desc, Vec3Soa positions, uint32_t particleCount,
+                 const ParticleConstraint* constraints, uint32_t constraintCount){
+    memset(solver, 0, sizeof(*solver));
+    solver->desc = *desc;
+    solver->particleCount = particleCount;
+
+    solver->position.x = verlet_alloc_floats(particleCount);
+    solver->position.y = verlet_alloc_floats(particleCount);
+    solver->position.z = verlet_alloc_floats(particleCount);
+    solver->inverseMass = verlet_alloc_floats(particleCount);
+    memcpy(solver->position.x, positions.x, particleCount*sizeof(float));
+    memcpy(solver->position.y, positions.y, particleCount*sizeof(float));
+    memcpy(solver->position.z, positions.z, particleCount*sizeof(float));
+    if(desc->storage == VERLET_STORAGE_HALF){
+        solver->velocity.x = verlet_alloc_halfs(particleCount);
+        solver->velocity.y = verlet_alloc_halfs(particleCount);
+        solver->velocity.z = verlet_alloc_halfs(particleCount);
+    } else {
+        solver->previous.x = verlet_alloc_floats(particleCount);
+        solver->previous.y = verlet_alloc_floats(particleCount);
+        solver->previous.z = verlet_alloc_floats(particleCount);
+        memcpy(solver->previous.x, positions.x, particleCount*sizeof(float));
+        memcpy(solver->previous.y, positions.y, particleCount*sizeof(float));
+        memcpy(solver->previous.z, positions.z, particleCount*sizeof(float));
+    }
+    for(uint32_t i = 0; i<particleCount; ++i){
+        solver->inverseMass[i] = 1.0f;
+    }
+    solver->energy = verlet_alloc_floats(particleCount);
+    memset(solver->energy, 0, particleCount*sizeof(float));
+
+    // Every particle starts as its own awake island
+    uint32_t n = particleCount;
+    solver->colorMask = (uint64_t*)mem_calloc(MEM_TAG_PHYSICS, n+1, sizeof(uint64_t));
+    solver->parent = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*sizeof(uint32_t));
+    solver->particleIsland = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*sizeof(uint32_t));
+    for(uint32_t i = 0; i<n; ++i){
+        solver->parent[i] = i;
+        solver->particleIsland[i] = i;
+    }
+    solver->islandCount = n;
+    solver->islands = (VerletIsland*)mem_calloc(MEM_TAG_PHYSICS, n+1, sizeof(VerletIsland));
+    solver->spareIslands = (VerletIsland*)mem_calloc(MEM_TAG_PHYSICS, n+1, sizeof(VerletIsland));
+    solver->islandOffsets = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*sizeof(uint32_t));
+    solver->runs = (VerletRange*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*sizeof(VerletRange));
+    verlet_build_runs(solver);
+    solver->awakeIslands = (uint32_t*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*sizeof(uint32_t));
+    solver->batches = (VerletRange*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*sizeof(VerletRange));
+    solver->particleChunks = (VerletRange*)mem_alloc(MEM_TAG_PHYSICS, (n + n/VERLET_INTEGRATE_GRAIN + 2)*sizeof(VerletRange));
+
+    verlet_grow_constraints(solver, constraintCount);
+    verlet_grow_ids(solver, constraintCount);
+    for(uint32_t i = 0; i<constraintCount; ++i){
+        verlet_add_constraint(solver, constraints[i].a, constraints[i].b, constraints[i].restLength);
+    }
+    verlet_update_islands(solver);
+}
+
+void verlet_init_graph(VerletSolver* solver, const VerletDesc* desc, const ParticleGraph* graph){
+    verlet_init(solver, desc, graph->positions, graph->particleCount, graph->constraints, graph->constraintCount);
+}
+
+void verlet_set_compliance(VerletSolver* solver, uint32_t constraint, float compliance){
+    uint32_t slot = solver->constraintSlot[constraint];
+    if(slot != VERLET_BROKEN){
+        solver->compliance[slot] = compliance;
+    }
+}
+
+// Greedy coloring: the new constraint takes the lowest color neither of its
+// particles uses yet
+uint32_t verlet_add_constraint(VerletSolver* solver, uint32_t a, uint32_t b, float restLength){
+    if(solver->constraintCount == solver->constraintCapacity){
+        verlet_grow_constraints(solver, solver->constraintCapacity ? solver->constraintCapacity*2 : 64);
+    }
+    if(solver->idCount == solver->idCapacity){
+        verlet_grow_ids(solver, solver->idCapacity ? solver->idCapacity*2 : 64);
+    }
+    uint32_t id = solver->idCount++;
+    uint32_t slot = solver->constraintCount++;
+    solver->constraintA[slot] = a;
+    solver->constraintB[slot] = b;
+    solver->restLength[slot] = restLength;
+    solver->compliance[slot] = solver->desc.compliance;
+    solver->lambda[slot] = 0.0f;
+    solver->constraintId[slot] = id;
+    solver->constraintSlot[id] = slot;
+
+    uint64_t free = ~(solver->colorMask[a] | solver->colorMask[b]);
+    uint32_t color = VERLET_MAX_COLORS;
+    if(free){
+        color = 0;
+        while(!(free & ((uint64_t)1 << color))){
+            ++color;
+        }
+        solver->colorMask[a] |= (uint64_t)1 << color;
+        solver->colorMask[b] |= (uint64_t)1 << color;
+    }
+    solver->constraintColor[id] = (uint8_t)color;
+    solver->dirty = 1;
+    return id;
+}
+
+void verlet_break_constraint(VerletSolver* solver, uint32_t constraint){
+    uint32_t slot = solver->constraintSlot[constraint];
+    if(slot == VERLET_BROKEN){
+        return;
+    }
+    uint32_t a = solver->constraintA[slot], b = solver->constraintB[slot];
+    uint32_t color = solver->constraintColor[constraint];
+    if(color < VERLET_MAX_COLORS){
+        solver->colorMask[a] &= ~((uint64_t)1 << color);
+        solver->colorMask[b] &= ~((uint64_t)1 << color);
+    }
+    solver->constraintSlot[constraint] = VERLET_BROKEN;
+    if(slot < solver->sortedCount){
+        solver->islands[solver->particleIsland[a]].split = 1;
+    }
+    solver->dirty = 1;
+}
+
+void verlet_free(VerletSolver* solver){
+    float* arrays[] = {solver->position.x, solver->position.y, solver->position.z,
+                       solver->previous.x, solver->previous.y, solver->previous.z,
+                       solver->inverseMass, solver->restLength, solver->compliance, solver->lambda, solver->energy};
+    for(size_t i = 0; i<sizeof(arrays)/sizeof(arrays[0]); ++i){
+        mem_free(arrays[i]);
+    }
+    void* buffers[] = {solver->constraintA, solver->constraintB, solver->constraintId, solver->constraintSlot,
+                       solver->constraintColor, solver->colorMask, solver->particleIsland, solver->islands, solver->runs,
+                       solver->spans, solver->awakeIslands, solver->batches, solver->particleChunks,
+                       solver->constraintChunks, solver->parent, solver->spareIslands, solver->order,
+                       solver->spareOrder, solver->islandOffsets, solver->velocity.x, solver->velocity.y,
+                       solver->velocity.z, solver->start.x, solver->start.y, solver->start.z};
+    for(size_t i = 0; i<sizeof(buffers)/sizeof(buffers[0]); ++i){
+        mem_free(buffers[i]);
+    }
+    memset(solver, 0, sizeof(*solver));
+}
+
+static void verlet_integrate_range(void* data, uint32_t begin, uint32_t end){
+    VerletIntegrate* integrate = (VerletIntegrate*)data;
+    VerletSolver* s = integrate->solver;
+    Vec3Soa position = {s->position.x+begin, s->position.y+begin, s->position.z+begin};
+    Vec3Soa previous = {s->previous.x+begin, s->previous.y+begin, s->previous.z+begin};
+    batch_verlet_integrate(position, previous, s->inverseMass+begin, integrate->step, integrate->damping, end-begin);
+}
+
+// fp16 storage, start receives the positions from before the step
+static void verlet_integrate_half(VerletIntegrate* integrate, uint32_t begin, uint32_t end, Vec3Soa start){
+    VerletSolver* s = integrate->solver;
+    Vec3Soa position = {s->position.x+begin, s->position.y+begin, s->position.z+begin};
+    Half3Soa velocity = {s->velocity.x+begin, s->velocity.y+begin, s->velocity.z+begin};
+    batch_verlet_integrate_half(position, start, velocity, s->inverseMass+begin, integrate->step, integrate->damping, end-begin);
+}
+
+static void verlet_velocity_half(VerletSolver* s, uint32_t begin, uint32_t end, Vec3Soa start){
+    Vec3Soa position = {s->position.x+begin, s->position.y+begin, s->position.z+begin};
+    Half3Soa velocity = {s->velocity.x+begin, s->velocity.y+begin, s->velocity.z+begin};
+    batch_verlet_velocity_half(position, start, velocity, end-begin);
+}
+
+// Large islands, chunk i keeps its start positions at i*VERLET_INTEGRATE_GRAIN
+static Vec3Soa verlet_chunk_start(const VerletSolver* s, uint32_t chunk){
+    size_t offset = (size_t)chunk*VERLET_INTEGRATE_GRAIN;
+    return (Vec3Soa){s->start.x+offset, s->start.y+offset, s->start.z+offset};
+}
+
+static void verlet_integrate_half_chunks(void* data, uint32_t begin, uint32_t end){
+    VerletIntegrate* integrate = (VerletIntegrate*)data;
+    VerletSolver* s = integrate->solver;
+    for(uint32_t i = begin; i<end; ++i){
+        verlet_integrate_half(integrate, s->particleChunks[i].begin, s->particleChunks[i].end, verlet_chunk_start(s, i));
+    }
+}
+
+static void verlet_velocity_half_chunks(void* data, uint32_t begin, uint32_t end){
+    VerletSolver* s = (VerletSolver*)data;
+    for(uint32_t i = begin; i<end; ++i){
+        verlet_velocity_half(s, s->particleChunks[i].begin, s->particleChunks[i].end, verlet_chunk_start(s, i));
+    }
+}
+
+// Moves both ends along the constraint so the length gets back to rest,
+// split by inverse mass
+static void verlet_solve_range(void* data, uint32_t begin, uint32_t end){
+    VerletColor* color = (VerletColor*)data;
+    VerletSolver* s = color->solver;
+    float* px = s->position.x;
+    float* py = s->position.y;
+    float* pz = s->position.z;
+    const float stiffness = s->desc.stiffness;
+    for(uint32_t i = color->first+begin; i<color->first+end; ++i){
+        uint32_t a = s->constraintA[i], b = s->constraintB[i];
+        float wa = s->inverseMass[a], wb = s->inverseMass[b];
+        float w = wa + wb;
+        float dx = px[b] - px[a], dy = py[b] - py[a], dz = pz[b] - pz[a];
+        float length = sqrtf(dx*dx + dy*dy + dz*dz);
+        if(w <= 0.0f || length <= 1e-12f){
+            continue;
+        }
+        float k = stiffness*(length - s->restLength[i]) / (length*w);
+        px[a] += wa*k*dx; py[a] += wa*k*dy; pz[a] += wa*k*dz;
+        px[b] -= wb*k*dx; py[b] -= wb*k*dy; pz[b] -= wb*k*dz;
+    }
+}
+
+// XPBD: the multiplier update solves C + alpha~ * lambda = 0 for this
+// constraint, alpha~ = compliance / h^2. Compliance 0 is a rigid rod.
+static void verlet_solve_xpbd_range(void* data, uint32_t begin, uint32_t end){
+    VerletColor* color = (VerletColor*)data;
+    VerletSolver* s = color->solver;
+    float* px = s->position.x;
+    float* py = s->position.y;
+    float* pz = s->position.z;
+    for(uint32_t i = color->first+begin; i<color->first+end; ++i){
+        uint32_t a = s->constraintA[i], b = s->constraintB[i];
+        float wa = s->inverseMass[a], wb = s->inverseMass[b];
+        float w = wa + wb;
+        float dx = px[b] - px[a], dy = py[b] - py[a], dz = pz[b] - pz[a];
+        float length = sqrtf(dx*dx + dy*dy + dz*dz);
+        if(w <= 0.0f || length <= 1e-12f){
+            continue;
+        }
+        float alpha = s->compliance[i]*color->alphaScale;
+        float dLambda = (s->restLength[i] - length - alpha*s->lambda[i]) / (w + alpha);
+        s->lambda[i] += dLambda;
+        float k = -dLambda/length;
+        px[a] += wa*k*dx; py[a] += wa*k*dy; pz[a] += wa*k*dz;
+        px[b] -= wb*k*dx; py[b] -= wb*k*dy; pz[b] -= wb*k*dz;
+    }
+}
+
+static void verlet_run_chunks(void* data, uint32_t begin, uint32_t end){
+    VerletChunks* work = (VerletChunks*)data;
+    for(uint32_t i = begin; i<end; ++i){
+        work->func(work->data, work->chunks[i].begin, work->chunks[i].end);
+    }
+}
+
+// Appends [begin, end) in pieces of at most grain, merged into the last chunk
+// when it continues it. Chunks before first are never merged into.
+static void verlet_append_chunks(VerletRange* chunks, uint32_t* count, uint32_t first, uint32_t begin, uint32_t end, uint32_t grain){
+    while(begin < end){
+        VerletRange* last = *count > first ? &chunks[*count-1] : NULL;
+        if(last && last->end == begin && last->end - last->begin < grain){
+            uint32_t take = grain - (last->end - last->begin);
+            take = take < end-begin ? take : end-begin;
+            last->end += take;
+            begin += take;
+        } else {
+            uint32_t take = grain < end-begin ? grain : end-begin;
+            chunks[(*count)++] = (VerletRange){begin, begin+take};
+            begin += take;
+        }
+    }
+}
+
+// Work lists of the awake islands: small ones batched into jobs first, then
+// the particle and per color constraint chunks of the large ones
+static void verlet_build_work(VerletSolver* solver){
+    solver->awakeCount = 0;
+    solver->awakeParticleCount = 0;
+    solver->batchCount = 0;
+    uint32_t work = 0;
+    for(uint32_t k = 0; k<solver->islandCount; ++k){
+        const VerletIsland* island = &solver->islands[k];
+        if(island->asleep || island->constraintCount > VERLET_ISLAND_JOB){
+            continue;
+        }
+        if(solver->batchCount == 0 || work >= VERLET_BATCH_WORK){
+            solver->batches[solver->batchCount++] = (VerletRange){solver->awakeCount, solver->awakeCount};
+            work = 0;
+        }
+        solver->batches[solver->batchCount-1].end++;
+        work += island->particleCount + island->constraintCount;
+        solver->awakeIslands[solver->awakeCount++] = k;
+        solver->awakeParticleCount += island->particleCount;
+    }
+
+    uint32_t firstLarge = solver->awakeCount;
+    solver->particleChunkCount = 0;
+    for(uint32_t k = 0; k<solver->islandCount; ++k){
+        const VerletIsland* island = &solver->islands[k];
+        if(island->asleep || island->constraintCount <= VERLET_ISLAND_JOB){
+            continue;
+        }
+        solver->awakeIslands[solver->awakeCount++] = k;
+        solver->awakeParticleCount += island->particleCount;
+        for(uint32_t r = island->firstRun; r<island->firstRun+island->runCount; ++r){
+            verlet_append_chunks(solver->particleChunks, &solver->particleChunkCount, 0, solver->runs[r].begin, solver->runs[r].end,
+                                 VERLET_INTEGRATE_GRAIN);
+        }
+    }
+    solver->largeCount = solver->awakeCount - firstLarge;
+    uint32_t startCount = solver->particleChunkCount*VERLET_INTEGRATE_GRAIN;
+    if(solver->velocity.x && startCount > solver->startCapacity){
+        solver->startCapacity = startCount;
+        solver->start.x = (float*)mem_realloc(MEM_TAG_PHYSICS, solver->start.x, startCount*sizeof(float));
+        solver->start.y = (float*)mem_realloc(MEM_TAG_PHYSICS, solver->start.y, startCount*sizeof(float));
+        solver->start.z = (float*)mem_realloc(MEM_TAG_PHYSICS, solver->start.z, startCount*sizeof(float));
+    }
+
+    uint32_t count = 0;
+    for(uint32_t c = 0; c<=VERLET_MAX_COLORS; ++c){
+        uint32_t first = count;
+        solver->colorChunkOffsets[c] = first;
+        for(uint32_t i = firstLarge; i<solver->awakeCount; ++i){
+            const VerletIsland* island = &solver->islands[solver->awakeIslands[i]];
+            for(uint32_t j = island->firstSpan; j<island->firstSpan+island->spanCount; ++j){
+                const VerletSpan* span = &solver->spans[j];
+                if(span->color == c){
+                    verlet_append_chunks(solver->constraintChunks, &count, first, span->begin, span->end, VERLET_SOLVE_GRAIN);
+                }
+            }
+        }
+    }
+    solver->colorChunkOffsets[VERLET_MAX_COLORS+1] = count;
+}
+
+// A whole step of one island on the calling thread
+static void verlet_step_island(const VerletIslandStep* step, const VerletIsland* island){
+    VerletSolver* s = step->solver;
+    VerletColor color = {s, 0, step->alphaScale};
+    float start[3][VERLET_ISLAND_PARTICLES];
+    for(uint32_t sub = 0; sub<step->substeps; ++sub){
+        for(uint32_t r = island->firstRun, offset = 0; r<island->firstRun+island->runCount; ++r){
+            if(s->velocity.x){
+                verlet_integrate_half(step->integrate, s->runs[r].begin, s->runs[r].end,
+                                      (Vec3Soa){start[0]+offset, start[1]+offset, start[2]+offset});
+                offset += s->runs[r].end - s->runs[r].begin;
+            } else {
+                verlet_integrate_range(step->integrate, s->runs[r].begin, s->runs[r].end);
+            }
+        }
+        if(step->xpbd){
+            memset(s->lambda+island->firstConstraint, 0, island->constraintCount*sizeof(float));
+        }
+        for(uint32_t it = 0; it<s->desc.iterations; ++it){
+            for(uint32_t j = island->firstSpan; j<island->firstSpan+island->spanCount; ++j){
+                step->solve(&color, s->spans[j].begin, s->spans[j].end);
+            }
+        }
+        for(uint32_t r = island->firstRun, offset = 0; r<island->firstRun+island->runCount && s->velocity.x; ++r){
+            verlet_velocity_half(s, s->runs[r].begin, s->runs[r].end, (Vec3Soa){start[0]+offset, start[1]+offset, start[2]+offset});
+            offset += s->runs[r].end - s->runs[r].begin;
+        }
+    }
+}
+
+static void verlet_batches_range(void* data, uint32_t begin, uint32_t end){
+    VerletIslandStep* step = (VerletIslandStep*)data;
+    VerletSolver* s = step->solver;
+    for(uint32_t b = begin; b<end; ++b){
+        for(uint32_t i = s->batches[b].begin; i<s->batches[b].end; ++i){
+            verlet_step_island(step, &s->islands[s->awakeIslands[i]]);
+        }
+    }
+}
+
+static void verlet_island_energy_range(void* data, uint32_t begin, uint32_t end){
+    VerletEnergy* energy = (VerletEnergy*)data;
+    VerletSolver* s = energy->solver;
+    for(uint32_t i = begin; i<end; ++i){
+        VerletIsland* island = &s->islands[s->awakeIslands[i]];
+        float sum = 0.0f;
+        for(uint32_t r = island->firstRun; r<island->firstRun+island->runCount; ++r){
+            for(uint32_t p = s->runs[r].begin; p<s->runs[r].end; ++p){
+                float w = s->inverseMass[p];
+                vec3 previous;
+                verlet_get_previous(s, p, previous);
+                float vx = (s->position.x[p] - previous[0])*energy->inverseStep;
+                float vy = (s->position.y[p] - previous[1])*energy->inverseStep;
+                float vz = (s->position.z[p] - previous[2])*energy->inverseStep;
+                s->energy[p] = w > 0.0f ? 0.5f*(vx*vx + vy*vy + vz*vz)/w : 0.0f;
+                sum += s->energy[p];
+            }
+        }
+        island->energy = sum;
+    }
+}
+
+// Islands that stayed quiet for sleepDelay stop, with zero velocity
+static void verlet_update_sleep(VerletSolver* solver, float dt, float h){
+    VerletEnergy energy = {solver, 1.0f/h};
+    parallel_for(&energy, solver->awakeCount, 16, verlet_island_energy_range);
+
+    for(uint32_t i = 0; i<solver->awakeCount; ++i){
+        VerletIsland* island = &solver->islands[solver->awakeIslands[i]];
+        if(island->energy >= solver->desc.sleepEnergy*island->particleCount){
+            island->quietTime = 0.0f;
+            continue;
+        }
+        island->quietTime += dt;
+        if(island->quietTime < solver->desc.sleepDelay){
+            continue;
+        }
+        island->asleep = 1;
+        island->quietTime = 0.0f;
+        island->energy = 0.0f;
+        for(uint32_t r = island->firstRun; r<island->firstRun+island->runCount; ++r){
+            uint32_t begin = solver->runs[r].begin, count = solver->runs[r].end - begin;
+            if(solver->velocity.x){
+                memset(solver->velocity.x+begin, 0, count*sizeof(uint16_t));
+                memset(solver->velocity.y+begin, 0, count*sizeof(uint16_t));
+                memset(solver->velocity.z+begin, 0, count*sizeof(uint16_t));
+            } else {
+                memcpy(solver->previous.x+begin, solver->position.x+begin, count*sizeof(float));
+                memcpy(solver->previous.y+begin, solver->position.y+begin, count*sizeof(float));
+                memcpy(solver->previous.z+begin, solver->position.z+begin, count*sizeof(float));
+            }
+            memset(solver->energy+begin, 0, count*sizeof(float));
+        }
+    }
+}
+
+void verlet_step(VerletSolver* solver, float dt){
+    uint32_t substeps = solver->desc.substeps > 1 ? solver->desc.substeps : 1;
+    float h = dt/substeps;
+    // Damping is per verlet_step, spread it over the substeps
+    VerletIntegrate integrate = {solver, {0, 0, 0}, solver->desc.damping};
+    glm_vec3_scale(solver->desc.gravity, h*h, integrate.step);
+    if(substeps > 1){
+        integrate.damping = powf(integrate.damping, 1.0f/substeps);
+    }
+    int xpbd = solver->desc.mode == VERLET_XPBD;
+    JobRangeFunc solve = xpbd ? verlet_solve_xpbd_range : verlet_solve_range;
+    if(solver->dirty){
+        verlet_update_islands(solver);
+    }
+    verlet_build_work(solver);
+
+    // Small islands, each job runs its islands' whole step
+    VerletIslandStep step = {solver, &integrate, solve, 1.0f/(h*h), substeps, xpbd};
+    parallel_for(&step, solver->batchCount, 1, verlet_batches_range);
+
+    // Large islands, one parallel_for per color with the colors in order
+    VerletColor color = {solver, 0, 1.0f/(h*h)};
+    for(uint32_t sub = 0; sub<substeps && solver->largeCount; ++sub){
+        VerletChunks particles = {solver->particleChunks, verlet_integrate_range, &integrate};
+        if(solver->velocity.x){
+            parallel_for(&integrate, solver->particleChunkCount, 1, verlet_integrate_half_chunks);
+        } else {
+            parallel_for(&particles, solver->particleChunkCount, 1, verlet_run_chunks);
+        }
+        if(xpbd){
+            for(uint32_t i = 0; i<solver->colorChunkOffsets[VERLET_MAX_COLORS+1]; ++i){
+                const VerletRange* chunk = &solver->constraintChunks[i];
+                memset(solver->lambda+chunk->begin, 0, (chunk->end - chunk->begin)*sizeof(float));
+            }
+        }
+        for(uint32_t it = 0; it<solver->desc.iterations; ++it){
+            for(uint32_t c = 0; c<=VERLET_MAX_COLORS; ++c){
+                VerletChunks work = {solver->constraintChunks + solver->colorChunkOffsets[c], solve, &color};
+                uint32_t count = solver->colorChunkOffsets[c+1] - solver->colorChunkOffsets[c];
+                if(c == VERLET_MAX_COLORS){
+                    verlet_run_chunks(&work, 0, count);
+                } else if(count > 0){
+                    parallel_for(&work, count, 1, verlet_run_chunks);
+                }
+            }
+        }
+        if(solver->velocity.x){
+            parallel_for(solver, solver->particleChunkCount, 1, verlet_velocity_half_chunks);
+        }
+    }
+    if(solver->desc.sleepEnergy > 0.0f){
+        verlet_update_sleep(solver, dt, h);
+    }
+}
+
+void verlet_wake_island(VerletSolver* solver, uint32_t island){
+    solver->islands[island].asleep = 0;
+}
+
+void verlet_wake_particle(VerletSolver* solver, uint32_t particle){
+    verlet_wake_island(solver, solver->particleIsland[particle]);
+}
+
+// Displacement the next step carries on with, position - previous
+static void verlet_set_displacement(VerletSolver* solver, uint32_t particle, const float* displacement){
+    if(solver->velocity.x){
+        solver->velocity.x[particle] = batch_float_to_half(displacement[0]);
+        solver->velocity.y[particle] = batch_float_to_half(displacement[1]);
+        solver->velocity.z[particle] = batch_float_to_half(displacement[2]);
+    } else {
+        solver->previous.x[particle] = solver->position.x[particle] - displacement[0];
+        solver->previous.y[particle] = solver->position.y[particle] - displacement[1];
+        solver->previous.z[particle] = solver->position.z[particle] - displacement[2];
+    }
+}
+
+void verlet_move_particle(VerletSolver* solver, uint32_t particle, const vec3 position){
+    float displacement[3] = {position[0] - solver->position.x[particle], position[1] - solver->position.y[particle],
+                             position[2] - solver->position.z[particle]};
+    solver->position.x[particle] = position[0];
+    solver->position.y[particle] = position[1];
+    solver->position.z[particle] = position[2];
+    verlet_set_displacement(solver, particle, displacement);
+    verlet_wake_particle(solver, particle);
+}
+
+void verlet_add_displacement(VerletSolver* solver, uint32_t particle, const vec3 displacement){
+    vec3 previous;
+    verlet_get_previous(solver, particle, previous);
+    float sum[3] = {solver->position.x[particle] - previous[0] + displacement[0],
+                    solver->position.y[particle] - previous[1] + displacement[1],
+                    solver->position.z[particle] - previous[2] + displacement[2]};
+    verlet_set_displacement(solver, particle, sum);
+    verlet_wake_particle(solver, particle);
+}
+
+static void verlet_contacts_range(void* data, uint32_t begin, uint32_t end){
+    VerletContacts* contacts = (VerletContacts*)data;
+    VerletSolver* s = contacts->solver;
+    uint32_t neighbours[VERLET_CONTACT_MAX];
+    for(uint32_t i = begin; i<end; ++i){
+        const VerletIsland* awake = &s->islands[s->awakeIslands[i]];
+        for(uint32_t r = awake->firstRun; r<awake->firstRun+awake->runCount; ++r){
+            for(uint32_t p = s->runs[r].begin; p<s->runs[r].end; ++p){
+                uint32_t n = spatial_hash_query_particle(contacts->hash, p, contacts->radius, neighbours, VERLET_CONTACT_MAX);
+                n = n < VERLET_CONTACT_MAX ? n : VERLET_CONTACT_MAX;
+                for(uint32_t j = 0; j<n; ++j){
+                    VerletIsland* island = &s->islands[s->particleIsland[neighbours[j]]];
+                    if(atomic_load_i32(&island->asleep)){
+                        atomic_store_i32(&island->asleep, 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void verlet_wake_contacts(VerletSolver* solver, const SpatialHash* hash, float radius){
+    // Only the particles awake before this call ask, islands woken here do
+    // not wake others until the next call
+    if(solver->dirty){
+        verlet_update_islands(solver);
+    }
+    verlet_build_work(solver);
+    VerletContacts contacts = {solver, hash, radius};
+    parallel_for(&contacts, solver->awakeCount, 1, verlet_contacts_range);
+}
+
+static void verlet_permute_particles(void* array, size_t size, const uint32_t* oldToNew, uint32_t count, void* scratch){
+    for(uint32_t i = 0; i<count; ++i){
+        memcpy((uint8_t*)scratch + oldToNew[i]*size, (const uint8_t*)array + i*size, size);
+    }
+    memcpy(array, scratch, count*size);
+}
+
+void verlet_reorder(VerletSolver* solver, ParticleOrder order, uint32_t* oldToNew){
+    if(solver->dirty){
+        verlet_update_islands(solver);
+    }
+    uint32_t n = solver->particleCount, count = solver->constraintCount;
+    ParticleConstraint* constraints = (ParticleConstraint*)mem_alloc(MEM_TAG_PHYSICS, (count+1)*sizeof(ParticleConstraint));
+    for(uint32_t i = 0; i<count; ++i){
+        constraints[i] = (ParticleConstraint){solver->constraintA[i], solver->constraintB[i], solver->restLength[i]};
+    }
+    particle_order_compute(order, solver->position, n, constraints, count, oldToNew);
+    mem_free(constraints);
+
+    uint64_t* scratch = (uint64_t*)mem_alloc(MEM_TAG_PHYSICS, (n+1)*sizeof(uint64_t));
+    float* floats[] = {solver->position.x, solver->position.y, solver->position.z,
+                       solver->previous.x, solver->previous.y, solver->previous.z, solver->inverseMass, solver->energy};
+    for(size_t i = 0; i<sizeof(floats)/sizeof(floats[0]); ++i){
+        if(floats[i]){
+            verlet_permute_particles(floats[i], sizeof(float), oldToNew, n, scratch);
+        }
+    }
+    uint16_t* halfs[] = {solver->velocity.x, solver->velocity.y, solver->velocity.z};
+    for(size_t i = 0; i<3 && halfs[i]; ++i){
+        verlet_permute_particles(halfs[i], sizeof(uint16_t), oldToNew, n, scratch);
+    }
+    verlet_permute_particles(solver->particleIsland, sizeof(uint32_t), oldToNew, n, scratch);
+    verlet_permute_particles(solver->colorMask, sizeof(uint64_t), oldToNew, n, scratch);
+    mem_free(scratch);
+
+    // Constraints by their first particle so the sort by island and color
+    // keeps them in the new particle order
+    uint64_t* keys = (uint64_t*)mem_alloc(MEM_TAG_PHYSICS, (count+1)*sizeof(uint64_t));
+    for(uint32_t i = 0; i<count; ++i){
+        uint32_t a = oldToNew[solver->constraintA[i]], b = oldToNew[solver->constraintB[i]];
+        solver->constraintA[i] = a;
+        solver->constraintB[i] = b;
+        keys[i] = (uint64_t)(a < b ? a : b) << 32 | (a < b ? b : a);
+        solver->order[i] = i;
+    }
+    radix_sort_u64(keys, solver->order, count);
+    mem_free(keys);
+    void* arrays[] = {solver->constraintA, solver->constraintB, solver->restLength, solver->compliance, solver->lambda,
+                      solver->constraintId};
+    for(size_t a = 0; a<sizeof(arrays)/sizeof(arrays[0]); ++a){
+        verlet_permute(arrays[a], solver->spareOrder, solver->order, count);
+    }
+
+    // Islands are found again from scratch, the permuted particleIsland
+    // still points at the old ones so their sleep state carries over
+    for(uint32_t i = 0; i<count; ++i){
+        solver->constraintSlot[solver->constraintId[i]] = i;
+    }
+    for(uint32_t i = 0; i<n; ++i){
+        solver->parent[i] = i;
+    }
+    for(uint32_t i = 0; i<count; ++i){
+        verlet_union(solver->parent, solver->constraintA[i], solver->constraintB[i]);
+    }
+    verlet_update_islands(solver);
+}
+
+void verlet_get_previous(const VerletSolver* solver, uint32_t particle, vec3 previous){
+    if(solver->velocity.x){
+        previous[0] = solver->position.x[particle] - batch_half_to_float(solver->velocity.x[particle]);
+        previous[1] = solver->position.y[particle] - batch_half_to_float(solver->velocity.y[particle]);
+        previous[2] = solver->position.z[particle] - batch_half_to_float(solver->velocity.z[particle]);
+    } else {
+        previous[0] = solver->previous.x[particle];
+        previous[1] = solver->previous.y[particle];
+        previous[2] = solver->previous.z[particle];
+    }
+}
+
+float verlet_max_stretch(const VerletSolver* solver){
+    float worst = 0.0f;
+    for(uint32_t i = 0; i<solver->constraintCount; ++i){
+        if(!verlet_slot_alive(solver, i)){
+            continue;
+        }
+        uint32_t a = solver->constraintA[i], b = solver->constraintB[i];
+        float dx = solver->position.x[b] - solver->position.x[a];
+        float dy = solver->position.y[b] - solver->position.y[a];
+        float dz = solver->position.z[b] - solver->position.z[a];
+        float rest = solver->restLength[i];
+        if(rest > 0.0f){
+            float e = fabsf(sqrtf(dx*dx + dy*dy + dz*dz) - rest) / rest;
+            worst = e > worst ? e : worst;
+        }
+    }
+    return worst;
+}
@@ -0,0 +1,194 @@
+#pragma once
+#include <stdint.h>
+#include "batch.h"
+#include "particle_graph.h"
+#include "spatial_hash.h"
+
+// CPU Verlet/PBD solver, the reference for the GPU solver.
+//
+// Particles are SoA (position, previous position, inverse mass). Integration
+// is batch_verlet_integrate over parallel_for ranges. Distance constraints are
+// greedily graph colored as they are added; no two constraints of a color
+// share a particle, so each color is one parallel_for with plain stores and
+// no atomics. Colors run one after another.
+//
+// VERLET_XPBD replaces the stiffness factor with per constraint compliance
+// and accumulated Lagrange multipliers, which makes the result independent of
+// the iteration count and time step. It is meant for small steps: many
+// substeps with one iteration each instead of many iterations.
+//
+// Islands are the connected components of the constraint graph, kept with
+// union-find as constraints are added and broken. Constraints are stored
+// sorted by island, then by color. Small islands are solved whole, all
+// substeps, iterations and colors, as one job each with no barrier against
+// the others; only large islands go through the per color parallel_for.
+// Adding or breaking constraints only marks the solver, the next step merges
+// islands, re-finds the components of broken islands and sorts again.
+//
+// With sleepEnergy set, an island whose mean kinetic energy per particle
+// stays below it for sleepDelay seconds falls asleep: its velocity is zeroed
+// and it is left out of integration and constraint solving until it is woken
+// by verlet_wake_particle (interaction), verlet_wake_contacts or a constraint
+// change. Every step works through lists of the awake islands only, so the
+// cost follows the awake particle count.
+//
+// VERLET_STORAGE_HALF keeps the displacement of the last substep (position -
+// previous) as fp16 instead of the fp32 previous position: 22 instead of 28
+// bytes of state per particle. Positions stay fp32, only the velocity is
+// rounded to 11 significant bits. The constraints need the positions from
+// before integration until the substep ends, those go to scratch: a stack
+// buffer for small islands that stays in cache, a buffer sized by the awake
+// large islands otherwise.
+
+// Colors are tracked as a 64 bit mask per particle. Constraints that would
+// need more colors go into one extra color that is solved on one thread.
+#define VERLET_MAX_COLORS 64
+// constraintSlot of a broken constraint
+#define VERLET_BROKEN UINT32_MAX
+
+typedef enum {
+    VERLET_PBD,
+    VERLET_XPBD,
+} VerletMode;
+
+typedef enum {
+    VERLET_STORAGE_FLOAT,
+    VERLET_STORAGE_HALF,
+} VerletStorage;
+
+typedef struct {
+    uint32_t iterations;    // per substep
+    float stiffness;        // PBD: fraction of the error corrected per iteration, 0..1
+    float damping;          // fraction of the velocity kept per verlet_step
+    vec3 gravity;
+    VerletMode mode;
+    uint32_t substeps;      // 0 is the same as 1
+    float compliance;       // XPBD: inverse stiffness of every constraint, 0 is rigid
+    float sleepEnergy;      // mean kinetic energy per particle below which islands sleep, 0 never sleeps
+    float sleepDelay;       // seconds an island has to stay below sleepEnergy
+    VerletStorage storage;
+} VerletDesc;
+
+typedef struct {
+    uint32_t begin;
+    uint32_t end;
+} VerletRange;
+
+typedef struct {
+    uint32_t firstRun;      // particle runs in VerletSolver.runs
+    uint32_t runCount;
+    uint32_t particleCount;
+    uint32_t firstConstraint;
+    uint32_t constraintCount;
+    uint32_t firstSpan;     // one span per color in VerletSolver.spans
+    uint32_t spanCount;
+    float energy;           // kinetic energy after the last step
+    float quietTime;        // seconds spent below the sleep threshold
+    volatile int32_t asleep;
+    int32_t split;          // lost a constraint, components are found again
+} VerletIsland;
+
+typedef struct {
+    uint32_t begin;
+    uint32_t end;
+    uint32_t color;
+} VerletSpan;
+
+typedef struct {
+    VerletDesc desc;
+
+    uint32_t particleCount;
+    Vec3Soa position;
+    Vec3Soa previous;       // VERLET_STORAGE_FLOAT only
+    Half3Soa velocity;      // VERLET_STORAGE_HALF only, position - previous
+    float* inverseMass;     // 0 pins a particle
+
+    // Sorted by island, then color. Constraints added since the last step sit
+    // at the end and broken ones stay in place until the next step.
+    uint32_t constraintCount;
+    uint32_t constraintCapacity;
+    uint32_t* constraintA;
+    uint32_t* constraintB;
+    float* restLength;
+    float* compliance;
+    float* lambda;          // XPBD multipliers, reset every substep
+    uint32_t* constraintId;     // slot -> constraint index
+    uint32_t sortedCount;       // slots covered by the islands
+
+    // Per constraint index: verlet_init's order, then verlet_add_constraint's
+    uint32_t idCount;
+    uint32_t idCapacity;
+    uint32_t* constraintSlot;   // index in the arrays above, VERLET_BROKEN once broken
+    uint8_t* constraintColor;
+    uint64_t* colorMask;        // per particle, colors its constraints use
+    uint32_t colorCount;        // highest color in use + 1
+    int serialColor;            // some constraints are in the overflow color
+
+    uint32_t islandCount;
+    uint32_t* particleIsland;
+    VerletIsland* islands;
+    VerletRange* runs;      // particle index ranges, grouped by island
+    uint32_t runCount;
+    VerletSpan* spans;      // constraint ranges of one island and color
+    uint32_t spanCount;
+    float* energy;          // per particle, only kept up to date while sleeping is on
+    Vec3Soa start;          // VERLET_STORAGE_HALF, large island positions before integration
+    uint32_t startCapacity;
+    int dirty;              // constraints were added or broken
+
+    // Work lists of the awake islands, rebuilt every step. Small islands are
+    // batched into jobs, large ones are split into chunks per color.
+    uint32_t awakeCount;
+    uint32_t* awakeIslands;
+    uint32_t awakeParticleCount;
+    uint32_t batchCount;
+    VerletRange* batches;   // ranges of awakeIslands, small islands only
+    uint32_t largeCount;    // large islands are at the end of awakeIslands
+    uint32_t particleChunkCount;
+    VerletRange* particleChunks;
+    uint32_t colorChunkOffsets[VERLET_MAX_COLORS+2];
+    VerletRange* constraintChunks;
+
+    // Scratch for re-sorting, sized with the particles and constraints
+    uint32_t* parent;
+    VerletIsland* spareIslands;
+    uint32_t* order;
+    uint32_t* spareOrder;
+    uint32_t* islandOffsets;
+} VerletSolver;
+
+void verlet_init(VerletSolver* solver, const VerletDesc* desc, Vec3Soa positions, uint32_t particleCount,
+                 const ParticleConstraint* constraints, uint32_t constraintCount);
+void verlet_init_graph(VerletSolver* solver, const VerletDesc* desc, const ParticleGraph* graph);
+void verlet_free(VerletSolver* solver);
+
+// Compliance of one constraint, index as passed to verlet_init or returned by
+// verlet_add_constraint
+void verlet_set_compliance(VerletSolver* solver, uint32_t constraint, float compliance);
+
+// Returns the new constraint's index. Neither call is thread safe, both take
+// effect at the next verlet_step and wake the islands involved.
+uint32_t verlet_add_constraint(VerletSolver* solver, uint32_t a, uint32_t b, float restLength);
+void verlet_break_constraint(VerletSolver* solver, uint32_t constraint);
+
+void verlet_step(VerletSolver* solver, float dt);
+
+void verlet_wake_island(VerletSolver* solver, uint32_t island);
+void verlet_wake_particle(VerletSolver* solver, uint32_t particle);
+// Both wake the particle's island. verlet_move_particle keeps the distance
+// moved as the particle's velocity, verlet_add_displacement adds to the
+// distance the next step moves it (velocity * dt).
+void verlet_move_particle(VerletSolver* solver, uint32_t particle, const vec3 position);
+void verlet_add_displacement(VerletSolver* solver, uint32_t particle, const vec3 displacement);
+// Wakes sleeping islands within radius of an awake particle. hash has to be
+// built from the solver positions, the queries skip constrained pairs.
+void verlet_wake_contacts(VerletSolver* solver, const SpatialHash* hash, float radius);
+// Renumbers the particles for cache locality, e.g. every few hundred frames
+// as a cloth folds. Fills oldToNew (particleCount entries) for remapping
+// anything that indexes particles, particle_graph_reorder does it for a
+// graph's render indices. Allocates, sleeping islands stay asleep.
+void verlet_reorder(VerletSolver* solver, ParticleOrder order, uint32_t* oldToNew);
+// Previous position of one particle with either storage
+void verlet_get_previous(const VerletSolver* solver, uint32_t particle, vec3 previous);
+// Largest |length - rest| / rest over all constraints
+float verlet_max_stretch(const VerletSolver* solver);